@@ -10,7 +10,7 @@ The ESP is connected to a max3485 with pins 17 (RX), 4 (TX) and 16 as RTS.
 
 #include <Arduino.h>
 #include <esp32ModbusRTU.h>
-#include <algorithm>  // for std::reverse
+#include <ModbusDecode.h>
 
 esp32ModbusRTU modbus(&Serial1, 16);  // use Serial1 and pin 16 as RTS
 
@@ -23,8 +23,9 @@ void setup() {
     for (size_t i = 0; i < length; ++i) {
       Serial.printf("%02x", data[i]);
     }
-    std::reverse(data, data + 4);  // fix endianness
-    Serial.printf("\nval: %.2f", *reinterpret_cast<float*>(data));
+    float value;
+    esp32Modbus::decodeFloat(data, 1, &value);  // big endian, high word first (ABCD)
+    Serial.printf("\nval: %.2f", value);
     Serial.print("\n\n");
   });
   modbus.onError([](uint16_t /*serverAddress*/, esp32Modbus::Error error) {
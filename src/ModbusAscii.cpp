@@ -0,0 +1,177 @@
+/* ModbusAscii
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusAscii.h"
+#include "ModbusMessage.h"
+
+#include <string.h>  // for memcpy
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+// ASCII doubles the bytes per frame, so the conversion is one table load per
+// byte (encode) or per char (decode) instead of per-nibble branches. Both
+// tables are const and stay in flash.
+
+namespace {
+
+// "00" "01" ... "FF": the two chars of a byte at offset 2 * byte
+const char kHexPairs[] =
+  "000102030405060708090A0B0C0D0E0F"
+  "101112131415161718191A1B1C1D1E1F"
+  "202122232425262728292A2B2C2D2E2F"
+  "303132333435363738393A3B3C3D3E3F"
+  "404142434445464748494A4B4C4D4E4F"
+  "505152535455565758595A5B5C5D5E5F"
+  "606162636465666768696A6B6C6D6E6F"
+  "707172737475767778797A7B7C7D7E7F"
+  "808182838485868788898A8B8C8D8E8F"
+  "909192939495969798999A9B9C9D9E9F"
+  "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+  "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+  "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+  "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+  "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+  "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+// nibble value of a char, 0xFF: not a hex digit
+const uint8_t kHexValue[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+}  // namespace
+
+uint8_t esp32ModbusRTUInternals::asciiLRC(const uint8_t* data, size_t length) {
+  uint8_t sum = 0;
+  for (size_t i = 0; i < length; ++i) sum += data[i];
+  return static_cast<uint8_t>(-sum);
+}
+
+void esp32ModbusRTUInternals::hexEncode(const uint8_t* in, size_t length, char* out) {
+  for (size_t i = 0; i < length; ++i) {
+    memcpy(&out[2 * i], &kHexPairs[2 * in[i]], 2);
+  }
+}
+
+bool esp32ModbusRTUInternals::hexDecode(const char* in, size_t length, uint8_t* out) {
+  for (size_t i = 0; i < length; ++i) {
+    uint8_t high = kHexValue[static_cast<uint8_t>(in[2 * i])];
+    uint8_t low = kHexValue[static_cast<uint8_t>(in[2 * i + 1])];
+    if ((high | low) & 0xF0) return false;
+    out[i] = (high << 4) | low;
+  }
+  return true;
+}
+
+size_t esp32ModbusRTUInternals::asciiEncodeFrame(const uint8_t* rtuFrame, size_t rtuLength, char* out, size_t capacity) {
+  if (rtuLength < 2 + MODBUS_CRC_LENGTH) return 0;
+  size_t length = rtuLength - MODBUS_CRC_LENGTH;
+  size_t chars = 1 + 2 * (length + 1) + 2;
+  if (chars > capacity) return 0;
+  out[0] = ':';
+  hexEncode(rtuFrame, length, &out[1]);
+  uint8_t lrc = asciiLRC(rtuFrame, length);
+  hexEncode(&lrc, 1, &out[1 + 2 * length]);
+  out[chars - 2] = '\r';
+  out[chars - 1] = '\n';
+  return chars;
+}
+
+AsciiDecoder::AsciiDecoder() {
+  reset();
+}
+
+void AsciiDecoder::reset() {
+  _length = 0;
+  _high = 0xFF;
+  _started = false;
+  _cr = false;
+  _complete = false;
+  _error = esp32Modbus::SUCCESS;
+}
+
+bool AsciiDecoder::feed(char c) {
+  if (c == ':') {
+    reset();  // a start char always begins a new frame
+    _started = true;
+    return false;
+  }
+  if (!_started || _complete) return false;  // between frames
+  if (_cr) {
+    if (c == '\n') {
+      _end();
+      return true;
+    }
+    _error = esp32Modbus::INVALID_RESPONSE;  // CR not followed by LF
+    _cr = false;
+  }
+  if (c == '\r') {
+    _cr = true;
+    return false;
+  }
+  uint8_t nibble = kHexValue[static_cast<uint8_t>(c)];
+  if (nibble == 0xFF || _length >= sizeof(_frame) - 1) {
+    _error = esp32Modbus::INVALID_RESPONSE;
+    return false;
+  }
+  if (_high == 0xFF) {
+    _high = nibble;
+  } else {
+    _frame[_length++] = (_high << 4) | nibble;
+    _high = 0xFF;
+  }
+  return false;
+}
+
+// Checks the LRC and replaces it by the CRC of the RTU form
+void AsciiDecoder::_end() {
+  _complete = true;
+  if (_error != esp32Modbus::SUCCESS) return;
+  if (_high != 0xFF || _length < 3) {
+    _error = esp32Modbus::INVALID_RESPONSE;  // odd number of hex chars, or no PDU
+    return;
+  }
+  if (asciiLRC(_frame, _length - 1) != _frame[_length - 1]) {
+    _error = esp32Modbus::CRC_ERROR;
+    return;
+  }
+  uint16_t crc = CRC16(_frame, _length - 1);
+  _frame[_length - 1] = crc & 0xFF;
+  _frame[_length] = crc >> 8;
+  ++_length;
+}
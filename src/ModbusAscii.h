@@ -0,0 +1,78 @@
+/* ModbusAscii
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTUInternals_ModbusAscii_h
+#define esp32ModbusRTUInternals_ModbusAscii_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+
+#include "esp32ModbusTypeDefs.h"
+#include "ModbusFramer.h"
+
+namespace esp32ModbusRTUInternals {
+
+constexpr size_t MODBUS_ASCII_MAX_ADU = 513;  // ':' + 2 * (slave + PDU(253) + LRC) + CR LF
+
+// Longitudinal redundancy check: two's complement of the 8 bit sum
+uint8_t asciiLRC(const uint8_t* data, size_t length);
+
+// Table-driven hex conversion. hexEncode writes 2 * length upper case chars,
+// hexDecode reads 2 * length chars of either case and fails on a non-hex char.
+void hexEncode(const uint8_t* in, size_t length, char* out);
+bool hexDecode(const char* in, size_t length, uint8_t* out);
+
+// ASCII frame of an RTU frame (slave, PDU, CRC; the CRC is not sent): ':',
+// slave, PDU and LRC in hex, CR LF. Returns the number of chars, 0 when out
+// is too small.
+size_t asciiEncodeFrame(const uint8_t* rtuFrame, size_t rtuLength, char* out, size_t capacity);
+
+// Streaming ASCII frame decoder. ':' (re)starts a frame, CR LF ends it. A valid
+// frame is converted to its RTU form, with a CRC instead of the LRC, so it can
+// be fed to a ModbusResponse like a frame read in RTU mode.
+class AsciiDecoder {
+ public:
+  AsciiDecoder();
+  void reset();
+  bool feed(char c);  // true once a frame has ended, valid or not
+  bool isComplete() const { return _complete; }
+  // SUCCESS, CRC_ERROR (LRC mismatch) or INVALID_RESPONSE (not hex, odd length, too long/short)
+  esp32Modbus::Error getError() const { return _error; }
+  const uint8_t* frame() const { return _frame; }  // RTU frame, valid once complete without error
+  size_t size() const { return _length; }
+
+ private:
+  void _end();
+  uint8_t _frame[MODBUS_RTU_MAX_ADU + 1];  // decoded bytes; the LRC becomes the CRC
+  size_t _length;
+  uint8_t _high;   // first nibble of a pair, 0xFF: none
+  bool _started;
+  bool _cr;
+  bool _complete;
+  esp32Modbus::Error _error;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
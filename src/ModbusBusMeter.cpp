@@ -0,0 +1,120 @@
+/* ModbusBusMeter
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ModbusBusMeter.h"
+
+#include <string.h>  // for memset
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+static const uint32_t WINDOW_US = 1000000;
+
+BusMeter::BusMeter() :
+  _sequence(0),
+  _started(false),
+  _phase(BUS_IDLE),
+  _phaseStart(0),
+  _windowStart(0),
+  _pendingTx(0),
+  _pendingRx(0),
+  _haveSecond(false) {
+  memset(&_total, 0, sizeof(_total));
+  memset(&_window, 0, sizeof(_window));
+  memset(&_lastSecond, 0, sizeof(_lastSecond));
+}
+
+void BusMeter::enter(BusPhase phase, uint32_t nowUs) {
+  if (!_started) {
+    _started = true;
+    _phaseStart = nowUs;
+    _windowStart = nowUs;
+  }
+  uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+  _sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // a phase spanning the end of the window is split over both
+  while (nowUs - _windowStart >= WINDOW_US) {
+    _windowStart += WINDOW_US;
+    _charge(_windowStart - _phaseStart);
+    _phaseStart = _windowStart;
+    _lastSecond = _window;
+    _haveSecond = true;
+    memset(&_window, 0, sizeof(_window));
+  }
+  _charge(nowUs - _phaseStart);
+  _phaseStart = nowUs;
+  _total.txBytes += _pendingTx;
+  _window.txBytes += _pendingTx;
+  _total.rxBytes += _pendingRx;
+  _window.rxBytes += _pendingRx;
+  _pendingTx = 0;
+  _pendingRx = 0;
+  _phase = phase;
+
+  _sequence.store(sequence + 2, std::memory_order_release);
+}
+
+esp32Modbus::BusUsage BusMeter::total() const {
+  return _read(_total, false);
+}
+
+// All zero until a second has passed
+esp32Modbus::BusUsage BusMeter::lastSecond() const {
+  return _read(_lastSecond, true);
+}
+
+void BusMeter::_charge(uint32_t us) {
+  _total.phaseUs[_phase] += us;
+  _window.phaseUs[_phase] += us;
+}
+
+esp32Modbus::BusUsage BusMeter::_read(const Counters& counters, bool window) const {
+  Counters copy;
+  bool haveSecond;
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = _sequence.load(std::memory_order_acquire);
+    copy = counters;
+    haveSecond = _haveSecond;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = _sequence.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+
+  esp32Modbus::BusUsage usage;
+  memset(&usage, 0, sizeof(usage));
+  if (window && !haveSecond) return usage;
+  usage.txBytes = copy.txBytes;
+  usage.rxBytes = copy.rxBytes;
+  usage.silenceUs = copy.phaseUs[BUS_SILENCE];
+  usage.txUs = copy.phaseUs[BUS_TX];
+  usage.guardUs = copy.phaseUs[BUS_GUARD];
+  usage.waitUs = copy.phaseUs[BUS_WAIT];
+  usage.rxUs = copy.phaseUs[BUS_RX];
+  usage.idleUs = copy.phaseUs[BUS_IDLE];
+  for (uint8_t phase = BUS_IDLE; phase <= BUS_RX; ++phase) usage.elapsedUs += copy.phaseUs[phase];
+  return usage;
+}
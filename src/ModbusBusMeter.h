@@ -0,0 +1,83 @@
+/* ModbusBusMeter
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef esp32ModbusRTUInternals_ModbusBusMeter_h
+#define esp32ModbusRTUInternals_ModbusBusMeter_h
+
+#include <stdint.h>  // for uint*_t
+#include <atomic>
+
+#include "esp32ModbusTypeDefs.h"
+
+namespace esp32ModbusRTUInternals {
+
+enum BusPhase : uint8_t {
+  BUS_IDLE = 0,
+  BUS_SILENCE,
+  BUS_TX,
+  BUS_GUARD,
+  BUS_WAIT,
+  BUS_RX
+};
+
+// Splits the bus time into phases: enter() charges the time since the previous
+// call to the phase that ends there. Bytes are counted towards the next enter().
+// Totals are kept from the first enter() on, and the figures of the last
+// complete second. Written by the worker task only; readers copy the figures
+// under a sequence counter and retry when an update came in between.
+class BusMeter {
+ public:
+  BusMeter();
+  void enter(BusPhase phase, uint32_t nowUs);
+  void sent(uint32_t bytes) { _pendingTx += bytes; }
+  void received(uint32_t bytes) { _pendingRx += bytes; }
+  BusPhase phase() const { return _phase; }
+  esp32Modbus::BusUsage total() const;
+  esp32Modbus::BusUsage lastSecond() const;
+
+ private:
+  struct Counters {
+    uint64_t phaseUs[BUS_RX + 1];
+    uint64_t txBytes;
+    uint64_t rxBytes;
+  };
+  void _charge(uint32_t us);
+  esp32Modbus::BusUsage _read(const Counters& counters, bool window) const;
+  std::atomic<uint32_t> _sequence;
+  bool _started;
+  BusPhase _phase;
+  uint32_t _phaseStart;
+  uint32_t _windowStart;
+  uint32_t _pendingTx;
+  uint32_t _pendingRx;
+  bool _haveSecond;
+  Counters _total;
+  Counters _window;
+  Counters _lastSecond;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
@@ -0,0 +1,212 @@
+/* ModbusDecode
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusDecode.h"
+
+#include <string.h>  // for memcpy
+
+using namespace esp32Modbus;  // NOLINT
+
+// The word order is a template parameter, so every kernel is a branch-free
+// loop. On little endian hosts (ESP32, x86, ARM) a value is loaded with one
+// memcpy, which gives DCBA, and the other orders are a byte swap, a swap of
+// the bytes within each register (SWAR) or a rotation of the registers.
+// memcpy is also the portable way to reinterpret the bits as float/double.
+
+namespace {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MODBUS_DECODE_LITTLE_ENDIAN 1
+#else
+#define MODBUS_DECODE_LITTLE_ENDIAN 0
+#endif
+
+template <WordOrder O, size_t N> struct Loader;
+
+#if MODBUS_DECODE_LITTLE_ENDIAN
+template <WordOrder O> struct Loader<O, 4> {
+  static uint32_t load(const uint8_t* p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    switch (O) {
+    case ABCD: return __builtin_bswap32(x);
+    case CDAB: return ((x & 0x00FF00FFUL) << 8) | ((x >> 8) & 0x00FF00FFUL);
+    case BADC: return (x << 16) | (x >> 16);
+    default:   return x;
+    }
+  }
+};
+
+template <WordOrder O> struct Loader<O, 8> {
+  static uint64_t load(const uint8_t* p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    switch (O) {
+    case ABCD: return __builtin_bswap64(x);
+    case CDAB: return ((x & 0x00FF00FF00FF00FFULL) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFULL);
+    case BADC:
+      x = (x << 32) | (x >> 32);
+      return ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+    default:   return x;
+    }
+  }
+};
+#else
+// Assemble the value byte by byte, most significant byte first
+template <WordOrder O, size_t N> struct Loader {
+  static uint64_t load(const uint8_t* p) {
+    uint64_t value = 0;
+    for (size_t k = 0; k < N; ++k) {
+      size_t reg = k / 2;
+      size_t byte = k & 1;
+      if (O == CDAB || O == DCBA) reg = N / 2 - 1 - reg;
+      if (O == BADC || O == DCBA) byte = 1 - byte;
+      value = (value << 8) | p[reg * 2 + byte];
+    }
+    return value;
+  }
+};
+#endif
+
+template <WordOrder O, typename T, typename U>
+void decode(const uint8_t* data, size_t count, T* out) {
+  for (size_t i = 0; i < count; ++i) {
+    U value = static_cast<U>(Loader<O, sizeof(U)>::load(data + i * sizeof(U)));
+    memcpy(&out[i], &value, sizeof(T));
+  }
+}
+
+template <typename T, typename U>
+void decode(const uint8_t* data, size_t count, T* out, WordOrder order) {
+  switch (order) {
+  case CDAB: decode<CDAB, T, U>(data, count, out); break;
+  case BADC: decode<BADC, T, U>(data, count, out); break;
+  case DCBA: decode<DCBA, T, U>(data, count, out); break;
+  default:   decode<ABCD, T, U>(data, count, out); break;
+  }
+}
+
+}  // namespace
+
+void esp32Modbus::decodeU16(const uint8_t* data, size_t count, uint16_t* out) {
+  size_t i = 0;
+#if MODBUS_DECODE_LITTLE_ENDIAN
+  // SWAR: swap the bytes of four registers at once
+  for (; i + 4 <= count; i += 4) {
+    uint64_t word;
+    memcpy(&word, data + i * 2, sizeof(word));
+    word = ((word & 0x00FF00FF00FF00FFULL) << 8) | ((word >> 8) & 0x00FF00FF00FF00FFULL);
+    memcpy(&out[i], &word, sizeof(word));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = static_cast<uint16_t>(data[i * 2] << 8 | data[i * 2 + 1]);
+  }
+}
+
+void esp32Modbus::decodeI16(const uint8_t* data, size_t count, int16_t* out) {
+  // same bits, int16_t may alias uint16_t
+  decodeU16(data, count, reinterpret_cast<uint16_t*>(out));
+}
+
+void esp32Modbus::decodeU32(const uint8_t* data, size_t count, uint32_t* out, WordOrder order) {
+  decode<uint32_t, uint32_t>(data, count, out, order);
+}
+
+void esp32Modbus::decodeI32(const uint8_t* data, size_t count, int32_t* out, WordOrder order) {
+  decode<int32_t, uint32_t>(data, count, out, order);
+}
+
+void esp32Modbus::decodeFloat(const uint8_t* data, size_t count, float* out, WordOrder order) {
+  decode<float, uint32_t>(data, count, out, order);
+}
+
+void esp32Modbus::decodeDouble(const uint8_t* data, size_t count, double* out, WordOrder order) {
+  decode<double, uint64_t>(data, count, out, order);
+}
+
+// Bit kernels work on 8 bits at a time. Unpacking multiplies a byte into
+// all 8 lanes of a 64 bit word, keeps bit k in lane k and turns every
+// nonzero lane into 1 by adding 0x7F (no carry can leave a lane). Packing is
+// the reverse: lane k (0 or 1) times 2^(56 - 7k) lands in bit 56 + k without
+// any two partial products overlapping.
+static_assert(sizeof(bool) == 1, "bit kernels assume 1 byte bool");
+
+void esp32Modbus::unpackBits(const uint8_t* data, size_t count, bool* out) {
+  size_t i = 0;
+#if MODBUS_DECODE_LITTLE_ENDIAN
+  for (; i + 8 <= count; i += 8) {
+    uint64_t lanes = (data[i / 8] * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+    lanes = ((lanes + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL;
+    memcpy(&out[i], &lanes, sizeof(lanes));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = (data[i / 8] >> (i % 8)) & 0x01;
+  }
+}
+
+void esp32Modbus::packBits(const bool* values, size_t count, uint8_t* out) {
+  size_t i = 0;
+#if MODBUS_DECODE_LITTLE_ENDIAN
+  for (; i + 8 <= count; i += 8) {
+    uint64_t lanes;
+    memcpy(&lanes, &values[i], sizeof(lanes));
+    out[i / 8] = (lanes * 0x0102040810204080ULL) >> 56;
+  }
+#endif
+  for (; i < count; i += 8) {
+    uint8_t byte = 0;
+    for (size_t bit = 0; bit < 8 && i + bit < count; ++bit) {
+      if (values[i + bit]) byte |= 1 << bit;
+    }
+    out[i / 8] = byte;
+  }
+}
+
+void esp32Modbus::decodeBits(const uint8_t* data, size_t count, uint32_t* out) {
+  size_t bytes = (count + 7) / 8;
+  size_t words = (count + 31) / 32;
+  if (words == 0) return;
+#if MODBUS_DECODE_LITTLE_ENDIAN
+  // the wire layout is the memory layout of little endian words
+  out[words - 1] = 0;
+  memcpy(out, data, bytes);
+#else
+  for (size_t w = 0; w < words; ++w) out[w] = 0;
+  for (size_t b = 0; b < bytes; ++b) out[b / 4] |= static_cast<uint32_t>(data[b]) << (8 * (b % 4));
+#endif
+  if (count % 32) out[words - 1] &= (1UL << (count % 32)) - 1;
+}
+
+void esp32Modbus::encodeBits(const uint32_t* words, size_t count, uint8_t* out) {
+  size_t bytes = (count + 7) / 8;
+  if (bytes == 0) return;
+#if MODBUS_DECODE_LITTLE_ENDIAN
+  memcpy(out, words, bytes);
+#else
+  for (size_t b = 0; b < bytes; ++b) out[b] = words[b / 4] >> (8 * (b % 4));
+#endif
+  if (count % 8) out[bytes - 1] &= (1 << (count % 8)) - 1;
+}
@@ -0,0 +1,65 @@
+/* ModbusDecode
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTU_ModbusDecode_h
+#define esp32ModbusRTU_ModbusDecode_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+
+namespace esp32Modbus {
+
+// Order of the bytes of a 32/64 bit value spread over registers, A being the
+// most significant byte. Registers are big endian on the wire (AB CD = ABCD),
+// devices differ in the order of the registers (CDAB) and some swap the bytes
+// within a register as well (BADC, DCBA). For 64 bit values the same rule
+// applies to four registers: CDAB means least significant register first.
+enum WordOrder : uint8_t {
+  ABCD = 0,  // big endian
+  CDAB = 1,  // word swapped
+  BADC = 2,  // byte swapped
+  DCBA = 3   // little endian
+};
+
+// Decode count values from a register payload as delivered by onData
+// (data must hold 2, 4 resp. 8 bytes per value). out may not overlap data.
+void decodeU16(const uint8_t* data, size_t count, uint16_t* out);
+void decodeI16(const uint8_t* data, size_t count, int16_t* out);
+void decodeU32(const uint8_t* data, size_t count, uint32_t* out, WordOrder order = ABCD);
+void decodeI32(const uint8_t* data, size_t count, int32_t* out, WordOrder order = ABCD);
+void decodeFloat(const uint8_t* data, size_t count, float* out, WordOrder order = ABCD);
+void decodeDouble(const uint8_t* data, size_t count, double* out, WordOrder order = ABCD);
+
+// Coils and discrete inputs: Modbus packs bit i into byte i / 8, bit i % 8
+// (LSB first). Unused bits of the last byte are zero when packing.
+void unpackBits(const uint8_t* data, size_t count, bool* out);
+void packBits(const bool* values, size_t count, uint8_t* out);
+// Packed bitsets in 32 bit words: bit i is bit i % 32 of word i / 32. Unused
+// bits of the last word are cleared. encodeBits writes (count + 7) / 8 bytes.
+void decodeBits(const uint8_t* data, size_t count, uint32_t* out);
+void encodeBits(const uint32_t* words, size_t count, uint8_t* out);
+
+}  // namespace esp32Modbus
+
+#endif
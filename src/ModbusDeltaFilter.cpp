@@ -0,0 +1,101 @@
+/* ModbusDeltaFilter
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusDeltaFilter.h"
+
+#include <string.h>  // for memcmp, memcpy, memset
+
+#include "esp32ModbusTypeDefs.h"
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+DeltaFilter::DeltaFilter() :
+  _useCounter(0) {
+  clear();
+}
+
+void DeltaFilter::clear() {
+  for (uint8_t i = 0; i < MODBUS_DELTA_SLOTS; ++i) {
+    _slots[i].used = false;
+  }
+}
+
+DeltaFilter::Slot* DeltaFilter::_slot(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t count, bool* found) {
+  Slot* victim = &_slots[0];
+  for (uint8_t i = 0; i < MODBUS_DELTA_SLOTS; ++i) {
+    Slot& slot = _slots[i];
+    if (slot.used && slot.slaveAddress == slaveAddress && slot.functionCode == functionCode &&
+        slot.address == address && slot.count == count) {
+      *found = true;
+      return &slot;
+    }
+    if (!slot.used) {
+      if (victim->used) victim = &slot;
+    } else if (victim->used && _useCounter - slot.lastUse > _useCounter - victim->lastUse) {
+      victim = &slot;  // least recently used
+    }
+  }
+  *found = false;
+  return victim;
+}
+
+bool DeltaFilter::update(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t count,
+                         const uint8_t* data, uint16_t length, uint8_t* dirty) {
+  bool bits = (functionCode == esp32Modbus::READ_COIL || functionCode == esp32Modbus::READ_DISCR_INPUT);
+  uint16_t items = bits ? length * 8 : length / 2;
+  if (length > MODBUS_DELTA_MAX_PAYLOAD) {
+    // not tracked, always a change
+    if (dirty) memset(dirty, 0xFF, (items + 7) / 8);
+    return true;
+  }
+
+  bool found;
+  Slot* slot = _slot(slaveAddress, functionCode, address, count, &found);
+  slot->lastUse = ++_useCounter;
+  if (found && memcmp(slot->data, data, length) == 0) return false;
+
+  if (dirty) {
+    if (!found) {
+      memset(dirty, 0xFF, (items + 7) / 8);
+    } else if (bits) {
+      // packed coils: the XOR is the dirty mask
+      for (uint16_t i = 0; i < length; ++i) dirty[i] = slot->data[i] ^ data[i];
+    } else {
+      memset(dirty, 0, (items + 7) / 8);
+      for (uint16_t i = 0; i < items; ++i) {
+        if (slot->data[2 * i] != data[2 * i] || slot->data[2 * i + 1] != data[2 * i + 1]) {
+          dirty[i / 8] |= (1 << (i % 8));
+        }
+      }
+    }
+  }
+
+  slot->used = true;
+  slot->slaveAddress = slaveAddress;
+  slot->functionCode = functionCode;
+  slot->address = address;
+  slot->count = count;
+  memcpy(slot->data, data, length);
+  return true;
+}
@@ -0,0 +1,69 @@
+/* ModbusDeltaFilter
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTUInternals_ModbusDeltaFilter_h
+#define esp32ModbusRTUInternals_ModbusDeltaFilter_h
+
+#include <stdint.h>  // for uint*_t
+
+// Number of distinct reads (slave, function code, address, count) whose last
+// payload is remembered. The least recently seen read is forgotten first.
+#ifndef MODBUS_DELTA_SLOTS
+#define MODBUS_DELTA_SLOTS 16
+#endif
+
+namespace esp32ModbusRTUInternals {
+
+constexpr uint16_t MODBUS_DELTA_MAX_PAYLOAD = 250;  // 125 registers or 2000 coils
+
+class DeltaFilter {
+ public:
+  DeltaFilter();
+  // Compares a read payload with the previous one of the same read (count
+  // registers or coils) and stores it. Returns true if it differs (or was not
+  // seen before). When dirty is not null it receives one bit per register
+  // (FC03/04/17) or per coil/input (FC01/02), LSB first: (length / 2 + 7) / 8
+  // resp. length bytes.
+  bool update(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t count,
+              const uint8_t* data, uint16_t length, uint8_t* dirty);
+  void clear();
+
+ private:
+  struct Slot {
+    bool used;
+    uint8_t slaveAddress;
+    uint8_t functionCode;
+    uint16_t address;
+    uint16_t count;  // 9 and 16 coils both take 2 bytes
+    uint32_t lastUse;
+    uint8_t data[MODBUS_DELTA_MAX_PAYLOAD];
+  };
+  Slot* _slot(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t count, bool* found);
+  Slot _slots[MODBUS_DELTA_SLOTS];
+  uint32_t _useCounter;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
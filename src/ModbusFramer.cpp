@@ -0,0 +1,193 @@
+/* ModbusFramer
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusFramer.h"
+
+#include <string.h>  // for memset
+
+#include "ModbusMessage.h"
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+size_t esp32ModbusRTUInternals::rtuResponseLength(const uint8_t* frame, size_t received) {
+  if (received < 2) return 0;
+  if (frame[1] & MODBUS_ERROR_FLAG) return MODBUS_EXCEPTION_RESPONSE_LENGTH;
+  switch (frame[1]) {
+  case esp32Modbus::READ_COIL:
+  case esp32Modbus::READ_DISCR_INPUT:
+  case esp32Modbus::READ_HOLD_REGISTER:
+  case esp32Modbus::READ_INPUT_REGISTER:
+  case esp32Modbus::READ_WRITE_MULT_REGISTERS:
+  case esp32Modbus::GET_COMM_EVENT_LOG:
+  case esp32Modbus::READ_FILE_RECORD:
+  case esp32Modbus::WRITE_FILE_RECORD:
+    // slaveAddress(1) + functionCode(1) + byteCount(1) + data + CRC(2)
+    if (received < 3) return 0;
+    return 5 + frame[2];
+  case esp32Modbus::WRITE_COIL:
+  case esp32Modbus::WRITE_HOLD_REGISTER:
+  case esp32Modbus::WRITE_MULT_COILS:
+  case esp32Modbus::WRITE_MULT_REGISTERS:
+  case esp32Modbus::DIAGNOSTICS:
+  case esp32Modbus::GET_COMM_EVENT_COUNTER:
+    return 8;
+  case esp32Modbus::MASK_WRITE_REGISTER:
+    return 10;
+  case esp32Modbus::READ_FIFO_QUEUE:
+    // slaveAddress(1) + functionCode(1) + byteCount(2) + data + CRC(2)
+    if (received < 4 || frame[2] != 0) return 0;
+    return 6 + frame[3];
+  case esp32Modbus::ENCAPSULATED_INTERFACE: {
+    // MEI 0x0E: 8 header bytes (slave, fc, MEI, code, conformity, more
+    // follows, next object, object count), then [id, length, value] per object
+    if (received < 8 || frame[2] != MODBUS_MEI_DEVICE_ID) return 0;
+    size_t length = 8;
+    for (uint8_t i = 0; i < frame[7]; ++i) {
+      if (received < length + 2) return 0;  // object header not there yet
+      length += 2 + frame[length + 1];
+    }
+    length += MODBUS_CRC_LENGTH;
+    return length <= MODBUS_RTU_MAX_ADU ? length : 0;
+  }
+  default:
+    return 0;
+  }
+}
+
+size_t esp32ModbusRTUInternals::rtuRequestLength(const uint8_t* frame, size_t received) {
+  if (received < 2) return 0;
+  switch (frame[1]) {
+  case esp32Modbus::READ_COIL:
+  case esp32Modbus::READ_DISCR_INPUT:
+  case esp32Modbus::READ_HOLD_REGISTER:
+  case esp32Modbus::READ_INPUT_REGISTER:
+  case esp32Modbus::WRITE_COIL:
+  case esp32Modbus::WRITE_HOLD_REGISTER:
+    return 8;
+  case esp32Modbus::WRITE_MULT_COILS:
+  case esp32Modbus::WRITE_MULT_REGISTERS:
+    // slaveAddress(1) + functionCode(1) + address(2) + quantity(2) + byteCount(1) + data + CRC(2)
+    if (received < 7) return 0;
+    return 9 + frame[6];
+  case esp32Modbus::READ_WRITE_MULT_REGISTERS:
+    // read address(2) + quantity(2), write address(2) + quantity(2) + byteCount(1)
+    if (received < 11) return 0;
+    return 13 + frame[10];
+  default:
+    return 0;
+  }
+}
+
+uint32_t esp32ModbusRTUInternals::rtuSilenceUs(uint32_t baudRate) {
+  if (baudRate == 0 || baudRate > 19200) return 1750;
+  return 38500000UL / baudRate;  // 3.5 characters of 11 bits
+}
+
+bool esp32ModbusRTUInternals::rtuCheckCRC(const uint8_t* frame, size_t length) {
+  if (length < MODBUS_CRC_LENGTH + 2) return false;  // slave + fc + crc at least
+  // The CRC over a frame including its (little endian) CRC is zero
+  return CRC16(frame, length) == 0;
+}
+
+RTUFramer::RTUFramer(uint32_t silenceUs, LengthHint hint) :
+  _silenceUs(silenceUs),
+  _hint(hint),
+  _handler(nullptr),
+  _length(0),
+  _expected(0),
+  _overrun(false),
+  _unhinted(false),
+  _lastByteUs(0) {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+void RTUFramer::onFrame(FrameHandler handler) {
+  _handler = handler;
+}
+
+void RTUFramer::feed(uint8_t value, uint32_t nowUs) {
+  if (_length > 0 || _overrun) {
+    if (nowUs - _lastByteUs >= _silenceUs) _endFrame();
+  }
+  _lastByteUs = nowUs;
+  ++_stats.bytes;
+
+  if (_length >= MODBUS_RTU_MAX_ADU) {
+    _overrun = true;  // drop until the next silence
+    return;
+  }
+  _buffer[_length++] = value;
+
+  if (_hint && !_unhinted) {
+    if (_expected == 0) {
+      _expected = _hint(_buffer, _length);
+      if (_expected > MODBUS_RTU_MAX_ADU) _expected = 0;  // cannot be right, fall back to silence
+    }
+    if (_expected != 0 && _length == _expected) {
+      if (rtuCheckCRC(_buffer, _length)) {
+        _emit(_length);
+      } else {
+        _expected = 0;
+        _unhinted = true;
+      }
+    }
+  }
+}
+
+void RTUFramer::feed(const uint8_t* data, size_t length, uint32_t nowUs) {
+  for (size_t i = 0; i < length; ++i) {
+    feed(data[i], nowUs);
+  }
+}
+
+void RTUFramer::poll(uint32_t nowUs) {
+  if ((_length > 0 || _overrun) && nowUs - _lastByteUs >= _silenceUs) _endFrame();
+}
+
+void RTUFramer::reset() {
+  _length = 0;
+  _expected = 0;
+  _overrun = false;
+  _unhinted = false;
+}
+
+void RTUFramer::_endFrame() {
+  if (_overrun) {
+    ++_stats.overruns;
+  } else if (_length < _expected || _length < MODBUS_CRC_LENGTH + 2) {
+    ++_stats.truncated;
+  } else if (!rtuCheckCRC(_buffer, _length)) {
+    ++_stats.crcErrors;
+  } else {
+    _emit(_length);
+    return;
+  }
+  reset();
+}
+
+void RTUFramer::_emit(size_t length) {
+  ++_stats.frames;
+  if (_handler) _handler(_buffer, length);
+  reset();
+}
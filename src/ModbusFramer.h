@@ -0,0 +1,100 @@
+/* ModbusFramer
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTUInternals_ModbusFramer_h
+#define esp32ModbusRTUInternals_ModbusFramer_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+#include <functional>  // for std::function
+
+namespace esp32ModbusRTUInternals {
+
+constexpr size_t MODBUS_RTU_MAX_ADU = 256;  // slave(1) + PDU(253) + crc(2)
+
+// Expected length of an RTU response frame, derived from its first bytes.
+// Returns 0 while the length cannot be determined yet, or for function codes
+// whose responses can only be delimited by silence.
+size_t rtuResponseLength(const uint8_t* frame, size_t received);
+
+// Expected length of an RTU request frame (slave mode), 0 as above. Covers
+// the function codes ModbusServer serves.
+size_t rtuRequestLength(const uint8_t* frame, size_t received);
+
+// Inter-frame silence (t3.5) in microseconds. Fixed at 1750 us above 19200 baud.
+uint32_t rtuSilenceUs(uint32_t baudRate);
+
+// True if the frame ends with a valid CRC
+bool rtuCheckCRC(const uint8_t* frame, size_t length);
+
+// Streaming RTU framer: splits a byte stream into frames on t3.5 silence.
+// An optional length hint ends a frame as soon as its expected length is
+// reached, so glued frames are split and no silence has to be waited for.
+// If the CRC does not match at that length the frame was not the kind the
+// hint expects (e.g. another slave's response on a shared bus): it is then
+// delimited by silence and only counted as a CRC error if that fails too.
+// Valid frames are handed to the handler straight from the internal buffer;
+// the pointer is only valid during the call.
+// Used for the requests of slave mode. The master still frames its responses
+// in esp32ModbusRTU::_receive(), through ModbusResponse, not with this class.
+class RTUFramer {
+ public:
+  typedef size_t (*LengthHint)(const uint8_t* frame, size_t received);
+  typedef std::function<void(const uint8_t* frame, size_t length)> FrameHandler;
+
+  struct Stats {
+    uint32_t bytes;      // bytes fed
+    uint32_t frames;     // valid frames delivered
+    uint32_t crcErrors;  // complete frames with a wrong CRC
+    uint32_t truncated;  // frames shorter than their expected (or minimal) length
+    uint32_t overruns;   // frames longer than MODBUS_RTU_MAX_ADU
+  };
+
+  explicit RTUFramer(uint32_t silenceUs, LengthHint hint = nullptr);
+  void onFrame(FrameHandler handler);
+  void feed(uint8_t value, uint32_t nowUs);
+  void feed(const uint8_t* data, size_t length, uint32_t nowUs);  // burst without gaps
+  void poll(uint32_t nowUs);  // ends a pending frame once the line is silent
+  void reset();
+  size_t pending() const { return _length; }
+  const Stats& stats() const { return _stats; }
+
+ private:
+  void _endFrame();
+  void _emit(size_t length);  // a frame whose CRC checked out
+  uint32_t _silenceUs;
+  LengthHint _hint;
+  FrameHandler _handler;
+  uint8_t _buffer[MODBUS_RTU_MAX_ADU];
+  size_t _length;
+  size_t _expected;
+  bool _overrun;
+  bool _unhinted;  // hinted length gave a wrong CRC, the frame ends on silence
+  uint32_t _lastByteUs;
+  Stats _stats;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
@@ -0,0 +1,125 @@
+/* ModbusLatency
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ModbusLatency.h"
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+esp32Modbus::LatencySnapshot LatencyHistogram::snapshot() const {
+  esp32Modbus::LatencySnapshot result = {0, 0, 0, 0, 0};
+  uint32_t counts[BUCKETS];
+  for (uint8_t i = 0; i < BUCKETS; ++i) {
+    counts[i] = _counts[i].load(std::memory_order_relaxed);
+    result.count += counts[i];
+  }
+  result.maxUs = _max.load(std::memory_order_relaxed);
+  if (result.count == 0) return result;
+
+  // The value at a rank is reported as the highest one its bucket stands for
+  const uint8_t percentiles[] = {50, 90, 99};
+  uint32_t* values[] = {&result.p50Us, &result.p90Us, &result.p99Us};
+  uint32_t seen = 0;
+  uint8_t bucket = 0;
+  for (uint8_t p = 0; p < 3; ++p) {
+    uint32_t rank = (static_cast<uint64_t>(result.count) * percentiles[p] + 99) / 100;
+    while (seen + counts[bucket] < rank) seen += counts[bucket++];
+    uint32_t value = highestEquivalent(bucket);
+    *values[p] = value < result.maxUs ? value : result.maxUs;
+  }
+  return result;
+}
+
+void LatencyHistogram::reset() {
+  for (uint8_t i = 0; i < BUCKETS; ++i) {
+    _counts[i].store(0, std::memory_order_relaxed);
+  }
+  _max.store(0, std::memory_order_relaxed);
+}
+
+uint32_t LatencyHistogram::highestEquivalent(uint8_t bucket) {
+  if (bucket < 8) return bucket;
+  uint8_t shift = (bucket >> 3) - 1;  // msb - 3
+  return ((static_cast<uint32_t>(8 | (bucket & 7)) + 1) << shift) - 1;
+}
+
+LatencyStats::LatencyStats() {
+  reset();
+}
+
+void LatencyStats::record(uint8_t slaveAddress, uint8_t functionCode, uint32_t queueUs, uint32_t wireUs) {
+  _record(_totals, queueUs, wireUs);
+  uint16_t key = (slaveAddress << 8) | functionCode;
+  if (key == 0) return;
+  Entry* freeEntry = nullptr;
+  for (uint8_t i = 0; i < MODBUS_LATENCY_SLOTS; ++i) {
+    uint16_t entryKey = _entries[i].key.load(std::memory_order_relaxed);
+    if (entryKey == key) {
+      _record(_entries[i].histograms, queueUs, wireUs);
+      return;
+    }
+    if (entryKey == 0 && !freeEntry) freeEntry = &_entries[i];
+  }
+  if (freeEntry) {
+    for (uint8_t stage = 0; stage < 3; ++stage) freeEntry->histograms[stage].reset();
+    _record(freeEntry->histograms, queueUs, wireUs);
+    freeEntry->key.store(key, std::memory_order_release);
+  }
+}
+
+bool LatencyStats::get(uint8_t slaveAddress, uint8_t functionCode, esp32Modbus::LatencyStage stage,
+                       esp32Modbus::LatencySnapshot* snapshot) const {
+  uint16_t key = (slaveAddress << 8) | functionCode;
+  if (key == 0 || stage > esp32Modbus::LATENCY_TOTAL) return false;
+  for (uint8_t i = 0; i < MODBUS_LATENCY_SLOTS; ++i) {
+    if (_entries[i].key.load(std::memory_order_acquire) == key) {
+      *snapshot = _entries[i].histograms[stage].snapshot();
+      return true;
+    }
+  }
+  return false;
+}
+
+esp32Modbus::LatencySnapshot LatencyStats::totals(esp32Modbus::LatencyStage stage) const {
+  if (stage > esp32Modbus::LATENCY_TOTAL) return esp32Modbus::LatencySnapshot{0, 0, 0, 0, 0};
+  return _totals[stage].snapshot();
+}
+
+// Not synchronised with record(): a transaction recorded meanwhile may survive it in part
+void LatencyStats::reset() {
+  for (uint8_t i = 0; i < MODBUS_LATENCY_SLOTS; ++i) {
+    _entries[i].key.store(0, std::memory_order_relaxed);
+  }
+  for (uint8_t stage = 0; stage < 3; ++stage) _totals[stage].reset();
+}
+
+void LatencyStats::_record(LatencyHistogram* histograms, uint32_t queueUs, uint32_t wireUs) {
+  histograms[esp32Modbus::LATENCY_QUEUE_WAIT].record(queueUs);
+  histograms[esp32Modbus::LATENCY_WIRE].record(wireUs);
+  histograms[esp32Modbus::LATENCY_TOTAL].record(queueUs + wireUs);
+}
@@ -0,0 +1,95 @@
+/* ModbusLatency
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef esp32ModbusRTUInternals_ModbusLatency_h
+#define esp32ModbusRTUInternals_ModbusLatency_h
+
+#include <stdint.h>  // for uint*_t
+#include <atomic>
+
+#include "esp32ModbusTypeDefs.h"
+
+// Number of slave/function code pairs with their own latency histograms
+// (about 2.1 kB each). Further pairs still count towards the totals.
+#ifndef MODBUS_LATENCY_SLOTS
+#define MODBUS_LATENCY_SLOTS 4
+#endif
+
+namespace esp32ModbusRTUInternals {
+
+// Log-bucketed (HDR style) histogram of microsecond values: every power of two
+// is split in 8 buckets, so a bucket is at most 1/8 of its values wide. Values
+// from 2^24 us (16.7 s) on share the last bucket; the max is kept exactly.
+// One task records, any task may take snapshots: counters are atomics written
+// with plain loads and stores, a snapshot may miss the update in progress.
+class LatencyHistogram {
+ public:
+  static const uint8_t BUCKETS = 176;
+  LatencyHistogram();
+  void record(uint32_t us) {
+    std::atomic<uint32_t>& count = _counts[bucket(us)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (us > _max.load(std::memory_order_relaxed)) _max.store(us, std::memory_order_relaxed);
+  }
+  esp32Modbus::LatencySnapshot snapshot() const;
+  void reset();
+  static uint8_t bucket(uint32_t us) {
+    if (us < 8) return us;
+    if (us >= (1UL << 24)) return BUCKETS - 1;
+    uint8_t msb = 31 - __builtin_clz(us);
+    return ((msb - 2) << 3) | ((us >> (msb - 3)) & 7);
+  }
+  static uint32_t highestEquivalent(uint8_t bucket);
+
+ private:
+  std::atomic<uint32_t> _counts[BUCKETS];
+  std::atomic<uint32_t> _max;
+};
+
+// Queue wait, wire and total time per slave and function code, and over all
+// transactions. The pairs are taken in order of appearance until the table is
+// full; reset() frees them again. Written by the worker task only.
+class LatencyStats {
+ public:
+  LatencyStats();
+  void record(uint8_t slaveAddress, uint8_t functionCode, uint32_t queueUs, uint32_t wireUs);
+  bool get(uint8_t slaveAddress, uint8_t functionCode, esp32Modbus::LatencyStage stage,
+           esp32Modbus::LatencySnapshot* snapshot) const;
+  esp32Modbus::LatencySnapshot totals(esp32Modbus::LatencyStage stage) const;
+  void reset();
+
+ private:
+  struct Entry {
+    std::atomic<uint16_t> key;  // slave address << 8 | function code, 0: free
+    LatencyHistogram histograms[3];  // by LatencyStage
+  };
+  static void _record(LatencyHistogram* histograms, uint32_t queueUs, uint32_t wireUs);
+  Entry _entries[MODBUS_LATENCY_SLOTS];
+  LatencyHistogram _totals[3];
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
@@ -31,6 +31,11 @@ MODBUS over serial line specification and implementation guide V1.02
 
 #include "ModbusMessage.h"
 
+#include <string.h>  // for memcpy, memset
+
+#include "ModbusFramer.h"
+#include "ModbusDecode.h"
+
 using namespace esp32ModbusRTUInternals;  // NOLINT
 
 static const uint8_t crcHiTable[] = {
@@ -75,7 +80,7 @@ static const uint8_t crcLoTable[] = {
   0x40
 };
 
-uint16_t CRC16(uint8_t* msg, size_t len) {
+uint16_t esp32ModbusRTUInternals::CRC16(const uint8_t* msg, size_t len) {
   uint8_t crcHi = 0xFF;
   uint8_t crcLo = 0xFF;
   uint8_t index;
@@ -100,34 +105,43 @@ uint16_t make_word(uint8_t high, uint8_t low) {
   return ((high << 8) | low);
 }
 
-ModbusMessage::ModbusMessage(uint8_t length) :
+ModbusMessage::ModbusMessage(uint16_t length) :
   _buffer(nullptr),
   _length(length),
-  _index(0) {
+  _index(0),
+  _ownsBuffer(true) {
   if (length < MODBUS_MIN_RESPONSE_LENGTH) _length = MODBUS_MIN_RESPONSE_LENGTH;  // minimum for Modbus Exception codes
   
   // Safety check to prevent excessive allocation
-  if (_length > 255) {  // Max uint8_t value, reasonable for Modbus RTU
-    _length = 255;
+  if (_length > MODBUS_RTU_MAX_ADU) {  // a device ID response may take all 256 bytes
+    _length = MODBUS_RTU_MAX_ADU;
   }
   
   _buffer = new uint8_t[_length];
   if (_buffer != nullptr) {
-    for (uint8_t i = 0; i < _length; ++i) {
+    for (uint16_t i = 0; i < _length; ++i) {
       _buffer[i] = 0;
     }
   }
 }
 
+ModbusMessage::ModbusMessage(uint8_t* buffer, uint16_t length) :
+  _buffer(buffer),
+  _length(length),
+  _index(0),
+  _ownsBuffer(false) {
+  memset(_buffer, 0, _length);
+}
+
 ModbusMessage::~ModbusMessage() {
-  delete[] _buffer;
+  if (_ownsBuffer) delete[] _buffer;
 }
 
 uint8_t* ModbusMessage::getMessage() {
   return _buffer;
 }
 
-uint8_t ModbusMessage::getSize() {
+uint16_t ModbusMessage::getSize() {
   return _index;
 }
 
@@ -149,7 +163,12 @@ ModbusRequest::ModbusRequest(uint8_t length) :
   _functionCode(0),
   _address(0),
   _byteCount(0),
-  _priority(esp32Modbus::RELAY) {}  // Default to RELAY priority for backward compatibility
+  _priority(esp32Modbus::RELAY),  // Default to RELAY priority for backward compatibility
+  _retries(0),
+  _retryAt(0),
+  _queuedMicros(0),
+  _operation(nullptr),
+  _destination(nullptr) {}
 
   uint16_t ModbusRequest::getAddress() {
   return _address;
@@ -283,6 +302,57 @@ size_t ModbusRequest06::responseLength() {
   return 8;
 }
 
+ModbusRequest08::ModbusRequest08(uint8_t slaveAddress, uint16_t subFunction, uint16_t data) :
+  ModbusRequest(8) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::DIAGNOSTICS;
+  _address = subFunction;  // echoed like a write address
+  _byteCount = 2;
+  add(_slaveAddress);
+  add(_functionCode);
+  add(high(subFunction));
+  add(low(subFunction));
+  add(high(data));
+  add(low(data));
+  uint16_t CRC = CRC16(_buffer, 6);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequest08::responseLength() {
+  return 8;  // sub-function + data (echo or counter)
+}
+
+ModbusRequest0B::ModbusRequest0B(uint8_t slaveAddress) :
+  ModbusRequest(4) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::GET_COMM_EVENT_COUNTER;
+  add(_slaveAddress);
+  add(_functionCode);
+  uint16_t CRC = CRC16(_buffer, 2);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequest0B::responseLength() {
+  return 8;  // status + event count
+}
+
+ModbusRequest0C::ModbusRequest0C(uint8_t slaveAddress) :
+  ModbusRequest(4) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::GET_COMM_EVENT_LOG;
+  add(_slaveAddress);
+  add(_functionCode);
+  uint16_t CRC = CRC16(_buffer, 2);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequest0C::responseLength() {
+  return 0;  // byte count in the response, see rtuResponseLength()
+}
+
 ModbusRequest0F::ModbusRequest0F(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, bool* values) :
   ModbusRequest(9 + ((numberCoils + 7) / 8)) {
   // Note: numberCoils should already be validated by esp32ModbusRTU::writeMultipleCoils
@@ -299,16 +369,33 @@ ModbusRequest0F::ModbusRequest0F(uint8_t slaveAddress, uint16_t address, uint16_
   add(_byteCount);
   
   // Pack bool values into bytes (8 coils per byte)
+  esp32Modbus::packBits(values, numberCoils, &_buffer[_index]);
+  _index += _byteCount;
+
+  uint16_t CRC = CRC16(_buffer, 7 + _byteCount);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+ModbusRequest0F::ModbusRequest0F(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, const uint8_t* bits) :
+  ModbusRequest(9 + ((numberCoils + 7) / 8)) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::WRITE_MULT_COILS;
+  _address = address;
+  _byteCount = (numberCoils + 7) / 8;
+  add(_slaveAddress);
+  add(_functionCode);
+  add(high(_address));
+  add(low(_address));
+  add(high(numberCoils));
+  add(low(numberCoils));
+  add(_byteCount);
   for (int i = 0; i < _byteCount; i++) {
-    uint8_t byte = 0;
-    for (int bit = 0; bit < 8 && (i * 8 + bit) < numberCoils; bit++) {
-      if (values[i * 8 + bit]) {
-        byte |= (1 << bit);
-      }
-    }
-    add(byte);
+    add(bits[i]);
+  }
+  if (numberCoils % 8) {
+    _buffer[_index - 1] &= (1 << (numberCoils % 8)) - 1;  // unused bits must be zero
   }
-  
   uint16_t CRC = CRC16(_buffer, 7 + _byteCount);
   add(low(CRC));
   add(high(CRC));
@@ -318,7 +405,7 @@ size_t ModbusRequest0F::responseLength() {
   return 8;
 }
 
-ModbusRequest16::ModbusRequest16(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint8_t* data) :
+ModbusRequest16::ModbusRequest16(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, const uint8_t* data) :
   ModbusRequest(9 + (numberRegisters * 2)) {
   _slaveAddress = slaveAddress;
   _functionCode = esp32Modbus::WRITE_MULT_REGISTERS;
@@ -343,6 +430,123 @@ size_t ModbusRequest16::responseLength() {
   return 8;
 }
 
+ModbusRequestMaskWrite::ModbusRequestMaskWrite(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask) :
+  ModbusRequest(10) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::MASK_WRITE_REGISTER;
+  _address = address;
+  _byteCount = 4;  // and + or mask
+  add(_slaveAddress);
+  add(_functionCode);
+  add(high(_address));
+  add(low(_address));
+  add(high(andMask));
+  add(low(andMask));
+  add(high(orMask));
+  add(low(orMask));
+  uint16_t CRC = CRC16(_buffer, 8);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequestMaskWrite::responseLength() {
+  return 10;  // echo of the request
+}
+
+ModbusRequestDeviceId::ModbusRequestDeviceId(uint8_t slaveAddress, uint8_t readDeviceIdCode, uint8_t objectId) :
+  ModbusRequest(7) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::ENCAPSULATED_INTERFACE;
+  _address = objectId;
+  _byteCount = 0;  // unknown
+  add(_slaveAddress);
+  add(_functionCode);
+  add(MODBUS_MEI_DEVICE_ID);
+  add(readDeviceIdCode);
+  add(objectId);
+  uint16_t CRC = CRC16(_buffer, 5);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequestDeviceId::responseLength() {
+  return 0;  // variable, see rtuResponseLength()
+}
+
+ModbusRequest14::ModbusRequest14(uint8_t slaveAddress, const esp32Modbus::FileRecordRef* refs, uint8_t count) :
+  ModbusRequest(5 + 7 * count) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::READ_FILE_RECORD;
+  _address = refs[0].record;
+  _byteCount = 0;  // expected response data length
+  add(_slaveAddress);
+  add(_functionCode);
+  add(7 * count);
+  for (uint8_t i = 0; i < count; ++i) {
+    add(6);  // reference type
+    add(high(refs[i].file));
+    add(low(refs[i].file));
+    add(high(refs[i].record));
+    add(low(refs[i].record));
+    add(high(refs[i].length));
+    add(low(refs[i].length));
+    _byteCount += 2 + refs[i].length * 2;
+  }
+  uint16_t CRC = CRC16(_buffer, 3 + 7 * count);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequest14::responseLength() {
+  return 5 + _byteCount;
+}
+
+ModbusRequest15::ModbusRequest15(uint8_t slaveAddress, const esp32Modbus::FileRecordRef* refs, uint8_t count, const uint8_t* data) :
+  ModbusRequest(5 + fileRecordByteCount(refs, count, true)) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::WRITE_FILE_RECORD;
+  _address = refs[0].record;
+  _byteCount = _length - 5;  // echoed in the response
+  add(_slaveAddress);
+  add(_functionCode);
+  add(_byteCount);
+  for (uint8_t i = 0; i < count; ++i) {
+    add(6);  // reference type
+    add(high(refs[i].file));
+    add(low(refs[i].file));
+    add(high(refs[i].record));
+    add(low(refs[i].record));
+    add(high(refs[i].length));
+    add(low(refs[i].length));
+    for (uint16_t j = 0; j < refs[i].length * 2; ++j) {
+      add(*data++);
+    }
+  }
+  uint16_t CRC = CRC16(_buffer, 3 + _byteCount);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequest15::responseLength() {
+  return 5 + _byteCount;  // echo of the request
+}
+
+uint16_t esp32ModbusRTUInternals::fileRecordByteCount(const esp32Modbus::FileRecordRef* refs, uint8_t count, bool write) {
+  if (refs == nullptr || count == 0) return 0;
+  uint16_t requestBytes = 0;
+  uint16_t responseBytes = 0;
+  for (uint8_t i = 0; i < count; ++i) {
+    if (refs[i].file == 0 || refs[i].length == 0 || refs[i].record > MODBUS_MAX_FILE_RECORD ||
+        refs[i].length > MODBUS_MAX_FILE_RECORD + 1 - refs[i].record) {
+      return 0;
+    }
+    requestBytes += 7 + (write ? refs[i].length * 2 : 0);
+    responseBytes += 2 + refs[i].length * 2;
+    if (requestBytes > MODBUS_MAX_FILE_DATA || (!write && responseBytes > MODBUS_MAX_FILE_DATA)) return 0;
+  }
+  return requestBytes;
+}
+
 ModbusRequest17::ModbusRequest17(uint8_t slaveAddress, uint16_t readAddress, uint16_t readCount, uint16_t writeAddress, uint16_t writeCount, uint16_t* writeData) :
   ModbusRequest(11 + (writeCount * 2)) {
   _slaveAddress = slaveAddress;
@@ -378,42 +582,216 @@ size_t ModbusRequest17::responseLength() {
   return 5 + _byteCount;
 }
 
-ModbusResponse::ModbusResponse(uint8_t length, ModbusRequest* request) :
+ModbusRequest18::ModbusRequest18(uint8_t slaveAddress, uint16_t pointerAddress) :
+  ModbusRequest(6) {
+  _slaveAddress = slaveAddress;
+  _functionCode = esp32Modbus::READ_FIFO_QUEUE;
+  _address = pointerAddress;
+  add(_slaveAddress);
+  add(_functionCode);
+  add(high(_address));
+  add(low(_address));
+  uint16_t CRC = CRC16(_buffer, 4);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequest18::responseLength() {
+  return 0;  // depends on the queue count, see rtuResponseLength()
+}
+
+ModbusRequestRaw::ModbusRequestRaw(uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length, uint8_t responseDataLength) :
+  ModbusRequest(4 + length) {
+  _slaveAddress = slaveAddress;
+  _functionCode = functionCode;
+  _address = length >= 2 ? make_word(data[0], data[1]) : 0;  // reported to onData, most PDUs start with an address
+  _byteCount = responseDataLength;
+  add(_slaveAddress);
+  add(_functionCode);
+  for (uint8_t i = 0; i < length; ++i) {
+    add(data[i]);
+  }
+  uint16_t CRC = CRC16(_buffer, 2 + length);
+  add(low(CRC));
+  add(high(CRC));
+}
+
+size_t ModbusRequestRaw::responseLength() {
+  return _byteCount ? 4 + _byteCount : 0;
+}
+
+bool esp32ModbusRTUInternals::isBroadcastable(uint8_t functionCode) {
+  switch (functionCode) {
+  case esp32Modbus::WRITE_COIL:
+  case esp32Modbus::WRITE_HOLD_REGISTER:
+  case esp32Modbus::WRITE_MULT_COILS:
+  case esp32Modbus::WRITE_MULT_REGISTERS:
+  case esp32Modbus::WRITE_FILE_RECORD:
+  case esp32Modbus::MASK_WRITE_REGISTER:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void esp32ModbusRTUInternals::broadcastResponse(ModbusRequest* request, ModbusResponse* response) {
+  // every write echo is a prefix of the request (all of it for FC15/16) plus CRC
+  size_t length = request->responseLength();
+  uint8_t* message = request->getMessage();
+  for (size_t i = 0; i < length - MODBUS_CRC_LENGTH; ++i) {
+    response->add(message[i]);
+  }
+  uint16_t CRC = CRC16(message, length - MODBUS_CRC_LENGTH);
+  response->add(low(CRC));
+  response->add(high(CRC));
+}
+
+// Bytes to accept for a response: the expected length, all of the ADU when the
+// frame is delimited by silence
+static uint16_t receiveLength(ModbusRequest* request) {
+  size_t length = request->responseLength();
+  if (length == 0 || length > MODBUS_RTU_MAX_ADU) return MODBUS_RTU_MAX_ADU;
+  if (length < MODBUS_MIN_RESPONSE_LENGTH) return MODBUS_MIN_RESPONSE_LENGTH;  // room for an exception
+  return length;
+}
+
+ModbusResponse::ModbusResponse(uint16_t length, ModbusRequest* request) :
   ModbusMessage(length),
   _request(request),
-  _error(esp32Modbus::SUCCESS) {}
+  _destination(request->getDestination()),
+  _sentMicros(0),
+  _receivedMicros(0),
+  _error(esp32Modbus::SUCCESS),
+  _rejected(false),
+  _endOfFrame(false),
+  _converted(false) {}
+
+ModbusResponse::ModbusResponse(uint8_t* frame, ModbusRequest* request) :
+  ModbusMessage(frame, receiveLength(request)),
+  _request(request),
+  _destination(request->getDestination()),
+  _sentMicros(0),
+  _receivedMicros(0),
+  _error(esp32Modbus::SUCCESS),
+  _rejected(false),
+  _endOfFrame(false),
+  _converted(false) {}
+
+void ModbusResponse::add(uint8_t value) {
+  if (_rejected) return;  // discard the rest of the frame
+  ModbusMessage::add(value);
+
+  // Reject as soon as the header cannot belong to the request, instead of
+  // waiting for a length that will never be reached.
+  switch (_index) {
+  case 1:
+    if (_buffer[0] != _request->getSlaveAddress()) _reject(esp32Modbus::INVALID_SLAVE);
+    break;
+  case 2:
+    if ((_buffer[1] & ~MODBUS_ERROR_FLAG) != _request->getFunctionCode()) _reject(esp32Modbus::INVALID_RESPONSE);
+    break;
+  case 3:
+  case 4:
+    if (_buffer[1] & MODBUS_ERROR_FLAG) break;  // exception code, no header to check
+    if (_request->isRaw()) break;  // layout unknown
+    switch (_request->getFunctionCode()) {
+    case esp32Modbus::READ_COIL:
+    case esp32Modbus::READ_DISCR_INPUT:
+    case esp32Modbus::READ_HOLD_REGISTER:
+    case esp32Modbus::READ_INPUT_REGISTER:
+    case esp32Modbus::READ_WRITE_MULT_REGISTERS:
+    case esp32Modbus::READ_FILE_RECORD:
+    case esp32Modbus::WRITE_FILE_RECORD:
+      // byte count
+      if (_index == 3 && _buffer[2] != _request->getByteCount()) _reject(esp32Modbus::INVALID_RESPONSE);
+      break;
+    case esp32Modbus::WRITE_COIL:
+    case esp32Modbus::WRITE_HOLD_REGISTER:
+    case esp32Modbus::WRITE_MULT_COILS:
+    case esp32Modbus::WRITE_MULT_REGISTERS:
+    case esp32Modbus::MASK_WRITE_REGISTER:
+    case esp32Modbus::DIAGNOSTICS:
+      // echoed address (sub-function for FC08)
+      if (_buffer[_index - 1] != (_index == 3 ? high(_request->getAddress()) : low(_request->getAddress()))) {
+        _reject(esp32Modbus::INVALID_RESPONSE);
+      }
+      break;
+    case esp32Modbus::READ_FIFO_QUEUE:
+      // 16 bit byte count: queue count (2) + up to 31 registers
+      if (_index == 4 && ((_buffer[2] << 8 | _buffer[3]) < 2 || (_buffer[2] << 8 | _buffer[3]) > 2 + 2 * MODBUS_MAX_FIFO_COUNT ||
+                          (_buffer[3] & 1))) {
+        _reject(esp32Modbus::INVALID_RESPONSE);
+      }
+      break;
+    case esp32Modbus::ENCAPSULATED_INTERFACE:
+      // MEI type
+      if (_index == 3 && _buffer[2] != _request->getMessage()[2]) _reject(esp32Modbus::INVALID_RESPONSE);
+      break;
+    default:
+      break;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void ModbusResponse::_reject(esp32Modbus::Error error) {
+  _rejected = true;
+  _error = error;
+}
 
 bool ModbusResponse::isComplete() {
   if (_buffer[1] & MODBUS_ERROR_FLAG && _index == MODBUS_EXCEPTION_RESPONSE_LENGTH) {  // Exception response
     return true;
   }
-  if (_index == _request->responseLength()) return true;
-  return false;
+  // Expected length from the request, else from the header received so far,
+  // else the frame is delimited by silence only
+  size_t expected = _request->responseLength();
+  if (expected == 0) expected = rtuResponseLength(_buffer, _index);
+  if (expected != 0) return _index == expected;
+  // a raw response may consist of address, function code and CRC only
+  return _endOfFrame && _index >= (_request->isRaw() ? 2 + MODBUS_CRC_LENGTH : MODBUS_MIN_RESPONSE_LENGTH);
 }
 
 bool ModbusResponse::isSuccess() {
-  if (!isComplete()) {
+  if (_rejected) {
+    return false;  // _error set on rejection
+  } else if (!isComplete()) {
     _error = esp32Modbus::TIMEOUT;
-  } else if (_buffer[1] & MODBUS_ERROR_FLAG) {
-    _error = static_cast<esp32Modbus::Error>(_buffer[2]);
   } else if (!checkCRC()) {
     _error = esp32Modbus::CRC_ERROR;
+  } else if (_buffer[1] & MODBUS_ERROR_FLAG) {
+    _error = static_cast<esp32Modbus::Error>(_buffer[2]);
   } else if (_buffer[0] != _request->getSlaveAddress()) {
     // Response from wrong slave
     _error = esp32Modbus::INVALID_SLAVE;
   } else if (_buffer[1] != _request->getFunctionCode()) {
     // Function code mismatch (not an error response)
     _error = esp32Modbus::INVALID_RESPONSE;
+  } else if (_buffer[1] == esp32Modbus::READ_FIFO_QUEUE && (_buffer[2] << 8 | _buffer[3]) != 2 + 2 * (_buffer[4] << 8 | _buffer[5])) {
+    // queue count does not match the byte count
+    _error = esp32Modbus::INVALID_RESPONSE;
   } else {
     // Additional validation could be added here for specific function codes
     _error = esp32Modbus::SUCCESS;
+    // The frame checked out: only now the registers go to the caller's
+    // array, converted to host order, so an error leaves it untouched
+    if (_destination && !_converted) {
+      for (uint8_t i = 0; i < _buffer[2] / 2; ++i) {
+        _destination[i] = _buffer[3 + 2 * i] << 8 | _buffer[4 + 2 * i];
+      }
+      _converted = true;
+    }
   }
   return (_error == esp32Modbus::SUCCESS);
 }
 
 bool ModbusResponse::checkCRC() {
-  uint16_t CRC = CRC16(_buffer, _length - MODBUS_CRC_LENGTH);
-  if (low(CRC) == _buffer[_length - 2] && high(CRC) == _buffer[_length -1]) {
+  // Over the received bytes: an exception response is shorter than the buffer
+  if (_index < MODBUS_CRC_LENGTH + 1) return false;
+  uint16_t CRC = CRC16(_buffer, _index - MODBUS_CRC_LENGTH);
+  if (low(CRC) == _buffer[_index - 2] && high(CRC) == _buffer[_index - 1]) {
     return true;
   } else {
     return false;
@@ -436,17 +814,38 @@ uint8_t* ModbusResponse::getData() {
   // For write single responses (FC 05, 06), data starts at position 2
   // For read responses, data starts at position 3 (after byte count)
   esp32Modbus::FunctionCode fc = getFunctionCode();
+  if (_request->isRaw()) {
+    return &_buffer[2];  // everything after the function code
+  }
   if (fc == esp32Modbus::WRITE_COIL || fc == esp32Modbus::WRITE_HOLD_REGISTER) {
     return &_buffer[2];  // Points to register address + value
   }
+  if (fc == esp32Modbus::MASK_WRITE_REGISTER || fc == esp32Modbus::DIAGNOSTICS || fc == esp32Modbus::GET_COMM_EVENT_COUNTER) {
+    return &_buffer[2];  // no byte count
+  }
+  if (fc == esp32Modbus::READ_FIFO_QUEUE) {
+    return &_buffer[6];  // queued registers, after byte count and queue count
+  }
   return &_buffer[3];  // For read responses, skip byte count
 }
 
 uint8_t ModbusResponse::getByteCount() {
   // For write single responses (FC 05, 06), return fixed size
   esp32Modbus::FunctionCode fc = getFunctionCode();
+  if (_request->isRaw()) {
+    return _index > 4 ? _index - 4 : 0;  // all but address, function code and CRC
+  }
   if (fc == esp32Modbus::WRITE_COIL || fc == esp32Modbus::WRITE_HOLD_REGISTER) {
     return 4;  // 2 bytes address + 2 bytes value
   }
+  if (fc == esp32Modbus::MASK_WRITE_REGISTER) {
+    return 6;
+  }
+  if (fc == esp32Modbus::DIAGNOSTICS || fc == esp32Modbus::GET_COMM_EVENT_COUNTER) {
+    return 4;  // sub-function + data resp. status + event count
+  }
+  if (fc == esp32Modbus::READ_FIFO_QUEUE) {
+    return 2 * _buffer[5];  // queued registers only, at most 31
+  }
   return _buffer[2];  // For read responses, byte count is at position 2
 }
@@ -39,32 +39,70 @@ constexpr uint8_t MODBUS_MIN_RESPONSE_LENGTH = 5;  // Minimum valid response len
 constexpr uint8_t MODBUS_CRC_LENGTH = 2;  // CRC is always 2 bytes
 constexpr uint16_t MODBUS_COIL_ON = 0xFF00;  // Value for ON coil
 constexpr uint16_t MODBUS_COIL_OFF = 0x0000;  // Value for OFF coil
+constexpr uint16_t MODBUS_MAX_READ_REGISTERS = 125;  // FC03/04 quantity limit
+constexpr uint16_t MODBUS_MAX_READ_BITS = 2000;  // FC01/02 quantity limit
+constexpr uint16_t MODBUS_MAX_FC16_REGISTERS = 123;  // FC16 quantity limit
+constexpr uint16_t MODBUS_MAX_FC0F_COILS = 1968;  // FC0F quantity limit
+constexpr uint16_t MODBUS_MAX_FC17_WRITE_REGISTERS = 121;  // FC17 write quantity limit
+constexpr uint8_t MODBUS_MAX_FILE_DATA = 245;  // FC14/15 request and response data length limit
+constexpr uint16_t MODBUS_MAX_FC14_RECORDS = 121;  // one sub-request: 2 + 2 * 121 bytes
+constexpr uint16_t MODBUS_MAX_FC15_RECORDS = 119;  // one sub-request: 7 + 2 * 119 bytes
+constexpr uint16_t MODBUS_MAX_FILE_RECORD = 9999;  // highest record number
+constexpr uint8_t MODBUS_MAX_FIFO_COUNT = 31;  // FC18 queue length limit
+constexpr uint8_t MODBUS_MAX_RAW_DATA = 251;  // data bytes after the function code, 8 bit frame length
+constexpr uint8_t MODBUS_BROADCAST_ADDRESS = 0;  // written to by all slaves, answered by none
+constexpr uint8_t MODBUS_MEI_DEVICE_ID = 0x0E;  // FC 0x2B MEI type: read device identification
+
+uint16_t CRC16(const uint8_t* msg, size_t len);
 
 class ModbusMessage {
  public:
   virtual ~ModbusMessage();
   uint8_t* getMessage();
-  uint8_t getSize();
+  uint16_t getSize();
   void add(uint8_t value);
 
  protected:
-  explicit ModbusMessage(uint8_t length);
+  explicit ModbusMessage(uint16_t length);
+  ModbusMessage(uint8_t* buffer, uint16_t length);  // buffer owned by the caller, at least length bytes
   uint8_t* _buffer;
-  uint8_t _length;
-  uint8_t _index;
+  uint16_t _length;  // up to MODBUS_RTU_MAX_ADU (256)
+  uint16_t _index;
+  bool _ownsBuffer;
 };
 
 class ModbusResponse;  // forward declare for use in ModbusRequest
+class ModbusOperation;  // forward declare for use in ModbusRequest
 
 class ModbusRequest : public ModbusMessage {
  public:
-  virtual size_t responseLength() = 0;
+  virtual size_t responseLength() = 0;  // 0 = variable, the frame ends on silence
+  virtual bool isRaw() const { return false; }  // payload not interpreted, see ModbusRequestRaw
   uint16_t getAddress();
   uint8_t getSlaveAddress() const { return _slaveAddress; }
   uint8_t getFunctionCode() const { return _functionCode; }
+  uint16_t getByteCount() const { return _byteCount; }
   esp32Modbus::ModbusPriority getPriority() const { return _priority; }
   void setPriority(esp32Modbus::ModbusPriority priority) { _priority = priority; }
 
+  // Retry bookkeeping, managed by the worker task
+  uint8_t getRetries() const { return _retries; }
+  uint32_t getRetryAt() const { return _retryAt; }
+  void scheduleRetry(uint32_t retryAt) { ++_retries; _retryAt = retryAt; }
+
+  // micros() when first queued, start of the queue wait in the latency histograms
+  uint32_t getQueuedMicros() const { return _queuedMicros; }
+  void setQueuedMicros(uint32_t queuedMicros) { _queuedMicros = queuedMicros; }
+
+  // Operation this request is part of, nullptr for standalone requests
+  ModbusOperation* getOperation() const { return _operation; }
+  void setOperation(ModbusOperation* operation) { _operation = operation; }
+
+  // Caller-owned buffer receiving the registers of a register read (FC03/04/17)
+  // in host order, once the response passed its checks. nullptr: the payload stays in the response.
+  uint16_t* getDestination() const { return _destination; }
+  void setDestination(uint16_t* destination) { _destination = destination; }
+
  protected:
   explicit ModbusRequest(uint8_t length);
   uint8_t _slaveAddress;
@@ -72,6 +110,23 @@ class ModbusRequest : public ModbusMessage {
   uint16_t _address;
   uint16_t _byteCount;
   esp32Modbus::ModbusPriority _priority;  // Default priority will be set in constructor
+  uint8_t _retries;
+  uint32_t _retryAt;  // millis() timestamp after which the retry may be sent
+  uint32_t _queuedMicros;
+  ModbusOperation* _operation;
+  uint16_t* _destination;
+};
+
+// A sequence of requests resulting from one API call (split reads, bulk
+// writes, ...). The worker sends the requests returned by next() one after
+// the other, ahead of other requests of the same priority, and hands every
+// outcome to onResponse() instead of onData/onError. The operation is
+// deleted once next() returns nullptr.
+class ModbusOperation {
+ public:
+  virtual ~ModbusOperation() {}
+  virtual ModbusRequest* next() = 0;
+  virtual void onResponse(ModbusRequest* request, ModbusResponse* response) = 0;
 };
 
 // read coils
@@ -116,20 +171,102 @@ class ModbusRequest06 : public ModbusRequest {
   size_t responseLength();
 };
 
+// diagnostics (FC 0x08), one 16 bit data field
+class ModbusRequest08 : public ModbusRequest {
+ public:
+  explicit ModbusRequest08(uint8_t slaveAddress, uint16_t subFunction, uint16_t data);
+  size_t responseLength();
+};
+
+// get comm event counter (FC 0x0B)
+class ModbusRequest0B : public ModbusRequest {
+ public:
+  explicit ModbusRequest0B(uint8_t slaveAddress);
+  size_t responseLength();
+};
+
+// get comm event log (FC 0x0C)
+class ModbusRequest0C : public ModbusRequest {
+ public:
+  explicit ModbusRequest0C(uint8_t slaveAddress);
+  size_t responseLength();
+};
+
 // write multiple coils
 class ModbusRequest0F : public ModbusRequest {
  public:
   explicit ModbusRequest0F(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, bool* values);
+  // bits packed as on the wire: coil i is bit i % 8 of bits[i / 8]
+  explicit ModbusRequest0F(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, const uint8_t* bits);
   size_t responseLength();
 };
 
 // write multiple holding registers
 class ModbusRequest16 : public ModbusRequest {
  public:
-  explicit ModbusRequest16(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint8_t* data);
+  explicit ModbusRequest16(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, const uint8_t* data);
+  size_t responseLength();
+};
+
+// mask write register (FC 0x16): register = (register AND andMask) OR (orMask AND NOT andMask)
+class ModbusRequestMaskWrite : public ModbusRequest {
+ public:
+  explicit ModbusRequestMaskWrite(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask);
   size_t responseLength();
 };
 
+// read device identification (FC 0x2B / MEI 0x0E). The response length
+// depends on the objects, the framer works it out while they arrive.
+class ModbusRequestDeviceId : public ModbusRequest {
+ public:
+  explicit ModbusRequestDeviceId(uint8_t slaveAddress, uint8_t readDeviceIdCode, uint8_t objectId);
+  size_t responseLength();
+};
+
+// read file record, count sub-requests
+class ModbusRequest14 : public ModbusRequest {
+ public:
+  explicit ModbusRequest14(uint8_t slaveAddress, const esp32Modbus::FileRecordRef* refs, uint8_t count);
+  size_t responseLength();
+};
+
+// write file record, data holds the records of all sub-requests back to back (big endian)
+class ModbusRequest15 : public ModbusRequest {
+ public:
+  explicit ModbusRequest15(uint8_t slaveAddress, const esp32Modbus::FileRecordRef* refs, uint8_t count, const uint8_t* data);
+  size_t responseLength();
+};
+
+// Data length (byte count field) of a FC14 request (write = false) or FC15
+// request, 0 when a reference is out of range or the frame would be too long
+uint16_t fileRecordByteCount(const esp32Modbus::FileRecordRef* refs, uint8_t count, bool write);
+
+// read FIFO queue
+class ModbusRequest18 : public ModbusRequest {
+ public:
+  explicit ModbusRequest18(uint8_t slaveAddress, uint16_t pointerAddress);
+  size_t responseLength();
+};
+
+// Any function code (user defined ones included) with the data given as is.
+// The response is not interpreted beyond address, function code and CRC: its
+// data is everything after the function code. responseDataLength is the number
+// of such bytes if known, else 0 and the response ends on the inter-frame
+// silence. The frame is built in the request's own buffer.
+class ModbusRequestRaw : public ModbusRequest {
+ public:
+  explicit ModbusRequestRaw(uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length, uint8_t responseDataLength);
+  size_t responseLength();
+  bool isRaw() const { return true; }
+};
+
+// Write function codes a request to MODBUS_BROADCAST_ADDRESS may use
+bool isBroadcastable(uint8_t functionCode);
+
+// The answer a broadcast would have got if it were addressed to one slave: the
+// write echo, added to the (empty) response. Lets broadcasts complete like any other write.
+void broadcastResponse(ModbusRequest* request, ModbusResponse* response);
+
 // read/write multiple registers
 class ModbusRequest17 : public ModbusRequest {
  public:
@@ -139,12 +276,22 @@ class ModbusRequest17 : public ModbusRequest {
 
 class ModbusResponse : public ModbusMessage {
  public:
-  explicit ModbusResponse(uint8_t length, ModbusRequest* request);
+  explicit ModbusResponse(uint16_t length, ModbusRequest* request);
+  // Received into frame (MODBUS_RTU_MAX_ADU bytes), which the worker reuses for every transaction
+  ModbusResponse(uint8_t* frame, ModbusRequest* request);
+  void add(uint8_t value);  // validates the header as bytes arrive
+  void endOfFrame() { _endOfFrame = true; }  // inter-frame silence detected
   bool isComplete();
+  bool isRejected() const { return _rejected; }  // frame can no longer match the request
+  void reject(esp32Modbus::Error error) { _reject(error); }  // frame refused by the transport (e.g. ASCII LRC)
   bool isSuccess();  // Correct spelling
   bool isSucces() { return isSuccess(); }  // Deprecated: kept for backward compatibility
   bool checkCRC();
   esp32Modbus::Error getError() const;
+  bool isDirect() const { return _destination != nullptr; }  // on success the payload is converted into the request's destination
+  // Start of the request and last byte of the response on the bus (micros())
+  void setTiming(uint32_t sentMicros, uint32_t receivedMicros) { _sentMicros = sentMicros; _receivedMicros = receivedMicros; }
+  uint32_t getRoundTripMicros() const { return _receivedMicros - _sentMicros; }
 
   uint8_t getSlaveAddress();
   esp32Modbus::FunctionCode getFunctionCode();
@@ -152,8 +299,15 @@ class ModbusResponse : public ModbusMessage {
   uint8_t getByteCount();
 
  private:
+  void _reject(esp32Modbus::Error error);
   ModbusRequest* _request;
+  uint16_t* _destination;
+  uint32_t _sentMicros;
+  uint32_t _receivedMicros;
   esp32Modbus::Error _error;
+  bool _rejected;
+  bool _endOfFrame;
+  bool _converted;  // payload stored in _destination
 };
 
 }  // namespace esp32ModbusRTUInternals
@@ -0,0 +1,471 @@
+/* ModbusOperations
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusOperations.h"
+#include "ModbusFramer.h"
+
+#include <stdint.h>  // for UINT32_MAX
+#include <string.h>  // for memcpy
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+SplitReadOperation::SplitReadOperation(uint8_t slaveAddress, esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t count,
+                                       esp32Modbus::MBRTUOnData onData, esp32Modbus::MBRTUOnChunkError onError) :
+  _slaveAddress(slaveAddress),
+  _functionCode(functionCode),
+  _address(address),
+  _count(count),
+  _chunks(0),
+  _sent(0),
+  _received(0),
+  _failed(false),
+  _buffer(nullptr),
+  _bufferLength(0),
+  _onData(onData),
+  _onError(onError) {
+  if (count == 0) return;
+  if (functionCode != esp32Modbus::READ_COIL && functionCode != esp32Modbus::READ_DISCR_INPUT &&
+      functionCode != esp32Modbus::READ_HOLD_REGISTER && functionCode != esp32Modbus::READ_INPUT_REGISTER) return;
+  _chunks = (count + _chunkSize() - 1) / _chunkSize();
+  _bufferLength = _bits() ? (count + 7) / 8 : count * 2;
+  // onData reports the length as uint16_t
+  if (_bufferLength > UINT16_MAX) return;
+  _buffer = new uint8_t[_bufferLength];
+}
+
+SplitReadOperation::~SplitReadOperation() {
+  delete[] _buffer;
+}
+
+bool SplitReadOperation::_bits() const {
+  return _functionCode == esp32Modbus::READ_COIL || _functionCode == esp32Modbus::READ_DISCR_INPUT;
+}
+
+uint16_t SplitReadOperation::_chunkSize() const {
+  // 2000 bits are 250 whole bytes, so chunks of bits stay byte aligned
+  return _bits() ? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGISTERS;
+}
+
+ModbusRequest* SplitReadOperation::next() {
+  if (_failed || _buffer == nullptr || _sent == _chunks || _received < _sent) return nullptr;
+  uint16_t offset = _sent * _chunkSize();
+  uint16_t count = _count - offset < _chunkSize() ? _count - offset : _chunkSize();
+  uint16_t address = _address + offset;
+  ++_sent;
+  switch (_functionCode) {
+  case esp32Modbus::READ_COIL:          return new ModbusRequest01(_slaveAddress, address, count);
+  case esp32Modbus::READ_DISCR_INPUT:   return new ModbusRequest02(_slaveAddress, address, count);
+  case esp32Modbus::READ_HOLD_REGISTER: return new ModbusRequest03(_slaveAddress, address, count);
+  default:                              return new ModbusRequest04(_slaveAddress, address, count);
+  }
+}
+
+void SplitReadOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  uint16_t chunk = _received++;
+  if (!response->isSuccess()) {
+    _failed = true;
+    if (_onError) _onError(_slaveAddress, response->getError(), chunk, request->getAddress());
+    return;
+  }
+  uint32_t offset = _bits() ? chunk * (MODBUS_MAX_READ_BITS / 8) : chunk * MODBUS_MAX_READ_REGISTERS * 2;
+  uint32_t length = response->getByteCount();
+  if (offset + length > _bufferLength) length = _bufferLength - offset;
+  memcpy(&_buffer[offset], response->getData(), length);
+  if (_received == _chunks && _onData) {
+    _onData(_slaveAddress, _functionCode, _address, _buffer, static_cast<uint16_t>(_bufferLength));
+  }
+}
+
+BulkWriteOperation::BulkWriteOperation(uint8_t slaveAddress, uint16_t address, uint16_t count, const uint8_t* data,
+                                       esp32Modbus::MBRTUOnProgress onProgress, esp32Modbus::MBRTUOnChunkError onError) :
+  _slaveAddress(slaveAddress),
+  _address(address),
+  _count(count),
+  _sent(0),
+  _written(0),
+  _failed(false),
+  _data(nullptr),
+  _onProgress(onProgress),
+  _onError(onError) {
+  if (count == 0 || data == nullptr) return;
+  // copied: the caller's buffer may be gone before the last frame is sent
+  _data = new uint8_t[count * 2];
+  if (_data != nullptr) memcpy(_data, data, count * 2);
+}
+
+BulkWriteOperation::~BulkWriteOperation() {
+  delete[] _data;
+}
+
+ModbusRequest* BulkWriteOperation::next() {
+  if (_failed || _data == nullptr || _sent == _count || _written < _sent) return nullptr;
+  uint16_t count = _count - _sent < MODBUS_MAX_FC16_REGISTERS ? _count - _sent : MODBUS_MAX_FC16_REGISTERS;
+  ModbusRequest* request = new ModbusRequest16(_slaveAddress, _address + _sent, count, &_data[_sent * 2]);
+  _sent += count;
+  return request;
+}
+
+void BulkWriteOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  if (!response->isSuccess()) {
+    _failed = true;
+    if (_onError) _onError(_slaveAddress, response->getError(), _written / MODBUS_MAX_FC16_REGISTERS, request->getAddress());
+    return;
+  }
+  _written = _sent;
+  if (_onProgress) _onProgress(_slaveAddress, _written, _count);
+}
+
+ReadModifyWriteOperation::ReadModifyWriteOperation(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask,
+                                                   esp32Modbus::MBRTUOnData onData, esp32Modbus::MBRTUOnError onError) :
+  _slaveAddress(slaveAddress),
+  _address(address),
+  _andMask(andMask),
+  _orMask(orMask),
+  _value(0),
+  _state(READ),
+  _pending(false),
+  _onData(onData),
+  _onError(onError) {}
+
+ModbusRequest* ReadModifyWriteOperation::next() {
+  if (_pending || _state == DONE) return nullptr;
+  _pending = true;
+  if (_state == READ) return new ModbusRequest03(_slaveAddress, _address, 1);
+  return new ModbusRequest06(_slaveAddress, _address, _value);
+}
+
+void ReadModifyWriteOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  (void)request;
+  _pending = false;
+  if (!response->isSuccess()) {
+    _state = DONE;
+    if (_onError) _onError(_slaveAddress, response->getError());
+    return;
+  }
+  if (_state == READ) {
+    uint8_t* data = response->getData();
+    uint16_t current = (data[0] << 8) | data[1];
+    _value = (current & _andMask) | (_orMask & ~_andMask);
+    _state = WRITE;
+    return;
+  }
+  _state = DONE;
+  if (_onData) {
+    uint8_t echo[6] = {static_cast<uint8_t>(_address >> 8), static_cast<uint8_t>(_address),
+                       static_cast<uint8_t>(_andMask >> 8), static_cast<uint8_t>(_andMask),
+                       static_cast<uint8_t>(_orMask >> 8), static_cast<uint8_t>(_orMask)};
+    _onData(_slaveAddress, esp32Modbus::MASK_WRITE_REGISTER, _address, echo, sizeof(echo));
+  }
+}
+
+DeviceIdOperation::DeviceIdOperation(uint8_t slaveAddress, uint8_t readDeviceIdCode, uint8_t objectId, uint8_t* buffer, uint16_t capacity,
+                                     esp32Modbus::MBRTUOnDeviceId onDeviceId, esp32Modbus::MBRTUOnError onError) :
+  _slaveAddress(slaveAddress),
+  _code(readDeviceIdCode),
+  _objectId(objectId),
+  _conformity(0),
+  _pending(false),
+  _done(false),
+  _buffer(buffer),
+  _capacity(capacity),
+  _length(0),
+  _onDeviceId(onDeviceId),
+  _onError(onError) {}
+
+ModbusRequest* DeviceIdOperation::next() {
+  if (_pending || _done) return nullptr;
+  _pending = true;
+  return new ModbusRequestDeviceId(_slaveAddress, _code, _objectId);
+}
+
+void DeviceIdOperation::_fail(esp32Modbus::Error error) {
+  _done = true;
+  if (_onError) _onError(_slaveAddress, error);
+}
+
+bool DeviceIdOperation::_append(const uint8_t* frame, uint16_t size) {
+  // objects are validated by rtuResponseLength() already, copy them as a block
+  uint16_t objects = size - 8 - MODBUS_CRC_LENGTH;
+  if (_length + objects > _capacity) return false;
+  memcpy(&_buffer[_length], &frame[8], objects);
+  _length += objects;
+  return true;
+}
+
+void DeviceIdOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  (void)request;
+  _pending = false;
+  if (!response->isSuccess()) {
+    _fail(response->getError());
+    return;
+  }
+  const uint8_t* frame = response->getMessage();
+  uint16_t size = response->getSize();
+  if (size < 8 + MODBUS_CRC_LENGTH || rtuResponseLength(frame, size) != size) {
+    _fail(esp32Modbus::INVALID_RESPONSE);
+    return;
+  }
+  if (!_append(frame, size)) {
+    _fail(esp32Modbus::INVALID_PARAMETER);
+    return;
+  }
+  _conformity = frame[4];
+  bool moreFollows = frame[5] == 0xFF && _code != esp32Modbus::DEVICE_ID_SPECIFIC;
+  if (moreFollows) {
+    if (frame[7] == 0 || frame[6] <= _objectId) {
+      _fail(esp32Modbus::INVALID_RESPONSE);  // no progress, the slave would loop forever
+      return;
+    }
+    _objectId = frame[6];
+    return;
+  }
+  _done = true;
+  if (_onDeviceId) _onDeviceId(_slaveAddress, _conformity, _buffer, _length);
+}
+
+static uint16_t word(const uint8_t* data) {
+  return (data[0] << 8) | data[1];
+}
+
+FileReadOperation::FileReadOperation(uint8_t slaveAddress, uint16_t file, uint16_t record, uint16_t count,
+                                     esp32Modbus::MBRTUOnFileRecords onRecords, esp32Modbus::MBRTUOnChunkError onError) :
+  _slaveAddress(slaveAddress),
+  _file(file),
+  _record(record),
+  _count(count),
+  _sent(0),
+  _received(0),
+  _failed(false),
+  _onRecords(onRecords),
+  _onError(onError) {}
+
+ModbusRequest* FileReadOperation::next() {
+  if (_failed || _sent == _count || _received < _sent) return nullptr;
+  esp32Modbus::FileRecordRef ref;
+  ref.file = _file;
+  ref.record = _record + _sent;
+  ref.length = _count - _sent < MODBUS_MAX_FC14_RECORDS ? _count - _sent : MODBUS_MAX_FC14_RECORDS;
+  _sent += ref.length;
+  return new ModbusRequest14(_slaveAddress, &ref, 1);
+}
+
+void FileReadOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  esp32Modbus::Error error = esp32Modbus::SUCCESS;
+  uint16_t records = 0;
+  const uint8_t* data = nullptr;
+  if (!response->isSuccess()) {
+    error = response->getError();
+  } else {
+    data = esp32Modbus::findFileSubResponse(response->getData(), response->getByteCount(), 0, &records);
+    if (data == nullptr || records != _sent - _received) error = esp32Modbus::INVALID_RESPONSE;
+  }
+  if (error != esp32Modbus::SUCCESS) {
+    _failed = true;
+    if (_onError) _onError(_slaveAddress, error, _received / MODBUS_MAX_FC14_RECORDS, request->getAddress());
+    return;
+  }
+  if (_onRecords) _onRecords(_slaveAddress, _file, _record + _received, data, records);
+  _received = _sent;
+}
+
+FifoDrainOperation::FifoDrainOperation(uint8_t slaveAddress, uint16_t pointerAddress, uint16_t maxReads,
+                                       esp32Modbus::MBRTUOnFifo onFifo, esp32Modbus::MBRTUOnError onError) :
+  _slaveAddress(slaveAddress),
+  _pointerAddress(pointerAddress),
+  _maxReads(maxReads),
+  _reads(0),
+  _pending(false),
+  _done(false),
+  _onFifo(onFifo),
+  _onError(onError) {}
+
+ModbusRequest* FifoDrainOperation::next() {
+  if (_pending || _done) return nullptr;
+  _pending = true;
+  ++_reads;
+  return new ModbusRequest18(_slaveAddress, _pointerAddress);
+}
+
+void FifoDrainOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  (void)request;
+  _pending = false;
+  if (!response->isSuccess()) {
+    _done = true;
+    if (_onError) _onError(_slaveAddress, response->getError());
+    return;
+  }
+  uint16_t count = response->getByteCount() / 2;
+  if (count > 0 && _onFifo) _onFifo(_slaveAddress, _pointerAddress, response->getData(), count);
+  if (count == 0 || _reads == _maxReads) {
+    _done = true;
+    if (_onFifo) _onFifo(_slaveAddress, _pointerAddress, nullptr, 0);
+  }
+}
+
+DiagnosticCountersOperation::DiagnosticCountersOperation(uint8_t slaveAddress, esp32Modbus::MBRTUOnDiagnostics onCounters,
+                                                         esp32Modbus::MBRTUOnError onError) :
+  _slaveAddress(slaveAddress),
+  _index(0),
+  _pending(false),
+  _done(false),
+  _counters(),
+  _onCounters(onCounters),
+  _onError(onError) {}
+
+ModbusRequest* DiagnosticCountersOperation::next() {
+  if (_pending || _done) return nullptr;
+  _pending = true;
+  return new ModbusRequest08(_slaveAddress, esp32Modbus::DIAG_BUS_MESSAGE_COUNT + _index, 0);
+}
+
+void DiagnosticCountersOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  (void)request;
+  _pending = false;
+  if (response->isSuccess()) {
+    uint16_t* counters[] = {&_counters.busMessages, &_counters.crcErrors, &_counters.exceptions, &_counters.slaveMessages,
+                            &_counters.noResponse, &_counters.nak, &_counters.busy, &_counters.overruns};
+    *counters[_index] = word(&response->getData()[2]);
+    _counters.available |= 1 << _index;
+  } else if (!esp32Modbus::isException(response->getError())) {
+    // no answer or a broken one: the next counter would fare no better
+    _done = true;
+    if (_onError) _onError(_slaveAddress, response->getError());
+    return;
+  }
+  if (++_index == 8) {
+    _done = true;
+    if (_onCounters) _onCounters(_slaveAddress, _counters);
+  }
+}
+
+CommEventOperation::CommEventOperation(uint8_t slaveAddress, esp32Modbus::MBRTUOnCommEventCounter onCounter,
+                                       esp32Modbus::MBRTUOnCommEventLog onLog, esp32Modbus::MBRTUOnError onError) :
+  _slaveAddress(slaveAddress),
+  _sent(false),
+  _onCounter(onCounter),
+  _onLog(onLog),
+  _onError(onError) {}
+
+ModbusRequest* CommEventOperation::next() {
+  if (_sent) return nullptr;
+  _sent = true;
+  if (_onLog) return new ModbusRequest0C(_slaveAddress);
+  return new ModbusRequest0B(_slaveAddress);
+}
+
+void CommEventOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  if (!response->isSuccess()) {
+    if (_onError) _onError(_slaveAddress, response->getError());
+    return;
+  }
+  const uint8_t* frame = response->getMessage();
+  if (request->getFunctionCode() == esp32Modbus::GET_COMM_EVENT_COUNTER) {
+    esp32Modbus::CommEventCounter counter;
+    counter.status = word(&frame[2]);
+    counter.eventCount = word(&frame[4]);
+    if (_onCounter) _onCounter(_slaveAddress, counter);
+    return;
+  }
+  // byte count, status, event count, message count, events
+  if (frame[2] < 6 || frame[2] > 6 + sizeof(esp32Modbus::CommEventLog::events)) {
+    if (_onError) _onError(_slaveAddress, esp32Modbus::INVALID_RESPONSE);
+    return;
+  }
+  esp32Modbus::CommEventLog log;
+  log.status = word(&frame[3]);
+  log.eventCount = word(&frame[5]);
+  log.messageCount = word(&frame[7]);
+  log.eventLength = frame[2] - 6;
+  memcpy(log.events, &frame[9], log.eventLength);
+  if (_onLog) _onLog(_slaveAddress, log);
+}
+
+LoopbackOperation::LoopbackOperation(uint8_t slaveAddress, uint16_t probes, esp32Modbus::MBRTUOnLatency onLatency,
+                                     esp32Modbus::MBRTUOnError onError) :
+  _slaveAddress(slaveAddress),
+  _probes(probes),
+  _sent(0),
+  _pending(false),
+  _lastError(esp32Modbus::SUCCESS),
+  _result(),
+  _onLatency(onLatency),
+  _onError(onError) {
+  _result.minUs = UINT32_MAX;
+}
+
+ModbusRequest* LoopbackOperation::next() {
+  if (_pending || _sent == _probes) return nullptr;
+  _pending = true;
+  // a different pattern per probe, so a stale echo cannot pass
+  uint16_t pattern = 0xA5C3 ^ (_sent * 0x0101);
+  ++_sent;
+  return new ModbusRequest08(_slaveAddress, esp32Modbus::DIAG_RETURN_QUERY_DATA, pattern);
+}
+
+void LoopbackOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  _pending = false;
+  if (!response->isSuccess()) {
+    _lastError = response->getError();
+    ++_result.failures;
+  } else if (word(&response->getData()[2]) != word(&request->getMessage()[4])) {
+    _lastError = esp32Modbus::INVALID_RESPONSE;
+    ++_result.failures;
+  } else {
+    uint32_t roundTrip = response->getRoundTripMicros();
+    ++_result.samples;
+    _result.totalUs += roundTrip;
+    if (roundTrip < _result.minUs) _result.minUs = roundTrip;
+    if (roundTrip > _result.maxUs) _result.maxUs = roundTrip;
+  }
+  if (_sent < _probes) return;
+  if (_result.samples == 0) {
+    if (_onError) _onError(_slaveAddress, _lastError);
+    return;
+  }
+  if (_onLatency) _onLatency(_slaveAddress, _result);
+}
+
+ForwardOperation::ForwardOperation(uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length,
+                                   esp32Modbus::MBRTUOnReply onReply) :
+  _request(new ModbusRequestRaw(slaveAddress, functionCode, data, length, 0)),
+  _onReply(onReply) {}
+
+ForwardOperation::~ForwardOperation() {
+  delete _request;
+}
+
+ModbusRequest* ForwardOperation::next() {
+  ModbusRequest* request = _request;
+  _request = nullptr;
+  return request;
+}
+
+void ForwardOperation::onResponse(ModbusRequest* request, ModbusResponse* response) {
+  (void)request;
+  if (!response->isSuccess()) {
+    _onReply(response->getError(), nullptr, 0);
+    return;
+  }
+  _onReply(esp32Modbus::SUCCESS, response->getData(), response->getByteCount());
+}
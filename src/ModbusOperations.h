@@ -0,0 +1,264 @@
+/* ModbusOperations
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTUInternals_ModbusOperations_h
+#define esp32ModbusRTUInternals_ModbusOperations_h
+
+#include <stdint.h>  // for uint*_t
+
+#include "esp32ModbusTypeDefs.h"
+#include "ModbusMessage.h"
+
+namespace esp32ModbusRTUInternals {
+
+// Read of more registers (or bits) than fit in one frame: the range is split
+// in maximal chunks, sent back-to-back and reassembled into one buffer that is
+// delivered in a single onData call. The first failing chunk ends the read.
+class SplitReadOperation : public ModbusOperation {
+ public:
+  SplitReadOperation(uint8_t slaveAddress, esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t count,
+                     esp32Modbus::MBRTUOnData onData, esp32Modbus::MBRTUOnChunkError onError);
+  ~SplitReadOperation();
+  bool isValid() const { return _buffer != nullptr; }
+  uint16_t chunks() const { return _chunks; }
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  bool _bits() const;
+  uint16_t _chunkSize() const;
+  uint8_t _slaveAddress;
+  esp32Modbus::FunctionCode _functionCode;
+  uint16_t _address;
+  uint16_t _count;
+  uint16_t _chunks;
+  uint16_t _sent;
+  uint16_t _received;
+  bool _failed;
+  uint8_t* _buffer;
+  uint32_t _bufferLength;
+  esp32Modbus::MBRTUOnData _onData;
+  esp32Modbus::MBRTUOnChunkError _onError;
+};
+
+// Write of more holding registers than fit in one FC16 frame: the data is
+// copied and written in maximal (123 register) frames, back-to-back. Progress
+// is reported after every frame; the first failing frame ends the write.
+class BulkWriteOperation : public ModbusOperation {
+ public:
+  BulkWriteOperation(uint8_t slaveAddress, uint16_t address, uint16_t count, const uint8_t* data,
+                     esp32Modbus::MBRTUOnProgress onProgress, esp32Modbus::MBRTUOnChunkError onError);
+  ~BulkWriteOperation();
+  bool isValid() const { return _data != nullptr; }
+  uint16_t chunks() const { return (_count + MODBUS_MAX_FC16_REGISTERS - 1) / MODBUS_MAX_FC16_REGISTERS; }
+  uint16_t written() const { return _written; }
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  uint8_t _slaveAddress;
+  uint16_t _address;
+  uint16_t _count;
+  uint16_t _sent;      // registers handed out in requests
+  uint16_t _written;   // registers confirmed by the slave
+  bool _failed;
+  uint8_t* _data;
+  esp32Modbus::MBRTUOnProgress _onProgress;
+  esp32Modbus::MBRTUOnChunkError _onError;
+};
+
+// Bit update of one holding register for slaves without FC 0x16: the register
+// is read (FC03) and the result written back (FC06) in consecutive frames.
+// Success is reported to onData like a mask write echo (FC 0x16, address, and
+// mask, or mask) so callers do not need to know which path was taken.
+class ReadModifyWriteOperation : public ModbusOperation {
+ public:
+  ReadModifyWriteOperation(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask,
+                           esp32Modbus::MBRTUOnData onData, esp32Modbus::MBRTUOnError onError);
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  enum State : uint8_t { READ, WRITE, DONE };
+  uint8_t _slaveAddress;
+  uint16_t _address;
+  uint16_t _andMask;
+  uint16_t _orMask;
+  uint16_t _value;
+  State _state;
+  bool _pending;  // request handed out, response not yet seen
+  esp32Modbus::MBRTUOnData _onData;
+  esp32Modbus::MBRTUOnError _onError;
+};
+
+// Read Device Identification (FC 0x2B / MEI 0x0E). While the slave answers
+// "more follows", the next frame asks for the next object. The objects are
+// appended to the caller's buffer as received ([id, length, value...]), so
+// nothing is allocated per object. A buffer too small for all objects ends
+// the read with INVALID_PARAMETER.
+class DeviceIdOperation : public ModbusOperation {
+ public:
+  DeviceIdOperation(uint8_t slaveAddress, uint8_t readDeviceIdCode, uint8_t objectId, uint8_t* buffer, uint16_t capacity,
+                    esp32Modbus::MBRTUOnDeviceId onDeviceId, esp32Modbus::MBRTUOnError onError);
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+  uint16_t length() const { return _length; }
+
+ private:
+  bool _append(const uint8_t* frame, uint16_t size);
+  void _fail(esp32Modbus::Error error);
+  uint8_t _slaveAddress;
+  uint8_t _code;
+  uint8_t _objectId;  // object to ask for in the next frame
+  uint8_t _conformity;
+  bool _pending;
+  bool _done;
+  uint8_t* _buffer;
+  uint16_t _capacity;
+  uint16_t _length;
+  esp32Modbus::MBRTUOnDeviceId _onDeviceId;
+  esp32Modbus::MBRTUOnError _onError;
+};
+
+// Streaming file read: count records from record on, read with FC 0x14 in
+// frames of one maximal sub-request (121 records). Every frame's records are
+// handed to onRecords as they arrive, nothing is buffered across frames. The
+// first failing frame ends the read and is reported with its index and record.
+class FileReadOperation : public ModbusOperation {
+ public:
+  FileReadOperation(uint8_t slaveAddress, uint16_t file, uint16_t record, uint16_t count,
+                    esp32Modbus::MBRTUOnFileRecords onRecords, esp32Modbus::MBRTUOnChunkError onError);
+  uint16_t chunks() const { return (_count + MODBUS_MAX_FC14_RECORDS - 1) / MODBUS_MAX_FC14_RECORDS; }
+  uint16_t received() const { return _received; }
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  uint8_t _slaveAddress;
+  uint16_t _file;
+  uint16_t _record;
+  uint16_t _count;
+  uint16_t _sent;      // records asked for
+  uint16_t _received;  // records delivered
+  bool _failed;
+  esp32Modbus::MBRTUOnFileRecords _onRecords;
+  esp32Modbus::MBRTUOnChunkError _onError;
+};
+
+// FIFO drain: FC 0x18 reads of one queue, repeated until the slave reports it
+// empty (or maxReads frames, 0 = no limit, for a queue refilled faster than it
+// is read). Every non-empty batch goes to onFifo; a final call with count 0
+// marks the end of the drain. Errors end the drain without that call.
+class FifoDrainOperation : public ModbusOperation {
+ public:
+  FifoDrainOperation(uint8_t slaveAddress, uint16_t pointerAddress, uint16_t maxReads,
+                     esp32Modbus::MBRTUOnFifo onFifo, esp32Modbus::MBRTUOnError onError);
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  uint8_t _slaveAddress;
+  uint16_t _pointerAddress;
+  uint16_t _maxReads;
+  uint16_t _reads;
+  bool _pending;
+  bool _done;
+  esp32Modbus::MBRTUOnFifo _onFifo;
+  esp32Modbus::MBRTUOnError _onError;
+};
+
+// Slave counters: FC 0x08 sub-functions 0x0B-0x12, one frame each, collected
+// into one DiagnosticCounters. A counter answered with an exception is marked
+// unavailable; any other error ends the operation.
+class DiagnosticCountersOperation : public ModbusOperation {
+ public:
+  DiagnosticCountersOperation(uint8_t slaveAddress, esp32Modbus::MBRTUOnDiagnostics onCounters, esp32Modbus::MBRTUOnError onError);
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  uint8_t _slaveAddress;
+  uint8_t _index;  // counter asked for, 0 = sub-function 0x0B
+  bool _pending;
+  bool _done;
+  esp32Modbus::DiagnosticCounters _counters;
+  esp32Modbus::MBRTUOnDiagnostics _onCounters;
+  esp32Modbus::MBRTUOnError _onError;
+};
+
+// FC 0x0B or FC 0x0C (whichever callback is given), parsed into a struct
+class CommEventOperation : public ModbusOperation {
+ public:
+  CommEventOperation(uint8_t slaveAddress, esp32Modbus::MBRTUOnCommEventCounter onCounter,
+                     esp32Modbus::MBRTUOnCommEventLog onLog, esp32Modbus::MBRTUOnError onError);
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  uint8_t _slaveAddress;
+  bool _sent;
+  esp32Modbus::MBRTUOnCommEventCounter _onCounter;
+  esp32Modbus::MBRTUOnCommEventLog _onLog;
+  esp32Modbus::MBRTUOnError _onError;
+};
+
+// Link latency probe: a number of FC 0x08 / 0x00 loopbacks (2 data bytes, so
+// 8 byte frames both ways), sent back-to-back. Each echo is checked and its
+// round trip taken from the response timing. Failed probes are counted, not
+// reported one by one; onError fires only when no probe succeeded.
+class LoopbackOperation : public ModbusOperation {
+ public:
+  LoopbackOperation(uint8_t slaveAddress, uint16_t probes, esp32Modbus::MBRTUOnLatency onLatency, esp32Modbus::MBRTUOnError onError);
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  uint8_t _slaveAddress;
+  uint16_t _probes;
+  uint16_t _sent;
+  bool _pending;
+  esp32Modbus::Error _lastError;
+  esp32Modbus::LatencyProbe _result;
+  esp32Modbus::MBRTUOnLatency _onLatency;
+  esp32Modbus::MBRTUOnError _onError;
+};
+
+// One raw request whose outcome goes to its own callback instead of onData/
+// onError, so the caller can tell its reply from all others (gateway).
+class ForwardOperation : public ModbusOperation {
+ public:
+  ForwardOperation(uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length,
+                   esp32Modbus::MBRTUOnReply onReply);
+  ~ForwardOperation();
+  ModbusRequest* next();
+  void onResponse(ModbusRequest* request, ModbusResponse* response);
+
+ private:
+  ModbusRequest* _request;  // until handed to the worker
+  esp32Modbus::MBRTUOnReply _onReply;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
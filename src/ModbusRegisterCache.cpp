@@ -0,0 +1,236 @@
+/* ModbusRegisterCache
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusRegisterCache.h"
+
+#include "esp32ModbusTypeDefs.h"
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+static_assert((MODBUS_CACHE_SIZE & (MODBUS_CACHE_SIZE - 1)) == 0, "MODBUS_CACHE_SIZE must be a power of 2");
+
+static const uint8_t EMPTY_TABLE = 0xFF;
+static const uint8_t MAX_PROBES = 8;  // entries inspected before evicting the oldest
+
+static uint16_t word(const uint8_t* data) {
+  return (data[0] << 8) | data[1];
+}
+
+RegisterCache::RegisterCache() :
+  _hits(0),
+  _misses(0) {
+  clear();
+}
+
+uint32_t RegisterCache::_hash(uint8_t slaveAddress, RegisterTable table, uint16_t address) {
+  // Consecutive addresses land in consecutive slots, blocks stay together
+  uint32_t key = (static_cast<uint32_t>(slaveAddress) << 18) ^ (static_cast<uint32_t>(table) << 16);
+  key = (key * 2654435761u) >> 16;  // spread slave/table over the table
+  return (key + address) & (MODBUS_CACHE_SIZE - 1);
+}
+
+RegisterCache::Entry* RegisterCache::_find(uint8_t slaveAddress, RegisterTable table, uint16_t address) {
+  uint32_t slot = _hash(slaveAddress, table, address);
+  for (uint8_t i = 0; i < MAX_PROBES; ++i) {
+    Entry& entry = _entries[(slot + i) & (MODBUS_CACHE_SIZE - 1)];
+    if (entry.table == table && entry.slaveAddress == slaveAddress && entry.address == address) return &entry;
+  }
+  return nullptr;
+}
+
+void RegisterCache::store(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t value, uint32_t nowMs) {
+  uint32_t slot = _hash(slaveAddress, table, address);
+  Entry* victim = nullptr;
+  for (uint8_t i = 0; i < MAX_PROBES; ++i) {
+    Entry& entry = _entries[(slot + i) & (MODBUS_CACHE_SIZE - 1)];
+    if (entry.table == table && entry.slaveAddress == slaveAddress && entry.address == address) {
+      victim = &entry;
+      break;
+    }
+    if (entry.table == EMPTY_TABLE) {
+      if (!victim || victim->table != EMPTY_TABLE) victim = &entry;
+    } else if (!victim || (victim->table != EMPTY_TABLE && nowMs - entry.stampMs > nowMs - victim->stampMs)) {
+      victim = &entry;  // oldest so far
+    }
+  }
+  victim->slaveAddress = slaveAddress;
+  victim->table = table;
+  victim->address = address;
+  victim->value = value;
+  victim->stampMs = nowMs;
+}
+
+bool RegisterCache::load(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+                         uint32_t maxAgeMs, uint32_t nowMs, uint16_t* values) {
+  for (uint16_t i = 0; i < count; ++i) {
+    Entry* entry = _find(slaveAddress, table, address + i);
+    if (!entry || nowMs - entry->stampMs > maxAgeMs) {
+      ++_misses;
+      return false;
+    }
+    values[i] = entry->value;
+  }
+  ++_hits;
+  return true;
+}
+
+bool RegisterCache::load(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+                         uint32_t maxAgeMs, uint32_t nowMs, bool* values) {
+  for (uint16_t i = 0; i < count; ++i) {
+    Entry* entry = _find(slaveAddress, table, address + i);
+    if (!entry || nowMs - entry->stampMs > maxAgeMs) {
+      ++_misses;
+      return false;
+    }
+    values[i] = entry->value != 0;
+  }
+  ++_hits;
+  return true;
+}
+
+void RegisterCache::invalidateWrite(const uint8_t* request, size_t requestLength) {
+  if (requestLength < 6) return;
+  RegisterTable table;
+  uint16_t address = word(&request[2]);
+  uint16_t count = 1;
+  switch (request[1]) {
+  case esp32Modbus::WRITE_COIL:
+    table = TABLE_COILS;
+    break;
+  case esp32Modbus::WRITE_HOLD_REGISTER:
+  case esp32Modbus::MASK_WRITE_REGISTER:
+    table = TABLE_HOLDING_REGISTERS;
+    break;
+  case esp32Modbus::WRITE_MULT_COILS:
+    table = TABLE_COILS;
+    count = word(&request[4]);
+    break;
+  case esp32Modbus::WRITE_MULT_REGISTERS:
+    table = TABLE_HOLDING_REGISTERS;
+    count = word(&request[4]);
+    break;
+  case esp32Modbus::READ_WRITE_MULT_REGISTERS:
+    if (requestLength < 10) return;
+    table = TABLE_HOLDING_REGISTERS;
+    address = word(&request[6]);
+    count = word(&request[8]);
+    break;
+  default:
+    return;
+  }
+  bool broadcast = request[0] == 0;
+  for (size_t i = 0; i < MODBUS_CACHE_SIZE; ++i) {
+    if (_entries[i].table == table && (broadcast || _entries[i].slaveAddress == request[0]) &&
+        static_cast<uint16_t>(_entries[i].address - address) < count) {
+      _entries[i].table = EMPTY_TABLE;
+    }
+  }
+}
+
+void RegisterCache::invalidate(uint8_t slaveAddress) {
+  for (size_t i = 0; i < MODBUS_CACHE_SIZE; ++i) {
+    if (_entries[i].slaveAddress == slaveAddress) _entries[i].table = EMPTY_TABLE;
+  }
+}
+
+void RegisterCache::clear() {
+  for (size_t i = 0; i < MODBUS_CACHE_SIZE; ++i) {
+    _entries[i].table = EMPTY_TABLE;
+  }
+}
+
+void RegisterCache::update(const uint8_t* request, size_t requestLength,
+                           const uint8_t* response, size_t responseLength, uint32_t nowMs) {
+  if (requestLength < 6 || responseLength < 5) return;
+  uint8_t slaveAddress = request[0];
+  uint16_t address = word(&request[2]);
+  uint16_t count = word(&request[4]);
+
+  switch (request[1]) {
+  case esp32Modbus::READ_COIL:
+    if (response[2] >= (count + 7) / 8) _storeBits(slaveAddress, TABLE_COILS, address, count, &response[3], nowMs);
+    break;
+  case esp32Modbus::READ_DISCR_INPUT:
+    if (response[2] >= (count + 7) / 8) _storeBits(slaveAddress, TABLE_DISCRETE_INPUTS, address, count, &response[3], nowMs);
+    break;
+  case esp32Modbus::READ_HOLD_REGISTER:
+    if (response[2] == count * 2) _storeRegisters(slaveAddress, TABLE_HOLDING_REGISTERS, address, count, &response[3], nowMs);
+    break;
+  case esp32Modbus::READ_INPUT_REGISTER:
+    if (response[2] == count * 2) _storeRegisters(slaveAddress, TABLE_INPUT_REGISTERS, address, count, &response[3], nowMs);
+    break;
+  case esp32Modbus::WRITE_COIL:
+    // echo: address + 0xFF00/0x0000
+    if (responseLength >= 6) store(slaveAddress, TABLE_COILS, word(&response[2]), response[4] == 0xFF ? 1 : 0, nowMs);
+    break;
+  case esp32Modbus::WRITE_HOLD_REGISTER:
+    if (responseLength >= 6) store(slaveAddress, TABLE_HOLDING_REGISTERS, word(&response[2]), word(&response[4]), nowMs);
+    break;
+  case esp32Modbus::WRITE_MULT_COILS:
+    // echo only confirms address/count, the values are in the request
+    if (requestLength >= 7u + (count + 7) / 8) _storeBits(slaveAddress, TABLE_COILS, address, count, &request[7], nowMs);
+    break;
+  case esp32Modbus::WRITE_MULT_REGISTERS:
+    if (requestLength >= 7u + count * 2) _storeRegisters(slaveAddress, TABLE_HOLDING_REGISTERS, address, count, &request[7], nowMs);
+    break;
+  case esp32Modbus::MASK_WRITE_REGISTER: {
+    // only a cached register can be updated, its age stays: the bits
+    // outside the masks were not seen on the bus
+    Entry* entry = _find(slaveAddress, TABLE_HOLDING_REGISTERS, address);
+    if (entry && requestLength >= 8) {
+      uint16_t andMask = word(&request[4]);
+      uint16_t orMask = word(&request[6]);
+      entry->value = (entry->value & andMask) | (orMask & ~andMask);
+    }
+    break;
+  }
+  case esp32Modbus::READ_WRITE_MULT_REGISTERS: {
+    // the write is performed before the read, so store the read values last
+    if (requestLength < 11) break;
+    uint16_t writeAddress = word(&request[6]);
+    uint16_t writeCount = word(&request[8]);
+    if (requestLength >= 11u + writeCount * 2) {
+      _storeRegisters(slaveAddress, TABLE_HOLDING_REGISTERS, writeAddress, writeCount, &request[11], nowMs);
+    }
+    if (response[2] == count * 2) _storeRegisters(slaveAddress, TABLE_HOLDING_REGISTERS, address, count, &response[3], nowMs);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void RegisterCache::_storeBits(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+                               const uint8_t* bits, uint32_t nowMs) {
+  for (uint16_t i = 0; i < count; ++i) {
+    store(slaveAddress, table, address + i, (bits[i / 8] >> (i % 8)) & 0x01, nowMs);
+  }
+}
+
+void RegisterCache::_storeRegisters(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+                                    const uint8_t* data, uint32_t nowMs) {
+  for (uint16_t i = 0; i < count; ++i) {
+    store(slaveAddress, table, address + i, word(&data[i * 2]), nowMs);
+  }
+}
@@ -0,0 +1,94 @@
+/* ModbusRegisterCache
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTUInternals_ModbusRegisterCache_h
+#define esp32ModbusRTUInternals_ModbusRegisterCache_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+
+// Number of registers/bits the shadow cache holds over all slaves.
+// Must be a power of 2. Each entry takes 12 bytes.
+#ifndef MODBUS_CACHE_SIZE
+#define MODBUS_CACHE_SIZE 256
+#endif
+
+namespace esp32ModbusRTUInternals {
+
+enum RegisterTable : uint8_t {
+  TABLE_COILS             = 0,
+  TABLE_DISCRETE_INPUTS   = 1,
+  TABLE_HOLDING_REGISTERS = 2,
+  TABLE_INPUT_REGISTERS   = 3
+};
+
+// Register image of the slaves, updated from completed transactions.
+// Every register (or bit) is stored with the time it was last seen on the
+// bus; reads succeed only when all requested entries are young enough.
+// Not thread safe: the owner serialises access.
+class RegisterCache {
+ public:
+  RegisterCache();
+  void store(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t value, uint32_t nowMs);
+  bool load(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+            uint32_t maxAgeMs, uint32_t nowMs, uint16_t* values);
+  bool load(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+            uint32_t maxAgeMs, uint32_t nowMs, bool* values);  // coils and discrete inputs
+  void invalidate(uint8_t slaveAddress);
+  // Drops the range a write (FC05/06/0F/10/16/17) may have changed without an
+  // echo to update from: a failed write, or a broadcast (for every slave)
+  void invalidateWrite(const uint8_t* request, size_t requestLength);
+  void clear();
+
+  // Update from a validated request/response pair (complete RTU frames).
+  // Handles FC01/02/03/04 responses, FC05/06/0F/10/16 write echoes and FC17.
+  void update(const uint8_t* request, size_t requestLength,
+              const uint8_t* response, size_t responseLength, uint32_t nowMs);
+
+  uint32_t hits() const { return _hits; }
+  uint32_t misses() const { return _misses; }
+  void resetStats() { _hits = 0; _misses = 0; }
+
+ private:
+  struct Entry {
+    uint8_t slaveAddress;
+    uint8_t table;  // RegisterTable, 0xFF = empty
+    uint16_t address;
+    uint16_t value;
+    uint32_t stampMs;
+  };
+  static uint32_t _hash(uint8_t slaveAddress, RegisterTable table, uint16_t address);
+  Entry* _find(uint8_t slaveAddress, RegisterTable table, uint16_t address);
+  void _storeBits(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+                  const uint8_t* bits, uint32_t nowMs);
+  void _storeRegisters(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count,
+                       const uint8_t* data, uint32_t nowMs);
+  Entry _entries[MODBUS_CACHE_SIZE];
+  uint32_t _hits;
+  uint32_t _misses;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
@@ -0,0 +1,79 @@
+/* ModbusRetry
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusRetry.h"
+
+#include <string.h>  // for memset
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+RetryStats::RetryStats() {
+  reset();
+}
+
+void RetryStats::record(uint8_t slaveAddress, esp32Modbus::Error error) {
+  _count(&_totals, error);
+  Entry* freeEntry = nullptr;
+  for (uint8_t i = 0; i < MODBUS_RETRY_STATS_SLAVES; ++i) {
+    if (_entries[i].used && _entries[i].slaveAddress == slaveAddress) {
+      _count(&_entries[i].counters, error);
+      return;
+    }
+    if (!_entries[i].used && !freeEntry) freeEntry = &_entries[i];
+  }
+  if (freeEntry) {
+    freeEntry->slaveAddress = slaveAddress;
+    freeEntry->used = true;
+    _count(&freeEntry->counters, error);
+  }
+}
+
+bool RetryStats::get(uint8_t slaveAddress, esp32Modbus::RetryCounters* counters) const {
+  for (uint8_t i = 0; i < MODBUS_RETRY_STATS_SLAVES; ++i) {
+    if (_entries[i].used && _entries[i].slaveAddress == slaveAddress) {
+      *counters = _entries[i].counters;
+      return true;
+    }
+  }
+  return false;
+}
+
+esp32Modbus::RetryCounters RetryStats::totals() const {
+  return _totals;
+}
+
+void RetryStats::reset() {
+  memset(_entries, 0, sizeof(_entries));
+  memset(&_totals, 0, sizeof(_totals));
+}
+
+void RetryStats::_count(esp32Modbus::RetryCounters* counters, esp32Modbus::Error error) {
+  ++counters->total;
+  switch (error) {
+    case esp32Modbus::TIMEOUT:            ++counters->timeout; break;
+    case esp32Modbus::CRC_ERROR:          ++counters->crc;     break;
+    case esp32Modbus::SERVER_DEVICE_BUSY: ++counters->busy;    break;
+    default:                              ++counters->other;   break;
+  }
+}
@@ -0,0 +1,62 @@
+/* ModbusRetry
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTUInternals_ModbusRetry_h
+#define esp32ModbusRTUInternals_ModbusRetry_h
+
+#include <stdint.h>  // for uint*_t
+
+#include "esp32ModbusTypeDefs.h"
+
+// Number of slaves for which individual retry counters are kept.
+// Retries of further slaves still count towards the totals.
+#ifndef MODBUS_RETRY_STATS_SLAVES
+#define MODBUS_RETRY_STATS_SLAVES 16
+#endif
+
+namespace esp32ModbusRTUInternals {
+
+// Fixed-size retry bookkeeping. Not thread safe: the owner serialises access.
+class RetryStats {
+ public:
+  RetryStats();
+  void record(uint8_t slaveAddress, esp32Modbus::Error error);
+  bool get(uint8_t slaveAddress, esp32Modbus::RetryCounters* counters) const;
+  esp32Modbus::RetryCounters totals() const;
+  void reset();
+
+ private:
+  struct Entry {
+    uint8_t slaveAddress;
+    bool used;
+    esp32Modbus::RetryCounters counters;
+  };
+  static void _count(esp32Modbus::RetryCounters* counters, esp32Modbus::Error error);
+  Entry _entries[MODBUS_RETRY_STATS_SLAVES];
+  esp32Modbus::RetryCounters _totals;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
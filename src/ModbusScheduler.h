@@ -0,0 +1,54 @@
+/* ModbusScheduler
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+#ifndef esp32ModbusRTUInternals_ModbusScheduler_h
+#define esp32ModbusRTUInternals_ModbusScheduler_h
+
+#include <stdint.h>  // for uint*_t
+
+namespace esp32ModbusRTUInternals {
+
+// What the worker task serves next, decided on which priority levels hold a
+// continuation (bit n: the next request of a running operation at level n) or
+// queued requests. Levels go from EMERGENCY (0) to STATUS (3), a continuation
+// before the queue of its level. priority is -1 when nothing is waiting.
+// Used by the driver and by the host-side trace replay alike.
+struct ScheduleChoice {
+  int8_t priority;
+  bool continuation;
+};
+
+inline ScheduleChoice nextToServe(uint8_t continuations, uint8_t queued) {
+  for (int8_t priority = 0; priority < 4; ++priority) {
+    if (continuations & (1 << priority)) return ScheduleChoice{priority, true};
+    if (queued & (1 << priority)) return ScheduleChoice{priority, false};
+  }
+  return ScheduleChoice{-1, false};
+}
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
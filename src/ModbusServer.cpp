@@ -0,0 +1,292 @@
+/* ModbusServer
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ModbusServer.h"
+#include "ModbusFramer.h"
+#include "ModbusMessage.h"
+
+#include <string.h>  // for memcpy
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+using esp32Modbus::RegisterMap;
+
+static uint16_t word(const uint8_t* data) {
+  return (data[0] << 8) | data[1];
+}
+
+// count bits from bit offset first of bits, packed into out from bit 0 on
+static void copyBitsOut(const uint8_t* bits, uint16_t first, uint16_t count, uint8_t* out) {
+  uint16_t bytes = (count + 7) / 8;
+  uint8_t shift = first & 7;
+  const uint8_t* in = &bits[first / 8];
+  if (shift == 0) {
+    memcpy(out, in, bytes);
+  } else {
+    // two source bytes per output byte; the second one only if it holds wanted bits
+    uint16_t lastIn = (shift + count - 1) / 8;
+    for (uint16_t i = 0; i < bytes; ++i) {
+      uint8_t value = in[i] >> shift;
+      if (i + 1u <= lastIn) value |= in[i + 1] << (8 - shift);
+      out[i] = value;
+    }
+  }
+  if (count & 7) out[bytes - 1] &= (1 << (count & 7)) - 1;
+}
+
+// count packed bits of in (from bit 0) into bits from bit offset first on
+static void copyBitsIn(const uint8_t* in, uint16_t count, uint8_t* bits, uint16_t first) {
+  for (uint16_t i = 0; i < count; ++i) {
+    uint16_t bit = first + i;
+    if ((in[i / 8] >> (i % 8)) & 1) {
+      bits[bit / 8] |= 1 << (bit % 8);
+    } else {
+      bits[bit / 8] &= ~(1 << (bit % 8));
+    }
+  }
+}
+
+RegisterMap::RegisterMap() :
+  _coils{0, 0, nullptr},
+  _discreteInputs{0, 0, nullptr},
+  _holdingRegisters{0, 0, nullptr},
+  _inputRegisters{0, 0, nullptr},
+  _onWrite(nullptr) {}
+
+void RegisterMap::setCoils(uint16_t address, uint16_t count, uint8_t* bits) {
+  _coils = {address, count, bits};
+}
+
+void RegisterMap::setDiscreteInputs(uint16_t address, uint16_t count, const uint8_t* bits) {
+  _discreteInputs = {address, count, const_cast<uint8_t*>(bits)};  // never written through
+}
+
+void RegisterMap::setHoldingRegisters(uint16_t address, uint16_t count, uint16_t* registers) {
+  _holdingRegisters = {address, count, registers};
+}
+
+void RegisterMap::setInputRegisters(uint16_t address, uint16_t count, const uint16_t* registers) {
+  _inputRegisters = {address, count, const_cast<uint16_t*>(registers)};  // never written through
+}
+
+bool RegisterMap::_contains(const Block& block, uint16_t address, uint16_t count) {
+  return block.data != nullptr && address >= block.address &&
+         static_cast<uint32_t>(address - block.address) + count <= block.count;
+}
+
+uint8_t* RegisterMap::coils(uint16_t address, uint16_t count, uint16_t* bit) {
+  if (!_contains(_coils, address, count)) return nullptr;
+  *bit = address - _coils.address;
+  return static_cast<uint8_t*>(_coils.data);
+}
+
+const uint8_t* RegisterMap::discreteInputs(uint16_t address, uint16_t count, uint16_t* bit) const {
+  if (!_contains(_discreteInputs, address, count)) return nullptr;
+  *bit = address - _discreteInputs.address;
+  return static_cast<const uint8_t*>(_discreteInputs.data);
+}
+
+uint16_t* RegisterMap::holdingRegisters(uint16_t address, uint16_t count) {
+  if (!_contains(_holdingRegisters, address, count)) return nullptr;
+  return &static_cast<uint16_t*>(_holdingRegisters.data)[address - _holdingRegisters.address];
+}
+
+const uint16_t* RegisterMap::inputRegisters(uint16_t address, uint16_t count) const {
+  if (!_contains(_inputRegisters, address, count)) return nullptr;
+  return &static_cast<const uint16_t*>(_inputRegisters.data)[address - _inputRegisters.address];
+}
+
+void RegisterMap::notifyWrite(esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t count) const {
+  if (_onWrite) _onWrite(functionCode, address, count);
+}
+
+ModbusServer::ModbusServer(uint8_t slaveAddress, esp32Modbus::RegisterMap* map) :
+  _slaveAddress(slaveAddress),
+  _map(map),
+  _stats() {}
+
+size_t ModbusServer::handle(const uint8_t* request, size_t length, uint8_t* response) {
+  if (length < 4 || !rtuCheckCRC(request, length)) {
+    ++_stats.crcErrors;
+    return 0;
+  }
+  bool broadcast = request[0] == MODBUS_BROADCAST_ADDRESS;
+  if (!broadcast && request[0] != _slaveAddress) {
+    ++_stats.ignored;
+    return 0;
+  }
+  ++_stats.requests;
+  length -= MODBUS_CRC_LENGTH;
+
+  size_t responseLength = 2;
+  response[0] = _slaveAddress;
+  response[1] = request[1];
+  uint8_t exception = _execute(request, length, response, &responseLength);
+  if (exception != 0) {
+    ++_stats.exceptions;
+    response[1] |= MODBUS_ERROR_FLAG;
+    response[2] = exception;
+    responseLength = 3;
+  }
+  if (broadcast) {
+    ++_stats.broadcasts;
+    return 0;
+  }
+  uint16_t crc = CRC16(response, responseLength);
+  response[responseLength++] = crc & 0xFF;
+  response[responseLength++] = crc >> 8;
+  ++_stats.responses;
+  return responseLength;
+}
+
+void ModbusServer::recordLatency(uint32_t us) {
+  _stats.lastLatencyUs = us;
+  if (us > _stats.maxLatencyUs) _stats.maxLatencyUs = us;
+}
+
+// Returns the exception code, 0 on success. request and length exclude the CRC.
+uint8_t ModbusServer::_execute(const uint8_t* request, size_t length, uint8_t* response, size_t* responseLength) {
+  if (_map == nullptr) return esp32Modbus::SERVER_DEVICE_FAILURE;
+  switch (request[1]) {
+  case esp32Modbus::READ_COIL:
+  case esp32Modbus::READ_DISCR_INPUT:
+    if (length != 6) return esp32Modbus::ILLEGAL_DATA_VALUE;
+    return _readBits(request, response, responseLength);
+  case esp32Modbus::READ_HOLD_REGISTER:
+  case esp32Modbus::READ_INPUT_REGISTER:
+    if (length != 6) return esp32Modbus::ILLEGAL_DATA_VALUE;
+    return _readRegisters(request, response, responseLength);
+  case esp32Modbus::WRITE_COIL: {
+    if (length != 6) return esp32Modbus::ILLEGAL_DATA_VALUE;
+    uint16_t value = word(&request[4]);
+    if (value != MODBUS_COIL_ON && value != MODBUS_COIL_OFF) return esp32Modbus::ILLEGAL_DATA_VALUE;
+    const uint8_t asFC0F[] = {request[0], request[1], request[2], request[3], 0x00, 0x01, 0x01,
+                              static_cast<uint8_t>(value ? 0x01 : 0x00)};
+    return _echo(request, _writeCoils(asFC0F, sizeof(asFC0F)), response, responseLength);
+  }
+  case esp32Modbus::WRITE_HOLD_REGISTER: {
+    if (length != 6) return esp32Modbus::ILLEGAL_DATA_VALUE;
+    const uint8_t asFC10[] = {request[0], request[1], request[2], request[3], 0x00, 0x01, 0x02, request[4], request[5]};
+    return _echo(request, _writeRegisters(asFC10, sizeof(asFC10)), response, responseLength);
+  }
+  case esp32Modbus::WRITE_MULT_COILS:
+    return _echo(request, _writeCoils(request, length), response, responseLength);
+  case esp32Modbus::WRITE_MULT_REGISTERS:
+    return _echo(request, _writeRegisters(request, length), response, responseLength);
+  case esp32Modbus::READ_WRITE_MULT_REGISTERS:
+    return _readWriteRegisters(request, length, response, responseLength);
+  default:
+    return esp32Modbus::ILLEGAL_FUNCTION;
+  }
+}
+
+// Write responses repeat bytes 2-5 of the request: address and value (FC05/06)
+// or address and quantity (FC0F/10)
+uint8_t ModbusServer::_echo(const uint8_t* request, uint8_t exception, uint8_t* response, size_t* responseLength) {
+  if (exception == 0) {
+    memcpy(&response[2], &request[2], 4);
+    *responseLength = 6;
+  }
+  return exception;
+}
+
+uint8_t ModbusServer::_readBits(const uint8_t* request, uint8_t* response, size_t* responseLength) {
+  uint16_t address = word(&request[2]);
+  uint16_t count = word(&request[4]);
+  if (count == 0 || count > MODBUS_MAX_READ_BITS) return esp32Modbus::ILLEGAL_DATA_VALUE;
+  uint16_t first = 0;
+  const uint8_t* bits = request[1] == esp32Modbus::READ_COIL ? _map->coils(address, count, &first)
+                                                              : _map->discreteInputs(address, count, &first);
+  if (bits == nullptr) return esp32Modbus::ILLEGAL_DATA_ADDRESS;
+  response[2] = (count + 7) / 8;
+  copyBitsOut(bits, first, count, &response[3]);
+  *responseLength = 3 + response[2];
+  return 0;
+}
+
+uint8_t ModbusServer::_readRegisters(const uint8_t* request, uint8_t* response, size_t* responseLength) {
+  uint16_t address = word(&request[2]);
+  uint16_t count = word(&request[4]);
+  if (count == 0 || count > MODBUS_MAX_READ_REGISTERS) return esp32Modbus::ILLEGAL_DATA_VALUE;
+  const uint16_t* registers = request[1] == esp32Modbus::READ_HOLD_REGISTER ? _map->holdingRegisters(address, count)
+                                                                            : _map->inputRegisters(address, count);
+  if (registers == nullptr) return esp32Modbus::ILLEGAL_DATA_ADDRESS;
+  response[2] = count * 2;
+  for (uint16_t i = 0; i < count; ++i) {
+    response[3 + 2 * i] = registers[i] >> 8;
+    response[4 + 2 * i] = registers[i] & 0xFF;
+  }
+  *responseLength = 3 + response[2];
+  return 0;
+}
+
+// FC0F (FC05 as a one coil FC0F); the response is the echo of address and count
+uint8_t ModbusServer::_writeCoils(const uint8_t* request, size_t length) {
+  if (length < 7) return esp32Modbus::ILLEGAL_DATA_VALUE;
+  uint16_t address = word(&request[2]);
+  uint16_t count = word(&request[4]);
+  if (count == 0 || count > MODBUS_MAX_FC0F_COILS || request[6] != (count + 7) / 8 || length != 7u + request[6]) {
+    return esp32Modbus::ILLEGAL_DATA_VALUE;
+  }
+  uint16_t first = 0;
+  uint8_t* bits = _map->coils(address, count, &first);
+  if (bits == nullptr) return esp32Modbus::ILLEGAL_DATA_ADDRESS;
+  copyBitsIn(&request[7], count, bits, first);
+  _map->notifyWrite(static_cast<esp32Modbus::FunctionCode>(request[1]), address, count);
+  return 0;
+}
+
+// FC10 (FC06 as a one register FC10)
+uint8_t ModbusServer::_writeRegisters(const uint8_t* request, size_t length) {
+  if (length < 7) return esp32Modbus::ILLEGAL_DATA_VALUE;
+  uint16_t address = word(&request[2]);
+  uint16_t count = word(&request[4]);
+  if (count == 0 || count > MODBUS_MAX_FC16_REGISTERS || request[6] != count * 2 || length != 7u + request[6]) {
+    return esp32Modbus::ILLEGAL_DATA_VALUE;
+  }
+  uint16_t* registers = _map->holdingRegisters(address, count);
+  if (registers == nullptr) return esp32Modbus::ILLEGAL_DATA_ADDRESS;
+  for (uint16_t i = 0; i < count; ++i) registers[i] = word(&request[7 + 2 * i]);
+  _map->notifyWrite(static_cast<esp32Modbus::FunctionCode>(request[1]), address, count);
+  return 0;
+}
+
+// FC17: the write is done before the read
+uint8_t ModbusServer::_readWriteRegisters(const uint8_t* request, size_t length, uint8_t* response, size_t* responseLength) {
+  if (length < 11) return esp32Modbus::ILLEGAL_DATA_VALUE;
+  uint16_t readCount = word(&request[4]);
+  uint16_t writeAddress = word(&request[6]);
+  uint16_t writeCount = word(&request[8]);
+  if (readCount == 0 || readCount > MODBUS_MAX_READ_REGISTERS || writeCount == 0 || writeCount > MODBUS_MAX_FC17_WRITE_REGISTERS ||
+      request[10] != writeCount * 2 || length != 11u + request[10]) {
+    return esp32Modbus::ILLEGAL_DATA_VALUE;
+  }
+  uint16_t* registers = _map->holdingRegisters(writeAddress, writeCount);
+  if (registers == nullptr || _map->holdingRegisters(word(&request[2]), readCount) == nullptr) {
+    return esp32Modbus::ILLEGAL_DATA_ADDRESS;
+  }
+  for (uint16_t i = 0; i < writeCount; ++i) registers[i] = word(&request[11 + 2 * i]);
+  _map->notifyWrite(esp32Modbus::READ_WRITE_MULT_REGISTERS, writeAddress, writeCount);
+  const uint8_t read[] = {request[0], esp32Modbus::READ_HOLD_REGISTER, request[2], request[3], request[4], request[5]};
+  return _readRegisters(read, response, responseLength);
+}
@@ -0,0 +1,108 @@
+/* ModbusServer
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusRTU_ModbusServer_h
+#define esp32ModbusRTU_ModbusServer_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+
+#include "esp32ModbusTypeDefs.h"
+
+namespace esp32Modbus {
+
+// Data of a Modbus slave: one block of consecutive addresses per table, kept
+// in the application's memory and served as is. A lookup is a range check and
+// an offset. Coils and discrete inputs are packed, bit i in byte i / 8 (LSB
+// first, as ModbusDecode.h packBits). A table without block answers every
+// address with ILLEGAL_DATA_ADDRESS.
+// The server task reads and writes the blocks while serving requests; values
+// that must change together are best updated from onWrite or under a lock of
+// the application's own.
+class RegisterMap {
+ public:
+  RegisterMap();
+  void setCoils(uint16_t address, uint16_t count, uint8_t* bits);
+  void setDiscreteInputs(uint16_t address, uint16_t count, const uint8_t* bits);
+  void setHoldingRegisters(uint16_t address, uint16_t count, uint16_t* registers);
+  void setInputRegisters(uint16_t address, uint16_t count, const uint16_t* registers);
+  // Called from the server task after a master wrote to the map
+  void onWrite(MBServerOnWrite handler) { _onWrite = handler; }
+
+  // Start of count entries from address on, nullptr when not all are mapped
+  uint8_t* coils(uint16_t address, uint16_t count, uint16_t* bit);
+  const uint8_t* discreteInputs(uint16_t address, uint16_t count, uint16_t* bit) const;
+  uint16_t* holdingRegisters(uint16_t address, uint16_t count);
+  const uint16_t* inputRegisters(uint16_t address, uint16_t count) const;
+  void notifyWrite(FunctionCode functionCode, uint16_t address, uint16_t count) const;
+
+ private:
+  struct Block {
+    uint16_t address;
+    uint16_t count;
+    void* data;
+  };
+  static bool _contains(const Block& block, uint16_t address, uint16_t count);
+  Block _coils;
+  Block _discreteInputs;
+  Block _holdingRegisters;
+  Block _inputRegisters;
+  MBServerOnWrite _onWrite;
+};
+
+}  // namespace esp32Modbus
+
+namespace esp32ModbusRTUInternals {
+
+// Slave side protocol engine, without I/O: takes a complete RTU request frame
+// and builds the response frame from the register map. FC01-06, 0F, 10 and 17
+// are served, other function codes get ILLEGAL_FUNCTION. Broadcasts (address
+// 0) are executed without response.
+class ModbusServer {
+ public:
+  ModbusServer(uint8_t slaveAddress, esp32Modbus::RegisterMap* map);
+  // Returns the length of the response written to response (room for
+  // MODBUS_RTU_MAX_ADU bytes), 0 when nothing is to be sent.
+  size_t handle(const uint8_t* request, size_t length, uint8_t* response);
+  uint8_t getSlaveAddress() const { return _slaveAddress; }
+  void recordLatency(uint32_t us);
+  void recordCrcError() { ++_stats.crcErrors; }
+  const esp32Modbus::ServerStats& stats() const { return _stats; }
+
+ private:
+  uint8_t _execute(const uint8_t* request, size_t length, uint8_t* response, size_t* responseLength);
+  uint8_t _echo(const uint8_t* request, uint8_t exception, uint8_t* response, size_t* responseLength);
+  uint8_t _readBits(const uint8_t* request, uint8_t* response, size_t* responseLength);
+  uint8_t _readRegisters(const uint8_t* request, uint8_t* response, size_t* responseLength);
+  uint8_t _writeCoils(const uint8_t* request, size_t length);
+  uint8_t _writeRegisters(const uint8_t* request, size_t length);
+  uint8_t _readWriteRegisters(const uint8_t* request, size_t length, uint8_t* response, size_t* responseLength);
+  uint8_t _slaveAddress;
+  esp32Modbus::RegisterMap* _map;
+  esp32Modbus::ServerStats _stats;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
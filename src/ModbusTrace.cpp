@@ -0,0 +1,273 @@
+/* ModbusTrace
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ModbusTrace.h"
+#include "ModbusFramer.h"
+
+#include <stdio.h>   // for snprintf
+#include <string.h>  // for memcpy
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+// pcapng blocks
+static const uint32_t SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+static const uint32_t INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+static const uint32_t ENHANCED_PACKET_BLOCK = 0x00000006;
+static const uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+static const uint16_t OPTION_END = 0;
+static const uint16_t OPTION_COMMENT = 1;
+static const uint16_t OPTION_IF_NAME = 2;
+static const uint16_t OPTION_EPB_FLAGS = 2;
+static const uint16_t OPTION_IF_TSRESOL = 9;
+static const uint32_t FLAG_INBOUND = 1;
+static const uint32_t FLAG_OUTBOUND = 2;
+
+// Record header fields; a scheduled request has RECORD_SCHEDULED in the
+// direction and its priority, continuation and retry flags instead of an outcome
+static const uint8_t RECORD_WAIT = 4;
+static const uint8_t RECORD_DIRECTION = 8;
+static const uint8_t RECORD_SLAVE = 9;
+static const uint8_t RECORD_OUTCOME = 10;
+static const uint8_t RECORD_LENGTH = 11;  // 16 bit: a frame may take all 256 bytes of the ADU
+static const uint8_t RECORD_SCHEDULED = 0x80;
+static const uint8_t SCHEDULE_CONTINUATION = 0x04;
+static const uint8_t SCHEDULE_RETRY = 0x08;
+static const size_t COMMENT_SIZE = 64;  // including the terminating zero of snprintf
+
+static uint16_t recordLength(const uint8_t* header) {
+  uint16_t length;
+  memcpy(&length, &header[RECORD_LENGTH], 2);
+  return length;
+}
+
+// Appends to a block under construction, fields in host byte order as the
+// byte order magic tells
+class BlockWriter {
+ public:
+  explicit BlockWriter(uint8_t* block) : _block(block), _length(0) {}
+  void u16(uint16_t value) { _append(&value, 2); }
+  void u32(uint32_t value) { _append(&value, 4); }
+  void bytes(const void* data, size_t length) {
+    if (length > 0) _append(data, length);
+    while (_length % 4) _block[_length++] = 0;
+  }
+  void option(uint16_t code, const void* data, uint16_t length) {
+    u16(code);
+    u16(length);
+    bytes(data, length);
+  }
+  // Block type and total length at the start and the end
+  size_t finish(uint32_t type) {
+    uint32_t total = _length + 4;
+    memcpy(_block, &type, 4);
+    memcpy(&_block[4], &total, 4);
+    u32(total);
+    return _length;
+  }
+  void begin() { _length = 8; }
+
+ private:
+  void _append(const void* data, size_t length) {
+    memcpy(&_block[_length], data, length);
+    _length += length;
+  }
+  uint8_t* _block;
+  size_t _length;
+};
+
+// size is rounded down to a power of two, positions stay continuous when they wrap
+static uint32_t powerOfTwo(size_t size) {
+  uint32_t result = 1;
+  while (result <= size / 2 && result < 0x40000000) result <<= 1;
+  return result;
+}
+
+FrameTrace::FrameTrace(size_t size) :
+  _buffer(new uint8_t[powerOfTwo(size)]),
+  _size(powerOfTwo(size)),
+  _head(0),
+  _tail(0),
+  _start(0),
+  _captured(0),
+  _overwritten(0) {}
+
+FrameTrace::~FrameTrace() {
+  delete[] _buffer;
+}
+
+void FrameTrace::capture(TraceDirection direction, uint8_t slaveAddress, esp32Modbus::Error outcome,
+                         const uint8_t* frame, uint16_t length, uint32_t nowUs) {
+  uint8_t header[RECORD_HEADER] = {0};
+  memcpy(header, &nowUs, 4);
+  header[RECORD_DIRECTION] = direction;
+  header[RECORD_SLAVE] = slaveAddress;
+  header[RECORD_OUTCOME] = outcome;
+  _capture(header, frame, length);
+}
+
+void FrameTrace::captureRequest(esp32Modbus::ModbusPriority priority, bool continuation, uint8_t retries, uint32_t queueWaitUs,
+                                const uint8_t* frame, uint16_t length, uint32_t nowUs) {
+  uint8_t header[RECORD_HEADER];
+  memcpy(header, &nowUs, 4);
+  memcpy(&header[RECORD_WAIT], &queueWaitUs, 4);
+  header[RECORD_DIRECTION] = TRACE_TX | RECORD_SCHEDULED;
+  header[RECORD_SLAVE] = length > 0 ? frame[0] : 0;
+  header[RECORD_OUTCOME] = (priority & 0x03) | (continuation ? SCHEDULE_CONTINUATION : 0) | (retries ? SCHEDULE_RETRY : 0);
+  _capture(header, frame, length);
+}
+
+bool FrameTrace::exportPcapng(const esp32Modbus::MBTraceWriter& write) const {
+  // enhanced packet block: header and fixed fields, frame, flags, comment, end of options, trailer
+  uint8_t block[28 + MODBUS_RTU_MAX_ADU + 8 + (4 + COMMENT_SIZE) + 4 + 4];
+  BlockWriter writer(block);
+
+  writer.begin();
+  writer.u32(BYTE_ORDER_MAGIC);
+  writer.u16(1);  // version 1.0
+  writer.u16(0);
+  writer.u32(0xFFFFFFFF);  // section length unknown
+  writer.u32(0xFFFFFFFF);
+  size_t length = writer.finish(SECTION_HEADER_BLOCK);
+  if (!write(block, length)) return false;
+
+  writer.begin();
+  writer.u16(MODBUS_TRACE_LINKTYPE);
+  writer.u16(0);
+  writer.u32(MODBUS_RTU_MAX_ADU);  // snap length
+  writer.option(OPTION_IF_NAME, "rs485", 5);
+  const uint8_t microseconds = 6;
+  writer.option(OPTION_IF_TSRESOL, &microseconds, 1);
+  writer.option(OPTION_END, nullptr, 0);
+  length = writer.finish(INTERFACE_DESCRIPTION_BLOCK);
+  if (!write(block, length)) return false;
+
+  uint32_t head = _head.load(std::memory_order_acquire);
+  uint32_t position = _tail.load(std::memory_order_acquire);
+  uint32_t start = _start.load(std::memory_order_relaxed);
+  if (static_cast<int32_t>(start - position) > 0) position = start;
+  uint64_t timestamp = 0;
+  uint32_t lastUs = 0;
+  bool first = true;
+  while (static_cast<int32_t>(head - position) > 0) {
+    uint8_t header[RECORD_HEADER];
+    uint8_t frame[MODBUS_RTU_MAX_ADU];
+    _get(position, header, RECORD_HEADER);
+    uint16_t frameLength = recordLength(header);
+    if (frameLength > MODBUS_RTU_MAX_ADU) frameLength = 0;  // torn header, dropped below
+    _get(position + RECORD_HEADER, frame, frameLength);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (static_cast<int32_t>(tail - position) > 0) {
+      position = tail;  // overwritten meanwhile, continue with the oldest one left
+      continue;
+    }
+    position += RECORD_HEADER + frameLength;
+
+    // micros() wraps around every 71 minutes
+    uint32_t us;
+    memcpy(&us, header, 4);
+    timestamp = first ? us : timestamp + static_cast<uint32_t>(us - lastUs);
+    lastUs = us;
+    first = false;
+
+    writer.begin();
+    writer.u32(0);  // interface
+    writer.u32(timestamp >> 32);
+    writer.u32(timestamp & 0xFFFFFFFF);
+    writer.u32(frameLength);
+    writer.u32(frameLength);
+    writer.bytes(frame, frameLength);
+    uint8_t direction = header[RECORD_DIRECTION] & ~RECORD_SCHEDULED;
+    uint32_t flags = direction == TRACE_TX ? FLAG_OUTBOUND : FLAG_INBOUND;
+    writer.option(OPTION_EPB_FLAGS, &flags, 4);
+    char comment[COMMENT_SIZE];
+    int commentLength;
+    if (header[RECORD_DIRECTION] & RECORD_SCHEDULED) {
+      uint32_t waitUs;
+      memcpy(&waitUs, &header[RECORD_WAIT], 4);
+      uint8_t schedule = header[RECORD_OUTCOME];
+      commentLength = snprintf(comment, sizeof(comment), "TX slave=%u priority=%u wait=%lu%s%s", header[RECORD_SLAVE], schedule & 0x03,
+                               static_cast<unsigned long>(waitUs), schedule & SCHEDULE_CONTINUATION ? " continuation" : "",
+                               schedule & SCHEDULE_RETRY ? " retry" : "");
+    } else {
+      commentLength = snprintf(comment, sizeof(comment), "%s slave=%u outcome=0x%02X %s", direction == TRACE_TX ? "TX" : "RX",
+                               header[RECORD_SLAVE], header[RECORD_OUTCOME],
+                               esp32Modbus::getErrorDescription(static_cast<esp32Modbus::Error>(header[RECORD_OUTCOME])));
+    }
+    if (commentLength >= static_cast<int>(sizeof(comment))) commentLength = sizeof(comment) - 1;
+    writer.option(OPTION_COMMENT, comment, commentLength);
+    writer.option(OPTION_END, nullptr, 0);
+    length = writer.finish(ENHANCED_PACKET_BLOCK);
+    if (!write(block, length)) return false;
+  }
+  return true;
+}
+
+void FrameTrace::_capture(uint8_t* header, const uint8_t* frame, uint16_t length) {
+  if (length > MODBUS_RTU_MAX_ADU) length = MODBUS_RTU_MAX_ADU;  // what an export can take
+  memcpy(&header[RECORD_LENGTH], &length, 2);
+  uint32_t need = RECORD_HEADER + length;
+  if (need > _size) return;
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  uint32_t evicted = 0;
+  while (head + need - tail > _size) {
+    uint16_t oldLength;
+    _get(tail + RECORD_LENGTH, &oldLength, 2);
+    tail += RECORD_HEADER + oldLength;
+    ++evicted;
+  }
+  if (evicted) {
+    // readers have to see the records go before they are overwritten
+    _tail.store(tail, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _overwritten.store(_overwritten.load(std::memory_order_relaxed) + evicted, std::memory_order_relaxed);
+  }
+
+  _put(head, header, RECORD_HEADER);
+  _put(head + RECORD_HEADER, frame, length);
+  _head.store(head + need, std::memory_order_release);
+  _captured.store(_captured.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void FrameTrace::clear() {
+  _start.store(_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+void FrameTrace::_put(uint32_t position, const void* data, size_t length) {
+  uint32_t offset = position & (_size - 1);
+  size_t first = length < _size - offset ? length : _size - offset;
+  if (length == 0) return;
+  memcpy(&_buffer[offset], data, first);
+  memcpy(_buffer, static_cast<const uint8_t*>(data) + first, length - first);
+}
+
+void FrameTrace::_get(uint32_t position, void* data, size_t length) const {
+  uint32_t offset = position & (_size - 1);
+  size_t first = length < _size - offset ? length : _size - offset;
+  if (length == 0) return;
+  memcpy(data, &_buffer[offset], first);
+  memcpy(static_cast<uint8_t*>(data) + first, _buffer, length - first);
+}
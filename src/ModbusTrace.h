@@ -0,0 +1,86 @@
+/* ModbusTrace
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef esp32ModbusRTUInternals_ModbusTrace_h
+#define esp32ModbusRTUInternals_ModbusTrace_h
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint*_t
+#include <atomic>
+
+#include "esp32ModbusTypeDefs.h"
+
+#ifndef MODBUS_TRACE_BYTES
+#define MODBUS_TRACE_BYTES 4096  // Default frame trace ring size (a power of two), frames plus 13 bytes each
+#endif
+
+namespace esp32ModbusRTUInternals {
+
+// Link type of the exported frames: DLT_USER0, map it to "mbrtu" in Wireshark
+const uint16_t MODBUS_TRACE_LINKTYPE = 147;
+
+enum TraceDirection : uint8_t {
+  TRACE_TX = 0,
+  TRACE_RX = 1
+};
+
+// Ring of captured frames, each a record header (timestamp, queue wait,
+// direction, slave, outcome or scheduling, length) followed by the frame.
+// The oldest records are overwritten. One task captures, another may export:
+// the capturing side moves the tail past records before overwriting them, the
+// exporting side drops a record that was overwritten while it was read.
+class FrameTrace {
+ public:
+  static const uint8_t RECORD_HEADER = 13;
+  explicit FrameTrace(size_t size);
+  ~FrameTrace();
+  void capture(TraceDirection direction, uint8_t slaveAddress, esp32Modbus::Error outcome,
+               const uint8_t* frame, uint16_t length, uint32_t nowUs);
+  // A request the worker took from the queues: how it was scheduled, for the trace replay
+  void captureRequest(esp32Modbus::ModbusPriority priority, bool continuation, uint8_t retries, uint32_t queueWaitUs,
+                      const uint8_t* frame, uint16_t length, uint32_t nowUs);
+  // pcapng with one interface; timestamps are micros() since boot
+  bool exportPcapng(const esp32Modbus::MBTraceWriter& write) const;
+  void clear();  // exports start after the frames captured so far
+  uint32_t captured() const { return _captured.load(std::memory_order_relaxed); }
+  uint32_t overwritten() const { return _overwritten.load(std::memory_order_relaxed); }
+
+ private:
+  void _capture(uint8_t* header, const uint8_t* frame, uint16_t length);
+  void _put(uint32_t position, const void* data, size_t length);
+  void _get(uint32_t position, void* data, size_t length) const;
+  uint8_t* _buffer;
+  uint32_t _size;
+  // Positions count bytes since the start and wrap around at 2^32
+  std::atomic<uint32_t> _head;
+  std::atomic<uint32_t> _tail;
+  std::atomic<uint32_t> _start;
+  std::atomic<uint32_t> _captured;
+  std::atomic<uint32_t> _overwritten;
+};
+
+}  // namespace esp32ModbusRTUInternals
+
+#endif
@@ -0,0 +1,604 @@
+/* esp32ModbusGateway
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "esp32ModbusGateway.h"
+#include "ModbusMessage.h"
+
+#include <errno.h>
+#include <fcntl.h>  // for fcntl, O_NONBLOCK
+#include <string.h>  // for memcpy, memmove, memset
+#include <unistd.h>  // for close, usleep
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+#include <esp_timer.h>
+#include "esp32ModbusRTU.h"
+#else
+#include <chrono>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MODBUS_GATEWAY_TASK_STACK_SIZE
+#define MODBUS_GATEWAY_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef MODBUS_GATEWAY_TASK_PRIORITY
+#define MODBUS_GATEWAY_TASK_PRIORITY 4  // below the RTU worker
+#endif
+
+using namespace esp32ModbusRTUInternals;  // NOLINT
+
+static uint16_t word(const uint8_t* data) {
+  return (data[0] << 8) | data[1];
+}
+
+static uint32_t nowMs() {
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+  return esp_timer_get_time() / 1000;
+#else
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static bool isRead(uint8_t functionCode) {
+  return functionCode >= esp32Modbus::READ_COIL && functionCode <= esp32Modbus::READ_INPUT_REGISTER;
+}
+
+// The table and range a known write changes; table 0 means unknown
+static uint8_t writeRange(uint8_t functionCode, const uint8_t* data, size_t length, uint16_t* address, uint16_t* count) {
+  *address = 0;
+  *count = 0;
+  if ((functionCode == esp32Modbus::WRITE_COIL || functionCode == esp32Modbus::WRITE_HOLD_REGISTER ||
+       functionCode == esp32Modbus::MASK_WRITE_REGISTER) && length >= 2) {
+    *address = word(data);
+    *count = 1;
+  } else if ((functionCode == esp32Modbus::WRITE_MULT_COILS || functionCode == esp32Modbus::WRITE_MULT_REGISTERS) &&
+             length >= 4) {
+    *address = word(data);
+    *count = word(&data[2]);
+  } else if (functionCode == esp32Modbus::READ_WRITE_MULT_REGISTERS && length >= 8) {
+    *address = word(&data[4]);
+    *count = word(&data[6]);
+  }
+  if (*count == 0) return 0;
+  if (functionCode == esp32Modbus::WRITE_COIL || functionCode == esp32Modbus::WRITE_MULT_COILS) {
+    return esp32Modbus::READ_COIL;
+  }
+  return esp32Modbus::READ_HOLD_REGISTER;
+}
+
+static bool overlaps(uint16_t address, uint16_t count, uint16_t otherAddress, uint16_t otherCount) {
+  return static_cast<uint32_t>(address) < static_cast<uint32_t>(otherAddress) + otherCount &&
+         static_cast<uint32_t>(otherAddress) < static_cast<uint32_t>(address) + count;
+}
+
+size_t esp32ModbusRTUInternals::mbapFrameLength(const uint8_t* header) {
+  uint16_t length = word(&header[4]);  // unit id + PDU
+  if (word(&header[2]) != 0 || length < 2 || length > 254) return 0;
+  return 6 + length;
+}
+
+uint8_t esp32ModbusRTUInternals::gatewayException(esp32Modbus::Error error) {
+  switch (error) {
+  case esp32Modbus::ILLEGAL_FUNCTION:
+  case esp32Modbus::ILLEGAL_DATA_ADDRESS:
+  case esp32Modbus::ILLEGAL_DATA_VALUE:
+  case esp32Modbus::SERVER_DEVICE_FAILURE:
+  case esp32Modbus::ACKNOWLEDGE:
+  case esp32Modbus::SERVER_DEVICE_BUSY:
+  case esp32Modbus::NEGATIVE_ACKNOWLEDGE:
+  case esp32Modbus::MEMORY_PARITY_ERROR:
+  case esp32Modbus::GATEWAY_PATH_UNAVAILABLE:
+  case esp32Modbus::GATEWAY_TARGET_FAILED:
+    return error;  // the slave's (or a gateway behind it) exception
+  case esp32Modbus::QUEUE_FULL:
+    return esp32Modbus::SERVER_DEVICE_BUSY;
+  case esp32Modbus::INVALID_PARAMETER:
+    return esp32Modbus::ILLEGAL_DATA_VALUE;
+  default:
+    return esp32Modbus::GATEWAY_TARGET_FAILED;  // timeout or garbled response
+  }
+}
+
+esp32ModbusGateway::esp32ModbusGateway(Forwarder forwarder) :
+  _forwarder(forwarder),
+  _listener(-1),
+  _inFlight(0),
+  _collapseReads(false),
+  _ttlRuleCount(0),
+  _stats()
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+  , _task(nullptr),
+  _stopping(false)
+#endif
+{
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; ++i) {
+    _clients[i].socket = -1;
+    _clients[i].generation = 0;
+    _clients[i].received = 0;
+  }
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_PENDING; ++i) {
+    _pending[i].state.store(PENDING_FREE);
+  }
+  clearCache();
+  memset(_mapped, 0, sizeof(_mapped));
+  for (uint16_t unit = 0; unit < 256; ++unit) {
+    _slaveOf[unit] = unit;
+    if (unit >= 1 && unit <= 247) _mapped[unit / 32] |= 1UL << (unit % 32);
+  }
+}
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+esp32ModbusGateway::esp32ModbusGateway(esp32ModbusRTU* rtu, esp32Modbus::ModbusPriority priority) :
+  esp32ModbusGateway([rtu, priority](uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length,
+                                     esp32Modbus::MBRTUOnReply onReply) {
+    return rtu->forwardRequest(slaveAddress, functionCode, data, length, onReply, priority);
+  }) {}
+
+bool esp32ModbusGateway::start(uint16_t port, int coreID) {
+  if (_task != nullptr || !begin(port)) return false;
+  _stopping = false;
+  if (xTaskCreatePinnedToCore(&_run, "ModbusGateway", MODBUS_GATEWAY_TASK_STACK_SIZE, this, MODBUS_GATEWAY_TASK_PRIORITY,
+                              &_task, coreID >= 0 ? coreID : tskNO_AFFINITY) != pdPASS) {
+    _task = nullptr;
+    end();
+    return false;
+  }
+  return true;
+}
+
+void esp32ModbusGateway::stop() {
+  if (_task == nullptr) return;
+  _stopping = true;
+  while (_task != nullptr) vTaskDelay(1);
+  end();
+}
+
+void esp32ModbusGateway::_run(void* gateway) {
+  esp32ModbusGateway* instance = static_cast<esp32ModbusGateway*>(gateway);
+  while (!instance->_stopping) {
+    instance->poll(100);
+  }
+  instance->_task = nullptr;
+  vTaskDelete(NULL);
+}
+#endif
+
+esp32ModbusGateway::~esp32ModbusGateway() {
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+  stop();
+#endif
+  end();
+  // The RTU side still holds callbacks into the pending slots
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_PENDING; ++i) {
+    while (_pending[i].state.load(std::memory_order_acquire) == PENDING_WAITING) usleep(1000);
+  }
+}
+
+bool esp32ModbusGateway::begin(uint16_t port) {
+  if (_listener >= 0) return false;
+  _listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (_listener < 0) return false;
+  int on = 1;
+  setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(_listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(_listener, MODBUS_GATEWAY_MAX_CLIENTS) != 0) {
+    close(_listener);
+    _listener = -1;
+    return false;
+  }
+  return true;
+}
+
+void esp32ModbusGateway::end() {
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; ++i) {
+    if (_clients[i].socket >= 0) _close(i);
+  }
+  if (_listener >= 0) {
+    close(_listener);
+    _listener = -1;
+  }
+}
+
+uint16_t esp32ModbusGateway::getPort() const {
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  if (_listener < 0 || getsockname(_listener, reinterpret_cast<struct sockaddr*>(&address), &length) != 0) return 0;
+  return ntohs(address.sin_port);
+}
+
+bool esp32ModbusGateway::mapUnit(uint8_t unitId, uint8_t slaveAddress) {
+  // a broadcast gets no reply to pass on, the RTU side refuses raw ones anyway
+  if (slaveAddress == 0 || slaveAddress > 247) return false;
+  _slaveOf[unitId] = slaveAddress;
+  _mapped[unitId / 32] |= 1UL << (unitId % 32);
+  return true;
+}
+
+void esp32ModbusGateway::unmapUnit(uint8_t unitId) {
+  _mapped[unitId / 32] &= ~(1UL << (unitId % 32));
+}
+
+bool esp32ModbusGateway::setCacheTtl(uint8_t slaveAddress, esp32Modbus::FunctionCode functionCode, uint16_t address,
+                                     uint16_t count, uint32_t ttlMs) {
+  if (!isRead(functionCode) || count == 0 || _ttlRuleCount == MODBUS_GATEWAY_TTL_RULES) return false;
+  _ttlRules[_ttlRuleCount++] = {slaveAddress, static_cast<uint8_t>(functionCode), address, count, ttlMs};
+  return true;
+}
+
+void esp32ModbusGateway::clearCache() {
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_CACHE_ENTRIES; ++i) {
+    _cache[i].valid = false;
+  }
+}
+
+bool esp32ModbusGateway::poll(uint32_t timeoutMs) {
+  if (_listener < 0) return false;
+  _deliverReplies();
+
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(_listener, &readable);
+  int maxSocket = _listener;
+  int polled[MODBUS_GATEWAY_MAX_CLIENTS];
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; ++i) {
+    // a full buffer holds a frame waiting for a free slot: leave the rest in TCP's window
+    polled[i] = _clients[i].received < sizeof(_clients[i].buffer) ? _clients[i].socket : -1;
+    if (polled[i] < 0) continue;
+    FD_SET(polled[i], &readable);
+    if (polled[i] > maxSocket) maxSocket = polled[i];
+  }
+  if (_inFlight > 0 && timeoutMs > 1) timeoutMs = 1;  // replies arrive without waking select()
+  struct timeval timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+  if (select(maxSocket + 1, &readable, nullptr, nullptr, &timeout) > 0) {
+    if (FD_ISSET(_listener, &readable)) _accept();
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; ++i) {
+      if (polled[i] >= 0 && polled[i] == _clients[i].socket && FD_ISSET(polled[i], &readable)) _read(i);
+    }
+  }
+  _deliverReplies();
+  return true;
+}
+
+void esp32ModbusGateway::_accept() {
+  int socket = accept(_listener, nullptr, nullptr);
+  if (socket < 0) return;
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; ++i) {
+    if (_clients[i].socket < 0) {
+      int on = 1;
+      setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));  // replies are single small writes
+      // a client that stops reading must not block the loop all clients share
+      fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+      _clients[i].socket = socket;
+      _clients[i].received = 0;
+      ++_stats.connections;
+      return;
+    }
+  }
+  close(socket);  // all slots taken
+  ++_stats.refused;
+}
+
+void esp32ModbusGateway::_read(uint8_t index) {
+  Client& client = _clients[index];
+  ssize_t received = recv(client.socket, &client.buffer[client.received], sizeof(client.buffer) - client.received, 0);
+  if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+  if (received <= 0) {
+    _close(index);
+    return;
+  }
+  client.received += received;
+  _parse(index);
+}
+
+void esp32ModbusGateway::_parse(uint8_t index) {
+  Client& client = _clients[index];
+  while (client.socket >= 0 && client.received >= MODBUS_MBAP_HEADER_LENGTH) {
+    size_t length = mbapFrameLength(client.buffer);
+    if (length == 0) {
+      ++_stats.protocolErrors;  // no way to find the next frame
+      _close(index);
+      return;
+    }
+    if (client.received < length) return;
+    if (!_handleFrame(index, client.buffer, length)) return;  // retried once a reply frees a slot
+    if (client.socket < 0) return;  // closed while answering
+    client.received -= length;
+    memmove(client.buffer, &client.buffer[length], client.received);
+  }
+}
+
+// false if the frame has to wait for a free slot
+bool esp32ModbusGateway::_handleFrame(uint8_t index, const uint8_t* frame, size_t length) {
+  uint16_t transactionId = word(frame);
+  uint8_t unitId = frame[6];
+  uint8_t functionCode = frame[7];
+  const uint8_t* data = &frame[8];
+  size_t dataLength = length - 8;
+
+  esp32Modbus::Error refusal = esp32Modbus::SUCCESS;
+  if (!(_mapped[unitId / 32] & (1UL << (unitId % 32)))) {
+    refusal = esp32Modbus::GATEWAY_PATH_UNAVAILABLE;
+  } else if (functionCode == 0 || (functionCode & MODBUS_ERROR_FLAG)) {
+    refusal = esp32Modbus::ILLEGAL_FUNCTION;
+  } else if (dataLength > MODBUS_MAX_RAW_DATA) {
+    refusal = esp32Modbus::ILLEGAL_DATA_VALUE;  // one byte more than an RTU frame holds
+  }
+  if (refusal != esp32Modbus::SUCCESS) {
+    ++_stats.requests;
+    _respond(index, transactionId, unitId, functionCode, refusal, nullptr, 0);
+    return true;
+  }
+
+  Pending request;
+  request.client = index;
+  request.generation = _clients[index].generation;
+  request.transactionId = transactionId;
+  request.unitId = unitId;
+  request.functionCode = functionCode;
+  request.slaveAddress = _slaveOf[unitId];
+  request.read = isRead(functionCode) && dataLength == 4;
+  if (request.read) {
+    request.table = functionCode;
+    request.address = word(data);
+    request.count = word(&data[2]);
+  } else {
+    request.table = writeRange(functionCode, data, dataLength, &request.address, &request.count);
+  }
+
+  if (request.read) {
+    const CacheEntry* entry = _lookup(request, nowMs());
+    if (entry != nullptr) {
+      ++_stats.requests;
+      ++_stats.cacheHits;
+      _respond(index, transactionId, unitId, functionCode, esp32Modbus::SUCCESS, entry->data, entry->length);
+      return true;
+    }
+  }
+
+  uint8_t slot = 0;
+  while (slot < MODBUS_GATEWAY_MAX_PENDING && _pending[slot].state.load(std::memory_order_acquire) != PENDING_FREE) ++slot;
+  if (slot == MODBUS_GATEWAY_MAX_PENDING) return false;
+  ++_stats.requests;
+  Pending& pending = _pending[slot];
+  pending.client = request.client;
+  pending.generation = request.generation;
+  pending.transactionId = request.transactionId;
+  pending.unitId = request.unitId;
+  pending.functionCode = request.functionCode;
+  pending.slaveAddress = request.slaveAddress;
+  pending.read = request.read;
+  pending.table = request.table;
+  pending.address = request.address;
+  pending.count = request.count;
+  pending.current = request.read;
+  pending.leader = slot;
+
+  if (request.read && _collapseReads) {
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_PENDING; ++i) {
+      const Pending& other = _pending[i];
+      uint8_t state = other.state.load(std::memory_order_acquire);
+      if ((state == PENDING_WAITING || state == PENDING_DONE) && other.current && other.slaveAddress == request.slaveAddress &&
+          other.functionCode == functionCode && other.address == request.address && other.count == request.count) {
+        pending.leader = i;
+        pending.state.store(PENDING_FOLLOWING, std::memory_order_relaxed);  // gateway side only
+        ++_inFlight;
+        ++_stats.collapsed;
+        return true;
+      }
+    }
+  }
+
+  if (!request.read) _invalidate(request.slaveAddress, request.table, request.address, request.count);
+  pending.state.store(PENDING_WAITING, std::memory_order_release);
+  ++_inFlight;
+  bool forwarded = _forwarder(request.slaveAddress, functionCode, data, dataLength,
+                              [this, slot](esp32Modbus::Error error, const uint8_t* reply, uint8_t replyLength) {
+                                _complete(slot, error, reply, replyLength);
+                              });
+  if (!forwarded) {
+    pending.state.store(PENDING_FREE, std::memory_order_release);
+    --_inFlight;
+    // no path to the RTU side right now, e.g. its queue is full
+    _respond(index, transactionId, unitId, functionCode, esp32Modbus::GATEWAY_PATH_UNAVAILABLE, nullptr, 0);
+    return true;
+  }
+  ++_stats.forwarded;
+  return true;
+}
+
+// Called by the RTU side
+void esp32ModbusGateway::_complete(uint8_t slot, esp32Modbus::Error error, const uint8_t* data, uint8_t length) {
+  Pending& pending = _pending[slot];
+  pending.error = error;
+  pending.length = data != nullptr && length <= sizeof(pending.data) ? length : 0;
+  if (pending.length > 0) memcpy(pending.data, data, pending.length);
+  pending.state.store(PENDING_DONE, std::memory_order_release);
+}
+
+void esp32ModbusGateway::_deliverReplies() {
+  bool freed = false;
+  uint32_t now = nowMs();
+  for (uint8_t slot = 0; slot < MODBUS_GATEWAY_MAX_PENDING; ++slot) {
+    Pending& pending = _pending[slot];
+    if (pending.state.load(std::memory_order_acquire) != PENDING_DONE) continue;
+    // a read forwarded before a write to its range may hold the old values,
+    // whichever of the two is delivered first
+    if (pending.error == esp32Modbus::SUCCESS && pending.current) {
+      _store(pending, now);
+    }
+    _reply(pending, pending);
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_PENDING; ++i) {
+      Pending& follower = _pending[i];
+      if (follower.state.load(std::memory_order_relaxed) != PENDING_FOLLOWING || follower.leader != slot) continue;
+      _reply(follower, pending);
+      follower.state.store(PENDING_FREE, std::memory_order_relaxed);
+      --_inFlight;
+    }
+    pending.state.store(PENDING_FREE, std::memory_order_release);
+    --_inFlight;
+    freed = true;
+  }
+  if (!freed) return;
+  // frames that waited for a slot
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; ++i) {
+    if (_clients[i].socket >= 0) _parse(i);
+  }
+}
+
+// Reply from's outcome to to's client
+void esp32ModbusGateway::_reply(const Pending& to, const Pending& from) {
+  const Client& client = _clients[to.client];
+  if (client.socket < 0 || client.generation != to.generation) {
+    ++_stats.dropped;  // the client left meanwhile
+    return;
+  }
+  _respond(to.client, to.transactionId, to.unitId, to.functionCode, from.error, from.data, from.length);
+}
+
+uint32_t esp32ModbusGateway::_ttl(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t count) const {
+  for (uint8_t i = 0; i < _ttlRuleCount; ++i) {
+    const TtlRule& rule = _ttlRules[i];
+    if ((rule.slaveAddress == 0 || rule.slaveAddress == slaveAddress) && rule.functionCode == functionCode &&
+        address >= rule.address && static_cast<uint32_t>(address) + count <= static_cast<uint32_t>(rule.address) + rule.count) {
+      return rule.ttlMs;
+    }
+  }
+  return 0;
+}
+
+const esp32ModbusGateway::CacheEntry* esp32ModbusGateway::_lookup(const Pending& read, uint32_t now) const {
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_CACHE_ENTRIES; ++i) {
+    const CacheEntry& entry = _cache[i];
+    if (entry.valid && entry.slaveAddress == read.slaveAddress && entry.functionCode == read.functionCode &&
+        entry.address == read.address && entry.count == read.count && now - entry.storedAt < entry.ttlMs) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void esp32ModbusGateway::_store(const Pending& read, uint32_t now) {
+  uint32_t ttlMs = _ttl(read.slaveAddress, read.functionCode, read.address, read.count);
+  if (ttlMs == 0) return;
+  // the same read, else a free or expired entry, else the oldest one
+  CacheEntry* target = &_cache[0];
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_CACHE_ENTRIES; ++i) {
+    CacheEntry& entry = _cache[i];
+    if (entry.valid && entry.slaveAddress == read.slaveAddress && entry.functionCode == read.functionCode &&
+        entry.address == read.address && entry.count == read.count) {
+      target = &entry;
+      break;
+    }
+    if (!entry.valid || now - entry.storedAt >= entry.ttlMs) {
+      target = &entry;
+    } else if (target->valid && now - target->storedAt < target->ttlMs && entry.storedAt - target->storedAt > UINT32_MAX / 2) {
+      target = &entry;  // older than the current candidate
+    }
+  }
+  target->valid = true;
+  target->slaveAddress = read.slaveAddress;
+  target->functionCode = read.functionCode;
+  target->address = read.address;
+  target->count = read.count;
+  target->storedAt = now;
+  target->ttlMs = ttlMs;
+  target->length = read.length;
+  memcpy(target->data, read.data, read.length);
+}
+
+// For a write being forwarded: drops the cached reads in table (READ_COIL or
+// READ_HOLD_REGISTER) that overlap it, or everything of the slave when table
+// is 0, and keeps later reads from joining or caching the reads in flight
+void esp32ModbusGateway::_invalidate(uint8_t slaveAddress, uint8_t table, uint16_t address, uint16_t count) {
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_CACHE_ENTRIES; ++i) {
+    CacheEntry& entry = _cache[i];
+    if (!entry.valid || entry.slaveAddress != slaveAddress) continue;
+    if (table == 0 || (entry.functionCode == table && overlaps(entry.address, entry.count, address, count))) {
+      entry.valid = false;
+    }
+  }
+  for (uint8_t i = 0; i < MODBUS_GATEWAY_MAX_PENDING; ++i) {
+    Pending& read = _pending[i];
+    uint8_t state = read.state.load(std::memory_order_acquire);
+    if ((state != PENDING_WAITING && state != PENDING_DONE) || !read.current || read.slaveAddress != slaveAddress) continue;
+    if (table == 0 || (read.functionCode == table && overlaps(read.address, read.count, address, count))) {
+      read.current = false;
+    }
+  }
+}
+
+void esp32ModbusGateway::_respond(uint8_t index, uint16_t transactionId, uint8_t unitId, uint8_t functionCode,
+                                  esp32Modbus::Error error, const uint8_t* data, uint8_t length) {
+  uint8_t frame[MODBUS_TCP_MAX_ADU];
+  size_t pduLength;
+  if (error == esp32Modbus::SUCCESS) {
+    frame[7] = functionCode;
+    memcpy(&frame[8], data, length);
+    pduLength = 1 + length;
+  } else {
+    frame[7] = functionCode | MODBUS_ERROR_FLAG;
+    frame[8] = gatewayException(error);
+    pduLength = 2;
+    ++_stats.exceptions;
+  }
+  frame[0] = transactionId >> 8;
+  frame[1] = transactionId & 0xFF;
+  frame[2] = 0;
+  frame[3] = 0;
+  frame[4] = 0;
+  frame[5] = pduLength + 1;
+  frame[6] = unitId;
+  size_t frameLength = MODBUS_MBAP_HEADER_LENGTH + pduLength;
+  ssize_t sent = send(_clients[index].socket, frame, frameLength, MSG_NOSIGNAL);
+  if (sent != static_cast<ssize_t>(frameLength)) {
+    // Send buffer full: the client does not take its replies. Waiting would
+    // stall everyone else, and part of a frame cannot be taken back.
+    if (sent >= 0 || errno == EAGAIN || errno == EWOULDBLOCK) ++_stats.stalled;
+    _close(index);
+    return;
+  }
+  ++_stats.responses;
+}
+
+void esp32ModbusGateway::_close(uint8_t index) {
+  close(_clients[index].socket);
+  _clients[index].socket = -1;
+  _clients[index].received = 0;
+  ++_clients[index].generation;
+}
@@ -0,0 +1,204 @@
+/* esp32ModbusGateway
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusGateway_h
+#define esp32ModbusGateway_h
+
+#ifndef MODBUS_GATEWAY_MAX_CLIENTS
+#define MODBUS_GATEWAY_MAX_CLIENTS 8  // TCP connections served at the same time (mind lwIP's socket limit)
+#endif
+
+#ifndef MODBUS_GATEWAY_MAX_PENDING
+#define MODBUS_GATEWAY_MAX_PENDING 16  // Forwarded requests awaiting their reply, all clients together
+#endif
+
+#ifndef MODBUS_GATEWAY_CACHE_ENTRIES
+#define MODBUS_GATEWAY_CACHE_ENTRIES 16  // Read replies the gateway keeps for setCacheTtl() ranges
+#endif
+
+#ifndef MODBUS_GATEWAY_TTL_RULES
+#define MODBUS_GATEWAY_TTL_RULES 8  // Ranges with a cache TTL
+#endif
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+#include <atomic>
+#include <functional>
+
+#include "esp32ModbusTypeDefs.h"
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+extern "C" {
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+}
+class esp32ModbusRTU;
+#endif
+
+namespace esp32ModbusRTUInternals {
+
+constexpr size_t MODBUS_MBAP_HEADER_LENGTH = 7;  // transaction(2) + protocol(2) + length(2) + unit(1)
+constexpr size_t MODBUS_TCP_MAX_ADU = 260;  // MBAP header + PDU(253)
+
+// Length of the MBAP frame starting with a complete header, 0 for a header no
+// Modbus client sends (protocol id not 0, length field outside 2-254)
+size_t mbapFrameLength(const uint8_t* header);
+
+// Exception code a TCP client gets for a failed forward
+uint8_t gatewayException(esp32Modbus::Error error);
+
+}  // namespace esp32ModbusRTUInternals
+
+// Modbus TCP server in front of the RTU master: MBAP requests are forwarded
+// to the slave their unit id maps to and answered with the slave's reply and
+// the request's transaction id. All clients are served from one select()
+// loop; requests of all clients are in flight together (pipelining included)
+// up to MODBUS_GATEWAY_MAX_PENDING, the RTU queues do the multiplexing.
+// Optionally, identical reads in flight share one RTU transaction and read
+// replies are kept for a TTL per register range.
+class esp32ModbusGateway {
+ public:
+  // Hands a request PDU to the RTU side. Returns false if it was not taken,
+  // else onReply must be called exactly once, from any task.
+  typedef std::function<bool(uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length,
+                             esp32Modbus::MBRTUOnReply onReply)> Forwarder;
+
+  explicit esp32ModbusGateway(Forwarder forwarder);
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+  // Forward through rtu's queues at the given priority. Destroy the gateway
+  // before rtu: it waits for the replies still due.
+  explicit esp32ModbusGateway(esp32ModbusRTU* rtu, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  // begin() and a task calling poll()
+  bool start(uint16_t port = 502, int coreID = -1);
+  void stop();
+#endif
+  ~esp32ModbusGateway();
+
+  bool begin(uint16_t port = 502);  // 0: any free port, see getPort()
+  void end();  // closes all connections, replies still due are dropped
+  // Accepts, reads and answers what is ready, waiting up to timeoutMs for
+  // network activity (1 ms while replies are due). false if not begun.
+  bool poll(uint32_t timeoutMs);
+  uint16_t getPort() const;
+
+  // Units 1-247 go to the slave with the same address by default; 0 and
+  // 248-255 are answered with GATEWAY_PATH_UNAVAILABLE until mapped.
+  // Broadcasts are not gatewayed: false for a slave address outside 1-247.
+  bool mapUnit(uint8_t unitId, uint8_t slaveAddress);
+  void unmapUnit(uint8_t unitId);
+
+  // Reads (FC01-04) asking for the same range of the same slave while one of
+  // them is being forwarded get its reply instead of a transaction of their own,
+  // unless a write to that range was forwarded after it.
+  void setCollapseReads(bool enabled) { _collapseReads = enabled; }
+  // Replies to reads of function code functionCode (01-04) within count
+  // addresses from address of the slave (0: any slave) are answered from
+  // memory for ttlMs. The first matching range counts, ttlMs 0 excludes one.
+  // Writes forwarded to a slave invalidate what they overlap. Configure
+  // before start()/poll().
+  bool setCacheTtl(uint8_t slaveAddress, esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t count, uint32_t ttlMs);
+  void clearCache();
+  esp32Modbus::GatewayStats getStats() const { return _stats; }
+
+ private:
+  enum PendingState : uint8_t { PENDING_FREE, PENDING_WAITING, PENDING_DONE, PENDING_FOLLOWING };
+  struct Client {
+    int socket;  // -1: slot free
+    uint16_t generation;  // tells a reply's client from a later one in the same slot
+    uint16_t received;
+    uint8_t buffer[esp32ModbusRTUInternals::MODBUS_TCP_MAX_ADU];
+  };
+  // Written by the RTU side until state is PENDING_DONE, then by the gateway
+  struct Pending {
+    std::atomic<uint8_t> state;
+    uint8_t client;
+    uint16_t generation;
+    uint16_t transactionId;
+    uint8_t unitId;
+    uint8_t functionCode;
+    uint8_t slaveAddress;
+    bool read;  // FC01-04 with a range
+    uint8_t table;  // read: its function code, write: the read it changes, 0: unknown
+    bool current;  // read: no overlapping write forwarded since, its reply may be shared and cached
+    uint16_t address;
+    uint16_t count;
+    uint8_t leader;  // slot forwarded for a FOLLOWING one
+    esp32Modbus::Error error;
+    uint8_t length;
+    uint8_t data[esp32ModbusRTUInternals::MODBUS_TCP_MAX_ADU - 8];  // reply PDU after the function code
+  };
+  struct TtlRule {
+    uint8_t slaveAddress;
+    uint8_t functionCode;
+    uint16_t address;
+    uint16_t count;
+    uint32_t ttlMs;
+  };
+  struct CacheEntry {
+    bool valid;
+    uint8_t slaveAddress;
+    uint8_t functionCode;
+    uint8_t length;
+    uint16_t address;
+    uint16_t count;
+    uint32_t storedAt;
+    uint32_t ttlMs;
+    uint8_t data[esp32ModbusRTUInternals::MODBUS_TCP_MAX_ADU - 8];
+  };
+
+  void _accept();
+  void _read(uint8_t index);
+  void _parse(uint8_t index);
+  bool _handleFrame(uint8_t index, const uint8_t* frame, size_t length);
+  void _complete(uint8_t slot, esp32Modbus::Error error, const uint8_t* data, uint8_t length);
+  void _deliverReplies();
+  void _reply(const Pending& to, const Pending& from);
+  uint32_t _ttl(uint8_t slaveAddress, uint8_t functionCode, uint16_t address, uint16_t count) const;
+  const CacheEntry* _lookup(const Pending& read, uint32_t now) const;
+  void _store(const Pending& read, uint32_t now);
+  void _invalidate(uint8_t slaveAddress, uint8_t table, uint16_t address, uint16_t count);
+  void _respond(uint8_t index, uint16_t transactionId, uint8_t unitId, uint8_t functionCode,
+                esp32Modbus::Error error, const uint8_t* data, uint8_t length);
+  void _close(uint8_t index);
+
+  Forwarder _forwarder;
+  int _listener;
+  Client _clients[MODBUS_GATEWAY_MAX_CLIENTS];
+  Pending _pending[MODBUS_GATEWAY_MAX_PENDING];
+  uint8_t _inFlight;  // slots not free, gateway side count
+  uint8_t _slaveOf[256];
+  uint32_t _mapped[8];  // bitset of mapped unit ids
+  bool _collapseReads;
+  TtlRule _ttlRules[MODBUS_GATEWAY_TTL_RULES];
+  uint8_t _ttlRuleCount;
+  CacheEntry _cache[MODBUS_GATEWAY_CACHE_ENTRIES];
+  esp32Modbus::GatewayStats _stats;
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP32) || defined(ESP_PLATFORM)
+  static void _run(void* gateway);
+  TaskHandle_t _task;
+  volatile bool _stopping;
+#endif
+};
+
+#endif
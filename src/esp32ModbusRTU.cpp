@@ -71,11 +71,41 @@ bool esp32ModbusRTU::_globalWatchdogActive = false;
 esp32ModbusRTU::esp32ModbusRTU(HardwareSerial *serial, int8_t rtsPin) : TimeOutValue(TIMEOUT_MS),
                                                                         _serial(serial),
                                                                         _lastMillis(0),
+                                                                        _lastMicros(0),
+                                                                        _txStartMicros(0),
                                                                         _interval(0),
+                                                                        _silenceMicros(1750),
+                                                                        _broadcastTurnaround(MODBUS_BROADCAST_TURNAROUND_MS),
+                                                                        _serialMode(esp32Modbus::RTU_MODE),
                                                                         _rtsPin(rtsPin),
                                                                         _task(nullptr),
+                                                                        _deltaFilter(nullptr),
+                                                                        _deltaMode(false),
+                                                                        _deltaReset(false),
+                                                                        _retryLock(nullptr),
+                                                                        _cache(nullptr),
+                                                                        _cacheLock(nullptr),
+                                                                        _server(nullptr),
+                                                                        _trace(nullptr),
                                                                         _shutdown(false)
 {
+  for (int i = 0; i < MODBUS_RETRY_SLOTS; i++) {
+    _retryPending[i] = nullptr;
+  }
+  for (int i = 0; i < 4; i++) {
+    _continuations[i] = nullptr;
+  }
+  for (int i = 0; i < 8; i++) {
+    _noMaskWrite[i] = 0;
+  }
+
+  _retryLock = xSemaphoreCreateMutex();
+  if (_retryLock == nullptr) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("Failed to create retry lock!");
+    #endif
+  }
+
   // Create 4 priority queues
   _queues[esp32Modbus::EMERGENCY] = xQueueCreate(EMERGENCY_QUEUE_SIZE, sizeof(ModbusRequest *));
   _queues[esp32Modbus::SENSOR] = xQueueCreate(SENSOR_QUEUE_SIZE, sizeof(ModbusRequest *));
@@ -105,7 +135,7 @@ esp32ModbusRTU::~esp32ModbusRTU()
 
   // We may be processing a modbus request, then queues will be empty so we add another to know
   // that we are not processing a real modbus request
-  readDiscreteInputs(0, 0, 0);
+  _addToQueue(new ModbusRequest02(0, 0, 0));
 
   // Wait until we have processed outstanding modbus requests in all queues
   bool queuesEmpty = false;
@@ -132,6 +162,22 @@ esp32ModbusRTU::~esp32ModbusRTU()
     _task = nullptr;
   }
 
+  // Drop requests that were still waiting for a retry or continuing an operation
+  for (int i = 0; i < MODBUS_RETRY_SLOTS; i++) {
+    if (_retryPending[i] != nullptr) {
+      delete _retryPending[i]->getOperation();
+      delete _retryPending[i];
+      _retryPending[i] = nullptr;
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    if (_continuations[i] != nullptr) {
+      delete _continuations[i]->getOperation();
+      delete _continuations[i];
+      _continuations[i] = nullptr;
+    }
+  }
+
   // Delete all priority queues
   for (int i = 0; i < 4; i++) {
     if (_queues[i] != nullptr) {
@@ -139,9 +185,46 @@ esp32ModbusRTU::~esp32ModbusRTU()
       _queues[i] = nullptr;
     }
   }
+
+  delete _deltaFilter;
+  delete _cache;
+  delete _server;
+  delete _trace.load();
+  if (_cacheLock != nullptr) {
+    vSemaphoreDelete(_cacheLock);
+  }
+  if (_retryLock != nullptr) {
+    vSemaphoreDelete(_retryLock);
+  }
 }
 
 void esp32ModbusRTU::begin(int coreID /* = -1 */)
+{
+  _startTask((TaskFunction_t)&_handleConnection, coreID);
+}
+
+bool esp32ModbusRTU::beginServer(uint8_t slaveAddress, esp32Modbus::RegisterMap *map, int coreID /* = -1 */)
+{
+  if (map == nullptr || slaveAddress == MODBUS_BROADCAST_ADDRESS || slaveAddress > 247 ||
+      _serialMode != esp32Modbus::RTU_MODE || _task != nullptr) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("beginServer: invalid parameters (slave=%d, map=%p)", slaveAddress, map);
+    #endif
+    return false;
+  }
+  _server = new ModbusServer(slaveAddress, map);
+  return _startTask((TaskFunction_t)&_serveConnection, coreID);
+}
+
+esp32Modbus::ServerStats esp32ModbusRTU::getServerStats() const
+{
+  esp32Modbus::ServerStats stats = {};
+  if (_server != nullptr)
+    stats = _server->stats();
+  return stats;
+}
+
+bool esp32ModbusRTU::_startTask(TaskFunction_t task, int coreID)
 {
   // Log watchdog configuration
   #ifdef MODBUS_DISABLE_WATCHDOG
@@ -161,7 +244,7 @@ void esp32ModbusRTU::begin(int coreID /* = -1 */)
     }
   }
   if (!allQueuesCreated) {
-    return;
+    return false;
   }
   
   // If rtsPin is >=0, the RS485 adapter needs send/receive toggle
@@ -171,7 +254,7 @@ void esp32ModbusRTU::begin(int coreID /* = -1 */)
     digitalWrite(_rtsPin, LOW);
   }
   
-  BaseType_t taskResult = xTaskCreatePinnedToCore((TaskFunction_t)&_handleConnection, MODBUS_TASK_NAME, MODBUS_TASK_STACK_SIZE, this, MODBUS_TASK_PRIORITY, &_task, coreID >= 0 ? coreID : NULL);
+  BaseType_t taskResult = xTaskCreatePinnedToCore(task, MODBUS_TASK_NAME, MODBUS_TASK_STACK_SIZE, this, MODBUS_TASK_PRIORITY, &_task, coreID >= 0 ? coreID : NULL);
   
   if (taskResult == pdPASS && _task != nullptr) {
     #ifdef MODBUS_RTU_DEBUG
@@ -187,28 +270,61 @@ void esp32ModbusRTU::begin(int coreID /* = -1 */)
   _interval = 40000 / _serial->baudRate(); // 4 * 1000 * 10 / baud
   if (_interval == 0)
     _interval = 1; // minimum of 1msec interval
+  _silenceMicros = rtuSilenceUs(_serial->baudRate());
+  return taskResult == pdPASS && _task != nullptr;
 }
 
 bool esp32ModbusRTU::readCoils(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils)
 {
+  // Validate parameters
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_COILS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readCoils: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_COILS);
+    #endif
+    return false;
+  }
+  
   ModbusRequest *request = new ModbusRequest01(slaveAddress, address, numberCoils);
   return _addToQueue(request);
 }
 
 bool esp32ModbusRTU::readDiscreteInputs(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils)
 {
+  // Validate parameters
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_COILS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readDiscreteInputs: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_COILS);
+    #endif
+    return false;
+  }
+  
   ModbusRequest *request = new ModbusRequest02(slaveAddress, address, numberCoils);
   return _addToQueue(request);
 }
 bool esp32ModbusRTU::readHoldingRegisters(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters)
 {
+  // Validate parameters
+  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readHoldingRegisters: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+  
   ModbusRequest *request = new ModbusRequest03(slaveAddress, address, numberRegisters);
   return _addToQueue(request);
 }
 
 bool esp32ModbusRTU::readInputRegisters(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters)
 {
-
+  // Validate parameters
+  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readInputRegisters: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+  
   ModbusRequest *request = new ModbusRequest04(slaveAddress, address, numberRegisters);
   return _addToQueue(request);
 }
@@ -228,9 +344,9 @@ bool esp32ModbusRTU::writeSingleHoldingRegister(uint8_t slaveAddress, uint16_t a
 bool esp32ModbusRTU::writeMultipleCoils(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, bool *values)
 {
   // Validate parameters
-  if (numberCoils == 0 || numberCoils > MODBUS_MAX_COILS || values == nullptr) {
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_WRITE_COILS || values == nullptr) {
     #ifdef MODBUS_RTU_DEBUG
-    MODBUS_LOG_E("writeMultipleCoils: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_COILS);
+    MODBUS_LOG_E("writeMultipleCoils: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_WRITE_COILS);
     #endif
     return false;
   }
@@ -242,9 +358,9 @@ bool esp32ModbusRTU::writeMultipleCoils(uint8_t slaveAddress, uint16_t address,
 bool esp32ModbusRTU::writeMultHoldingRegisters(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint8_t *data)
 {
   // Validate parameters
-  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS || data == nullptr) {
+  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_WRITE_REGISTERS || data == nullptr) {
     #ifdef MODBUS_RTU_DEBUG
-    MODBUS_LOG_E("writeMultHoldingRegisters: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    MODBUS_LOG_E("writeMultHoldingRegisters: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_WRITE_REGISTERS);
     #endif
     return false;
   }
@@ -274,6 +390,14 @@ bool esp32ModbusRTU::readWriteMultipleRegisters(uint8_t slaveAddress, uint16_t r
 
 bool esp32ModbusRTU::readCoilsWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, esp32Modbus::ModbusPriority priority)
 {
+  // Validate parameters
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_COILS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readCoilsWithPriority: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_COILS);
+    #endif
+    return false;
+  }
+  
   ModbusRequest *request = new ModbusRequest01(slaveAddress, address, numberCoils);
   request->setPriority(priority);
   return _addToQueue(request);
@@ -281,79 +405,694 @@ bool esp32ModbusRTU::readCoilsWithPriority(uint8_t slaveAddress, uint16_t addres
 
 bool esp32ModbusRTU::readDiscreteInputsWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, esp32Modbus::ModbusPriority priority)
 {
+  // Validate parameters
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_COILS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readDiscreteInputsWithPriority: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_COILS);
+    #endif
+    return false;
+  }
+  
   ModbusRequest *request = new ModbusRequest02(slaveAddress, address, numberCoils);
   request->setPriority(priority);
   return _addToQueue(request);
 }
 
-bool esp32ModbusRTU::readHoldingRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority)
+bool esp32ModbusRTU::readHoldingRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority)
+{
+  // Validate parameters
+  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readHoldingRegistersWithPriority: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+  
+  ModbusRequest *request = new ModbusRequest03(slaveAddress, address, numberRegisters);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::readInputRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority)
+{
+  // Validate parameters
+  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readInputRegistersWithPriority: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+  
+  ModbusRequest *request = new ModbusRequest04(slaveAddress, address, numberRegisters);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::writeSingleCoilWithPriority(uint8_t slaveAddress, uint16_t address, bool value, esp32Modbus::ModbusPriority priority)
+{
+  ModbusRequest *request = new ModbusRequest05(slaveAddress, address, value);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::writeSingleHoldingRegisterWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t data, esp32Modbus::ModbusPriority priority)
+{
+  ModbusRequest *request = new ModbusRequest06(slaveAddress, address, data);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::writeMultipleCoilsWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, bool *values, esp32Modbus::ModbusPriority priority)
+{
+  // Validate parameters
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_WRITE_COILS || values == nullptr) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("writeMultipleCoilsWithPriority: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_WRITE_COILS);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest0F(slaveAddress, address, numberCoils, values);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::writeMultHoldingRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint8_t *data, esp32Modbus::ModbusPriority priority)
+{
+  // Validate parameters
+  if (numberRegisters == 0 || numberRegisters > MODBUS_MAX_WRITE_REGISTERS || data == nullptr) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("writeMultHoldingRegistersWithPriority: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_WRITE_REGISTERS);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest16(slaveAddress, address, numberRegisters, data);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::readWriteMultipleRegistersWithPriority(uint8_t slaveAddress, uint16_t readAddress, uint16_t readCount, uint16_t writeAddress, uint16_t writeCount, uint16_t *writeData, esp32Modbus::ModbusPriority priority)
+{
+  // Validate parameters
+  if (readCount == 0 || readCount > MODBUS_MAX_REGISTERS ||
+      writeCount == 0 || writeCount > MODBUS_MAX_REGISTERS ||
+      writeData == nullptr) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readWriteMultipleRegistersWithPriority: Invalid parameters (read=%d, write=%d, max=%d)",
+                  readCount, writeCount, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest17(slaveAddress, readAddress, readCount, writeAddress, writeCount, writeData);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+// ===== Mask write =====
+
+bool esp32ModbusRTU::maskWriteRegister(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask)
+{
+  ModbusRequest *request = new ModbusRequestMaskWrite(slaveAddress, address, andMask, orMask);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::maskWriteRegisterWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask, esp32Modbus::ModbusPriority priority)
+{
+  ModbusRequest *request = new ModbusRequestMaskWrite(slaveAddress, address, andMask, orMask);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::updateRegisterBits(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask, esp32Modbus::ModbusPriority priority)
+{
+  if (isMaskWriteSupported(slaveAddress)) {
+    return maskWriteRegisterWithPriority(slaveAddress, address, andMask, orMask, priority);
+  }
+
+  ReadModifyWriteOperation *operation = new ReadModifyWriteOperation(slaveAddress, address, andMask, orMask, _onData, _onError);
+  return _submit(operation, priority);
+}
+
+void esp32ModbusRTU::setMaskWriteSupported(uint8_t slaveAddress, bool supported)
+{
+  if (supported) {
+    _noMaskWrite[slaveAddress / 32] &= ~(1UL << (slaveAddress % 32));
+  } else {
+    _noMaskWrite[slaveAddress / 32] |= 1UL << (slaveAddress % 32);
+  }
+}
+
+bool esp32ModbusRTU::isMaskWriteSupported(uint8_t slaveAddress) const
+{
+  return !(_noMaskWrite[slaveAddress / 32] & (1UL << (slaveAddress % 32)));
+}
+
+// ===== Packed coils =====
+
+bool esp32ModbusRTU::writeMultipleCoilsPacked(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, const uint8_t *bits, esp32Modbus::ModbusPriority priority)
+{
+  if (numberCoils == 0 || numberCoils > MODBUS_MAX_WRITE_COILS || bits == nullptr) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("writeMultipleCoilsPacked: Invalid parameters (coils=%d, max=%d)", numberCoils, MODBUS_MAX_WRITE_COILS);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest0F(slaveAddress, address, numberCoils, bits);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+// ===== Device identification =====
+
+bool esp32ModbusRTU::readDeviceIdentification(uint8_t slaveAddress, uint8_t *buffer, uint16_t capacity, esp32Modbus::MBRTUOnDeviceId onDeviceId, esp32Modbus::DeviceIdCode code, uint8_t objectId, esp32Modbus::ModbusPriority priority)
+{
+  if (buffer == nullptr || capacity == 0 || code < esp32Modbus::DEVICE_ID_BASIC || code > esp32Modbus::DEVICE_ID_SPECIFIC) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readDeviceIdentification: Invalid parameters (capacity=%d, code=%d)", capacity, code);
+    #endif
+    return false;
+  }
+
+  DeviceIdOperation *operation = new DeviceIdOperation(slaveAddress, code, objectId, buffer, capacity, onDeviceId, _onError);
+  return _submit(operation, priority);
+}
+
+// ===== Diagnostics =====
+
+bool esp32ModbusRTU::diagnostics(uint8_t slaveAddress, uint16_t subFunction, uint16_t data, esp32Modbus::ModbusPriority priority)
+{
+  ModbusRequest *request = new ModbusRequest08(slaveAddress, subFunction, data);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::clearDiagnosticCounters(uint8_t slaveAddress, esp32Modbus::ModbusPriority priority)
+{
+  return diagnostics(slaveAddress, esp32Modbus::DIAG_CLEAR_COUNTERS, 0, priority);
+}
+
+bool esp32ModbusRTU::readDiagnosticCounters(uint8_t slaveAddress, esp32Modbus::MBRTUOnDiagnostics onCounters, esp32Modbus::ModbusPriority priority)
+{
+  DiagnosticCountersOperation *operation = new DiagnosticCountersOperation(slaveAddress, onCounters, _onError);
+  return _submit(operation, priority);
+}
+
+bool esp32ModbusRTU::getCommEventCounter(uint8_t slaveAddress, esp32Modbus::MBRTUOnCommEventCounter onCounter, esp32Modbus::ModbusPriority priority)
+{
+  CommEventOperation *operation = new CommEventOperation(slaveAddress, onCounter, nullptr, _onError);
+  return _submit(operation, priority);
+}
+
+bool esp32ModbusRTU::getCommEventLog(uint8_t slaveAddress, esp32Modbus::MBRTUOnCommEventLog onLog, esp32Modbus::ModbusPriority priority)
+{
+  if (!onLog) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("getCommEventLog: no callback given");
+    #endif
+    return false;
+  }
+  CommEventOperation *operation = new CommEventOperation(slaveAddress, nullptr, onLog, _onError);
+  return _submit(operation, priority);
+}
+
+bool esp32ModbusRTU::probeLatency(uint8_t slaveAddress, uint16_t probes, esp32Modbus::MBRTUOnLatency onLatency, esp32Modbus::ModbusPriority priority)
+{
+  if (probes == 0) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("probeLatency: Invalid parameters (probes=%d)", probes);
+    #endif
+    return false;
+  }
+  LoopbackOperation *operation = new LoopbackOperation(slaveAddress, probes, onLatency, _onError);
+  return _submit(operation, priority);
+}
+
+// ===== Split reads =====
+
+bool esp32ModbusRTU::readCoilsSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  return _readSplit(slaveAddress, esp32Modbus::READ_COIL, address, numberCoils, priority, onChunkError);
+}
+
+bool esp32ModbusRTU::readDiscreteInputsSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  return _readSplit(slaveAddress, esp32Modbus::READ_DISCR_INPUT, address, numberCoils, priority, onChunkError);
+}
+
+bool esp32ModbusRTU::readHoldingRegistersSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  return _readSplit(slaveAddress, esp32Modbus::READ_HOLD_REGISTER, address, numberRegisters, priority, onChunkError);
+}
+
+bool esp32ModbusRTU::readInputRegistersSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  return _readSplit(slaveAddress, esp32Modbus::READ_INPUT_REGISTER, address, numberRegisters, priority, onChunkError);
+}
+
+bool esp32ModbusRTU::_readSplit(uint8_t slaveAddress, esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t count, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  // Validate parameters: the range must not wrap around the address space
+  if (count == 0 || static_cast<uint32_t>(address) + count > 0x10000) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("_readSplit: Invalid parameters (address=%d, count=%d)", address, count);
+    #endif
+    return false;
+  }
+
+  // The joined payload goes through change-only delivery like any other read
+  SplitReadOperation *operation = new SplitReadOperation(slaveAddress, functionCode, address, count,
+    [this, count](uint8_t slave, esp32Modbus::FunctionCode fc, uint16_t first, uint8_t *data, uint16_t length) {
+      _deliverPayload(slave, fc, first, count, data, length);
+    }, _chunkErrorHandler(onChunkError));
+  if (!operation->isValid()) {
+    MODBUS_LOG_E("_readSplit: failed to allocate %d items", count);
+    delete operation;
+    return false;
+  }
+  return _submit(operation, priority);
+}
+
+// ===== Bulk writes =====
+
+bool esp32ModbusRTU::writeHoldingRegistersBulk(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, const uint8_t *data, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnProgress onProgress, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  // Validate parameters: the range must not wrap around the address space
+  if (numberRegisters == 0 || data == nullptr || static_cast<uint32_t>(address) + numberRegisters > 0x10000) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("writeHoldingRegistersBulk: Invalid parameters (address=%d, registers=%d)", address, numberRegisters);
+    #endif
+    return false;
+  }
+
+  BulkWriteOperation *operation = new BulkWriteOperation(slaveAddress, address, numberRegisters, data, onProgress, _chunkErrorHandler(onChunkError));
+  if (!operation->isValid()) {
+    MODBUS_LOG_E("writeHoldingRegistersBulk: failed to allocate %d registers", numberRegisters);
+    delete operation;
+    return false;
+  }
+  return _submit(operation, priority);
+}
+
+bool esp32ModbusRTU::readHoldingRegistersInto(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint16_t *values, esp32Modbus::ModbusPriority priority)
+{
+  if (values == nullptr || numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readHoldingRegistersInto: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest03(slaveAddress, address, numberRegisters);
+  request->setDestination(values);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::readInputRegistersInto(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint16_t *values, esp32Modbus::ModbusPriority priority)
+{
+  if (values == nullptr || numberRegisters == 0 || numberRegisters > MODBUS_MAX_REGISTERS) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readInputRegistersInto: Invalid parameters (registers=%d, max=%d)", numberRegisters, MODBUS_MAX_REGISTERS);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest04(slaveAddress, address, numberRegisters);
+  request->setDestination(values);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+// ===== File records =====
+
+bool esp32ModbusRTU::readFileRecords(uint8_t slaveAddress, const esp32Modbus::FileRecordRef *refs, uint8_t count, esp32Modbus::ModbusPriority priority)
+{
+  if (fileRecordByteCount(refs, count, false) == 0) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readFileRecords: Invalid parameters (sub-requests=%d)", count);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest14(slaveAddress, refs, count);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::writeFileRecords(uint8_t slaveAddress, const esp32Modbus::FileRecordRef *refs, uint8_t count, const uint8_t *data, esp32Modbus::ModbusPriority priority)
+{
+  if (data == nullptr || fileRecordByteCount(refs, count, true) == 0) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("writeFileRecords: Invalid parameters (sub-requests=%d)", count);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequest15(slaveAddress, refs, count, data);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::readFile(uint8_t slaveAddress, uint16_t file, uint16_t record, uint16_t count, esp32Modbus::MBRTUOnFileRecords onRecords, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  if (file == 0 || count == 0 || record > MODBUS_MAX_FILE_RECORD || count > MODBUS_MAX_FILE_RECORD + 1 - record) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("readFile: Invalid parameters (file=%d, record=%d, count=%d)", file, record, count);
+    #endif
+    return false;
+  }
+
+  FileReadOperation *operation = new FileReadOperation(slaveAddress, file, record, count, onRecords, _chunkErrorHandler(onChunkError));
+  return _submit(operation, priority);
+}
+
+// ===== Raw requests =====
+
+bool esp32ModbusRTU::sendRawRequest(uint8_t slaveAddress, uint8_t functionCode, const uint8_t *data, uint8_t length, uint8_t responseDataLength, esp32Modbus::ModbusPriority priority)
+{
+  if (functionCode == 0 || (functionCode & MODBUS_ERROR_FLAG) || (length > 0 && data == nullptr) ||
+      length > MODBUS_MAX_RAW_DATA || responseDataLength > MODBUS_MAX_RAW_DATA) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("sendRawRequest: Invalid parameters (FC=0x%02X, length=%d, response=%d)", functionCode, length, responseDataLength);
+    #endif
+    return false;
+  }
+
+  ModbusRequest *request = new ModbusRequestRaw(slaveAddress, functionCode, data, length, responseDataLength);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::forwardRequest(uint8_t slaveAddress, uint8_t functionCode, const uint8_t *data, uint8_t length, esp32Modbus::MBRTUOnReply onReply, esp32Modbus::ModbusPriority priority)
+{
+  if (functionCode == 0 || (functionCode & MODBUS_ERROR_FLAG) || (length > 0 && data == nullptr) ||
+      length > MODBUS_MAX_RAW_DATA || !onReply) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("forwardRequest: Invalid parameters (FC=0x%02X, length=%d)", functionCode, length);
+    #endif
+    return false;
+  }
+  return _submit(new ForwardOperation(slaveAddress, functionCode, data, length, onReply), priority);
+}
+
+// ===== FIFO queues =====
+
+bool esp32ModbusRTU::readFifoQueue(uint8_t slaveAddress, uint16_t pointerAddress, esp32Modbus::ModbusPriority priority)
+{
+  ModbusRequest *request = new ModbusRequest18(slaveAddress, pointerAddress);
+  request->setPriority(priority);
+  return _addToQueue(request);
+}
+
+bool esp32ModbusRTU::drainFifoQueue(uint8_t slaveAddress, uint16_t pointerAddress, esp32Modbus::MBRTUOnFifo onFifo, esp32Modbus::ModbusPriority priority, uint16_t maxReads)
+{
+  if (!onFifo) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("drainFifoQueue: no callback given");
+    #endif
+    return false;
+  }
+
+  FifoDrainOperation *operation = new FifoDrainOperation(slaveAddress, pointerAddress, maxReads, onFifo, _onError);
+  return _submit(operation, priority);
+}
+
+// Chunk errors go to onError when the caller did not pass its own handler
+esp32Modbus::MBRTUOnChunkError esp32ModbusRTU::_chunkErrorHandler(esp32Modbus::MBRTUOnChunkError onChunkError)
+{
+  if (onChunkError) {
+    return onChunkError;
+  }
+  esp32Modbus::MBRTUOnError onError = _onError;
+  return [onError](uint8_t slaveAddress, esp32Modbus::Error error, uint16_t chunk, uint16_t address) {
+    (void)chunk;
+    (void)address;
+    if (onError) {
+      onError(slaveAddress, error);
+    }
+  };
+}
+
+void esp32ModbusRTU::onData(esp32Modbus::MBRTUOnData handler)
+{
+  _onData = handler;
+}
+
+void esp32ModbusRTU::onError(esp32Modbus::MBRTUOnError handler)
+{
+  _onError = handler;
+}
+
+void esp32ModbusRTU::onRegisters(esp32Modbus::MBRTUOnRegisters handler)
+{
+  _onRegisters = handler;
+}
+
+void esp32ModbusRTU::setDeltaMode(bool enabled)
+{
+  _deltaMode = enabled;
+}
+
+void esp32ModbusRTU::onDataChanged(esp32Modbus::MBRTUOnDataChanged handler)
+{
+  _onDataChanged = handler;
+}
+
+void esp32ModbusRTU::resetDeltaState()
+{
+  _deltaReset = true;  // handled by the worker task, which owns the filter
+}
+
+void esp32ModbusRTU::setRetryPolicy(esp32Modbus::ModbusPriority priority, const esp32Modbus::RetryPolicy &policy)
+{
+  if (static_cast<uint8_t>(priority) >= 4 || _retryLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(_retryLock, portMAX_DELAY);
+  _retryPolicies[priority] = policy;
+  xSemaphoreGive(_retryLock);
+}
+
+bool esp32ModbusRTU::getRetryCounters(uint8_t slaveAddress, esp32Modbus::RetryCounters *counters) const
+{
+  if (counters == nullptr || _retryLock == nullptr) {
+    return false;
+  }
+  xSemaphoreTake(_retryLock, portMAX_DELAY);
+  bool found = _retryStats.get(slaveAddress, counters);
+  xSemaphoreGive(_retryLock);
+  return found;
+}
+
+esp32Modbus::RetryCounters esp32ModbusRTU::getRetryTotals() const
+{
+  esp32Modbus::RetryCounters totals = {0, 0, 0, 0, 0};
+  if (_retryLock == nullptr) {
+    return totals;
+  }
+  xSemaphoreTake(_retryLock, portMAX_DELAY);
+  totals = _retryStats.totals();
+  xSemaphoreGive(_retryLock);
+  return totals;
+}
+
+void esp32ModbusRTU::resetRetryCounters()
+{
+  if (_retryLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(_retryLock, portMAX_DELAY);
+  _retryStats.reset();
+  xSemaphoreGive(_retryLock);
+}
+
+bool esp32ModbusRTU::getLatency(uint8_t slaveAddress, uint8_t functionCode, esp32Modbus::LatencyStage stage,
+                                esp32Modbus::LatencySnapshot *snapshot) const
+{
+  if (snapshot == nullptr) {
+    return false;
+  }
+  return _latencyStats.get(slaveAddress, functionCode, stage, snapshot);
+}
+
+esp32Modbus::LatencySnapshot esp32ModbusRTU::getLatencyTotals(esp32Modbus::LatencyStage stage) const
+{
+  return _latencyStats.totals(stage);
+}
+
+void esp32ModbusRTU::resetLatency()
+{
+  _latencyStats.reset();
+}
+
+esp32Modbus::BusUsage esp32ModbusRTU::getBusUsage() const
+{
+  return _busMeter.total();
+}
+
+esp32Modbus::BusUsage esp32ModbusRTU::getBusUsageLastSecond() const
+{
+  return _busMeter.lastSecond();
+}
+
+bool esp32ModbusRTU::enableTrace(size_t bytes)
+{
+  if (_trace.load() != nullptr) {
+    return true;  // the ring keeps its size
+  }
+  if (bytes < FrameTrace::RECORD_HEADER + MODBUS_RTU_MAX_ADU) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("enableTrace: ring of %u bytes cannot hold a frame", static_cast<unsigned>(bytes));
+    #endif
+    return false;
+  }
+  // Another task may enable it at the same time: the first ring stays
+  FrameTrace *trace = new FrameTrace(bytes);
+  FrameTrace *expected = nullptr;
+  if (!_trace.compare_exchange_strong(expected, trace, std::memory_order_acq_rel)) {
+    delete trace;
+  }
+  return true;
+}
+
+bool esp32ModbusRTU::exportTrace(const esp32Modbus::MBTraceWriter &write) const
+{
+  FrameTrace *trace = _trace.load(std::memory_order_acquire);
+  if (trace == nullptr || !write) {
+    return false;
+  }
+  return trace->exportPcapng(write);
+}
+
+void esp32ModbusRTU::clearTrace()
+{
+  FrameTrace *trace = _trace.load(std::memory_order_acquire);
+  if (trace != nullptr) {
+    trace->clear();
+  }
+}
+
+bool esp32ModbusRTU::enableRegisterCache()
+{
+  if (_cacheLock == nullptr) {
+    _cacheLock = xSemaphoreCreateMutex();
+    if (_cacheLock == nullptr) {
+      MODBUS_LOG_E("enableRegisterCache: failed to create mutex");
+      return false;
+    }
+  }
+  xSemaphoreTake(_cacheLock, portMAX_DELAY);
+  if (_cache == nullptr) {
+    _cache = new RegisterCache();
+  }
+  bool enabled = (_cache != nullptr);
+  xSemaphoreGive(_cacheLock);
+  return enabled;
+}
+
+void esp32ModbusRTU::disableRegisterCache()
 {
-  ModbusRequest *request = new ModbusRequest03(slaveAddress, address, numberRegisters);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  if (_cacheLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(_cacheLock, portMAX_DELAY);
+  delete _cache;
+  _cache = nullptr;
+  xSemaphoreGive(_cacheLock);
 }
 
-bool esp32ModbusRTU::readInputRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority)
+esp32Modbus::CacheResult esp32ModbusRTU::readCoilsCached(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, uint32_t maxAgeMs, bool *values, esp32Modbus::ModbusPriority priority)
 {
-  ModbusRequest *request = new ModbusRequest04(slaveAddress, address, numberRegisters);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  if (values != nullptr && _loadCached(slaveAddress, TABLE_COILS, address, numberCoils, maxAgeMs, values)) {
+    return esp32Modbus::CACHE_HIT;
+  }
+  return readCoilsWithPriority(slaveAddress, address, numberCoils, priority) ? esp32Modbus::CACHE_QUEUED : esp32Modbus::CACHE_FAILED;
 }
 
-bool esp32ModbusRTU::writeSingleCoilWithPriority(uint8_t slaveAddress, uint16_t address, bool value, esp32Modbus::ModbusPriority priority)
+esp32Modbus::CacheResult esp32ModbusRTU::readDiscreteInputsCached(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, uint32_t maxAgeMs, bool *values, esp32Modbus::ModbusPriority priority)
 {
-  ModbusRequest *request = new ModbusRequest05(slaveAddress, address, value);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  if (values != nullptr && _loadCached(slaveAddress, TABLE_DISCRETE_INPUTS, address, numberCoils, maxAgeMs, values)) {
+    return esp32Modbus::CACHE_HIT;
+  }
+  return readDiscreteInputsWithPriority(slaveAddress, address, numberCoils, priority) ? esp32Modbus::CACHE_QUEUED : esp32Modbus::CACHE_FAILED;
 }
 
-bool esp32ModbusRTU::writeSingleHoldingRegisterWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t data, esp32Modbus::ModbusPriority priority)
+esp32Modbus::CacheResult esp32ModbusRTU::readHoldingRegistersCached(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint32_t maxAgeMs, uint16_t *values, esp32Modbus::ModbusPriority priority)
 {
-  ModbusRequest *request = new ModbusRequest06(slaveAddress, address, data);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  if (values != nullptr && _loadCached(slaveAddress, TABLE_HOLDING_REGISTERS, address, numberRegisters, maxAgeMs, values)) {
+    return esp32Modbus::CACHE_HIT;
+  }
+  return readHoldingRegistersWithPriority(slaveAddress, address, numberRegisters, priority) ? esp32Modbus::CACHE_QUEUED : esp32Modbus::CACHE_FAILED;
 }
 
-bool esp32ModbusRTU::writeMultipleCoilsWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, bool *values, esp32Modbus::ModbusPriority priority)
+esp32Modbus::CacheResult esp32ModbusRTU::readInputRegistersCached(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint32_t maxAgeMs, uint16_t *values, esp32Modbus::ModbusPriority priority)
 {
-  ModbusRequest *request = new ModbusRequest0F(slaveAddress, address, numberCoils, values);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  if (values != nullptr && _loadCached(slaveAddress, TABLE_INPUT_REGISTERS, address, numberRegisters, maxAgeMs, values)) {
+    return esp32Modbus::CACHE_HIT;
+  }
+  return readInputRegistersWithPriority(slaveAddress, address, numberRegisters, priority) ? esp32Modbus::CACHE_QUEUED : esp32Modbus::CACHE_FAILED;
 }
 
-bool esp32ModbusRTU::writeMultHoldingRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint8_t *data, esp32Modbus::ModbusPriority priority)
+esp32Modbus::CacheStats esp32ModbusRTU::getCacheStats()
 {
-  ModbusRequest *request = new ModbusRequest16(slaveAddress, address, numberRegisters, data);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  esp32Modbus::CacheStats stats = {0, 0};
+  if (_cacheLock == nullptr) {
+    return stats;
+  }
+  xSemaphoreTake(_cacheLock, portMAX_DELAY);
+  if (_cache != nullptr) {
+    stats.hits = _cache->hits();
+    stats.misses = _cache->misses();
+  }
+  xSemaphoreGive(_cacheLock);
+  return stats;
 }
 
-bool esp32ModbusRTU::readWriteMultipleRegistersWithPriority(uint8_t slaveAddress, uint16_t readAddress, uint16_t readCount, uint16_t writeAddress, uint16_t writeCount, uint16_t *writeData, esp32Modbus::ModbusPriority priority)
+bool esp32ModbusRTU::_loadCached(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count, uint32_t maxAgeMs, uint16_t *values)
 {
-  // Validate parameters
-  if (readCount == 0 || readCount > MODBUS_MAX_REGISTERS ||
-      writeCount == 0 || writeCount > MODBUS_MAX_REGISTERS ||
-      writeData == nullptr) {
-    #ifdef MODBUS_RTU_DEBUG
-    MODBUS_LOG_E("readWriteMultipleRegistersWithPriority: Invalid parameters (read=%d, write=%d, max=%d)",
-                  readCount, writeCount, MODBUS_MAX_REGISTERS);
-    #endif
+  if (_cacheLock == nullptr || count == 0) {
     return false;
   }
-
-  ModbusRequest *request = new ModbusRequest17(slaveAddress, readAddress, readCount, writeAddress, writeCount, writeData);
-  request->setPriority(priority);
-  return _addToQueue(request);
+  bool hit = false;
+  xSemaphoreTake(_cacheLock, portMAX_DELAY);
+  if (_cache != nullptr) {
+    hit = _cache->load(slaveAddress, table, address, count, maxAgeMs, millis(), values);
+  }
+  xSemaphoreGive(_cacheLock);
+  return hit;
 }
 
-void esp32ModbusRTU::onData(esp32Modbus::MBRTUOnData handler)
+bool esp32ModbusRTU::_loadCached(uint8_t slaveAddress, RegisterTable table, uint16_t address, uint16_t count, uint32_t maxAgeMs, bool *values)
 {
-  _onData = handler;
+  if (_cacheLock == nullptr || count == 0) {
+    return false;
+  }
+  bool hit = false;
+  xSemaphoreTake(_cacheLock, portMAX_DELAY);
+  if (_cache != nullptr) {
+    hit = _cache->load(slaveAddress, table, address, count, maxAgeMs, millis(), values);
+  }
+  xSemaphoreGive(_cacheLock);
+  return hit;
 }
 
-void esp32ModbusRTU::onError(esp32Modbus::MBRTUOnError handler)
+void esp32ModbusRTU::_updateCache(ModbusRequest *request, ModbusResponse *response)
 {
-  _onError = handler;
+  if (_cacheLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(_cacheLock, portMAX_DELAY);
+  if (_cache != nullptr && (request->getSlaveAddress() == MODBUS_BROADCAST_ADDRESS || response->getError() != esp32Modbus::SUCCESS)) {
+    // the slaves that took a broadcast are unknown, and a failed write may or
+    // may not have been applied: none of them keeps the old values
+    _cache->invalidateWrite(request->getMessage(), request->getSize());
+  } else if (_cache != nullptr) {
+    _cache->update(request->getMessage(), request->getSize(), response->getMessage(), response->getSize(), millis());
+  }
+  xSemaphoreGive(_cacheLock);
 }
 
 bool esp32ModbusRTU::_addToQueue(ModbusRequest *request)
@@ -366,6 +1105,29 @@ bool esp32ModbusRTU::_addToQueue(ModbusRequest *request)
     return false;
   }
 
+  // A broadcast read would never be answered, and a raw request's echo is unknown.
+  // On shutdown the destructor queues a read from address 0 to wake the worker,
+  // which drops it unsent.
+  if (!_shutdown && request->getSlaveAddress() == MODBUS_BROADCAST_ADDRESS &&
+      (request->isRaw() || !isBroadcastable(request->getFunctionCode())))
+  {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("_addToQueue: FC 0x%02X cannot be broadcast", request->getFunctionCode());
+    #endif
+    delete request;
+    return false;
+  }
+
+  // A slave does not send requests; on shutdown the wake-up read is let through
+  if (!_shutdown && _server != nullptr)
+  {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_E("_addToQueue: instance is in slave mode");
+    #endif
+    delete request;
+    return false;
+  }
+
   // Get priority from request
   esp32Modbus::ModbusPriority priority = request->getPriority();
   uint8_t queueIndex = static_cast<uint8_t>(priority);
@@ -401,6 +1163,7 @@ bool esp32ModbusRTU::_addToQueue(ModbusRequest *request)
   }
 
   // Enqueue into appropriate priority queue
+  request->setQueuedMicros(micros());
   if (xQueueSend(_queues[queueIndex], reinterpret_cast<void *>(&request), (TickType_t)0) != pdPASS)
   {
     #ifdef MODBUS_RTU_DEBUG
@@ -415,27 +1178,175 @@ bool esp32ModbusRTU::_addToQueue(ModbusRequest *request)
   return true;
 }
 
-ModbusRequest* esp32ModbusRTU::_dequeueByPriority()
+ModbusRequest* esp32ModbusRTU::_dequeueByPriority(bool *continuation)
 {
   ModbusRequest* request = nullptr;
 
-  // Check queues in priority order (EMERGENCY=0 first, STATUS=3 last)
+  // The order is decided by nextToServe(), which the trace replay runs on the host too
+  uint8_t continuations = 0;
+  uint8_t queued = 0;
   for (int priority = 0; priority < 4; priority++) {
-    if (_queues[priority] != nullptr) {
-      if (xQueueReceive(_queues[priority], &request, 0) == pdTRUE) {
-        #ifdef MODBUS_RTU_DEBUG
-        MODBUS_LOG_D("Dequeued request from priority %s queue",
-                     esp32Modbus::getPriorityDescription(static_cast<esp32Modbus::ModbusPriority>(priority)));
-        #endif
-        return request;  // Found request in this priority
+    if (_continuations[priority] != nullptr)
+      continuations |= 1 << priority;
+    if (_queues[priority] != nullptr && uxQueueMessagesWaiting(_queues[priority]) > 0)
+      queued |= 1 << priority;
+  }
+  ScheduleChoice choice = nextToServe(continuations, queued);
+  if (continuation != nullptr)
+    *continuation = choice.continuation;
+  if (choice.priority < 0)
+    return nullptr;  // No requests in any queue
+
+  if (choice.continuation) {
+    request = _continuations[choice.priority];
+    _continuations[choice.priority] = nullptr;
+    return request;
+  }
+  if (xQueueReceive(_queues[choice.priority], &request, 0) == pdTRUE) {
+    #ifdef MODBUS_RTU_DEBUG
+    MODBUS_LOG_D("Dequeued request from priority %s queue",
+                 esp32Modbus::getPriorityDescription(static_cast<esp32Modbus::ModbusPriority>(choice.priority)));
+    #endif
+    return request;
+  }
+  return nullptr;
+}
+
+void esp32ModbusRTU::_deliverData(ModbusRequest *request, ModbusResponse *response)
+{
+  esp32Modbus::FunctionCode fc = response->getFunctionCode();
+  if (response->isDirect())
+  {
+    // registers are already in the caller's buffer
+    if (_onRegisters)
+      _onRegisters(response->getSlaveAddress(), fc, request->getAddress(), request->getDestination(), request->getByteCount() / 2);
+    return;
+  }
+
+  // FC01-04 and FC17 ask for their (read) count at the same place
+  uint8_t *message = request->getMessage();
+  _deliverPayload(response->getSlaveAddress(), fc, request->getAddress(), message[4] << 8 | message[5],
+                  response->getData(), response->getByteCount());
+}
+
+void esp32ModbusRTU::_deliverPayload(uint8_t slaveAddress, esp32Modbus::FunctionCode fc, uint16_t address, uint16_t count,
+                                     uint8_t *data, uint16_t length)
+{
+  bool isRead = (fc == esp32Modbus::READ_COIL || fc == esp32Modbus::READ_DISCR_INPUT ||
+                 fc == esp32Modbus::READ_HOLD_REGISTER || fc == esp32Modbus::READ_INPUT_REGISTER ||
+                 fc == esp32Modbus::READ_WRITE_MULT_REGISTERS);
+
+  if (isRead && (_deltaMode || _onDataChanged))
+  {
+    if (_deltaFilter == nullptr)
+      _deltaFilter = new DeltaFilter();
+    if (_deltaReset.exchange(false))
+      _deltaFilter->clear();
+
+    bool changed = _deltaFilter->update(slaveAddress, fc, address, count, data, length, _dirty);
+    if (changed && _onDataChanged)
+      _onDataChanged(slaveAddress, fc, address, data, length, _dirty);
+    if (!changed && _deltaMode)
+      return;  // unchanged, suppress onData
+  }
+
+  if (_onData)
+    _onData(slaveAddress, fc, address, data, length);
+}
+
+bool esp32ModbusRTU::_submit(ModbusOperation *operation, esp32Modbus::ModbusPriority priority)
+{
+  ModbusRequest *request = operation->next();
+  if (request == nullptr) {
+    delete operation;
+    return false;
+  }
+  request->setOperation(operation);
+  request->setPriority(priority);
+  if (!_addToQueue(request)) {  // deletes the request on failure
+    delete operation;
+    return false;
+  }
+  return true;
+}
+
+void esp32ModbusRTU::_continueOperation(ModbusRequest *request, ModbusResponse *response)
+{
+  ModbusOperation *operation = request->getOperation();
+  operation->onResponse(request, response);
+
+  ModbusRequest *next = _shutdown ? nullptr : operation->next();
+  if (next == nullptr) {
+    delete operation;  // finished
+    return;
+  }
+  next->setOperation(operation);
+  next->setPriority(request->getPriority());
+  next->setQueuedMicros(micros());
+  _continuations[request->getPriority()] = next;
+}
+
+bool esp32ModbusRTU::_scheduleRetry(ModbusRequest *request, esp32Modbus::Error error)
+{
+  if (!esp32Modbus::isRetryable(error) || _shutdown || _retryLock == nullptr) {
+    return false;
+  }
+
+  xSemaphoreTake(_retryLock, portMAX_DELAY);
+  esp32Modbus::RetryPolicy policy = _retryPolicies[request->getPriority()];
+  xSemaphoreGive(_retryLock);
+  if (request->getRetries() >= policy.maxRetries) {
+    return false;
+  }
+
+  // Park the request; the worker requeues it once its backoff has expired
+  for (int i = 0; i < MODBUS_RETRY_SLOTS; i++) {
+    if (_retryPending[i] == nullptr) {
+      request->scheduleRetry(millis() + policy.backoff(request->getRetries() + 1));
+      _retryPending[i] = request;
+      xSemaphoreTake(_retryLock, portMAX_DELAY);
+      _retryStats.record(request->getSlaveAddress(), error);
+      xSemaphoreGive(_retryLock);
+      MODBUS_LOG_D("Retry %d/%d for address 0x%02X after %s",
+                   request->getRetries(), policy.maxRetries,
+                   request->getSlaveAddress(), esp32Modbus::getErrorDescription(error));
+      return true;
+    }
+  }
+
+  MODBUS_LOG_W("No free retry slot, reporting error for address 0x%02X", request->getSlaveAddress());
+  return false;
+}
+
+uint32_t esp32ModbusRTU::_promoteDueRetries()
+{
+  uint32_t nextDue = UINT32_MAX;
+  uint32_t now = millis();
+
+  for (int i = 0; i < MODBUS_RETRY_SLOTS; i++) {
+    ModbusRequest *request = _retryPending[i];
+    if (request == nullptr) {
+      continue;
+    }
+    int32_t remaining = static_cast<int32_t>(request->getRetryAt() - now);
+    if (remaining > 0) {
+      if (static_cast<uint32_t>(remaining) < nextDue) {
+        nextDue = remaining;
       }
+      continue;
+    }
+    // Due: back to the front of its own queue, it was submitted before anything queued there now
+    if (xQueueSendToFront(_queues[request->getPriority()], reinterpret_cast<void *>(&request), (TickType_t)0) == pdPASS) {
+      _retryPending[i] = nullptr;
+    } else {
+      nextDue = 0;  // queue full, try again on the next pass
     }
   }
 
-  return nullptr;  // No requests in any queue
+  return nextDue;
 }
 
-void esp32ModbusRTU::_handleConnection(esp32ModbusRTU *instance)
+void esp32ModbusRTU::_registerWatchdog(esp32ModbusRTU *instance)
 {
   // Debug: Log once at task start
   static bool taskStartLogged = false;
@@ -510,19 +1421,59 @@ void esp32ModbusRTU::_handleConnection(esp32ModbusRTU *instance)
     }
   }
   #endif
-  
+}
+
+void esp32ModbusRTU::_unregisterWatchdog(esp32ModbusRTU *instance)
+{
+  #if MODBUS_USE_WATCHDOG
+  if (_globalWatchdogActive && instance->_watchdogEnabled) {
+    // Try to unsubscribe cleanly before task exits
+    #if WATCHDOG_CLASS_AVAILABLE
+      Watchdog& watchdog = Watchdog::getInstance();
+      watchdog.unregisterCurrentTask();
+    #else
+      TaskHandle_t currentTask = xTaskGetCurrentTaskHandle();
+      esp_task_wdt_delete(currentTask);
+    #endif
+  }
+  #endif
+}
+
+// Only if registered and not shutting down
+void esp32ModbusRTU::_feedWatchdog()
+{
+  #if MODBUS_USE_WATCHDOG
+  if (_globalWatchdogActive && !_shutdown && _watchdogEnabled) {
+    #if WATCHDOG_CLASS_AVAILABLE
+      Watchdog::quickFeed();
+    #else
+      esp_task_wdt_reset();
+    #endif
+  }
+  #endif
+}
+
+void esp32ModbusRTU::_handleConnection(esp32ModbusRTU *instance)
+{
+  _registerWatchdog(instance);
+
   while (!instance->_shutdown)
   {
     ModbusRequest *request = nullptr;
 
+    // Retries whose backoff has expired compete with regular traffic again
+    uint32_t nextRetry = instance->_promoteDueRetries();
+
     // Try to dequeue from priority queues (non-blocking check)
-    request = instance->_dequeueByPriority();
+    bool continuation = false;
+    request = instance->_dequeueByPriority(&continuation);
 
     // If we got a request, process it
     if (request != nullptr)
     {
       if (instance->_shutdown)
       {
+        delete request->getOperation();
         delete request;
         break;  // Exit the loop on shutdown
       }
@@ -530,13 +1481,51 @@ void esp32ModbusRTU::_handleConnection(esp32ModbusRTU *instance)
       // block and wait for queued item
       MODBUS_TIME_START();
       instance->_send(request->getMessage(), request->getSize());
-      ModbusResponse *response = instance->_receive(request);
+      // Received into the worker's frame buffer: no allocation per transaction,
+      // and a register read is converted straight into the caller's array
+      ModbusResponse received(instance->_rxFrame, request);
+      ModbusResponse *response = &received;
+      instance->_receive(request, response);
+      uint32_t doneMicros = micros();
+      instance->_busMeter.enter(BUS_IDLE, doneMicros);
       MODBUS_TIME_END("Request/Response cycle");
       
-      if (response->isSuccess())
+      bool success = response->isSuccess();
+      FrameTrace *trace = instance->_trace.load(std::memory_order_acquire);
+      if (trace != nullptr)
+      {
+        trace->captureRequest(request->getPriority(), continuation, request->getRetries(),
+                              instance->_txStartMicros - request->getQueuedMicros(),
+                              request->getMessage(), request->getSize(), instance->_txStartMicros);
+      }
+      if (trace != nullptr && request->getSlaveAddress() != MODBUS_BROADCAST_ADDRESS)
+      {
+        trace->capture(TRACE_RX, request->getSlaveAddress(), response->getError(), response->getMessage(), response->getSize(), doneMicros);
+      }
+      instance->_updateCache(request, response);  // failed writes too
+
+      // A request parked for retry is recorded once its last attempt is done,
+      // with the queue wait counted from its first submission
+      bool retried = !success && instance->_scheduleRetry(request, response->getError());
+      if (!retried)
+      {
+        instance->_latencyStats.record(request->getSlaveAddress(), request->getFunctionCode(),
+                                       instance->_txStartMicros - request->getQueuedMicros(),
+                                       doneMicros - instance->_txStartMicros);
+      }
+
+      if (retried)
+      {
+        request = nullptr;  // parked for retry, ownership moved to _retryPending
+      }
+      else if (request->getOperation() != nullptr)
       {
-        if (instance->_onData)
-          instance->_onData(response->getSlaveAddress(), response->getFunctionCode(), request->getAddress(), response->getData(), response->getByteCount());
+        // Part of a multi-request operation, which handles the outcome itself
+        instance->_continueOperation(request, response);
+      }
+      else if (success)
+      {
+        instance->_deliverData(request, response);
       }
       else
       {
@@ -550,56 +1539,96 @@ void esp32ModbusRTU::_handleConnection(esp32ModbusRTU *instance)
         if (instance->_onError)
           instance->_onError(request->getSlaveAddress(), error);  // F18: pass slave address
       }
-      delete request;  // object created in public methods
-      delete response; // object created in _receive()
-      
-      #if MODBUS_USE_WATCHDOG
-      // Feed watchdog after processing request (only if registered and not shutting down)
-      if (_globalWatchdogActive && !instance->_shutdown && instance->_watchdogEnabled) {
-        #if WATCHDOG_CLASS_AVAILABLE
-          Watchdog::quickFeed();
-        #else
-          esp_task_wdt_reset();
-        #endif
-      }
-      #endif
+      delete request;  // object created in public methods (nullptr when parked for retry)
+
+      // Feed watchdog after processing request
+      instance->_feedWatchdog();
     }
     else
     {
-      // No requests available in any priority queue - wait before checking again
-      vTaskDelay(pdMS_TO_TICKS(100));  // 100ms delay to avoid busy-waiting
-
-      #if MODBUS_USE_WATCHDOG
-      // No message received, feed the watchdog (only if registered and not shutting down)
-      if (_globalWatchdogActive && !instance->_shutdown && instance->_watchdogEnabled) {
-        #if WATCHDOG_CLASS_AVAILABLE
-          Watchdog::quickFeed();
-        #else
-          esp_task_wdt_reset();
-        #endif
-      }
-      #endif
+      // No requests available in any priority queue - wait before checking again,
+      // but not beyond the moment the next retry becomes due
+      instance->_busMeter.enter(BUS_IDLE, micros());  // also ends the second for getBusUsage()
+      uint32_t idleMs = nextRetry < 100 ? nextRetry : 100;
+      vTaskDelay(pdMS_TO_TICKS(idleMs > 0 ? idleMs : 1));  // avoid busy-waiting
+
+      // No message received, feed the watchdog
+      instance->_feedWatchdog();
     }
   }
   
   // Task is exiting due to shutdown
-  #if MODBUS_USE_WATCHDOG
-  if (_globalWatchdogActive && instance->_watchdogEnabled) {
-    // Try to unsubscribe cleanly before task exits
-    #if WATCHDOG_CLASS_AVAILABLE
-      Watchdog& watchdog = Watchdog::getInstance();
-      watchdog.unregisterCurrentTask();
-    #else
-      TaskHandle_t currentTask = xTaskGetCurrentTaskHandle();
-      esp_task_wdt_delete(currentTask);
-    #endif
-  }
-  #endif
-  
+  _unregisterWatchdog(instance);
+
   // Delete ourselves
   vTaskDelete(NULL);
 }
 
+// Slave mode task: frames requests as they arrive (the length hint ends most of
+// them on their last byte, without waiting for t3.5) and answers them from the
+// register map.
+void esp32ModbusRTU::_serveConnection(esp32ModbusRTU *instance)
+{
+  _registerWatchdog(instance);
+
+  ModbusServer *server = instance->_server;
+  uint8_t response[MODBUS_RTU_MAX_ADU];
+  uint32_t requestEndMicros = 0;
+  RTUFramer framer(instance->_silenceMicros, rtuRequestLength);
+  framer.onFrame([&](const uint8_t *frame, size_t length) {
+    FrameTrace *trace = instance->_trace.load(std::memory_order_acquire);
+    if (trace != nullptr)
+      trace->capture(TRACE_RX, frame[0], esp32Modbus::SUCCESS, frame, length, requestEndMicros);
+    size_t responseLength = server->handle(frame, length, response);
+    if (responseLength == 0)
+      return;
+    instance->_lastMicros = requestEndMicros;  // t3.5 counts from the request's last byte
+    instance->_send(response, responseLength);
+    server->recordLatency(instance->_txStartMicros - requestEndMicros);
+    if (trace != nullptr)
+      trace->capture(TRACE_TX, response[0], esp32Modbus::SUCCESS, response, responseLength, instance->_txStartMicros);
+  });
+  uint32_t crcErrors = 0;
+
+  while (!instance->_shutdown)
+  {
+    // Nothing is sent on request of the application, except the destructor's
+    // wake-up read: drop whatever was queued
+    ModbusRequest *request = instance->_dequeueByPriority();
+    if (request != nullptr)
+    {
+      delete request->getOperation();
+      delete request;
+      continue;
+    }
+
+    bool received = false;
+    while (instance->_serial->available())
+    {
+      requestEndMicros = micros();
+      if (instance->_busMeter.phase() != BUS_RX)
+        instance->_busMeter.enter(BUS_RX, requestEndMicros);
+      instance->_busMeter.received(1);
+      framer.feed(instance->_serial->read(), requestEndMicros);
+      received = true;
+    }
+    uint32_t now = micros();
+    framer.poll(now);
+    // A request (and its response) is done, or garbage was dropped
+    if (framer.pending() == 0 && instance->_busMeter.phase() != BUS_IDLE)
+      instance->_busMeter.enter(BUS_IDLE, now);
+    for (; crcErrors < framer.stats().crcErrors; ++crcErrors)
+      server->recordCrcError();
+
+    instance->_feedWatchdog();
+    if (!received)
+      delay(1);
+  }
+
+  _unregisterWatchdog(instance);
+  vTaskDelete(NULL);
+}
+
 void esp32ModbusRTU::_send(uint8_t *data, uint8_t length)
 {
   // Validate inputs
@@ -608,8 +1637,20 @@ void esp32ModbusRTU::_send(uint8_t *data, uint8_t length)
     return;
   }
   
-  while (millis() - _lastMillis < _interval)
-    delay(1); // respect _interval
+  // Respect the inter-frame silence (t3.5), timed in microseconds so back-to-back
+  // frames are not held up by millisecond rounding
+  uint32_t now = micros();
+  _busMeter.enter(BUS_SILENCE, now);
+  uint32_t sinceLast = now - _lastMicros;
+  while (sinceLast < _silenceMicros)
+  {
+    uint32_t remaining = _silenceMicros - sinceLast;
+    if (remaining > 2000)
+      delay(1);
+    else
+      delayMicroseconds(remaining);
+    sinceLast = micros() - _lastMicros;
+  }
   
   // Debug logging with buffer dump
   MODBUS_LOG_PROTO("Sending %d bytes to address 0x%02X, FC=0x%02X", length, data[0], data[1]);
@@ -624,11 +1665,24 @@ void esp32ModbusRTU::_send(uint8_t *data, uint8_t length)
     (void)_serial->read();
   }
 
+  // ASCII mode: the same frame hex encoded, with LRC instead of CRC
+  const uint8_t *frame = data;
+  size_t frameLength = length;
+  if (_serialMode == esp32Modbus::ASCII_MODE)
+  {
+    frameLength = asciiEncodeFrame(data, length, _asciiFrame, sizeof(_asciiFrame));
+    frame = reinterpret_cast<const uint8_t *>(_asciiFrame);
+  }
+
   // Toggle rtsPin to TX mode
   if (_rtsPin >= 0)
     digitalWrite(_rtsPin, HIGH);
-  _serial->write(data, length);
+  _txStartMicros = micros();
+  _busMeter.enter(BUS_TX, _txStartMicros);
+  _busMeter.sent(frameLength);
+  _serial->write(frame, frameLength);
   _serial->flush();
+  _busMeter.enter(BUS_GUARD, micros());
 
   // CRITICAL: Wait for last byte to physically transmit before switching to RX
   // flush() only waits for TX buffer to empty to UART, not for physical transmission.
@@ -641,6 +1695,33 @@ void esp32ModbusRTU::_send(uint8_t *data, uint8_t length)
   if (_rtsPin >= 0)
     digitalWrite(_rtsPin, LOW);
   _lastMillis = millis();
+  _lastMicros = micros();
+  _busMeter.enter(BUS_WAIT, _lastMicros);
+}
+
+// Discard incoming bytes until the line has been quiet for the silent interval,
+// bounded by the timeout in case a slave keeps babbling.
+void esp32ModbusRTU::_awaitSilence()
+{
+  uint32_t start = millis();
+  uint32_t lastByte = start;
+  while (millis() - lastByte <= _interval)
+  {
+    if (_serial->available())
+    {
+      (void)_serial->read();
+      _busMeter.received(1);
+      lastByte = millis();
+    }
+    else
+    {
+      delay(1);
+    }
+    if (millis() - start > TimeOutValue)
+      break;
+  }
+  _lastMillis = millis();
+  _lastMicros = micros();
 }
 
 // Adjust timeout on MODBUS - some slaves require longer/allow for shorter times
@@ -650,6 +1731,16 @@ void esp32ModbusRTU::setTimeOutValue(uint32_t tov)
     TimeOutValue = tov;
 }
 
+void esp32ModbusRTU::setBroadcastTurnaround(uint32_t ms)
+{
+  _broadcastTurnaround = ms;
+}
+
+void esp32ModbusRTU::setSerialMode(esp32Modbus::SerialMode mode)
+{
+  _serialMode = mode;
+}
+
 // Control watchdog behavior
 void esp32ModbusRTU::setWatchdogEnabled(bool enabled)
 {
@@ -718,28 +1809,81 @@ bool esp32ModbusRTU::isWatchdogEnabled() const
   return _watchdogEnabled;
 }
 
-ModbusResponse *esp32ModbusRTU::_receive(ModbusRequest *request)
+void esp32ModbusRTU::_receive(ModbusRequest *request, ModbusResponse *response)
 {
-  // Get expected response length and validate
-  size_t responseLen = request->responseLength();
-  if (responseLen > MODBUS_MAX_MESSAGE_SIZE) {
-    responseLen = MODBUS_MAX_MESSAGE_SIZE;
+  // No slave answers a broadcast: give them the turnaround delay to act on it
+  // instead of waiting for the timeout
+  if (request->getSlaveAddress() == MODBUS_BROADCAST_ADDRESS)
+  {
+    _busMeter.enter(BUS_GUARD, micros());
+    delay(_broadcastTurnaround);
+    _lastMillis = millis();
+    _lastMicros = micros();
+    broadcastResponse(request, response);
+    return;
   }
-  
-  ModbusResponse *response = new ModbusResponse(responseLen, request);
+
+  AsciiDecoder &ascii = _asciiDecoder;  // ASCII mode: chars to RTU frame, then into the response
+  ascii.reset();
   uint32_t lastWatchdogFeed = millis();
+  uint32_t lastByteMicros = micros();
   
   while (true)
   {
-    while (_serial->available())
+    bool received = false;
+    while (_serial->available() && !response->isRejected() && !ascii.isComplete())
+    {
+      uint8_t value = _serial->read();
+      _busMeter.received(1);
+      received = true;
+      if (_serialMode == esp32Modbus::RTU_MODE)
+      {
+        response->add(value);
+      }
+      else if (ascii.feed(value))
+      {
+        // The frame ended on CR LF, it has to be complete
+        if (ascii.getError() != esp32Modbus::SUCCESS)
+          response->reject(ascii.getError());
+        for (size_t i = 0; i < ascii.size() && !response->isRejected(); ++i)
+          response->add(ascii.frame()[i]);
+        response->endOfFrame();
+        if (!response->isRejected() && !response->isComplete())
+          response->reject(esp32Modbus::INVALID_RESPONSE);
+      }
+    }
+    if (received)
+    {
+      lastByteMicros = micros();
+      if (_busMeter.phase() == BUS_WAIT)
+        _busMeter.enter(BUS_RX, lastByteMicros);
+    }
+    else if (_serialMode == esp32Modbus::RTU_MODE && response->getSize() > 0 && micros() - lastByteMicros >= _silenceMicros)
     {
-      response->add(_serial->read());
+      response->endOfFrame();
+    }
+    if (response->isRejected())
+    {
+      // The frame cannot match the request: do not wait for the full length or
+      // the timeout, drop the remainder and resync on the inter-frame silence.
+      MODBUS_LOG_PROTO("Response rejected after %d bytes: %s", response->getSize(),
+                       esp32Modbus::getErrorDescription(response->getError()));
+      MODBUS_DUMP_BUFFER("RX", response->getMessage(), response->getSize());
+      _awaitSilence();
+      break;
     }
     if (response->isComplete())
     {
+      // A slave sending more than the expected length would otherwise still be
+      // talking when the next request goes out
+      if (_serial->available())
+        _awaitSilence();
+      else
+        _lastMicros = lastByteMicros;  // silence counts from the last byte
       _lastMillis = millis();
+      response->setTiming(_txStartMicros, lastByteMicros);
       MODBUS_LOG_PROTO("Response complete: %d bytes received", response->getSize());
-      MODBUS_DUMP_BUFFER("RX", response->getData(), response->getSize());
+      MODBUS_DUMP_BUFFER("RX", response->getMessage(), response->getSize());
       break;
     }
     if (millis() - _lastMillis > TimeOutValue)
@@ -751,6 +1895,7 @@ ModbusResponse *esp32ModbusRTU::_receive(ModbusRequest *request)
       // is the primary guard; this narrows the late-arrival window further.
       while (_serial->available()) {
         (void)_serial->read();
+        _busMeter.received(1);
       }
       break;
     }
@@ -770,7 +1915,6 @@ ModbusResponse *esp32ModbusRTU::_receive(ModbusRequest *request)
     
     delay(1); // small delay to prevent CPU hogging
   }
-  return response;
 }
 
 #elif defined ESP32MODBUSRTU_TEST
@@ -58,14 +58,31 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define MODBUS_MAX_REGISTERS 125  // Maximum registers in single request
 #endif
 
+#ifndef MODBUS_MAX_WRITE_REGISTERS
+#define MODBUS_MAX_WRITE_REGISTERS 123  // FC16 limit: 123 registers fit in one frame
+#endif
+
 #ifndef MODBUS_MAX_COILS  
 #define MODBUS_MAX_COILS 2000  // Maximum coils in single request
 #endif
 
+#ifndef MODBUS_MAX_WRITE_COILS
+#define MODBUS_MAX_WRITE_COILS 1968  // FC0F limit: 1968 coils fit in one frame
+#endif
+
 #ifndef MODBUS_MAX_MESSAGE_SIZE
 #define MODBUS_MAX_MESSAGE_SIZE 256  // Maximum message size
 #endif
 
+#ifndef MODBUS_BROADCAST_TURNAROUND_MS
+#define MODBUS_BROADCAST_TURNAROUND_MS 100  // Slaves' processing time after a broadcast
+#endif
+
+#ifndef MODBUS_RETRY_SLOTS
+#define MODBUS_RETRY_SLOTS 8  // Requests that can wait for a retry at the same time
+#endif
+
+#include <atomic>
 #include <functional>
 
 extern "C"
@@ -73,12 +90,24 @@ extern "C"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 }
 #include <HardwareSerial.h>
 #include <esp32-hal-gpio.h>
 
 #include "esp32ModbusTypeDefs.h"
 #include "ModbusMessage.h"
+#include "ModbusRetry.h"
+#include "ModbusScheduler.h"
+#include "ModbusLatency.h"
+#include "ModbusBusMeter.h"
+#include "ModbusTrace.h"
+#include "ModbusFramer.h"
+#include "ModbusAscii.h"
+#include "ModbusRegisterCache.h"
+#include "ModbusDeltaFilter.h"
+#include "ModbusOperations.h"
+#include "ModbusServer.h"
 
 // Logging configuration
 #include "esp32ModbusRTULogging.h"
@@ -89,6 +118,11 @@ public:
   explicit esp32ModbusRTU(HardwareSerial *serial, int8_t rtsPin = -1);
   ~esp32ModbusRTU();
   void begin(int coreID = -1);
+  // Slave mode instead of master: answer requests to slaveAddress (and execute
+  // broadcasts) from map, which must outlive this instance. RTU framing only.
+  // The instance cannot send requests of its own after this.
+  bool beginServer(uint8_t slaveAddress, esp32Modbus::RegisterMap *map, int coreID = -1);
+  esp32Modbus::ServerStats getServerStats() const;
 
   // ===== Legacy API (backward compatible) =====
   // These methods use default RELAY priority
@@ -114,20 +148,193 @@ public:
   bool writeMultHoldingRegistersWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint8_t *data, esp32Modbus::ModbusPriority priority);
   bool readWriteMultipleRegistersWithPriority(uint8_t slaveAddress, uint16_t readAddress, uint16_t readCount, uint16_t writeAddress, uint16_t writeCount, uint16_t *writeData, esp32Modbus::ModbusPriority priority);
 
+  // ===== Mask write =====
+  bool maskWriteRegister(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask);
+  bool maskWriteRegisterWithPriority(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask, esp32Modbus::ModbusPriority priority);
+  // Set bits of a holding register to (register AND andMask) OR (orMask AND NOT andMask),
+  // e.g. bit n on: andMask = ~(1 << n), orMask = 1 << n. Uses FC 0x16 (one transaction),
+  // or FC03 + FC06 in consecutive frames for slaves flagged with setMaskWriteSupported(false).
+  // Both paths report success to onData as a mask write echo (FC 0x16).
+  bool updateRegisterBits(uint8_t slaveAddress, uint16_t address, uint16_t andMask, uint16_t orMask, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  void setMaskWriteSupported(uint8_t slaveAddress, bool supported);  // default: supported
+  bool isMaskWriteSupported(uint8_t slaveAddress) const;
+
+  // ===== Packed coils =====
+  // Write coils given as a packed bitset in wire layout (coil i is bit i % 8 of
+  // bits[i / 8]), without going through a bool array. See ModbusDecode.h for
+  // conversions from/to bool arrays and 32 bit words.
+  bool writeMultipleCoilsPacked(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, const uint8_t *bits, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+
+  // ===== Device identification =====
+  // Read Device Identification (FC 0x2B / MEI 0x0E), following "more follows"
+  // until all objects of the category are read. The objects are stored in buffer
+  // ([id, length, value...] back to back, see esp32Modbus::findDeviceIdObject)
+  // which must stay valid until onDeviceId or onError is called.
+  bool readDeviceIdentification(uint8_t slaveAddress, uint8_t *buffer, uint16_t capacity, esp32Modbus::MBRTUOnDeviceId onDeviceId, esp32Modbus::DeviceIdCode code = esp32Modbus::DEVICE_ID_BASIC, uint8_t objectId = 0, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+
+  // ===== Diagnostics =====
+  // Raw FC 0x08 request, the echo (sub-function + data) is passed to onData.
+  bool diagnostics(uint8_t slaveAddress, uint16_t subFunction, uint16_t data = 0, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  bool clearDiagnosticCounters(uint8_t slaveAddress, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  // Read the eight bus/slave counters (sub-functions 0x0B-0x12) in consecutive
+  // frames. Counters the slave answers with an exception are left out of
+  // DiagnosticCounters::available instead of failing the whole read.
+  bool readDiagnosticCounters(uint8_t slaveAddress, esp32Modbus::MBRTUOnDiagnostics onCounters, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  bool getCommEventCounter(uint8_t slaveAddress, esp32Modbus::MBRTUOnCommEventCounter onCounter, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  bool getCommEventLog(uint8_t slaveAddress, esp32Modbus::MBRTUOnCommEventLog onLog, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  // Measure the round trip (start of request to last response byte) with
+  // a number of FC 0x08 loopbacks sent back-to-back.
+  bool probeLatency(uint8_t slaveAddress, uint16_t probes, esp32Modbus::MBRTUOnLatency onLatency, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+
+  // ===== Raw requests =====
+  // Send any function code, e.g. user defined ones (0x41-0x48, 0x64-0x6E), with
+  // data as the PDU after the function code. The response data (everything after
+  // the function code) goes to onData, exceptions to onError. responseDataLength:
+  // expected number of response data bytes, 0 = unknown, the response ends on the
+  // inter-frame silence.
+  bool sendRawRequest(uint8_t slaveAddress, uint8_t functionCode, const uint8_t *data, uint8_t length, uint8_t responseDataLength = 0, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  // The same, with the outcome passed to onReply (called once, from the worker
+  // task) instead of onData/onError. Used by esp32ModbusGateway.
+  bool forwardRequest(uint8_t slaveAddress, uint8_t functionCode, const uint8_t *data, uint8_t length, esp32Modbus::MBRTUOnReply onReply, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+
+  // ===== Split reads =====
+  // Read ranges beyond the single frame limit (125 registers, 2000 bits). The range
+  // is split in maximal chunks that are sent back-to-back; the reassembled data is
+  // delivered in one onData call. The first failing chunk ends the read and is
+  // reported to onChunkError, or to onError when no chunk handler is given.
+  bool readCoilsSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, esp32Modbus::MBRTUOnChunkError onChunkError = nullptr);
+  bool readDiscreteInputsSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, esp32Modbus::MBRTUOnChunkError onChunkError = nullptr);
+  bool readHoldingRegistersSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, esp32Modbus::MBRTUOnChunkError onChunkError = nullptr);
+  bool readInputRegistersSplit(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, esp32Modbus::MBRTUOnChunkError onChunkError = nullptr);
+
+  // ===== Bulk writes =====
+  // Write any number of holding registers (big endian data, 2 bytes per register)
+  // in maximal FC16 frames sent back-to-back. The data is copied. onProgress is
+  // called after every frame, the last call has written == total. The first
+  // failing frame ends the write and is reported like a split read chunk.
+  bool writeHoldingRegistersBulk(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, const uint8_t *data, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, esp32Modbus::MBRTUOnProgress onProgress = nullptr, esp32Modbus::MBRTUOnChunkError onChunkError = nullptr);
+
+  // ===== File records =====
+  // Read/Write File Record (FC 0x14/0x15) with up to 35 sub-requests per frame.
+  // The read payload goes to onData as received; esp32Modbus::findFileSubResponse
+  // returns the records of each sub-request. For writes, data holds the records of
+  // all sub-requests back to back (big endian) and onData gets the echo.
+  bool readFileRecords(uint8_t slaveAddress, const esp32Modbus::FileRecordRef *refs, uint8_t count, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  bool writeFileRecords(uint8_t slaveAddress, const esp32Modbus::FileRecordRef *refs, uint8_t count, const uint8_t *data, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  // Read count records of a file in maximal frames (121 records) sent back-to-back.
+  // onRecords is called per frame with the records just received; the whole file
+  // is never held in memory. Errors are reported like a split read chunk.
+  bool readFile(uint8_t slaveAddress, uint16_t file, uint16_t record, uint16_t count, esp32Modbus::MBRTUOnFileRecords onRecords, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, esp32Modbus::MBRTUOnChunkError onChunkError = nullptr);
+
+  // ===== FIFO queues =====
+  // Read FIFO Queue (FC 0x18): up to 31 queued registers, passed to onData
+  // (address = FIFO pointer address, empty queue: length 0).
+  bool readFifoQueue(uint8_t slaveAddress, uint16_t pointerAddress, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  // Read the queue until it is empty, one frame per batch, sent back-to-back at
+  // the given priority. onFifo gets every batch and a final call with count 0.
+  // maxReads bounds the drain of a queue that keeps refilling (0 = no limit).
+  bool drainFifoQueue(uint8_t slaveAddress, uint16_t pointerAddress, esp32Modbus::MBRTUOnFifo onFifo, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY, uint16_t maxReads = 0);
+
+  // ===== Reads into caller-owned buffers =====
+  // The registers are stored in host order into values once the response passed
+  // its CRC check. values must stay valid until onRegisters or onError is called
+  // for the read; after an error it is left untouched.
+  bool readHoldingRegistersInto(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint16_t *values, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  bool readInputRegistersInto(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint16_t *values, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  void onRegisters(esp32Modbus::MBRTUOnRegisters handler);
+
   void onData(esp32Modbus::MBRTUOnData handler);
   void onError(esp32Modbus::MBRTUOnError handler);
+
+  // ===== Change-only notifications =====
+  // With delta mode on, onData fires for reads only when the payload differs from
+  // the previous response to the same (slave, FC, address, count). onDataChanged
+  // receives changed read payloads with a per-register dirty mask. Write echoes
+  // are always passed to onData.
+  void setDeltaMode(bool enabled);
+  void onDataChanged(esp32Modbus::MBRTUOnDataChanged handler);
+  void resetDeltaState();  // next response of every read counts as changed
   void setTimeOutValue(uint32_t tov);
+  // Writes to slave address 0 are broadcast: nothing is received, the bus is
+  // left quiet for the turnaround delay and the write is reported to onData as
+  // if echoed. Only write function codes can be broadcast.
+  void setBroadcastTurnaround(uint32_t ms);
+  // RTU (default) or ASCII framing for all requests of this instance. The serial
+  // port settings (e.g. 7E1 for ASCII) are up to the caller.
+  void setSerialMode(esp32Modbus::SerialMode mode);
+  esp32Modbus::SerialMode getSerialMode() const { return _serialMode; }
   
+  // Retry policy per priority level (default: no retries), may be changed while running
+  void setRetryPolicy(esp32Modbus::ModbusPriority priority, const esp32Modbus::RetryPolicy &policy);
+  bool getRetryCounters(uint8_t slaveAddress, esp32Modbus::RetryCounters *counters) const;
+  esp32Modbus::RetryCounters getRetryTotals() const;
+  void resetRetryCounters();
+
+  // Latency histograms of queue wait, wire time and total per slave and function
+  // code (the first MODBUS_LATENCY_SLOTS pairs seen) and over all transactions.
+  // Every transaction that is not retried is recorded, timeouts included.
+  bool getLatency(uint8_t slaveAddress, uint8_t functionCode, esp32Modbus::LatencyStage stage,
+                  esp32Modbus::LatencySnapshot *snapshot) const;
+  esp32Modbus::LatencySnapshot getLatencyTotals(esp32Modbus::LatencyStage stage) const;
+  void resetLatency();
+
+  // Bus time split into silence, sending, guard, waiting, receiving and idle,
+  // since begin() and over the last complete second
+  esp32Modbus::BusUsage getBusUsage() const;
+  esp32Modbus::BusUsage getBusUsageLastSecond() const;
+
+  // ===== Register shadow cache (optional) =====
+  // Every successful read and write echo updates the cache once it is enabled.
+  // The cached reads return fresh enough values without a bus transaction,
+  // otherwise they queue a regular read (result via onData) at the given priority.
+  // Coil/discrete input reads are served from the cache for any count it holds.
+  // A write that failed or got an exception drops its range from the cache.
+  bool enableRegisterCache();
+  void disableRegisterCache();
+  esp32Modbus::CacheResult readCoilsCached(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, uint32_t maxAgeMs, bool *values, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  esp32Modbus::CacheResult readDiscreteInputsCached(uint8_t slaveAddress, uint16_t address, uint16_t numberCoils, uint32_t maxAgeMs, bool *values, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  esp32Modbus::CacheResult readHoldingRegistersCached(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint32_t maxAgeMs, uint16_t *values, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  esp32Modbus::CacheResult readInputRegistersCached(uint8_t slaveAddress, uint16_t address, uint16_t numberRegisters, uint32_t maxAgeMs, uint16_t *values, esp32Modbus::ModbusPriority priority = esp32Modbus::RELAY);
+  esp32Modbus::CacheStats getCacheStats();
+
+  // ===== Frame trace (optional) =====
+  // Every frame sent and received (slave mode: requests delivered) is copied
+  // into a ring of the given size with its micros() timestamp, direction, slave
+  // and outcome; a timeout is a received frame with the bytes that did arrive.
+  // Requests also keep their priority and queue wait, for the trace replay.
+  // exportTrace() writes the ring as pcapng, in chunks, from any task.
+  bool enableTrace(size_t bytes = MODBUS_TRACE_BYTES);
+  bool exportTrace(const esp32Modbus::MBTraceWriter &write) const;
+  void clearTrace();
+
   // Watchdog control methods
   void setWatchdogEnabled(bool enabled);
   bool isWatchdogEnabled() const;
 
 private:
   bool _addToQueue(esp32ModbusRTUInternals::ModbusRequest *request);
-  esp32ModbusRTUInternals::ModbusRequest* _dequeueByPriority();  // Dequeue from highest priority queue
+  esp32ModbusRTUInternals::ModbusRequest* _dequeueByPriority(bool *continuation = nullptr);  // Dequeue from highest priority queue
+  bool _startTask(TaskFunction_t task, int coreID);
   static void _handleConnection(esp32ModbusRTU *instance);
+  static void _serveConnection(esp32ModbusRTU *instance);
+  static void _registerWatchdog(esp32ModbusRTU *instance);
+  static void _unregisterWatchdog(esp32ModbusRTU *instance);
+  void _feedWatchdog();
+  bool _readSplit(uint8_t slaveAddress, esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t count, esp32Modbus::ModbusPriority priority, esp32Modbus::MBRTUOnChunkError onChunkError);
+  esp32Modbus::MBRTUOnChunkError _chunkErrorHandler(esp32Modbus::MBRTUOnChunkError onChunkError);
+  bool _submit(esp32ModbusRTUInternals::ModbusOperation *operation, esp32Modbus::ModbusPriority priority);
+  void _continueOperation(esp32ModbusRTUInternals::ModbusRequest *request, esp32ModbusRTUInternals::ModbusResponse *response);
+  bool _scheduleRetry(esp32ModbusRTUInternals::ModbusRequest *request, esp32Modbus::Error error);
+  uint32_t _promoteDueRetries();  // Requeue due retries, returns ms until the next one
+  bool _loadCached(uint8_t slaveAddress, esp32ModbusRTUInternals::RegisterTable table, uint16_t address, uint16_t count, uint32_t maxAgeMs, uint16_t *values);
+  bool _loadCached(uint8_t slaveAddress, esp32ModbusRTUInternals::RegisterTable table, uint16_t address, uint16_t count, uint32_t maxAgeMs, bool *values);
+  void _updateCache(esp32ModbusRTUInternals::ModbusRequest *request, esp32ModbusRTUInternals::ModbusResponse *response);
+  void _deliverData(esp32ModbusRTUInternals::ModbusRequest *request, esp32ModbusRTUInternals::ModbusResponse *response);
+  // onData, filtered by delta mode and onDataChanged for reads of count items
+  void _deliverPayload(uint8_t slaveAddress, esp32Modbus::FunctionCode fc, uint16_t address, uint16_t count, uint8_t *data, uint16_t length);
   void _send(uint8_t *data, uint8_t length);
-  esp32ModbusRTUInternals::ModbusResponse *_receive(esp32ModbusRTUInternals::ModbusRequest *request);
+  void _awaitSilence();
+  void _receive(esp32ModbusRTUInternals::ModbusRequest *request, esp32ModbusRTUInternals::ModbusResponse *response);
 
   // Static member to track watchdog registration state across methods
   static bool _globalWatchdogActive;
@@ -136,12 +343,39 @@ private:
   uint32_t TimeOutValue;
   HardwareSerial *_serial;
   uint32_t _lastMillis;
+  uint32_t _lastMicros;  // end of the last frame on the bus
+  uint32_t _txStartMicros;  // start of the last request, for response round trips
   uint32_t _interval;
+  uint32_t _silenceMicros;  // t3.5, ends variable length responses
+  uint32_t _broadcastTurnaround;  // ms after a broadcast before the next request
+  esp32Modbus::SerialMode _serialMode;
   int8_t _rtsPin;
   TaskHandle_t _task;
   QueueHandle_t _queues[4];  // Priority queues: [EMERGENCY, SENSOR, RELAY, STATUS]
+  esp32ModbusRTUInternals::ModbusRequest *_continuations[4];  // Next request of a running operation, per priority
   esp32Modbus::MBRTUOnData _onData;
   esp32Modbus::MBRTUOnError _onError;
+  esp32Modbus::MBRTUOnDataChanged _onDataChanged;
+  esp32Modbus::MBRTUOnRegisters _onRegisters;
+  esp32ModbusRTUInternals::DeltaFilter *_deltaFilter;  // owned by the worker task, created on first use
+  std::atomic<bool> _deltaMode;  // set by the application, read by the worker
+  std::atomic<bool> _deltaReset;
+  esp32Modbus::RetryPolicy _retryPolicies[4];  // guarded by _retryLock
+  esp32ModbusRTUInternals::ModbusRequest *_retryPending[MODBUS_RETRY_SLOTS];
+  esp32ModbusRTUInternals::RetryStats _retryStats;  // guarded by _retryLock
+  SemaphoreHandle_t _retryLock;  // policies and counters: set by the application, used by the worker
+  esp32ModbusRTUInternals::LatencyStats _latencyStats;
+  esp32ModbusRTUInternals::BusMeter _busMeter;
+  esp32ModbusRTUInternals::RegisterCache *_cache;
+  uint32_t _noMaskWrite[8];  // bitset of slaves without FC 0x16
+  SemaphoreHandle_t _cacheLock;
+  esp32ModbusRTUInternals::ModbusServer *_server;  // slave mode, set by beginServer
+  std::atomic<esp32ModbusRTUInternals::FrameTrace*> _trace;  // set once by enableTrace
+  // Scratch buffers of the worker task, kept off its stack (MODBUS_TASK_STACK_SIZE)
+  uint8_t _dirty[esp32ModbusRTUInternals::MODBUS_DELTA_MAX_PAYLOAD];  // changed bytes for onDataChanged
+  char _asciiFrame[esp32ModbusRTUInternals::MODBUS_ASCII_MAX_ADU];  // ASCII mode: encoded request
+  esp32ModbusRTUInternals::AsciiDecoder _asciiDecoder;  // ASCII mode: response being decoded
+  uint8_t _rxFrame[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];  // response being received
 
   bool _shutdown = false;
   bool _watchdogEnabled = true;
@@ -27,6 +27,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef esp32Modbus_esp32ModbusTypeDefs_h
 #define esp32Modbus_esp32ModbusTypeDefs_h
 
+#include <stddef.h>  // for size_t
 #include <stdint.h>  // for uint*_t
 #include <functional>  // for std::function
 
@@ -39,9 +40,17 @@ enum FunctionCode : uint8_t {
   READ_INPUT_REGISTER  = 0x04,
   WRITE_COIL           = 0x05,
   WRITE_HOLD_REGISTER  = 0x06,
+  DIAGNOSTICS          = 0x08,
+  GET_COMM_EVENT_COUNTER = 0x0B,
+  GET_COMM_EVENT_LOG   = 0x0C,
   WRITE_MULT_COILS     = 0x0F,
   WRITE_MULT_REGISTERS = 0x10,
-  READ_WRITE_MULT_REGISTERS = 0x17
+  READ_FILE_RECORD     = 0x14,
+  WRITE_FILE_RECORD    = 0x15,
+  MASK_WRITE_REGISTER  = 0x16,
+  READ_WRITE_MULT_REGISTERS = 0x17,
+  READ_FIFO_QUEUE      = 0x18,
+  ENCAPSULATED_INTERFACE = 0x2B  // MEI 0x0E: read device identification
 };
 
 enum Error : uint8_t {
@@ -55,10 +64,12 @@ enum Error : uint8_t {
   SERVER_DEVICE_BUSY    = 0x06,
   NEGATIVE_ACKNOWLEDGE  = 0x07,
   MEMORY_PARITY_ERROR   = 0x08,
+  GATEWAY_PATH_UNAVAILABLE = 0x0A,
+  GATEWAY_TARGET_FAILED = 0x0B,  // target device failed to respond
   TIMEOUT               = 0xE0,
   INVALID_SLAVE         = 0xE1,
   INVALID_FUNCTION      = 0xE2,
-  CRC_ERROR             = 0xE3,  // only for Modbus-RTU
+  CRC_ERROR             = 0xE3,  // CRC (RTU) or LRC (ASCII) mismatch
   COMM_ERROR            = 0xE4,  // general communication error
   INVALID_PARAMETER     = 0xE5,  // invalid function parameter
   QUEUE_FULL            = 0xE6,  // request queue is full
@@ -68,6 +79,40 @@ enum Error : uint8_t {
 
 typedef std::function<void(uint16_t, uint8_t, esp32Modbus::FunctionCode, uint8_t*, uint16_t)> MBTCPOnData;
 typedef std::function<void(uint8_t, esp32Modbus::FunctionCode, uint16_t, uint8_t*, uint16_t)> MBRTUOnData;
+// Change-only variant of MBRTUOnData: the last argument is a dirty mask with one
+// bit per register (FC03/04/17) or per coil/input (FC01/02), LSB first.
+typedef std::function<void(uint8_t, esp32Modbus::FunctionCode, uint16_t, uint8_t*, uint16_t, const uint8_t*)> MBRTUOnDataChanged;
+// Register read into a caller-owned buffer: slave, function code, address, the
+// caller's buffer (host order) and number of registers
+typedef std::function<void(uint8_t, esp32Modbus::FunctionCode, uint16_t, uint16_t*, uint16_t)> MBRTUOnRegisters;
+// Device identification: slave, conformity level and the objects as received,
+// packed back to back as [object id, length, value...] (see findDeviceIdObject)
+typedef std::function<void(uint8_t, uint8_t, const uint8_t*, uint16_t)> MBRTUOnDeviceId;
+struct DiagnosticCounters;
+struct CommEventCounter;
+struct CommEventLog;
+struct LatencyProbe;
+typedef std::function<void(uint8_t, const esp32Modbus::DiagnosticCounters&)> MBRTUOnDiagnostics;
+typedef std::function<void(uint8_t, const esp32Modbus::CommEventCounter&)> MBRTUOnCommEventCounter;
+typedef std::function<void(uint8_t, const esp32Modbus::CommEventLog&)> MBRTUOnCommEventLog;
+typedef std::function<void(uint8_t, const esp32Modbus::LatencyProbe&)> MBRTUOnLatency;
+// Records of a file read: slave, file, first record, the records as received
+// (big endian, see ModbusDecode.h) and number of records (registers)
+typedef std::function<void(uint8_t, uint16_t, uint16_t, const uint8_t*, uint16_t)> MBRTUOnFileRecords;
+// FIFO read: slave, FIFO pointer address, the queued registers as received (big
+// endian) and their number; a drain ends with a call with count 0
+typedef std::function<void(uint8_t, uint16_t, const uint8_t*, uint16_t)> MBRTUOnFifo;
+// Error of a split read or bulk write: slave, error, index and first address of the failed chunk
+typedef std::function<void(uint8_t, esp32Modbus::Error, uint16_t, uint16_t)> MBRTUOnChunkError;
+// Progress of a bulk write: slave, registers written so far, total registers
+typedef std::function<void(uint8_t, uint16_t, uint16_t)> MBRTUOnProgress;
+// Outcome of a forwarded request: SUCCESS with the response data after the
+// function code, or the exception / communication error (data nullptr)
+typedef std::function<void(esp32Modbus::Error, const uint8_t*, uint8_t)> MBRTUOnReply;
+// Slave mode: a master wrote count coils or registers from address on
+typedef std::function<void(esp32Modbus::FunctionCode, uint16_t, uint16_t)> MBServerOnWrite;
+// Frame trace export: the next chunk of the capture file, false to stop
+typedef std::function<bool(const uint8_t*, size_t)> MBTraceWriter;
 typedef std::function<void(uint16_t, esp32Modbus::Error)> MBTCPOnError;
 // F18: include the slave address (like the TCP variant) so the firmware can
 // route a comm error to the OWNING device's handler. Without it, an error could
@@ -87,6 +132,8 @@ inline const char* getErrorDescription(Error error) {
     case SERVER_DEVICE_BUSY: return "Server device busy";
     case NEGATIVE_ACKNOWLEDGE: return "Negative acknowledge";
     case MEMORY_PARITY_ERROR: return "Memory parity error";
+    case GATEWAY_PATH_UNAVAILABLE: return "Gateway path unavailable";
+    case GATEWAY_TARGET_FAILED: return "Gateway target device failed to respond";
     case TIMEOUT: return "Timeout";
     case INVALID_SLAVE: return "Invalid slave address";
     case INVALID_FUNCTION: return "Invalid function";
@@ -118,6 +165,14 @@ enum ModbusPriority : uint8_t {
   STATUS = 3      ///< Low priority - status/diagnostic reads
 };
 
+/**
+ * @brief Serial transmission mode of an esp32ModbusRTU instance
+ */
+enum SerialMode : uint8_t {
+  RTU_MODE = 0,   ///< binary frames delimited by silence, CRC16
+  ASCII_MODE = 1  ///< hex encoded frames between ':' and CR LF, LRC
+};
+
 // Helper function to get priority description
 inline const char* getPriorityDescription(ModbusPriority priority) {
   switch (priority) {
@@ -129,6 +184,298 @@ inline const char* getPriorityDescription(ModbusPriority priority) {
   }
 }
 
+/**
+ * @brief Retry policy for failed requests
+ *
+ * A failed request is requeued by the worker task instead of being slept on,
+ * so other traffic keeps flowing while it waits for its backoff to expire.
+ * Only transient errors are retried (see isRetryable()); protocol exceptions
+ * such as ILLEGAL_DATA_ADDRESS are reported immediately.
+ *
+ * Backoff before retry n (1-based) is backoffMs * backoffFactor^(n-1),
+ * capped at maxBackoffMs (0 = no cap).
+ */
+struct RetryPolicy {
+  uint8_t maxRetries;     ///< 0 = no retries (default)
+  uint16_t backoffMs;     ///< delay before the first retry
+  uint8_t backoffFactor;  ///< multiplier per further retry (1 = constant)
+  uint16_t maxBackoffMs;  ///< upper bound for the delay (0 = none)
+
+  explicit RetryPolicy(uint8_t retries = 0, uint16_t backoff = 0, uint8_t factor = 2, uint16_t maxBackoff = 0) :
+    maxRetries(retries),
+    backoffMs(backoff),
+    backoffFactor(factor),
+    maxBackoffMs(maxBackoff) {}
+
+  uint32_t backoff(uint8_t retry) const {
+    uint32_t delayMs = backoffMs;
+    for (uint8_t i = 1; i < retry; ++i) {
+      if (maxBackoffMs && delayMs >= maxBackoffMs) break;
+      if (delayMs > UINT32_MAX / 256) break;  // saturate, factor is at most 255
+      delayMs *= backoffFactor;
+    }
+    if (maxBackoffMs && delayMs > maxBackoffMs) delayMs = maxBackoffMs;
+    return delayMs;
+  }
+};
+
+// Exception codes the slave (or a gateway in front of it) answered with, as
+// opposed to errors detected by the master (TIMEOUT and up)
+inline bool isException(Error error) {
+  return error != SUCCESS && error < TIMEOUT;
+}
+
+// Errors worth another attempt: line errors (also behind a gateway) and a busy
+// slave. Exceptions that will be answered identically on every attempt are not
+// retried.
+inline bool isRetryable(Error error) {
+  switch (error) {
+    case TIMEOUT:
+    case CRC_ERROR:
+    case INVALID_SLAVE:
+    case INVALID_RESPONSE:
+    case COMM_ERROR:
+    case SERVER_DEVICE_BUSY:
+    case GATEWAY_TARGET_FAILED:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Retry counters, kept per slave and in total
+ */
+struct RetryCounters {
+  uint32_t total;    ///< all retries
+  uint32_t timeout;  ///< retries after TIMEOUT
+  uint32_t crc;      ///< retries after CRC_ERROR
+  uint32_t busy;     ///< retries after SERVER_DEVICE_BUSY
+  uint32_t other;    ///< retries after INVALID_SLAVE, INVALID_RESPONSE, COMM_ERROR
+};
+
+/**
+ * @brief Outcome of a cached read
+ */
+enum CacheResult : uint8_t {
+  CACHE_HIT    = 0,  ///< values returned from the cache, no bus transaction
+  CACHE_QUEUED = 1,  ///< too old or absent: a read was queued, result via onData
+  CACHE_FAILED = 2   ///< too old or absent and the read could not be queued
+};
+
+/**
+ * @brief Register cache hit/miss counters
+ */
+struct CacheStats {
+  uint32_t hits;
+  uint32_t misses;
+  float hitRate() const { return (hits + misses) ? static_cast<float>(hits) / (hits + misses) : 0.0f; }
+};
+
+/**
+ * @brief Sub-functions of FC 0x08 (serial line diagnostics)
+ */
+enum DiagnosticSubFunction : uint16_t {
+  DIAG_RETURN_QUERY_DATA       = 0x00,  ///< loopback, the slave echoes the data
+  DIAG_CLEAR_COUNTERS          = 0x0A,
+  DIAG_BUS_MESSAGE_COUNT       = 0x0B,
+  DIAG_BUS_CRC_ERROR_COUNT     = 0x0C,
+  DIAG_BUS_EXCEPTION_COUNT     = 0x0D,
+  DIAG_SLAVE_MESSAGE_COUNT     = 0x0E,
+  DIAG_SLAVE_NO_RESPONSE_COUNT = 0x0F,
+  DIAG_SLAVE_NAK_COUNT         = 0x10,
+  DIAG_SLAVE_BUSY_COUNT        = 0x11,
+  DIAG_BUS_CHAR_OVERRUN_COUNT  = 0x12
+};
+
+/**
+ * @brief Slave counters read with FC 0x08 sub-functions 0x0B-0x12
+ *
+ * Counters a slave does not implement (answered with an exception) are 0 and
+ * their bit in available is clear: bit n is sub-function 0x0B + n.
+ */
+struct DiagnosticCounters {
+  uint16_t busMessages;    ///< 0x0B: messages seen on the bus
+  uint16_t crcErrors;      ///< 0x0C: messages with CRC error
+  uint16_t exceptions;     ///< 0x0D: exception responses sent
+  uint16_t slaveMessages;  ///< 0x0E: messages addressed to the slave
+  uint16_t noResponse;     ///< 0x0F: messages not answered (e.g. broadcasts)
+  uint16_t nak;            ///< 0x10: negative acknowledges sent
+  uint16_t busy;           ///< 0x11: busy exceptions sent
+  uint16_t overruns;       ///< 0x12: character overruns
+  uint8_t available;
+};
+
+/**
+ * @brief Result of FC 0x0B, Get Comm Event Counter
+ */
+struct CommEventCounter {
+  uint16_t status;      ///< 0xFFFF while the slave is busy with a program command
+  uint16_t eventCount;  ///< successfully completed messages
+};
+
+/**
+ * @brief Result of FC 0x0C, Get Comm Event Log
+ */
+struct CommEventLog {
+  uint16_t status;
+  uint16_t eventCount;
+  uint16_t messageCount;
+  uint8_t eventLength;
+  uint8_t events[64];  ///< most recent event first
+};
+
+/**
+ * @brief Loopback (FC 0x08 / 0x00) round trips, start of request to end of echo
+ */
+struct LatencyProbe {
+  uint16_t samples;   ///< probes answered with a correct echo
+  uint16_t failures;  ///< probes without (correct) echo
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t totalUs;
+  uint32_t averageUs() const { return samples ? totalUs / samples : 0; }
+};
+
+/**
+ * @brief Stage of a transaction covered by a latency histogram
+ */
+enum LatencyStage : uint8_t {
+  LATENCY_QUEUE_WAIT = 0,  ///< queued (or submitted, for a retry: first queued) to start of transmission
+  LATENCY_WIRE       = 1,  ///< start of transmission to end of response, timeout or turnaround
+  LATENCY_TOTAL      = 2   ///< queued to end of response, before the callbacks
+};
+
+/**
+ * @brief Percentiles of a latency histogram, within 1/8 of the recorded values
+ */
+struct LatencySnapshot {
+  uint32_t count;  ///< transactions recorded
+  uint32_t p50Us;
+  uint32_t p90Us;
+  uint32_t p99Us;
+  uint32_t maxUs;  ///< exact
+};
+
+/**
+ * @brief One sub-request of FC 0x14/0x15: length records (registers) from record on
+ */
+struct FileRecordRef {
+  uint16_t file;    ///< 1-0xFFFF
+  uint16_t record;  ///< 0-9999
+  uint16_t length;
+};
+
+/**
+ * @brief Sub-response index of a Read File Record (FC 0x14) payload
+ * @return the records (big endian) and their number, nullptr if absent or malformed
+ */
+inline const uint8_t* findFileSubResponse(const uint8_t* data, uint16_t length, uint8_t index, uint16_t* records) {
+  uint16_t i = 0;
+  // [length (1 + 2 * records), reference type 6, records...] per sub-request
+  while (i + 2u <= length && data[i] >= 1 && (data[i] & 1) && i + 1u + data[i] <= length && data[i + 1] == 6) {
+    if (index-- == 0) {
+      *records = (data[i] - 1) / 2;
+      return &data[i + 2];
+    }
+    i += 1 + data[i];
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Slave mode counters
+ *
+ * Latency is measured from the last byte of a request to the start of the
+ * response transmission, t3.5 included.
+ */
+struct ServerStats {
+  uint32_t requests;    ///< valid frames addressed to the slave or broadcast
+  uint32_t responses;   ///< responses sent, exceptions included
+  uint32_t exceptions;  ///< requests answered (or for broadcasts: refused) with an exception
+  uint32_t broadcasts;  ///< requests to address 0, executed without response
+  uint32_t ignored;     ///< valid frames for other slaves
+  uint32_t crcErrors;   ///< frames dropped for a wrong CRC
+  uint32_t lastLatencyUs;
+  uint32_t maxLatencyUs;
+};
+
+/**
+ * @brief Bus time split by what the bus was doing, from micros() timestamps
+ *
+ * The phases add up to elapsedUs. In slave mode waitUs stays 0 and rxUs runs
+ * from the first byte of a request to the end of its handling.
+ */
+struct BusUsage {
+  uint64_t elapsedUs;  ///< time covered
+  uint64_t txBytes;    ///< bytes (ASCII mode: characters) sent
+  uint64_t rxBytes;    ///< bytes received, drained garbage included
+  uint64_t silenceUs;  ///< enforced inter-frame silence (t3.5) before sending
+  uint64_t txUs;       ///< sending, until the UART is flushed
+  uint64_t guardUs;    ///< line held after sending: last character and margin, broadcast turnaround
+  uint64_t waitUs;     ///< waiting for the first byte of the response, or the timeout
+  uint64_t rxUs;       ///< receiving, from the first byte to the end of the frame
+  uint64_t idleUs;     ///< nothing to send
+  float utilization() const { return elapsedUs ? 1.0f - static_cast<float>(idleUs) / elapsedUs : 0.0f; }  ///< share not idle
+  float wireShare() const { return elapsedUs ? static_cast<float>(txUs + rxUs) / elapsedUs : 0.0f; }  ///< share sending or receiving
+};
+
+/**
+ * @brief Modbus TCP gateway counters
+ */
+struct GatewayStats {
+  uint32_t connections;     ///< TCP connections accepted
+  uint32_t refused;         ///< connections closed at once, all client slots taken
+  uint32_t requests;        ///< MBAP requests received
+  uint32_t forwarded;       ///< requests handed to the RTU side
+  uint32_t cacheHits;       ///< reads answered from the gateway's cache
+  uint32_t collapsed;       ///< reads that shared the transaction of an identical one
+  uint32_t responses;       ///< responses sent, exceptions included
+  uint32_t exceptions;      ///< exception responses, the slave's and the gateway's own
+  uint32_t dropped;         ///< replies for clients that disconnected meanwhile
+  uint32_t protocolErrors;  ///< connections closed for a malformed MBAP header
+  uint32_t stalled;         ///< connections closed because their replies no longer fit the send buffer
+};
+
+/**
+ * @brief Read Device ID codes of FC 0x2B / MEI 0x0E
+ */
+enum DeviceIdCode : uint8_t {
+  DEVICE_ID_BASIC    = 0x01,  ///< objects 0x00-0x02, mandatory
+  DEVICE_ID_REGULAR  = 0x02,  ///< objects 0x00-0x06 (0x03-0x06 optional)
+  DEVICE_ID_EXTENDED = 0x03,  ///< also private objects 0x80-0xFF
+  DEVICE_ID_SPECIFIC = 0x04   ///< one object, given by its id
+};
+
+/**
+ * @brief Standard device identification objects
+ */
+enum DeviceIdObject : uint8_t {
+  VENDOR_NAME           = 0x00,
+  PRODUCT_CODE          = 0x01,
+  MAJOR_MINOR_REVISION  = 0x02,
+  VENDOR_URL            = 0x03,
+  PRODUCT_NAME          = 0x04,
+  MODEL_NAME            = 0x05,
+  USER_APPLICATION_NAME = 0x06
+};
+
+/**
+ * @brief Find an object in the packed device identification objects
+ * @return the value (not null terminated) and its length, nullptr if absent
+ */
+inline const uint8_t* findDeviceIdObject(const uint8_t* objects, uint16_t length, uint8_t objectId, uint8_t* valueLength) {
+  uint16_t i = 0;
+  while (i + 2u <= length && i + 2u + objects[i + 1] <= length) {
+    if (objects[i] == objectId) {
+      *valueLength = objects[i + 1];
+      return &objects[i + 2];
+    }
+    i += 2 + objects[i + 1];
+  }
+  return nullptr;
+}
+
 }  // namespace esp32Modbus
 
 #endif
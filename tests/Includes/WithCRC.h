@@ -0,0 +1,18 @@
+/* copyright 2019 Bert Melis */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <ModbusMessage.h>
+
+// RTU frame: the given bytes plus their CRC
+inline std::vector<uint8_t> withCRC(std::vector<uint8_t> frame) {
+  uint16_t crc = esp32ModbusRTUInternals::CRC16(frame.data(), frame.size());
+  frame.push_back(crc & 0xFF);
+  frame.push_back(crc >> 8);
+  return frame;
+}
+
+inline std::vector<uint8_t> withCRC(const uint8_t* data, size_t length) {
+  return withCRC(std::vector<uint8_t>(data, data + length));
+}
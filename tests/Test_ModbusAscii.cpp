@@ -0,0 +1,162 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusAscii.h>
+#include <ModbusMessage.h>
+
+#include "Includes/catch.hpp"
+#include "Includes/CheckArray.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using esp32ModbusRTUInternals::AsciiDecoder;
+
+namespace {
+
+bool feedAll(AsciiDecoder* decoder, const char* chars) {
+  bool ended = false;
+  for (size_t i = 0; i < strlen(chars); ++i) ended = decoder->feed(chars[i]);
+  return ended;
+}
+
+}  // namespace
+
+TEST_CASE("LRC and hex conversion", "[ascii]") {
+  // spec example: read 3 holding registers from 0x006B of slave 0x11
+  const uint8_t pdu[] = {0x11, 0x03, 0x00, 0x6B, 0x00, 0x03};
+  CHECK(esp32ModbusRTUInternals::asciiLRC(pdu, sizeof(pdu)) == 0x7E);
+
+  char hex[256 * 2];
+  uint8_t all[256];
+  for (int i = 0; i < 256; ++i) all[i] = i;
+  esp32ModbusRTUInternals::hexEncode(all, 256, hex);
+  CHECK(std::string(hex, 6) == "000102");
+  CHECK(std::string(&hex[2 * 0xAF], 2) == "AF");
+  uint8_t decoded[256];
+  REQUIRE(esp32ModbusRTUInternals::hexDecode(hex, 256, decoded));
+  CHECK_THAT(decoded, ByteArrayEqual(all, 256));
+
+  REQUIRE(esp32ModbusRTUInternals::hexDecode("aF", 1, decoded));
+  CHECK(decoded[0] == 0xAF);
+  CHECK_FALSE(esp32ModbusRTUInternals::hexDecode("0G", 1, decoded));
+}
+
+TEST_CASE("ASCII frame of a request", "[ascii]") {
+  esp32ModbusRTUInternals::ModbusRequest03 request(0x11, 0x006B, 3);
+  char frame[esp32ModbusRTUInternals::MODBUS_ASCII_MAX_ADU];
+  size_t length = esp32ModbusRTUInternals::asciiEncodeFrame(request.getMessage(), request.getSize(), frame, sizeof(frame));
+  CHECK(std::string(frame, length) == ":1103006B00037E\r\n");
+  CHECK(esp32ModbusRTUInternals::asciiEncodeFrame(request.getMessage(), request.getSize(), frame, 16) == 0);
+}
+
+TEST_CASE("ASCII frame decoding", "[ascii]") {
+  AsciiDecoder decoder;
+
+  SECTION("valid response into a ModbusResponse") {
+    esp32ModbusRTUInternals::ModbusRequest03 request(0x11, 0x006B, 3);
+    // 0xAE41, 0x5652, 0x4340; LRC over 11 03 06 AE 41 56 52 43 40
+    REQUIRE(feedAll(&decoder, "noise:110306AE4156524340CC\r\n"));
+    REQUIRE(decoder.getError() == esp32Modbus::SUCCESS);
+    REQUIRE(decoder.size() == 11);
+    CHECK(esp32ModbusRTUInternals::rtuCheckCRC(decoder.frame(), decoder.size()));
+
+    esp32ModbusRTUInternals::ModbusResponse response(request.responseLength(), &request);
+    for (size_t i = 0; i < decoder.size(); ++i) response.add(decoder.frame()[i]);
+    CHECK(response.isComplete());
+    CHECK(response.isSuccess());
+    const uint8_t registers[] = {0xAE, 0x41, 0x56, 0x52, 0x43, 0x40};
+    CHECK_THAT(response.getData(), ByteArrayEqual(registers, sizeof(registers)));
+  }
+
+  SECTION("lower case hex") {
+    REQUIRE(feedAll(&decoder, ":110306ae4156524340cc\r\n"));
+    CHECK(decoder.getError() == esp32Modbus::SUCCESS);
+  }
+
+  SECTION("start char restarts the frame") {
+    CHECK_FALSE(feedAll(&decoder, ":1103"));
+    REQUIRE(feedAll(&decoder, ":110306AE4156524340CC\r\n"));
+    CHECK(decoder.getError() == esp32Modbus::SUCCESS);
+    CHECK(decoder.size() == 11);
+  }
+
+  SECTION("LRC mismatch") {
+    REQUIRE(feedAll(&decoder, ":110306AE4156524340CD\r\n"));
+    CHECK(decoder.getError() == esp32Modbus::CRC_ERROR);
+  }
+
+  SECTION("malformed") {
+    REQUIRE(feedAll(&decoder, ":1103X6AE4156524340CC\r\n"));
+    CHECK(decoder.getError() == esp32Modbus::INVALID_RESPONSE);
+    decoder.reset();
+    REQUIRE(feedAll(&decoder, ":110306AE4156524340C\r\n"));  // odd number of chars
+    CHECK(decoder.getError() == esp32Modbus::INVALID_RESPONSE);
+    decoder.reset();
+    REQUIRE(feedAll(&decoder, ":11\r\n"));
+    CHECK(decoder.getError() == esp32Modbus::INVALID_RESPONSE);
+  }
+}
+
+TEST_CASE("Hex conversion of a full frame", "[.][benchmark]") {
+  uint8_t frame[255];
+  for (int i = 0; i < 255; ++i) frame[i] = static_cast<uint8_t>(i * 37);
+  char hex[510];
+  uint8_t decoded[255];
+  const int rounds = 200000;
+  volatile uint32_t sink = 0;
+
+  auto report = [&](const char* name, std::chrono::steady_clock::time_point start) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-24s %7.1f ns/frame, %7.1f MB/s\n", name, seconds / rounds * 1e9, 255.0 * rounds / seconds / 1e6);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    frame[0] = static_cast<uint8_t>(r);
+    for (int i = 0; i < 255; ++i) {
+      uint8_t high = frame[i] >> 4;
+      uint8_t low = frame[i] & 0x0F;
+      hex[2 * i] = high < 10 ? '0' + high : 'A' + high - 10;
+      hex[2 * i + 1] = low < 10 ? '0' + low : 'A' + low - 10;
+    }
+    sink = sink + hex[r % 510];
+  }
+  report("encode, per nibble", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    frame[0] = static_cast<uint8_t>(r);
+    esp32ModbusRTUInternals::hexEncode(frame, 255, hex);
+    sink = sink + hex[r % 510];
+  }
+  report("hexEncode", start);
+
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+  };
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    hex[0] = "0123456789ABCDEF"[r & 0x0F];
+    bool valid = true;
+    for (int i = 0; i < 255; ++i) {
+      int high = nibble(hex[2 * i]);
+      int low = nibble(hex[2 * i + 1]);
+      if (high < 0 || low < 0) valid = false;
+      decoded[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    sink = sink + decoded[r % 255] + valid;
+  }
+  report("decode, per char branches", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    hex[0] = "0123456789ABCDEF"[r & 0x0F];
+    bool valid = esp32ModbusRTUInternals::hexDecode(hex, 255, decoded);
+    sink = sink + decoded[r % 255] + valid;
+  }
+  report("hexDecode", start);
+}
@@ -0,0 +1,78 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusBusMeter.h>
+
+#include "Includes/catch.hpp"
+
+using esp32ModbusRTUInternals::BusMeter;
+
+namespace {
+
+// One transaction as the worker task reports it, starting at start
+uint32_t transaction(BusMeter* meter, uint32_t start) {
+  meter->enter(esp32ModbusRTUInternals::BUS_SILENCE, start);         // idle until here
+  meter->enter(esp32ModbusRTUInternals::BUS_TX, start + 1750);       // t3.5
+  meter->sent(8);
+  meter->enter(esp32ModbusRTUInternals::BUS_GUARD, start + 10000);   // 8 bytes at 9600 baud
+  meter->enter(esp32ModbusRTUInternals::BUS_WAIT, start + 11500);    // last character and margin
+  meter->enter(esp32ModbusRTUInternals::BUS_RX, start + 20000);      // slave's turnaround
+  meter->received(9);
+  meter->enter(esp32ModbusRTUInternals::BUS_IDLE, start + 30000);
+  return start + 30000;
+}
+
+}  // namespace
+
+TEST_CASE("Bus meter phases", "[busmeter]") {
+  BusMeter meter;
+  CHECK(meter.total().elapsedUs == 0);
+  meter.enter(esp32ModbusRTUInternals::BUS_IDLE, 5000);  // starts here
+  uint32_t end = transaction(&meter, 25000);
+
+  esp32Modbus::BusUsage usage = meter.total();
+  CHECK(usage.elapsedUs == end - 5000);
+  CHECK(usage.idleUs == 20000);
+  CHECK(usage.silenceUs == 1750);
+  CHECK(usage.txUs == 8250);
+  CHECK(usage.guardUs == 1500);
+  CHECK(usage.waitUs == 8500);
+  CHECK(usage.rxUs == 10000);
+  CHECK(usage.txBytes == 8);
+  CHECK(usage.rxBytes == 9);
+  CHECK(usage.utilization() == Approx(30000.0 / 50000));
+  CHECK(usage.wireShare() == Approx(18250.0 / 50000));
+  CHECK(meter.phase() == esp32ModbusRTUInternals::BUS_IDLE);
+}
+
+TEST_CASE("Bus meter seconds", "[busmeter]") {
+  BusMeter meter;
+  meter.enter(esp32ModbusRTUInternals::BUS_IDLE, 0);
+  uint32_t now = 0;
+  for (int i = 0; i < 30; ++i) now = transaction(&meter, now);  // 900 ms, busy all the time
+  CHECK(meter.lastSecond().elapsedUs == 0);  // no second complete yet
+
+  // the idle time up to 1.5 s is split over the first and the second second
+  meter.enter(esp32ModbusRTUInternals::BUS_IDLE, 1500000);
+  esp32Modbus::BusUsage second = meter.lastSecond();
+  CHECK(second.elapsedUs == 1000000);
+  CHECK(second.idleUs == 100000);
+  CHECK(second.txBytes == 30 * 8);
+  CHECK(second.rxBytes == 30 * 9);
+  CHECK(second.utilization() == Approx(0.9));
+
+  // a long wait closes several seconds at once, the last one all idle
+  meter.enter(esp32ModbusRTUInternals::BUS_IDLE, 4200000);
+  second = meter.lastSecond();
+  CHECK(second.elapsedUs == 1000000);
+  CHECK(second.idleUs == 1000000);
+  CHECK(second.txBytes == 0);
+  CHECK(meter.total().elapsedUs == 4200000);
+  CHECK(meter.total().txBytes == 30 * 8);
+
+  // micros() wrapping around
+  BusMeter wrapped;
+  wrapped.enter(esp32ModbusRTUInternals::BUS_IDLE, UINT32_MAX - 10000);
+  transaction(&wrapped, UINT32_MAX - 5000);
+  CHECK(wrapped.total().elapsedUs == 35000);
+  CHECK(wrapped.total().rxUs == 10000);
+}
@@ -0,0 +1,266 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusDecode.h>
+
+#include "Includes/catch.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+TEST_CASE("Decode 16 bit registers", "[decode]") {
+  // 7 registers: one SWAR block plus a tail
+  uint8_t data[] = {0x00, 0x01, 0x12, 0x34, 0xFF, 0xFE, 0x80, 0x00, 0x7F, 0xFF, 0xAB, 0xCD, 0x00, 0x0A};
+  uint16_t u[7];
+  int16_t s[7];
+  esp32Modbus::decodeU16(data, 7, u);
+  esp32Modbus::decodeI16(data, 7, s);
+  uint16_t expected[] = {0x0001, 0x1234, 0xFFFE, 0x8000, 0x7FFF, 0xABCD, 0x000A};
+  for (int i = 0; i < 7; ++i) {
+    CHECK(u[i] == expected[i]);
+  }
+  CHECK(s[2] == -2);
+  CHECK(s[3] == -32768);
+  CHECK(s[4] == 32767);
+}
+
+TEST_CASE("Decode 32 bit values in all word orders", "[decode]") {
+  float f;
+  uint32_t u;
+  int32_t i;
+
+  SECTION("ABCD") {
+    uint8_t one[] = {0x3F, 0x80, 0x00, 0x00};
+    uint8_t value[] = {0x12, 0x34, 0x56, 0x78};
+    esp32Modbus::decodeFloat(one, 1, &f, esp32Modbus::ABCD);
+    esp32Modbus::decodeU32(value, 1, &u, esp32Modbus::ABCD);
+    CHECK(f == 1.0f);
+    CHECK(u == 0x12345678);
+  }
+
+  SECTION("CDAB") {
+    uint8_t one[] = {0x00, 0x00, 0x3F, 0x80};
+    uint8_t value[] = {0x56, 0x78, 0x12, 0x34};
+    esp32Modbus::decodeFloat(one, 1, &f, esp32Modbus::CDAB);
+    esp32Modbus::decodeU32(value, 1, &u, esp32Modbus::CDAB);
+    CHECK(f == 1.0f);
+    CHECK(u == 0x12345678);
+  }
+
+  SECTION("BADC") {
+    uint8_t one[] = {0x80, 0x3F, 0x00, 0x00};
+    uint8_t value[] = {0x34, 0x12, 0x78, 0x56};
+    esp32Modbus::decodeFloat(one, 1, &f, esp32Modbus::BADC);
+    esp32Modbus::decodeU32(value, 1, &u, esp32Modbus::BADC);
+    CHECK(f == 1.0f);
+    CHECK(u == 0x12345678);
+  }
+
+  SECTION("DCBA") {
+    uint8_t one[] = {0x00, 0x00, 0x80, 0x3F};
+    uint8_t value[] = {0x78, 0x56, 0x34, 0x12};
+    esp32Modbus::decodeFloat(one, 1, &f, esp32Modbus::DCBA);
+    esp32Modbus::decodeU32(value, 1, &u, esp32Modbus::DCBA);
+    CHECK(f == 1.0f);
+    CHECK(u == 0x12345678);
+  }
+
+  SECTION("signed") {
+    uint8_t minusTwo[] = {0xFF, 0xFF, 0xFF, 0xFE};
+    esp32Modbus::decodeI32(minusTwo, 1, &i);
+    CHECK(i == -2);
+  }
+}
+
+TEST_CASE("Decode doubles", "[decode]") {
+  double d[2];
+  uint8_t abcd[] = {0x3F, 0xF0, 0, 0, 0, 0, 0, 0, 0xC0, 0x00, 0, 0, 0, 0, 0, 0};
+  esp32Modbus::decodeDouble(abcd, 2, d, esp32Modbus::ABCD);
+  CHECK(d[0] == 1.0);
+  CHECK(d[1] == -2.0);
+
+  uint8_t cdab[] = {0, 0, 0, 0, 0, 0, 0x3F, 0xF0};
+  esp32Modbus::decodeDouble(cdab, 1, d, esp32Modbus::CDAB);
+  CHECK(d[0] == 1.0);
+
+  uint8_t badc[] = {0xF0, 0x3F, 0, 0, 0, 0, 0, 0};
+  esp32Modbus::decodeDouble(badc, 1, d, esp32Modbus::BADC);
+  CHECK(d[0] == 1.0);
+
+  uint8_t dcba[] = {0, 0, 0, 0, 0, 0, 0xF0, 0x3F};
+  esp32Modbus::decodeDouble(dcba, 1, d, esp32Modbus::DCBA);
+  CHECK(d[0] == 1.0);
+}
+
+TEST_CASE("Decode 125 register payloads", "[.][benchmark]") {
+  uint8_t data[250];
+  for (int i = 0; i < 250; ++i) data[i] = static_cast<uint8_t>(i * 37);
+  uint16_t u16[125];
+  uint32_t u32[62];
+  float f[62];
+  double d[31];
+  const int rounds = 200000;
+  volatile uint32_t sink = 0;
+
+  auto report = [&](const char* name, std::chrono::steady_clock::time_point start) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-24s %7.1f ns/payload, %7.1f MB/s\n", name, seconds / rounds * 1e9, 250.0 * rounds / seconds / 1e6);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    data[0] = static_cast<uint8_t>(r);
+    for (int i = 0; i < 125; ++i) u16[i] = (data[i * 2] << 8) | data[i * 2 + 1];
+    sink = sink + u16[r % 125];
+  }
+  report("u16 naive loop", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    data[0] = static_cast<uint8_t>(r);
+    esp32Modbus::decodeU16(data, 125, u16);
+    sink = sink + u16[r % 125];
+  }
+  report("decodeU16", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    data[0] = static_cast<uint8_t>(r);
+    for (int i = 0; i < 62; ++i) {
+      uint8_t bytes[4] = {data[i * 4 + 3], data[i * 4 + 2], data[i * 4 + 1], data[i * 4]};
+      memcpy(&f[i], bytes, 4);
+    }
+    sink = sink + static_cast<uint32_t>(f[r % 62]);
+  }
+  report("float naive reverse", start);
+
+  const esp32Modbus::WordOrder orders[] = {esp32Modbus::ABCD, esp32Modbus::CDAB, esp32Modbus::BADC, esp32Modbus::DCBA};
+  const char* names[] = {"ABCD", "CDAB", "BADC", "DCBA"};
+  for (int o = 0; o < 4; ++o) {
+    char name[32];
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+      data[0] = static_cast<uint8_t>(r);
+      esp32Modbus::decodeU32(data, 62, u32, orders[o]);
+      sink = sink + u32[r % 62];
+    }
+    std::snprintf(name, sizeof(name), "decodeU32 %s", names[o]);
+    report(name, start);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+      data[0] = static_cast<uint8_t>(r);
+      esp32Modbus::decodeFloat(data, 62, f, orders[o]);
+      sink = sink + static_cast<uint32_t>(f[r % 62]);
+    }
+    std::snprintf(name, sizeof(name), "decodeFloat %s", names[o]);
+    report(name, start);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+      data[0] = static_cast<uint8_t>(r);
+      esp32Modbus::decodeDouble(data, 31, d, orders[o]);
+      sink = sink + static_cast<uint32_t>(d[r % 31]);
+    }
+    std::snprintf(name, sizeof(name), "decodeDouble %s", names[o]);
+    report(name, start);
+  }
+  CHECK(sink != 1);  // keep the results alive
+}
+
+TEST_CASE("Pack and unpack coils", "[bits]") {
+  const size_t counts[] = {1, 7, 8, 13, 64, 2000};
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+    size_t count = counts[c];
+    CAPTURE(count);
+    bool values[2000];
+    for (size_t i = 0; i < count; ++i) values[i] = ((i * 7919) % 5) < 2;
+
+    uint8_t packed[250];
+    memset(packed, 0xFF, sizeof(packed));
+    esp32Modbus::packBits(values, count, packed);
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i) ok &= (((packed[i / 8] >> (i % 8)) & 1) != 0) == values[i];
+    CHECK(ok);
+    if (count % 8) CHECK((packed[count / 8] >> (count % 8)) == 0);  // unused bits cleared
+
+    bool unpacked[2000];
+    esp32Modbus::unpackBits(packed, count, unpacked);
+    CHECK(memcmp(values, unpacked, count) == 0);
+
+    uint32_t words[63];
+    memset(words, 0xFF, sizeof(words));
+    esp32Modbus::decodeBits(packed, count, words);
+    ok = true;
+    for (size_t i = 0; i < count; ++i) ok &= (((words[i / 32] >> (i % 32)) & 1) != 0) == values[i];
+    CHECK(ok);
+    if (count % 32) CHECK((words[count / 32] >> (count % 32)) == 0);
+
+    uint8_t encoded[250];
+    memset(encoded, 0xFF, sizeof(encoded));
+    if (count % 32) words[count / 32] |= 0x80000000;  // set bits beyond count are dropped
+    esp32Modbus::encodeBits(words, count, encoded);
+    CHECK(memcmp(packed, encoded, (count + 7) / 8) == 0);
+  }
+}
+
+TEST_CASE("Pack and unpack 2000 coils", "[.][benchmark]") {
+  bool values[2000];
+  for (int i = 0; i < 2000; ++i) values[i] = (i % 3) == 0;
+  uint8_t packed[250];
+  bool unpacked[2000];
+  uint32_t words[63];
+  const int rounds = 100000;
+  volatile uint32_t sink = 0;
+
+  auto report = [&](const char* name, std::chrono::steady_clock::time_point start) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-24s %8.1f ns per 2000 coils\n", name, seconds / rounds * 1e9);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    values[0] = r & 1;
+    for (int i = 0; i < 250; i++) {  // the former ModbusRequest0F loop
+      uint8_t byte = 0;
+      for (int bit = 0; bit < 8 && (i * 8 + bit) < 2000; bit++) {
+        if (values[i * 8 + bit]) byte |= (1 << bit);
+      }
+      packed[i] = byte;
+    }
+    sink = sink + packed[r % 250];
+  }
+  report("pack, per-bit loop", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    values[0] = r & 1;
+    esp32Modbus::packBits(values, 2000, packed);
+    sink = sink + packed[r % 250];
+  }
+  report("packBits", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    packed[0] = static_cast<uint8_t>(r);
+    for (int i = 0; i < 2000; ++i) unpacked[i] = (packed[i / 8] >> (i % 8)) & 1;
+    sink = sink + unpacked[r % 2000];
+  }
+  report("unpack, per-bit loop", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    packed[0] = static_cast<uint8_t>(r);
+    esp32Modbus::unpackBits(packed, 2000, unpacked);
+    sink = sink + unpacked[r % 2000];
+  }
+  report("unpackBits", start);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    packed[0] = static_cast<uint8_t>(r);
+    esp32Modbus::decodeBits(packed, 2000, words);
+    sink = sink + words[r % 63];
+  }
+  report("decodeBits (words)", start);
+  CHECK(sink != 1);
+}
@@ -0,0 +1,71 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusDeltaFilter.h>
+#include <esp32ModbusTypeDefs.h>
+
+#include "Includes/catch.hpp"
+
+using esp32ModbusRTUInternals::DeltaFilter;
+
+TEST_CASE("Delta filter on registers", "[delta]") {
+  DeltaFilter filter;
+  uint8_t dirty[2];
+  uint8_t data[] = {0x00, 0x01, 0x00, 0x02, 0x00, 0x03};
+
+  REQUIRE(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), dirty));
+  CHECK(dirty[0] == 0xFF);  // first time: everything is new
+
+  CHECK_FALSE(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), dirty));
+
+  data[3] = 0x22;  // register 1
+  REQUIRE(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), dirty));
+  CHECK(dirty[0] == 0x02);
+
+  data[4] = 0x10;  // register 2
+  data[1] = 0x10;  // register 0
+  REQUIRE(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), dirty));
+  CHECK(dirty[0] == 0x05);
+
+  SECTION("reads are keyed by slave, function code, address and count") {
+    CHECK(filter.update(0x12, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), nullptr));
+    CHECK(filter.update(0x11, esp32Modbus::READ_INPUT_REGISTER, 100, 3, data, sizeof(data), nullptr));
+    CHECK(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 101, 3, data, sizeof(data), nullptr));
+    CHECK(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 2, data, 4, nullptr));
+    CHECK_FALSE(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), nullptr));
+  }
+
+  SECTION("clear") {
+    filter.clear();
+    CHECK(filter.update(0x11, esp32Modbus::READ_HOLD_REGISTER, 100, 3, data, sizeof(data), nullptr));
+  }
+}
+
+TEST_CASE("Delta filter on coils", "[delta]") {
+  DeltaFilter filter;
+  uint8_t dirty[2];
+  uint8_t coils[] = {0xCD, 0x01};
+
+  filter.update(0x11, esp32Modbus::READ_COIL, 0x13, 10, coils, sizeof(coils), dirty);
+  coils[0] = 0xCC;
+  coils[1] = 0x03;
+  REQUIRE(filter.update(0x11, esp32Modbus::READ_COIL, 0x13, 10, coils, sizeof(coils), dirty));
+  CHECK(dirty[0] == 0x01);
+  CHECK(dirty[1] == 0x02);
+
+  // same address and byte count, but another read
+  CHECK(filter.update(0x11, esp32Modbus::READ_COIL, 0x13, 16, coils, sizeof(coils), nullptr));
+  CHECK_FALSE(filter.update(0x11, esp32Modbus::READ_COIL, 0x13, 10, coils, sizeof(coils), nullptr));
+}
+
+TEST_CASE("Delta filter forgets the least recently used read", "[delta]") {
+  DeltaFilter filter;
+  uint8_t data[] = {0x00, 0x01};
+  for (uint16_t i = 0; i < MODBUS_DELTA_SLOTS; ++i) {
+    filter.update(0x01, esp32Modbus::READ_HOLD_REGISTER, i, 1, data, sizeof(data), nullptr);
+  }
+  // keep address 0 recent, then push one more read in
+  CHECK_FALSE(filter.update(0x01, esp32Modbus::READ_HOLD_REGISTER, 0, 1, data, sizeof(data), nullptr));
+  filter.update(0x01, esp32Modbus::READ_HOLD_REGISTER, 1000, 1, data, sizeof(data), nullptr);
+  CHECK_FALSE(filter.update(0x01, esp32Modbus::READ_HOLD_REGISTER, 0, 1, data, sizeof(data), nullptr));
+  CHECK(filter.update(0x01, esp32Modbus::READ_HOLD_REGISTER, 1, 1, data, sizeof(data), nullptr));
+}
@@ -0,0 +1,221 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusFramer.h>
+#include <ModbusMessage.h>
+
+#include "Includes/catch.hpp"
+#include "Includes/CheckArray.h"
+#include "Includes/WithCRC.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using esp32ModbusRTUInternals::RTUFramer;
+
+namespace {
+
+// FC03 response, 2 registers, and FC06 echo
+const uint8_t frameA[] = {0x11, 0x03, 0x04, 0x00, 0x0A, 0x01, 0x02, 0x00, 0x00};
+const uint8_t frameB[] = {0x11, 0x06, 0x00, 0x01, 0x00, 0x03, 0x9A, 0x9B};
+
+struct Collector {
+  std::vector<std::vector<uint8_t>> frames;
+  void attach(RTUFramer* framer) {
+    framer->onFrame([this](const uint8_t* frame, size_t length) {
+      frames.push_back(std::vector<uint8_t>(frame, frame + length));
+    });
+  }
+};
+
+}  // namespace
+
+TEST_CASE("Response length hint", "[framer]") {
+  std::vector<uint8_t> a = withCRC(frameA, 7);
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(a.data(), 1) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(a.data(), 2) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(a.data(), 3) == 9);
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(frameB, 2) == 8);
+  const uint8_t exception[] = {0x11, 0x83, 0x02};
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(exception, 2) == 5);
+  const uint8_t custom[] = {0x11, 0x41};
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(custom, 2) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuCheckCRC(a.data(), a.size()));
+  CHECK(esp32ModbusRTUInternals::rtuSilenceUs(9600) == 4010);
+  CHECK(esp32ModbusRTUInternals::rtuSilenceUs(115200) == 1750);
+}
+
+TEST_CASE("Device identification length hint", "[framer]") {
+  // two objects: "AB" and "XYZ"
+  const uint8_t pdu[] = {0x11, 0x2B, 0x0E, 0x01, 0x01, 0x00, 0x00, 0x02,
+                         0x00, 0x02, 'A', 'B', 0x01, 0x03, 'X', 'Y', 'Z'};
+  std::vector<uint8_t> frame = withCRC(pdu, sizeof(pdu));
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(frame.data(), 7) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(frame.data(), 9) == 0);   // first object length missing
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(frame.data(), 13) == 0);  // second object length missing
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(frame.data(), 14) == frame.size());
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(frame.data(), frame.size()) == frame.size());
+}
+
+TEST_CASE("FIFO queue length hint", "[framer]") {
+  const uint8_t fifo[] = {0x11, 0x18, 0x00, 0x06, 0x00, 0x02};
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(fifo, 3) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(fifo, 4) == 12);
+  const uint8_t tooLong[] = {0x11, 0x18, 0x01, 0x00};
+  CHECK(esp32ModbusRTUInternals::rtuResponseLength(tooLong, 4) == 0);
+}
+
+TEST_CASE("Silence delimited framing", "[framer]") {
+  std::vector<uint8_t> a = withCRC(frameA, 7);
+  std::vector<uint8_t> b(frameB, frameB + sizeof(frameB));
+  Collector collector;
+
+  SECTION("frames separated by silence, no hint") {
+    RTUFramer framer(1750);
+    collector.attach(&framer);
+    framer.feed(a.data(), a.size(), 1000);
+    CHECK(collector.frames.empty());  // not before the silence
+    framer.poll(2000);
+    CHECK(collector.frames.empty());
+    framer.feed(b.data(), b.size(), 3000);  // 2000 us after frame A
+    REQUIRE(collector.frames.size() == 1);
+    CHECK(collector.frames[0] == a);
+    framer.poll(5000);
+    REQUIRE(collector.frames.size() == 2);
+    CHECK(collector.frames[1] == b);
+    CHECK(framer.stats().frames == 2);
+  }
+
+  SECTION("glued frames are split by the length hint") {
+    RTUFramer framer(1750, esp32ModbusRTUInternals::rtuResponseLength);
+    collector.attach(&framer);
+    std::vector<uint8_t> stream(a);
+    stream.insert(stream.end(), b.begin(), b.end());
+    framer.feed(stream.data(), stream.size(), 1000);
+    REQUIRE(collector.frames.size() == 2);  // no silence needed
+    CHECK(collector.frames[0] == a);
+    CHECK(collector.frames[1] == b);
+  }
+
+  SECTION("glued frames without hint fail the CRC") {
+    RTUFramer framer(1750);
+    collector.attach(&framer);
+    framer.feed(a.data(), a.size(), 1000);
+    framer.feed(b.data(), b.size(), 1000);
+    framer.poll(3000);
+    CHECK(collector.frames.empty());
+    CHECK(framer.stats().crcErrors == 1);
+  }
+
+  SECTION("truncated frame") {
+    RTUFramer framer(1750, esp32ModbusRTUInternals::rtuResponseLength);
+    collector.attach(&framer);
+    framer.feed(a.data(), a.size() - 3, 1000);
+    framer.feed(b.data(), b.size(), 3000);
+    REQUIRE(collector.frames.size() == 1);
+    CHECK(collector.frames[0] == b);
+    CHECK(framer.stats().truncated == 1);
+  }
+
+  SECTION("noise between frames") {
+    RTUFramer framer(1750, esp32ModbusRTUInternals::rtuResponseLength);
+    collector.attach(&framer);
+    const uint8_t noise[] = {0xFF, 0x00};
+    framer.feed(a.data(), a.size(), 1000);
+    framer.feed(noise, sizeof(noise), 4000);
+    framer.feed(b.data(), b.size(), 7000);
+    framer.poll(10000);
+    REQUIRE(collector.frames.size() == 2);
+    CHECK(framer.stats().truncated == 1);
+  }
+
+  SECTION("trailing bytes do not extend a hinted frame") {
+    RTUFramer framer(1750, esp32ModbusRTUInternals::rtuResponseLength);
+    collector.attach(&framer);
+    framer.feed(a.data(), a.size(), 1000);
+    framer.feed(0x00, 1100);
+    framer.poll(5000);
+    REQUIRE(collector.frames.size() == 1);
+    CHECK(collector.frames[0] == a);
+  }
+
+  SECTION("overrun") {
+    RTUFramer framer(1750);
+    collector.attach(&framer);
+    for (int i = 0; i < 300; ++i) framer.feed(0x55, 1000);
+    framer.poll(5000);
+    CHECK(collector.frames.empty());
+    CHECK(framer.stats().overruns == 1);
+  }
+}
+
+namespace {
+
+// user defined function code with a response of unknown length
+class SilenceRequest : public esp32ModbusRTUInternals::ModbusRequest {
+ public:
+  SilenceRequest() : ModbusRequest(4) {
+    _slaveAddress = 0x11;
+    _functionCode = 0x41;
+  }
+  size_t responseLength() { return 0; }
+};
+
+}  // namespace
+
+TEST_CASE("Variable length response ends on silence", "[framer]") {
+  SilenceRequest request;
+  const uint8_t pdu[] = {0x11, 0x41, 0x01, 0x02, 0x03, 0x04, 0x05};
+  std::vector<uint8_t> frame = withCRC(pdu, sizeof(pdu));
+  esp32ModbusRTUInternals::ModbusResponse response(255, &request);
+  for (size_t i = 0; i < frame.size(); ++i) response.add(frame[i]);
+  CHECK_FALSE(response.isComplete());
+  response.endOfFrame();
+  CHECK(response.isComplete());
+  CHECK(response.isSuccess());
+}
+
+TEST_CASE("Framer throughput", "[.][benchmark]") {
+  // 125 register response, glued / truncated / noisy stream mix
+  uint8_t pdu[3 + 250];
+  pdu[0] = 0x11;
+  pdu[1] = 0x03;
+  pdu[2] = 250;
+  for (int i = 0; i < 250; ++i) pdu[3 + i] = static_cast<uint8_t>(i);
+  std::vector<uint8_t> big = withCRC(pdu, sizeof(pdu));
+  std::vector<uint8_t> small = withCRC(frameA, 7);
+  const uint8_t noise[] = {0xFF, 0x13, 0x00};
+
+  struct Chunk { const uint8_t* data; size_t length; uint32_t gapUs; };
+  std::vector<Chunk> chunks;
+  for (int i = 0; i < 100; ++i) {
+    chunks.push_back({big.data(), big.size(), 2000});
+    chunks.push_back({small.data(), small.size(), 0});          // glued
+    chunks.push_back({small.data(), small.size() - 4, 2000});   // truncated
+    chunks.push_back({noise, sizeof(noise), 2000});             // noise
+  }
+  size_t streamBytes = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) streamBytes += chunks[i].length;
+
+  const int rounds = 200;
+  for (int hinted = 0; hinted < 2; ++hinted) {
+    RTUFramer framer(1750, hinted ? esp32ModbusRTUInternals::rtuResponseLength : nullptr);
+    size_t delivered = 0;
+    framer.onFrame([&delivered](const uint8_t*, size_t length) { delivered += length; });
+    uint32_t now = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        now += chunks[i].gapUs;
+        framer.feed(chunks[i].data, chunks[i].length, now);
+      }
+    }
+    framer.poll(now + 2000);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("framer (%s): %.1f MB/s, %u frames, %u crc errors, %u truncated\n",
+                hinted ? "length hint" : "silence only",
+                streamBytes * rounds / seconds / 1e6,
+                framer.stats().frames, framer.stats().crcErrors, framer.stats().truncated);
+    if (hinted) CHECK(delivered > 0);
+  }
+}
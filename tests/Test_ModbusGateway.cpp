@@ -0,0 +1,448 @@
+/* copyright 2019 Bert Melis */
+
+#include <esp32ModbusGateway.h>
+#include <ModbusFramer.h>
+#include <ModbusMessage.h>
+#include <ModbusServer.h>
+
+#include "Includes/catch.hpp"
+#include "Includes/WithCRC.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using esp32ModbusRTUInternals::ModbusServer;
+
+namespace {
+
+// Stands in for esp32ModbusRTU: requests are answered one by one by a slave
+// simulation on another thread, like the worker task does on the bus.
+// delay stands in for the time a transaction takes on the wire.
+class SimulatedBus {
+ public:
+  SimulatedBus(ModbusServer* slave, std::chrono::microseconds delay) :
+    transactions(0),
+    _slave(slave),
+    _delay(delay),
+    _stop(false),
+    _worker([this] { _run(); }) {}
+
+  ~SimulatedBus() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_one();
+    _worker.join();
+  }
+
+  bool forward(uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length, esp32Modbus::MBRTUOnReply onReply) {
+    std::vector<uint8_t> frame = {slaveAddress, functionCode};
+    frame.insert(frame.end(), data, data + length);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queue.push_back({frame, onReply});
+    _wake.notify_one();
+    return true;
+  }
+
+  std::atomic<uint32_t> transactions;
+
+ private:
+  struct Job {
+    std::vector<uint8_t> frame;
+    esp32Modbus::MBRTUOnReply onReply;
+  };
+
+  void _run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+      _wake.wait(lock, [this] { return _stop || !_queue.empty(); });
+      if (_queue.empty()) return;
+      Job job = _queue.front();
+      _queue.pop_front();
+      lock.unlock();
+      if (_delay.count() > 0) std::this_thread::sleep_for(_delay);
+      ++transactions;
+      std::vector<uint8_t> frame = withCRC(job.frame);
+      uint8_t response[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];
+      size_t length = _slave->handle(frame.data(), frame.size(), response);
+      if (length == 0) {
+        job.onReply(esp32Modbus::TIMEOUT, nullptr, 0);
+      } else if (response[1] & esp32ModbusRTUInternals::MODBUS_ERROR_FLAG) {
+        job.onReply(static_cast<esp32Modbus::Error>(response[2]), nullptr, 0);
+      } else {
+        job.onReply(esp32Modbus::SUCCESS, &response[2], length - 4);
+      }
+      lock.lock();
+    }
+  }
+
+  ModbusServer* _slave;
+  std::chrono::microseconds _delay;
+  bool _stop;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::deque<Job> _queue;
+  std::thread _worker;
+};
+
+// Gateway on an ephemeral localhost port, polled by its own thread.
+// configure runs before polling starts.
+class GatewayFixture {
+ public:
+  explicit GatewayFixture(std::function<void(esp32ModbusGateway&)> configure = nullptr,
+                          std::chrono::microseconds busDelay = std::chrono::microseconds(0)) :
+    holding{0x0102, 0x0304, 0x0506, 0x0708},
+    slave(0x11, &map),
+    bus(&slave, busDelay),
+    gateway([this](uint8_t slaveAddress, uint8_t functionCode, const uint8_t* data, uint8_t length, esp32Modbus::MBRTUOnReply onReply) {
+      return bus.forward(slaveAddress, functionCode, data, length, onReply);
+    }),
+    _stop(false) {
+    map.setHoldingRegisters(0, 4, holding);
+    if (configure) configure(gateway);
+    REQUIRE(gateway.begin(0));
+    _poller = std::thread([this] {
+      while (!_stop) gateway.poll(10);
+    });
+  }
+
+  ~GatewayFixture() {
+    stopPolling();
+  }
+
+  void stopPolling() {
+    if (_poller.joinable()) {
+      _stop = true;
+      _poller.join();
+    }
+  }
+
+  // receiveBuffer: SO_RCVBUF of the client, 0 for the default
+  int connectClient(int receiveBuffer = 0) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    if (receiveBuffer > 0) setsockopt(client, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(gateway.getPort());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(connect(client, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+    struct timeval timeout = {2, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return client;
+  }
+
+  uint16_t holding[4];
+  esp32Modbus::RegisterMap map;
+  ModbusServer slave;
+  SimulatedBus bus;
+  esp32ModbusGateway gateway;
+
+ private:
+  std::atomic<bool> _stop;
+  std::thread _poller;
+};
+
+void sendRequest(int client, uint16_t transactionId, uint8_t unitId, const std::vector<uint8_t>& pdu) {
+  std::vector<uint8_t> frame = {static_cast<uint8_t>(transactionId >> 8), static_cast<uint8_t>(transactionId & 0xFF),
+                                0x00, 0x00, 0x00, static_cast<uint8_t>(pdu.size() + 1), unitId};
+  frame.insert(frame.end(), pdu.begin(), pdu.end());
+  REQUIRE(send(client, frame.data(), frame.size(), 0) == static_cast<ssize_t>(frame.size()));
+}
+
+bool receiveAll(int client, uint8_t* buffer, size_t length) {
+  size_t received = 0;
+  while (received < length) {
+    ssize_t n = recv(client, &buffer[received], length - received, 0);
+    if (n <= 0) return false;
+    received += n;
+  }
+  return true;
+}
+
+// Whole MBAP frame, empty when the connection closed or timed out
+std::vector<uint8_t> receiveFrame(int client) {
+  uint8_t frame[esp32ModbusRTUInternals::MODBUS_TCP_MAX_ADU];
+  if (!receiveAll(client, frame, 7)) return {};
+  size_t length = esp32ModbusRTUInternals::mbapFrameLength(frame);
+  if (length == 0 || !receiveAll(client, &frame[7], length - 7)) return {};
+  return std::vector<uint8_t>(frame, frame + length);
+}
+
+}  // namespace
+
+TEST_CASE("MBAP header checks", "[gateway]") {
+  const uint8_t request[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x11, 0x03, 0x00, 0x6B, 0x00, 0x03};
+  CHECK(esp32ModbusRTUInternals::mbapFrameLength(request) == 12);
+  const uint8_t otherProtocol[] = {0x00, 0x01, 0x00, 0x01, 0x00, 0x06, 0x11};
+  CHECK(esp32ModbusRTUInternals::mbapFrameLength(otherProtocol) == 0);
+  const uint8_t tooShort[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x11};
+  CHECK(esp32ModbusRTUInternals::mbapFrameLength(tooShort) == 0);
+  const uint8_t tooLong[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0xFF, 0x11};
+  CHECK(esp32ModbusRTUInternals::mbapFrameLength(tooLong) == 0);
+
+  CHECK(esp32ModbusRTUInternals::gatewayException(esp32Modbus::ILLEGAL_DATA_ADDRESS) == 0x02);
+  CHECK(esp32ModbusRTUInternals::gatewayException(esp32Modbus::TIMEOUT) == 0x0B);
+  CHECK(esp32ModbusRTUInternals::gatewayException(esp32Modbus::CRC_ERROR) == 0x0B);
+  CHECK(esp32ModbusRTUInternals::gatewayException(esp32Modbus::QUEUE_FULL) == 0x06);
+}
+
+TEST_CASE("Gateway forwards requests of concurrent clients", "[gateway]") {
+  GatewayFixture fixture;
+  std::vector<int> clients;
+  for (int i = 0; i < 5; ++i) clients.push_back(fixture.connectClient());
+
+  // every client pipelines three reads before reading any response
+  for (size_t c = 0; c < clients.size(); ++c) {
+    for (uint16_t r = 0; r < 3; ++r) {
+      sendRequest(clients[c], 0x100 * c + r, 0x11, {0x03, 0x00, static_cast<uint8_t>(r), 0x00, 0x01});
+    }
+  }
+  for (size_t c = 0; c < clients.size(); ++c) {
+    for (uint16_t r = 0; r < 3; ++r) {
+      std::vector<uint8_t> response = receiveFrame(clients[c]);
+      uint16_t transactionId = 0x100 * c + r;
+      CHECK(response == std::vector<uint8_t>({static_cast<uint8_t>(transactionId >> 8), static_cast<uint8_t>(transactionId & 0xFF),
+                                              0x00, 0x00, 0x00, 0x05, 0x11, 0x03, 0x02,
+                                              static_cast<uint8_t>(fixture.holding[r] >> 8), static_cast<uint8_t>(fixture.holding[r] & 0xFF)}));
+    }
+  }
+
+  // writes reach the slave and come back as echo
+  sendRequest(clients[0], 0x0042, 0x11, {0x06, 0x00, 0x03, 0xAB, 0xCD});
+  CHECK(receiveFrame(clients[0]) == std::vector<uint8_t>({0x00, 0x42, 0x00, 0x00, 0x00, 0x06, 0x11, 0x06, 0x00, 0x03, 0xAB, 0xCD}));
+  CHECK(fixture.holding[3] == 0xABCD);
+
+  for (int client : clients) close(client);
+  fixture.stopPolling();
+  CHECK(fixture.gateway.getStats().connections == 5);
+  CHECK(fixture.gateway.getStats().forwarded == 16);
+  CHECK(fixture.bus.transactions == 16);
+}
+
+TEST_CASE("Gateway unit mapping and exceptions", "[gateway]") {
+  GatewayFixture fixture;
+  int client = fixture.connectClient();
+
+  // unit 0xFF is not mapped by default, then mapped onto the slave
+  sendRequest(client, 1, 0xFF, {0x03, 0x00, 0x00, 0x00, 0x01});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0xFF, 0x83, 0x0A}));
+  CHECK_FALSE(fixture.gateway.mapUnit(0xFF, 0x00));  // no broadcasts
+  CHECK_FALSE(fixture.gateway.mapUnit(0xFF, 0xF8));
+  CHECK(fixture.gateway.mapUnit(0xFF, 0x11));
+  sendRequest(client, 2, 0xFF, {0x03, 0x00, 0x00, 0x00, 0x01});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x02, 0x00, 0x00, 0x00, 0x05, 0xFF, 0x03, 0x02, 0x01, 0x02}));
+
+  // the slave's exception is passed on, a slave that does not answer is a failed target
+  sendRequest(client, 3, 0x11, {0x03, 0x00, 0x10, 0x00, 0x01});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x03, 0x00, 0x00, 0x00, 0x03, 0x11, 0x83, 0x02}));
+  sendRequest(client, 4, 0x22, {0x03, 0x00, 0x00, 0x00, 0x01});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x04, 0x00, 0x00, 0x00, 0x03, 0x22, 0x83, 0x0B}));
+  fixture.gateway.unmapUnit(0x22);
+  sendRequest(client, 5, 0x22, {0x03, 0x00, 0x00, 0x00, 0x01});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x05, 0x00, 0x00, 0x00, 0x03, 0x22, 0x83, 0x0A}));
+
+  // a header with another protocol id ends the connection
+  const uint8_t garbage[] = {0x00, 0x06, 0x12, 0x34, 0x00, 0x06, 0x11, 0x03, 0x00, 0x00, 0x00, 0x01};
+  send(client, garbage, sizeof(garbage), 0);
+  CHECK(receiveFrame(client).empty());
+  close(client);
+
+  fixture.stopPolling();
+  CHECK(fixture.gateway.getStats().exceptions == 4);
+  CHECK(fixture.gateway.getStats().protocolErrors == 1);
+}
+
+TEST_CASE("Gateway drops replies for clients that left", "[gateway]") {
+  GatewayFixture fixture;
+  int client = fixture.connectClient();
+  sendRequest(client, 7, 0x11, {0x03, 0x00, 0x00, 0x00, 0x01});
+  close(client);
+  // wait for the reply: dropped, or sent if the close was not seen yet
+  for (int i = 0; i < 200 && fixture.gateway.getStats().dropped + fixture.gateway.getStats().responses == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  int next = fixture.connectClient();  // takes over the slot
+  sendRequest(next, 8, 0x11, {0x03, 0x00, 0x01, 0x00, 0x01});
+  CHECK(receiveFrame(next) == std::vector<uint8_t>({0x00, 0x08, 0x00, 0x00, 0x00, 0x05, 0x11, 0x03, 0x02, 0x03, 0x04}));
+  close(next);
+}
+
+TEST_CASE("Gateway disconnects a client that does not read its replies", "[gateway]") {
+  GatewayFixture fixture([](esp32ModbusGateway& gateway) {
+    gateway.setCacheTtl(0x11, esp32Modbus::READ_HOLD_REGISTER, 0, 4, 10000);  // replies without bus delay
+  });
+  int stalled = fixture.connectClient(1024);
+  int other = fixture.connectClient();
+
+  // pipeline reads without ever reading a reply until the gateway gives up on the client
+  std::vector<uint8_t> batch;
+  for (uint16_t i = 0; i < 1000; ++i) {
+    batch.insert(batch.end(), {static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i & 0xFF), 0x00, 0x00, 0x00, 0x06, 0x11,
+                               0x03, 0x00, 0x00, 0x00, 0x04});
+  }
+  for (int i = 0; i < 5000 && fixture.gateway.getStats().stalled == 0; ++i) {
+    ssize_t sent = send(stalled, batch.data(), batch.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) break;  // closed by the gateway
+    if (sent < 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  CHECK(fixture.gateway.getStats().stalled == 1);
+
+  // the others are still served
+  sendRequest(other, 1, 0x11, {0x03, 0x00, 0x00, 0x00, 0x01});
+  CHECK(receiveFrame(other) == std::vector<uint8_t>({0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x11, 0x03, 0x02, 0x01, 0x02}));
+
+  close(stalled);
+  close(other);
+}
+
+TEST_CASE("Gateway collapses identical reads in flight", "[gateway]") {
+  GatewayFixture fixture([](esp32ModbusGateway& gateway) { gateway.setCollapseReads(true); },
+                         std::chrono::milliseconds(100));
+  std::vector<int> clients;
+  for (int i = 0; i < 3; ++i) clients.push_back(fixture.connectClient());
+
+  // the first read occupies the bus, the others arrive while it is on the wire
+  sendRequest(clients[0], 1, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  sendRequest(clients[1], 2, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  sendRequest(clients[2], 3, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  // another range is forwarded on its own
+  sendRequest(clients[2], 4, 0x11, {0x03, 0x00, 0x01, 0x00, 0x02});
+  for (uint8_t c = 0; c < 3; ++c) {
+    CHECK(receiveFrame(clients[c]) == std::vector<uint8_t>({0x00, static_cast<uint8_t>(c + 1), 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04,
+                                                            0x01, 0x02, 0x03, 0x04}));
+  }
+  CHECK(receiveFrame(clients[2]) == std::vector<uint8_t>({0x00, 0x04, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x03, 0x04, 0x05, 0x06}));
+
+  for (int client : clients) close(client);
+  fixture.stopPolling();
+  CHECK(fixture.gateway.getStats().requests == 4);
+  CHECK(fixture.gateway.getStats().forwarded == 2);
+  CHECK(fixture.gateway.getStats().collapsed == 2);
+  CHECK(fixture.gateway.getStats().responses == 4);
+  CHECK(fixture.bus.transactions == 2);
+}
+
+TEST_CASE("Gateway reads see the client's own writes", "[gateway]") {
+  GatewayFixture fixture([](esp32ModbusGateway& gateway) {
+    gateway.setCollapseReads(true);
+    CHECK(gateway.setCacheTtl(0x11, esp32Modbus::READ_HOLD_REGISTER, 0, 4, 1000));
+  }, std::chrono::milliseconds(50));
+  int reader = fixture.connectClient();
+  int writer = fixture.connectClient();
+
+  // the writer's read comes after its write: it cannot share the reader's
+  // read forwarded before, and that one's reply is not cached
+  sendRequest(reader, 1, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  sendRequest(writer, 2, 0x11, {0x06, 0x00, 0x01, 0xBE, 0xEF});
+  sendRequest(writer, 3, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  CHECK(receiveFrame(reader) == std::vector<uint8_t>({0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04}));
+  CHECK(receiveFrame(writer).size() == 12);
+  CHECK(receiveFrame(writer) == std::vector<uint8_t>({0x00, 0x03, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x01, 0x02, 0xBE, 0xEF}));
+
+  // the read after the write was cached
+  sendRequest(reader, 4, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  CHECK(receiveFrame(reader) == std::vector<uint8_t>({0x00, 0x04, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x01, 0x02, 0xBE, 0xEF}));
+
+  close(reader);
+  close(writer);
+  fixture.stopPolling();
+  CHECK(fixture.gateway.getStats().collapsed == 0);
+  CHECK(fixture.gateway.getStats().cacheHits == 1);
+  CHECK(fixture.bus.transactions == 3);
+}
+
+TEST_CASE("Gateway caches reads for their range's TTL", "[gateway]") {
+  GatewayFixture fixture([](esp32ModbusGateway& gateway) {
+    CHECK_FALSE(gateway.setCacheTtl(0, esp32Modbus::WRITE_HOLD_REGISTER, 0, 3, 200));
+    CHECK(gateway.setCacheTtl(0x11, esp32Modbus::READ_HOLD_REGISTER, 0, 3, 200));
+  });
+  int client = fixture.connectClient();
+
+  sendRequest(client, 1, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04}));
+  sendRequest(client, 2, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x01, 0x02, 0x03, 0x04}));
+  CHECK(fixture.bus.transactions == 1);
+
+  // partly outside the rule's range: always forwarded
+  sendRequest(client, 3, 0x11, {0x03, 0x00, 0x02, 0x00, 0x02});
+  CHECK(receiveFrame(client).size() == 13);
+  sendRequest(client, 4, 0x11, {0x03, 0x00, 0x02, 0x00, 0x02});
+  CHECK(receiveFrame(client).size() == 13);
+  CHECK(fixture.bus.transactions == 3);
+
+  // a write drops the cached reads it overlaps
+  sendRequest(client, 5, 0x11, {0x03, 0x00, 0x01, 0x00, 0x02});
+  CHECK(receiveFrame(client).size() == 13);
+  sendRequest(client, 6, 0x11, {0x06, 0x00, 0x02, 0xBE, 0xEF});
+  CHECK(receiveFrame(client).size() == 12);
+  sendRequest(client, 7, 0x11, {0x03, 0x00, 0x01, 0x00, 0x02});
+  CHECK(receiveFrame(client) == std::vector<uint8_t>({0x00, 0x07, 0x00, 0x00, 0x00, 0x07, 0x11, 0x03, 0x04, 0x03, 0x04, 0xBE, 0xEF}));
+  sendRequest(client, 8, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  CHECK(receiveFrame(client).size() == 13);
+  CHECK(fixture.bus.transactions == 6);
+
+  // expired
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  sendRequest(client, 9, 0x11, {0x03, 0x00, 0x00, 0x00, 0x02});
+  CHECK(receiveFrame(client).size() == 13);
+  CHECK(fixture.bus.transactions == 7);
+
+  close(client);
+  fixture.stopPolling();
+  CHECK(fixture.gateway.getStats().cacheHits == 2);
+}
+
+// Clients poll the same registers in lockstep over a bus that takes 5 ms per
+// transaction. Collapsing and caching let the TCP side outrun the RTU side.
+TEST_CASE("Gateway load benchmark", "[.][benchmark]") {
+  const int clientCounts[] = {1, 4, 8};
+  const char* modes[] = {"forward all", "collapse", "collapse + 50 ms TTL"};
+  printf("%-22s %8s %14s %14s\n", "mode", "clients", "TCP req/s", "RTU trans/s");
+  for (int mode = 0; mode < 3; ++mode) {
+    for (int clientCount : clientCounts) {
+      GatewayFixture fixture([mode](esp32ModbusGateway& gateway) {
+        gateway.setCollapseReads(mode > 0);
+        if (mode > 1) gateway.setCacheTtl(0, esp32Modbus::READ_HOLD_REGISTER, 0, 4, 50);
+      }, std::chrono::milliseconds(5));
+      std::atomic<uint32_t> answered(0);
+      std::atomic<bool> stop(false);
+      std::vector<std::thread> clients;
+      for (int c = 0; c < clientCount; ++c) {
+        int socket = fixture.connectClient();
+        clients.emplace_back([socket, &answered, &stop] {
+          // no Catch assertions off the main thread
+          uint8_t request[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x11, 0x03, 0x00, 0x00, 0x00, 0x04};
+          while (!stop) {
+            ++request[1];
+            if (send(socket, request, sizeof(request), 0) != sizeof(request)) break;
+            if (receiveFrame(socket).size() != 17) break;
+            ++answered;
+          }
+          close(socket);
+        });
+      }
+      auto start = std::chrono::steady_clock::now();
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      stop = true;
+      for (std::thread& client : clients) client.join();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      fixture.stopPolling();
+      printf("%-22s %8d %14.0f %14.0f\n", modes[mode], clientCount, answered / seconds, fixture.bus.transactions / seconds);
+    }
+  }
+}
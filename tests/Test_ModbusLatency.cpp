@@ -0,0 +1,109 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusLatency.h>
+
+#include "Includes/catch.hpp"
+#include <chrono>
+#include <cstdio>
+
+using esp32ModbusRTUInternals::LatencyHistogram;
+using esp32ModbusRTUInternals::LatencyStats;
+
+TEST_CASE("Latency buckets", "[latency]") {
+  // exact below 16 us, then 8 buckets per power of two
+  for (uint32_t us = 0; us < 16; ++us) {
+    CHECK(LatencyHistogram::highestEquivalent(LatencyHistogram::bucket(us)) == us);
+  }
+  CHECK(LatencyHistogram::bucket(16) == LatencyHistogram::bucket(17));
+  CHECK(LatencyHistogram::bucket(17) != LatencyHistogram::bucket(18));
+  CHECK(LatencyHistogram::bucket(UINT32_MAX) == LatencyHistogram::BUCKETS - 1);
+
+  uint8_t previous = 0;
+  for (uint32_t us = 1; us < (1UL << 24); us += us / 64 + 1) {
+    uint8_t bucket = LatencyHistogram::bucket(us);
+    CHECK(bucket >= previous);
+    uint32_t highest = LatencyHistogram::highestEquivalent(bucket);
+    CHECK(highest >= us);
+    CHECK(highest - us <= us / 8);
+    previous = bucket;
+  }
+}
+
+TEST_CASE("Latency percentiles", "[latency]") {
+  LatencyHistogram histogram;
+  esp32Modbus::LatencySnapshot snapshot = histogram.snapshot();
+  CHECK(snapshot.count == 0);
+  CHECK(snapshot.p99Us == 0);
+
+  // 1..1000 us, one sample each
+  for (uint32_t us = 1; us <= 1000; ++us) histogram.record(us);
+  snapshot = histogram.snapshot();
+  CHECK(snapshot.count == 1000);
+  CHECK(snapshot.p50Us >= 500);
+  CHECK(snapshot.p50Us <= 500 + 500 / 8);
+  CHECK(snapshot.p90Us >= 900);
+  CHECK(snapshot.p90Us <= 900 + 900 / 8);
+  CHECK(snapshot.p99Us >= 990);
+  CHECK(snapshot.p99Us <= 1000);  // capped by the max
+  CHECK(snapshot.maxUs == 1000);
+
+  // one outlier moves the max, not the p99
+  histogram.record(5000000);
+  snapshot = histogram.snapshot();
+  CHECK(snapshot.maxUs == 5000000);
+  CHECK(snapshot.p99Us < 1200);
+
+  histogram.reset();
+  CHECK(histogram.snapshot().count == 0);
+  CHECK(histogram.snapshot().maxUs == 0);
+}
+
+TEST_CASE("Latency per slave and function code", "[latency]") {
+  LatencyStats stats;
+  esp32Modbus::LatencySnapshot snapshot;
+
+  stats.record(0x01, 0x03, 100, 2000);
+  stats.record(0x01, 0x03, 300, 4000);
+  stats.record(0x01, 0x10, 50, 8000);
+  REQUIRE(stats.get(0x01, 0x03, esp32Modbus::LATENCY_QUEUE_WAIT, &snapshot));
+  CHECK(snapshot.count == 2);
+  CHECK(snapshot.maxUs == 300);
+  REQUIRE(stats.get(0x01, 0x03, esp32Modbus::LATENCY_WIRE, &snapshot));
+  CHECK(snapshot.maxUs == 4000);
+  REQUIRE(stats.get(0x01, 0x03, esp32Modbus::LATENCY_TOTAL, &snapshot));
+  CHECK(snapshot.maxUs == 4300);
+  CHECK(snapshot.p50Us >= 2100);
+  CHECK(snapshot.p50Us <= 2100 + 2100 / 8);
+  REQUIRE(stats.get(0x01, 0x10, esp32Modbus::LATENCY_WIRE, &snapshot));
+  CHECK(snapshot.count == 1);
+  CHECK_FALSE(stats.get(0x02, 0x03, esp32Modbus::LATENCY_WIRE, &snapshot));
+
+  // table full: further pairs only count towards the totals
+  for (uint8_t slave = 2; slave < 2 + MODBUS_LATENCY_SLOTS; ++slave) stats.record(slave, 0x03, 10, 1000);
+  CHECK_FALSE(stats.get(1 + MODBUS_LATENCY_SLOTS, 0x03, esp32Modbus::LATENCY_WIRE, &snapshot));
+  snapshot = stats.totals(esp32Modbus::LATENCY_WIRE);
+  CHECK(snapshot.count == 3 + MODBUS_LATENCY_SLOTS);
+  CHECK(snapshot.maxUs == 8000);
+
+  // reset frees the pairs
+  stats.reset();
+  CHECK(stats.totals(esp32Modbus::LATENCY_TOTAL).count == 0);
+  CHECK_FALSE(stats.get(0x01, 0x03, esp32Modbus::LATENCY_WIRE, &snapshot));
+  stats.record(0x07, 0x04, 1, 2);
+  REQUIRE(stats.get(0x07, 0x04, esp32Modbus::LATENCY_WIRE, &snapshot));
+  CHECK(snapshot.count == 1);
+}
+
+TEST_CASE("Latency recording cost", "[.][benchmark]") {
+  LatencyStats stats;
+  const uint32_t transactions = 10000000;
+  uint32_t us = 12345;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < transactions; ++i) {
+    us = us * 1103515245 + 12345;  // spread over all buckets
+    stats.record(0x01 + (i & 3), 0x03, us >> 20, us >> 12);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("latency record (3 stages, pair + totals): %.1f ns\n", ns / transactions);
+  CHECK(stats.totals(esp32Modbus::LATENCY_TOTAL).count == transactions);
+}
@@ -1,6 +1,7 @@
 /* copyright 2019 Bert Melis */
 
 #include <ModbusMessage.h>
+#include <ModbusFramer.h>
 
 #include "Includes/catch.hpp"
 #include "Includes/CheckArray.h"
@@ -68,3 +69,521 @@ TEST_CASE("Write multiple holding registers", "[FC16]") {
   delete request;
   delete response;
 }
+
+TEST_CASE("Early rejection of mismatching responses", "[FC03]") {
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest03(0x11, 0x006B, 0x0003);
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+
+  SECTION("wrong slave address") {
+    response->add(0x12);
+    CHECK(response->isRejected());
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::INVALID_SLAVE);
+  }
+
+  SECTION("wrong function code") {
+    response->add(0x11);
+    CHECK_FALSE(response->isRejected());
+    response->add(0x04);
+    CHECK(response->isRejected());
+    CHECK(response->getError() == esp32Modbus::INVALID_RESPONSE);
+  }
+
+  SECTION("wrong byte count") {
+    response->add(0x11);
+    response->add(0x03);
+    response->add(0x04);
+    CHECK(response->isRejected());
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::INVALID_RESPONSE);
+  }
+
+  SECTION("exception response is accepted") {
+    uint8_t stdErrorResponse[] = {0x11, 0x83, 0x02, 0xC1, 0x34};
+    for (uint8_t i = 0; i < sizeof(stdErrorResponse); ++i) {
+      response->add(stdErrorResponse[i]);
+    }
+    CHECK_FALSE(response->isRejected());
+    CHECK(response->isComplete());
+    CHECK(response->getError() == esp32Modbus::SUCCESS);
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::ILLEGAL_DATA_ADDRESS);
+  }
+
+  SECTION("corrupted exception response") {
+    uint8_t badErrorResponse[] = {0x11, 0x83, 0x02, 0xC1, 0x35};
+    for (uint8_t i = 0; i < sizeof(badErrorResponse); ++i) {
+      response->add(badErrorResponse[i]);
+    }
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::CRC_ERROR);
+  }
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Early rejection of a wrong write echo", "[FC06]") {
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest06(0x11, 0x0001, 0x0003);
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+
+  response->add(0x11);
+  response->add(0x06);
+  response->add(0x00);
+  CHECK_FALSE(response->isRejected());
+  response->add(0x02);
+  CHECK(response->isRejected());
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Read holding registers into a caller buffer", "[FC03]") {
+  uint16_t values[3] = {0xAAAA, 0xAAAA, 0xAAAA};
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest03(0x11, 0x006B, 3);
+  request->setDestination(values);
+  uint8_t stdResponse[] = {0x11, 0x03, 0x06, 0xAE, 0x41, 0x56, 0x52, 0x43, 0x40, 0x49, 0xAD};
+  uint8_t stdErrorResponse[] = {0x11, 0x83, 0x02, 0xC1, 0x34};
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+  REQUIRE(response->isDirect());
+
+  SECTION("normal response") {
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response->add(stdResponse[i]);
+    }
+    CHECK(response->isComplete());
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 6);
+    CHECK(values[0] == 0xAE41);
+    CHECK(values[1] == 0x5652);
+    CHECK(values[2] == 0x4340);
+    CHECK(memcmp(response->getMessage(), stdResponse, sizeof(stdResponse)) == 0);
+  }
+
+  SECTION("exception response") {
+    for (uint8_t i = 0; i < sizeof(stdErrorResponse); ++i) {
+      response->add(stdErrorResponse[i]);
+    }
+    CHECK(response->isComplete());
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::ILLEGAL_DATA_ADDRESS);
+    CHECK(values[0] == 0xAAAA);
+    CHECK(memcmp(response->getMessage(), stdErrorResponse, sizeof(stdErrorResponse)) == 0);
+  }
+
+  SECTION("corrupted payload") {
+    stdResponse[4] ^= 0x01;
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response->add(stdResponse[i]);
+    }
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::CRC_ERROR);
+    CHECK(values[0] == 0xAAAA);
+    CHECK(values[1] == 0xAAAA);
+    CHECK(values[2] == 0xAAAA);
+  }
+
+  SECTION("truncated response") {
+    for (uint8_t i = 0; i < sizeof(stdResponse) - 3; ++i) {
+      response->add(stdResponse[i]);
+    }
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::TIMEOUT);
+    CHECK(values[0] == 0xAAAA);
+    CHECK(values[1] == 0xAAAA);
+  }
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Responses received into a reused frame buffer", "[FC03]") {
+  uint8_t frame[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];
+  uint16_t values[3] = {0xAAAA, 0xAAAA, 0xAAAA};
+  uint8_t stdResponse[] = {0x11, 0x03, 0x06, 0xAE, 0x41, 0x56, 0x52, 0x43, 0x40, 0x49, 0xAD};
+  uint8_t stdErrorResponse[] = {0x11, 0x83, 0x02, 0xC1, 0x34};
+  esp32ModbusRTUInternals::ModbusRequest03 request(0x11, 0x006B, 3);
+  request.setDestination(values);
+
+  {
+    esp32ModbusRTUInternals::ModbusResponse response(frame, &request);
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response.add(stdResponse[i]);
+    }
+    REQUIRE(response.getMessage() == frame);
+    CHECK(response.isSuccess());
+    CHECK(values[0] == 0xAE41);
+    CHECK(values[2] == 0x4340);
+
+    // converted once: a second check does not overwrite what the caller did with the values
+    values[0] = 0;
+    CHECK(response.isSuccess());
+    CHECK(values[0] == 0);
+  }
+
+  // the next transaction starts from an empty frame, extra bytes are not accepted
+  {
+    values[0] = 0xAAAA;
+    esp32ModbusRTUInternals::ModbusResponse response(frame, &request);
+    CHECK(response.getSize() == 0);
+    for (uint8_t i = 0; i < sizeof(stdErrorResponse); ++i) {
+      response.add(stdErrorResponse[i]);
+    }
+    CHECK_FALSE(response.isSuccess());
+    CHECK(response.getError() == esp32Modbus::ILLEGAL_DATA_ADDRESS);
+    CHECK(values[0] == 0xAAAA);
+  }
+  {
+    esp32ModbusRTUInternals::ModbusResponse response(frame, &request);
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response.add(stdResponse[i]);
+    }
+    response.add(0x00);
+    CHECK(response.getSize() == sizeof(stdResponse));
+    CHECK(response.isSuccess());
+  }
+  CHECK(frame[0] == 0x11);  // the frame buffer outlives the responses
+}
+
+TEST_CASE("Write multiple coils", "[FC0F]") {
+  // spec example: coils 20..29 = 1011 0011 10
+  bool values[] = {true, false, true, true, false, false, true, true, true, false};
+  uint8_t bits[] = {0xCD, 0xFD};  // unused bits of the last byte are cleared
+  uint8_t stdMessage[] = {0x11, 0x0F, 0x00, 0x13, 0x00, 0x0A, 0x02, 0xCD, 0x01, 0xBF, 0x0B};
+
+  esp32ModbusRTUInternals::ModbusRequest0F fromBools(0x11, 0x0013, 10, values);
+  esp32ModbusRTUInternals::ModbusRequest0F fromBits(0x11, 0x0013, 10, bits);
+
+  REQUIRE(fromBools.getSize() == sizeof(stdMessage));
+  CHECK_THAT(fromBools.getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  REQUIRE(fromBits.getSize() == sizeof(stdMessage));
+  CHECK_THAT(fromBits.getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+}
+
+TEST_CASE("Mask write register", "[FC16mask]") {
+  // spec example: register 4, AND 0x00F2, OR 0x0025
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequestMaskWrite(0x11, 0x0004, 0x00F2, 0x0025);
+  uint8_t stdMessage[] = {0x11, 0x16, 0x00, 0x04, 0x00, 0xF2, 0x00, 0x25, 0x66, 0xE2};
+  uint8_t stdErrorResponse[] = {0x11, 0x96, 0x01, 0x8F, 0xA5};
+
+  REQUIRE(request->getSize() == sizeof(stdMessage));
+  REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  CHECK(request->responseLength() == sizeof(stdMessage));
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+
+  SECTION("echo") {
+    for (uint8_t i = 0; i < sizeof(stdMessage); ++i) {
+      response->add(stdMessage[i]);
+    }
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 6);
+    CHECK_THAT(response->getData(), ByteArrayEqual(&stdMessage[2], 6));
+  }
+
+  SECTION("not supported by the slave") {
+    for (uint8_t i = 0; i < sizeof(stdErrorResponse); ++i) {
+      response->add(stdErrorResponse[i]);
+    }
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::ILLEGAL_FUNCTION);
+  }
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Diagnostics return query data", "[FC08]") {
+  // spec example: loopback of 0xA537
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest08(0x11, esp32Modbus::DIAG_RETURN_QUERY_DATA, 0xA537);
+  uint8_t stdMessage[] = {0x11, 0x08, 0x00, 0x00, 0xA5, 0x37, 0xD8, 0x1D};
+  uint8_t stdErrorResponse[] = {0x11, 0x88, 0x01, 0x86, 0x05};
+
+  REQUIRE(request->getSize() == sizeof(stdMessage));
+  REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  CHECK(request->responseLength() == sizeof(stdMessage));
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+
+  SECTION("echo") {
+    for (uint8_t i = 0; i < sizeof(stdMessage); ++i) {
+      response->add(stdMessage[i]);
+    }
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 4);
+    CHECK_THAT(response->getData(), ByteArrayEqual(&stdMessage[2], 4));
+  }
+
+  SECTION("other sub-function in the answer") {
+    uint8_t wrongSubFunction[] = {0x11, 0x08, 0x00, 0x0B};
+    for (uint8_t i = 0; i < sizeof(wrongSubFunction); ++i) {
+      response->add(wrongSubFunction[i]);
+    }
+    CHECK(response->isRejected());
+  }
+
+  SECTION("not supported by the slave") {
+    for (uint8_t i = 0; i < sizeof(stdErrorResponse); ++i) {
+      response->add(stdErrorResponse[i]);
+    }
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::ILLEGAL_FUNCTION);
+  }
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Get comm event counter", "[FC0B]") {
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest0B(0x11);
+  uint8_t stdMessage[] = {0x11, 0x0B, 0x4C, 0x27};
+  uint8_t stdResponse[] = {0x11, 0x0B, 0xFF, 0xFF, 0x01, 0x08, 0xA6, 0xE9};
+
+  REQUIRE(request->getSize() == sizeof(stdMessage));
+  REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  CHECK(request->responseLength() == sizeof(stdResponse));
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+  for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+    response->add(stdResponse[i]);
+  }
+  CHECK(response->isSuccess());
+  CHECK_THAT(response->getData(), ByteArrayEqual(&stdResponse[2], 4));
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Read file record", "[FC14]") {
+  // spec example: two sub-requests, file 4 record 1 and file 3 record 9, two records each
+  esp32Modbus::FileRecordRef refs[] = {{4, 1, 2}, {3, 9, 2}};
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest14(0x11, refs, 2);
+  uint8_t stdMessage[] = {0x11, 0x14, 0x0E, 0x06, 0x00, 0x04, 0x00, 0x01, 0x00, 0x02,
+                          0x06, 0x00, 0x03, 0x00, 0x09, 0x00, 0x02, 0xF9, 0x38};
+  uint8_t stdResponse[] = {0x11, 0x14, 0x0C, 0x05, 0x06, 0x0D, 0xFE, 0x00, 0x20,
+                           0x05, 0x06, 0x33, 0xCD, 0x00, 0x40, 0x69, 0xAD};
+
+  REQUIRE(request->getSize() == sizeof(stdMessage));
+  REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  CHECK(request->responseLength() == sizeof(stdResponse));
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+
+  SECTION("two sub-responses") {
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response->add(stdResponse[i]);
+    }
+    REQUIRE(response->isSuccess());
+    uint16_t records = 0;
+    const uint8_t* first = esp32Modbus::findFileSubResponse(response->getData(), response->getByteCount(), 0, &records);
+    REQUIRE(first != nullptr);
+    CHECK(records == 2);
+    CHECK_THAT(first, ByteArrayEqual(&stdResponse[5], 4));
+    const uint8_t* second = esp32Modbus::findFileSubResponse(response->getData(), response->getByteCount(), 1, &records);
+    REQUIRE(second != nullptr);
+    CHECK(records == 2);
+    CHECK_THAT(second, ByteArrayEqual(&stdResponse[11], 4));
+    CHECK(esp32Modbus::findFileSubResponse(response->getData(), response->getByteCount(), 2, &records) == nullptr);
+  }
+
+  SECTION("wrong data length") {
+    uint8_t shortResponse[] = {0x11, 0x14, 0x06};
+    for (uint8_t i = 0; i < sizeof(shortResponse); ++i) {
+      response->add(shortResponse[i]);
+    }
+    CHECK(response->isRejected());
+  }
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Write file record", "[FC15]") {
+  // spec example: file 4, records 7 to 9
+  esp32Modbus::FileRecordRef ref = {4, 7, 3};
+  uint8_t data[] = {0x06, 0xAF, 0x04, 0xBE, 0x10, 0x0D};
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest15(0x11, &ref, 1, data);
+  uint8_t stdMessage[] = {0x11, 0x15, 0x0D, 0x06, 0x00, 0x04, 0x00, 0x07, 0x00, 0x03,
+                          0x06, 0xAF, 0x04, 0xBE, 0x10, 0x0D, 0xDB, 0xC7};
+
+  REQUIRE(request->getSize() == sizeof(stdMessage));
+  REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  CHECK(request->responseLength() == sizeof(stdMessage));
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+  for (uint8_t i = 0; i < sizeof(stdMessage); ++i) {
+    response->add(stdMessage[i]);
+  }
+  CHECK(response->isSuccess());
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("File record limits", "[FC14]") {
+  esp32Modbus::FileRecordRef maxRead = {1, 0, esp32ModbusRTUInternals::MODBUS_MAX_FC14_RECORDS};
+  esp32Modbus::FileRecordRef maxWrite = {1, 0, esp32ModbusRTUInternals::MODBUS_MAX_FC15_RECORDS};
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&maxRead, 1, false) == 7);
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&maxWrite, 1, true) == 245);
+  maxRead.length++;
+  maxWrite.length++;
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&maxRead, 1, false) == 0);
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&maxWrite, 1, true) == 0);
+
+  esp32Modbus::FileRecordRef lastRecords = {1, 9990, 10};
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&lastRecords, 1, false) == 7);
+  lastRecords.length = 11;  // beyond record 9999
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&lastRecords, 1, false) == 0);
+  esp32Modbus::FileRecordRef fileZero = {0, 0, 1};
+  CHECK(esp32ModbusRTUInternals::fileRecordByteCount(&fileZero, 1, false) == 0);
+}
+
+TEST_CASE("Read FIFO queue", "[FC18]") {
+  // spec example: FIFO pointer 0x04DE, two queued registers
+  esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest18(0x11, 0x04DE);
+  uint8_t stdMessage[] = {0x11, 0x18, 0x04, 0xDE, 0x07, 0x87};
+  uint8_t stdResponse[] = {0x11, 0x18, 0x00, 0x06, 0x00, 0x02, 0x01, 0xB8, 0x12, 0x84, 0x18, 0x8D};
+
+  REQUIRE(request->getSize() == sizeof(stdMessage));
+  REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+  CHECK(request->responseLength() == 0);
+
+  esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(255, request);
+
+  SECTION("two registers") {
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response->add(stdResponse[i]);
+    }
+    REQUIRE(response->isComplete());
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 4);
+    CHECK_THAT(response->getData(), ByteArrayEqual(&stdResponse[6], 4));
+  }
+
+  SECTION("empty queue") {
+    uint8_t empty[] = {0x11, 0x18, 0x00, 0x02, 0x00, 0x00, 0x82, 0x98};
+    for (uint8_t i = 0; i < sizeof(empty); ++i) {
+      response->add(empty[i]);
+    }
+    REQUIRE(response->isComplete());
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 0);
+  }
+
+  SECTION("queue count does not match the byte count") {
+    uint8_t mismatch[] = {0x11, 0x18, 0x00, 0x06, 0x00, 0x03, 0x01, 0xB8, 0x12, 0x84, 0x25, 0x4D};
+    for (uint8_t i = 0; i < sizeof(mismatch); ++i) {
+      response->add(mismatch[i]);
+    }
+    REQUIRE(response->isComplete());
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::INVALID_RESPONSE);
+  }
+
+  SECTION("more than 31 registers") {
+    uint8_t tooLong[] = {0x11, 0x18, 0x00, 0x42};
+    for (uint8_t i = 0; i < sizeof(tooLong); ++i) {
+      response->add(tooLong[i]);
+    }
+    CHECK(response->isRejected());
+  }
+
+  delete request;
+  delete response;
+}
+
+TEST_CASE("Broadcast writes complete without an answer", "[broadcast]") {
+  CHECK(esp32ModbusRTUInternals::isBroadcastable(esp32Modbus::WRITE_HOLD_REGISTER));
+  CHECK(esp32ModbusRTUInternals::isBroadcastable(esp32Modbus::WRITE_MULT_REGISTERS));
+  CHECK_FALSE(esp32ModbusRTUInternals::isBroadcastable(esp32Modbus::READ_HOLD_REGISTER));
+  CHECK_FALSE(esp32ModbusRTUInternals::isBroadcastable(esp32Modbus::DIAGNOSTICS));
+
+  SECTION("single register") {
+    esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest06(0x00, 0x0010, 0x1234);
+    esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+    esp32ModbusRTUInternals::broadcastResponse(request, response);
+    CHECK(response->isSuccess());
+    REQUIRE(response->getSize() == 8);
+    CHECK_THAT(response->getMessage(), ByteArrayEqual(request->getMessage(), 8));
+    delete request;
+    delete response;
+  }
+
+  SECTION("multiple registers") {
+    uint8_t data[] = {0x00, 0x0A, 0x01, 0x02};
+    esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequest16(0x00, 0x0001, 2, data);
+    esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+    esp32ModbusRTUInternals::broadcastResponse(request, response);
+    CHECK(response->isSuccess());
+    REQUIRE(response->getSize() == 8);
+    CHECK_THAT(response->getMessage(), ByteArrayEqual(request->getMessage(), 6));
+    CHECK(response->checkCRC());
+    delete request;
+    delete response;
+  }
+}
+
+TEST_CASE("Raw request with a user defined function code", "[raw]") {
+  uint8_t data[] = {0x00, 0x10, 0xAB};
+  uint8_t stdMessage[] = {0x11, 0x41, 0x00, 0x10, 0xAB, 0x80, 0x40};
+  uint8_t stdResponse[] = {0x11, 0x41, 0x01, 0x02, 0x03, 0xDC, 0x9E};
+  uint8_t stdErrorResponse[] = {0x11, 0xC1, 0x01, 0xB1, 0x95};
+
+  SECTION("known response length") {
+    esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequestRaw(0x11, 0x41, data, sizeof(data), 3);
+    REQUIRE(request->getSize() == sizeof(stdMessage));
+    REQUIRE_THAT(request->getMessage(), ByteArrayEqual(stdMessage, sizeof(stdMessage)));
+    CHECK(request->responseLength() == sizeof(stdResponse));
+    CHECK(request->getAddress() == 0x0010);
+
+    esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+    for (uint8_t i = 0; i < sizeof(stdResponse); ++i) {
+      response->add(stdResponse[i]);
+    }
+    CHECK(response->isComplete());
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 3);
+    CHECK_THAT(response->getData(), ByteArrayEqual(&stdResponse[2], 3));
+    delete request;
+    delete response;
+  }
+
+  SECTION("response ends on silence") {
+    esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequestRaw(0x11, 0x64, nullptr, 0, 0);
+    CHECK(request->responseLength() == 0);
+    esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(255, request);
+    uint8_t noData[] = {0x11, 0x64, 0x0C, 0x0B};
+    for (uint8_t i = 0; i < sizeof(noData); ++i) {
+      response->add(noData[i]);
+    }
+    CHECK_FALSE(response->isComplete());
+    response->endOfFrame();
+    CHECK(response->isComplete());
+    CHECK(response->isSuccess());
+    CHECK(response->getByteCount() == 0);
+    delete request;
+    delete response;
+  }
+
+  SECTION("exception") {
+    esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequestRaw(0x11, 0x41, data, sizeof(data), 3);
+    esp32ModbusRTUInternals::ModbusResponse* response = new esp32ModbusRTUInternals::ModbusResponse(request->responseLength(), request);
+    for (uint8_t i = 0; i < sizeof(stdErrorResponse); ++i) {
+      response->add(stdErrorResponse[i]);
+    }
+    CHECK(response->isComplete());
+    CHECK_FALSE(response->isSuccess());
+    CHECK(response->getError() == esp32Modbus::ILLEGAL_FUNCTION);
+    delete request;
+    delete response;
+  }
+
+  SECTION("standard function code") {
+    uint8_t read[] = {0x00, 0x10, 0x00, 0x01};
+    esp32ModbusRTUInternals::ModbusRequest* request = new esp32ModbusRTUInternals::ModbusRequestRaw(0x11, 0x03, read, sizeof(read), 0);
+    uint8_t fc03[] = {0x11, 0x03, 0x00, 0x10, 0x00, 0x01, 0x87, 0x5F};
+    REQUIRE_THAT(request->getMessage(), ByteArrayEqual(fc03, sizeof(fc03)));
+    delete request;
+  }
+}
@@ -0,0 +1,687 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusOperations.h>
+
+#include <ModbusFramer.h>
+
+#include "Includes/catch.hpp"
+#include "Includes/WithCRC.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using esp32ModbusRTUInternals::ModbusRequest;
+using esp32ModbusRTUInternals::ModbusResponse;
+
+namespace {
+
+// Answers a FC03 request with register value == register address
+ModbusResponse* answerRegisters(ModbusRequest* request) {
+  uint8_t* message = request->getMessage();
+  uint16_t address = (message[2] << 8) | message[3];
+  uint16_t count = (message[4] << 8) | message[5];
+  ModbusResponse* response = new ModbusResponse(request->responseLength(), request);
+  std::vector<uint8_t> frame = {message[0], message[1], static_cast<uint8_t>(count * 2)};
+  for (uint16_t i = 0; i < count; ++i) {
+    frame.push_back((address + i) >> 8);
+    frame.push_back((address + i) & 0xFF);
+  }
+  frame = withCRC(frame);
+  for (size_t i = 0; i < frame.size(); ++i) response->add(frame[i]);
+  return response;
+}
+
+// Echo of a write request (FC05/06/0F/10)
+ModbusResponse* answerEcho(ModbusRequest* request) {
+  uint8_t frame[8];
+  for (int i = 0; i < 6; ++i) frame[i] = request->getMessage()[i];
+  uint16_t crc = esp32ModbusRTUInternals::CRC16(frame, 6);
+  frame[6] = crc & 0xFF;
+  frame[7] = crc >> 8;
+  ModbusResponse* response = new ModbusResponse(request->responseLength(), request);
+  for (size_t i = 0; i < sizeof(frame); ++i) response->add(frame[i]);
+  return response;
+}
+
+ModbusResponse* answerException(ModbusRequest* request, uint8_t code = esp32Modbus::ILLEGAL_DATA_ADDRESS) {
+  uint8_t frame[] = {request->getMessage()[0], static_cast<uint8_t>(request->getFunctionCode() | 0x80), code, 0, 0};
+  uint16_t crc = esp32ModbusRTUInternals::CRC16(frame, 3);
+  frame[3] = crc & 0xFF;
+  frame[4] = crc >> 8;
+  ModbusResponse* response = new ModbusResponse(request->responseLength(), request);
+  for (size_t i = 0; i < sizeof(frame); ++i) response->add(frame[i]);
+  return response;
+}
+
+// FC 0x2B / 0x0E response carrying the given objects
+ModbusResponse* answerDeviceId(ModbusRequest* request, bool moreFollows, uint8_t nextObjectId,
+                               const std::vector<std::vector<uint8_t>>& objects) {
+  uint8_t* message = request->getMessage();
+  std::vector<uint8_t> frame = {message[0], 0x2B, 0x0E, message[3], 0x81, static_cast<uint8_t>(moreFollows ? 0xFF : 0x00),
+                                nextObjectId, static_cast<uint8_t>(objects.size())};
+  for (size_t i = 0; i < objects.size(); ++i) frame.insert(frame.end(), objects[i].begin(), objects[i].end());
+  frame = withCRC(frame);
+  ModbusResponse* response = new ModbusResponse(esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU, request);
+  for (size_t i = 0; i < frame.size(); ++i) response->add(frame[i]);
+  return response;
+}
+
+// Any response: the given frame plus CRC
+ModbusResponse* answerFrame(ModbusRequest* request, std::vector<uint8_t> frame) {
+  frame = withCRC(frame);
+  ModbusResponse* response = new ModbusResponse(esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU, request);
+  for (size_t i = 0; i < frame.size(); ++i) response->add(frame[i]);
+  return response;
+}
+
+}  // namespace
+
+TEST_CASE("Split read of 400 registers", "[split]") {
+  std::vector<uint8_t> delivered;
+  uint16_t deliveredAddress = 0;
+  int dataCalls = 0;
+  int errorCalls = 0;
+  uint16_t failedChunk = 0xFFFF;
+  uint16_t failedAddress = 0;
+
+  esp32ModbusRTUInternals::SplitReadOperation operation(0x11, esp32Modbus::READ_HOLD_REGISTER, 1000, 400,
+    [&](uint8_t, esp32Modbus::FunctionCode, uint16_t address, uint8_t* data, uint16_t length) {
+      ++dataCalls;
+      deliveredAddress = address;
+      delivered.assign(data, data + length);
+    },
+    [&](uint8_t, esp32Modbus::Error, uint16_t chunk, uint16_t address) {
+      ++errorCalls;
+      failedChunk = chunk;
+      failedAddress = address;
+    });
+  REQUIRE(operation.isValid());
+  CHECK(operation.chunks() == 4);
+
+  SECTION("all chunks succeed") {
+    std::vector<uint16_t> counts;
+    while (ModbusRequest* request = operation.next()) {
+      CHECK(operation.next() == nullptr);  // one chunk at a time
+      uint8_t* message = request->getMessage();
+      counts.push_back((message[4] << 8) | message[5]);
+      ModbusResponse* response = answerRegisters(request);
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+    CHECK(counts == std::vector<uint16_t>({125, 125, 125, 25}));
+    REQUIRE(dataCalls == 1);
+    CHECK(errorCalls == 0);
+    CHECK(deliveredAddress == 1000);
+    REQUIRE(delivered.size() == 800);
+    for (uint16_t i = 0; i < 400; ++i) {
+      CHECK(((delivered[2 * i] << 8) | delivered[2 * i + 1]) == 1000 + i);
+    }
+  }
+
+  SECTION("third chunk fails") {
+    int chunk = 0;
+    while (ModbusRequest* request = operation.next()) {
+      ModbusResponse* response = (chunk++ == 2) ? answerException(request) : answerRegisters(request);
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+    CHECK(chunk == 3);
+    CHECK(dataCalls == 0);
+    REQUIRE(errorCalls == 1);
+    CHECK(failedChunk == 2);
+    CHECK(failedAddress == 1250);
+  }
+}
+
+TEST_CASE("Split read of coils stays byte aligned", "[split]") {
+  esp32ModbusRTUInternals::SplitReadOperation operation(0x11, esp32Modbus::READ_COIL, 0, 4500, nullptr, nullptr);
+  REQUIRE(operation.isValid());
+  CHECK(operation.chunks() == 3);
+  ModbusRequest* request = operation.next();
+  REQUIRE(request != nullptr);
+  CHECK(request->getByteCount() == 250);
+  delete request;
+}
+
+TEST_CASE("Bulk write of 1 KB", "[bulk]") {
+  uint8_t data[1024];
+  for (int i = 0; i < 1024; ++i) data[i] = static_cast<uint8_t>(i);
+  std::vector<uint16_t> progress;
+  int errorCalls = 0;
+  uint16_t failedChunk = 0xFFFF;
+
+  esp32ModbusRTUInternals::BulkWriteOperation operation(0x11, 0x0100, 512, data,
+    [&](uint8_t, uint16_t written, uint16_t total) {
+      CHECK(total == 512);
+      progress.push_back(written);
+    },
+    [&](uint8_t, esp32Modbus::Error, uint16_t chunk, uint16_t) {
+      ++errorCalls;
+      failedChunk = chunk;
+    });
+  REQUIRE(operation.isValid());
+  CHECK(operation.chunks() == 5);
+
+  SECTION("all frames succeed") {
+    std::vector<uint8_t> written;
+    while (ModbusRequest* request = operation.next()) {
+      uint8_t* message = request->getMessage();
+      CHECK(request->getFunctionCode() == esp32Modbus::WRITE_MULT_REGISTERS);
+      uint16_t count = (message[4] << 8) | message[5];
+      CHECK(request->getAddress() == 0x0100 + written.size() / 2);
+      written.insert(written.end(), &message[7], &message[7 + count * 2]);
+      ModbusResponse* response = answerEcho(request);
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+    CHECK(progress == std::vector<uint16_t>({123, 246, 369, 492, 512}));
+    CHECK(written == std::vector<uint8_t>(data, data + sizeof(data)));
+    CHECK(errorCalls == 0);
+  }
+
+  SECTION("stops on the first error") {
+    int frame = 0;
+    while (ModbusRequest* request = operation.next()) {
+      ModbusResponse* response = (frame++ == 1) ? answerException(request) : answerEcho(request);
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+    CHECK(frame == 2);
+    CHECK(progress == std::vector<uint16_t>({123}));
+    CHECK(errorCalls == 1);
+    CHECK(failedChunk == 1);
+    CHECK(operation.written() == 123);
+  }
+}
+
+TEST_CASE("Read-modify-write fallback for mask writes", "[rmw]") {
+  std::vector<uint8_t> echo;
+  int errorCalls = 0;
+  esp32Modbus::Error lastError = esp32Modbus::SUCCESS;
+  esp32ModbusRTUInternals::ReadModifyWriteOperation operation(0x11, 0x0004, 0x00F2, 0x0025,
+    [&](uint8_t, esp32Modbus::FunctionCode fc, uint16_t address, uint8_t* data, uint16_t length) {
+      CHECK(fc == esp32Modbus::MASK_WRITE_REGISTER);
+      CHECK(address == 0x0004);
+      echo.assign(data, data + length);
+    },
+    [&](uint16_t, esp32Modbus::Error error) {
+      ++errorCalls;
+      lastError = error;
+    });
+
+  SECTION("reads, then writes the masked value") {
+    ModbusRequest* read = operation.next();
+    REQUIRE(read != nullptr);
+    CHECK(read->getFunctionCode() == esp32Modbus::READ_HOLD_REGISTER);
+    CHECK(operation.next() == nullptr);  // one frame at a time
+    // answerRegisters returns the address as value: 0x0004
+    ModbusResponse* response = answerRegisters(read);
+    operation.onResponse(read, response);
+    delete response;
+    delete read;
+
+    ModbusRequest* write = operation.next();
+    REQUIRE(write != nullptr);
+    CHECK(write->getFunctionCode() == esp32Modbus::WRITE_HOLD_REGISTER);
+    // (0x0004 AND 0x00F2) OR (0x0025 AND NOT 0x00F2) = 0x0005
+    CHECK(write->getMessage()[4] == 0x00);
+    CHECK(write->getMessage()[5] == 0x05);
+    response = answerEcho(write);
+    operation.onResponse(write, response);
+    delete response;
+    delete write;
+
+    CHECK(operation.next() == nullptr);
+    CHECK(echo == std::vector<uint8_t>({0x00, 0x04, 0x00, 0xF2, 0x00, 0x25}));
+    CHECK(errorCalls == 0);
+  }
+
+  SECTION("a failing read skips the write") {
+    ModbusRequest* read = operation.next();
+    ModbusResponse* response = answerException(read);
+    operation.onResponse(read, response);
+    delete response;
+    delete read;
+    CHECK(operation.next() == nullptr);
+    CHECK(errorCalls == 1);
+    CHECK(lastError == esp32Modbus::ILLEGAL_DATA_ADDRESS);
+    CHECK(echo.empty());
+  }
+}
+
+TEST_CASE("Device identification over two frames", "[deviceid]") {
+  uint8_t buffer[32];
+  std::vector<uint8_t> objects;
+  uint8_t conformity = 0;
+  int errorCalls = 0;
+  esp32Modbus::Error lastError = esp32Modbus::SUCCESS;
+  auto onError = [&](uint16_t, esp32Modbus::Error error) {
+    ++errorCalls;
+    lastError = error;
+  };
+  auto onDeviceId = [&](uint8_t, uint8_t level, const uint8_t* data, uint16_t length) {
+    conformity = level;
+    objects.assign(data, data + length);
+  };
+
+  SECTION("more follows") {
+    esp32ModbusRTUInternals::DeviceIdOperation operation(0x11, esp32Modbus::DEVICE_ID_BASIC, 0, buffer, sizeof(buffer), onDeviceId, onError);
+    ModbusRequest* request = operation.next();
+    REQUIRE(request != nullptr);
+    CHECK(request->getMessage()[1] == 0x2B);
+    CHECK(request->getMessage()[2] == 0x0E);
+    CHECK(request->getMessage()[4] == 0x00);
+    ModbusResponse* response = answerDeviceId(request, true, 0x02, {{0x00, 0x04, 'A', 'C', 'M', 'E'}, {0x01, 0x02, 'P', '1'}});
+    REQUIRE(response->isComplete());
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+
+    request = operation.next();
+    REQUIRE(request != nullptr);
+    CHECK(request->getMessage()[4] == 0x02);  // continues at the next object
+    response = answerDeviceId(request, false, 0x00, {{0x02, 0x03, '1', '.', '2'}});
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+
+    CHECK(operation.next() == nullptr);
+    CHECK(errorCalls == 0);
+    CHECK(conformity == 0x81);
+    CHECK(objects.size() == 6 + 4 + 5);
+    uint8_t length = 0;
+    const uint8_t* vendor = esp32Modbus::findDeviceIdObject(objects.data(), objects.size(), esp32Modbus::VENDOR_NAME, &length);
+    REQUIRE(vendor != nullptr);
+    CHECK(std::string(reinterpret_cast<const char*>(vendor), length) == "ACME");
+    const uint8_t* revision = esp32Modbus::findDeviceIdObject(objects.data(), objects.size(), esp32Modbus::MAJOR_MINOR_REVISION, &length);
+    REQUIRE(revision != nullptr);
+    CHECK(std::string(reinterpret_cast<const char*>(revision), length) == "1.2");
+    CHECK(esp32Modbus::findDeviceIdObject(objects.data(), objects.size(), esp32Modbus::VENDOR_URL, &length) == nullptr);
+  }
+
+  SECTION("frame of the largest RTU size") {
+    // 8 bytes header + one object of 2 + 244 bytes + CRC = 256 bytes
+    uint8_t large[256];
+    std::vector<uint8_t> object = {0x80, 244};
+    object.insert(object.end(), 244, 'x');
+    esp32ModbusRTUInternals::DeviceIdOperation operation(0x11, esp32Modbus::DEVICE_ID_EXTENDED, 0x80, large, sizeof(large), onDeviceId, onError);
+    ModbusRequest* request = operation.next();
+    ModbusResponse* response = answerDeviceId(request, false, 0x00, {object});
+    CHECK(response->getSize() == 256);
+    CHECK(response->isComplete());
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+    CHECK(errorCalls == 0);
+    CHECK(objects == object);
+  }
+
+  SECTION("buffer too small") {
+    esp32ModbusRTUInternals::DeviceIdOperation operation(0x11, esp32Modbus::DEVICE_ID_BASIC, 0, buffer, 8, onDeviceId, onError);
+    ModbusRequest* request = operation.next();
+    ModbusResponse* response = answerDeviceId(request, false, 0x00, {{0x00, 0x04, 'A', 'C', 'M', 'E'}, {0x01, 0x02, 'P', '1'}});
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+    CHECK(operation.next() == nullptr);
+    CHECK(errorCalls == 1);
+    CHECK(lastError == esp32Modbus::INVALID_PARAMETER);
+    CHECK(objects.empty());
+  }
+
+  SECTION("slave not making progress") {
+    esp32ModbusRTUInternals::DeviceIdOperation operation(0x11, esp32Modbus::DEVICE_ID_REGULAR, 3, buffer, sizeof(buffer), onDeviceId, onError);
+    ModbusRequest* request = operation.next();
+    ModbusResponse* response = answerDeviceId(request, true, 0x03, {{0x03, 0x01, 'x'}});
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+    CHECK(operation.next() == nullptr);
+    CHECK(lastError == esp32Modbus::INVALID_RESPONSE);
+  }
+}
+
+TEST_CASE("Diagnostic counters", "[diagnostics]") {
+  esp32Modbus::DiagnosticCounters counters;
+  int counterCalls = 0;
+  int errorCalls = 0;
+  esp32Modbus::Error lastError = esp32Modbus::SUCCESS;
+  auto onCounters = [&](uint8_t, const esp32Modbus::DiagnosticCounters& c) { ++counterCalls; counters = c; };
+  auto onError = [&](uint8_t, esp32Modbus::Error error) { ++errorCalls; lastError = error; };
+
+  SECTION("one counter not supported") {
+    esp32ModbusRTUInternals::DiagnosticCountersOperation operation(0x11, onCounters, onError);
+    uint16_t subFunction = esp32Modbus::DIAG_BUS_MESSAGE_COUNT;
+    ModbusRequest* request;
+    while ((request = operation.next()) != nullptr) {
+      uint8_t* message = request->getMessage();
+      CHECK(message[1] == 0x08);
+      CHECK(((message[2] << 8) | message[3]) == subFunction);
+      ModbusResponse* response;
+      if (subFunction == esp32Modbus::DIAG_BUS_CHAR_OVERRUN_COUNT) {
+        response = answerException(request);
+      } else {
+        response = answerFrame(request, {0x11, 0x08, message[2], message[3], 0x01, static_cast<uint8_t>(subFunction)});
+      }
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+      ++subFunction;
+    }
+    CHECK(subFunction == esp32Modbus::DIAG_BUS_CHAR_OVERRUN_COUNT + 1);
+    CHECK(errorCalls == 0);
+    REQUIRE(counterCalls == 1);
+    CHECK(counters.available == 0x7F);
+    CHECK(counters.busMessages == 0x010B);
+    CHECK(counters.crcErrors == 0x010C);
+    CHECK(counters.busy == 0x0111);
+    CHECK(counters.overruns == 0);
+  }
+
+  SECTION("counter lost behind a gateway") {
+    esp32ModbusRTUInternals::DiagnosticCountersOperation operation(0x11, onCounters, onError);
+    ModbusRequest* request;
+    int requests = 0;
+    while ((request = operation.next()) != nullptr) {
+      uint8_t* message = request->getMessage();
+      ModbusResponse* response;
+      if (requests == 1) {
+        response = answerException(request, esp32Modbus::GATEWAY_TARGET_FAILED);
+      } else {
+        response = answerFrame(request, {0x11, 0x08, message[2], message[3], 0x00, 0x01});
+      }
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+      ++requests;
+    }
+    CHECK(requests == 8);
+    CHECK(errorCalls == 0);
+    REQUIRE(counterCalls == 1);
+    CHECK(counters.available == 0xFD);
+  }
+
+  SECTION("slave not answering") {
+    esp32ModbusRTUInternals::DiagnosticCountersOperation operation(0x11, onCounters, onError);
+    ModbusRequest* request = operation.next();
+    ModbusResponse* response = new ModbusResponse(request->responseLength(), request);
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+    CHECK(operation.next() == nullptr);
+    CHECK(counterCalls == 0);
+    CHECK(lastError == esp32Modbus::TIMEOUT);
+  }
+}
+
+TEST_CASE("Comm event log", "[diagnostics]") {
+  esp32Modbus::CommEventLog log;
+  int logCalls = 0;
+  esp32ModbusRTUInternals::CommEventOperation operation(0x11, nullptr,
+    [&](uint8_t, const esp32Modbus::CommEventLog& l) { ++logCalls; log = l; },
+    [&](uint8_t, esp32Modbus::Error) { FAIL("unexpected error"); });
+
+  ModbusRequest* request = operation.next();
+  REQUIRE(request != nullptr);
+  CHECK(request->getFunctionCode() == esp32Modbus::GET_COMM_EVENT_LOG);
+  // spec example: status 0, 264 events, 289 messages, events 20 00
+  ModbusResponse* response = answerFrame(request, {0x11, 0x0C, 0x08, 0x00, 0x00, 0x01, 0x08, 0x01, 0x21, 0x20, 0x00});
+  REQUIRE(response->isComplete());
+  operation.onResponse(request, response);
+  delete response;
+  delete request;
+
+  CHECK(operation.next() == nullptr);
+  REQUIRE(logCalls == 1);
+  CHECK(log.status == 0);
+  CHECK(log.eventCount == 264);
+  CHECK(log.messageCount == 289);
+  REQUIRE(log.eventLength == 2);
+  CHECK(log.events[0] == 0x20);
+  CHECK(log.events[1] == 0x00);
+}
+
+TEST_CASE("Loopback latency probe", "[diagnostics]") {
+  esp32Modbus::LatencyProbe result;
+  int latencyCalls = 0;
+  esp32ModbusRTUInternals::LoopbackOperation operation(0x11, 4,
+    [&](uint8_t, const esp32Modbus::LatencyProbe& r) { ++latencyCalls; result = r; },
+    [&](uint8_t, esp32Modbus::Error) { FAIL("unexpected error"); });
+
+  uint32_t roundTrips[] = {9000, 11000, 0, 10000};
+  uint16_t lastPattern = 0;
+  for (int i = 0; i < 4; ++i) {
+    ModbusRequest* request = operation.next();
+    REQUIRE(request != nullptr);
+    uint8_t* message = request->getMessage();
+    uint16_t pattern = (message[4] << 8) | message[5];
+    CHECK(pattern != lastPattern);
+    lastPattern = pattern;
+    ModbusResponse* response;
+    if (i == 2) {
+      // corrupted echo: a different pattern with a valid CRC
+      response = answerFrame(request, {0x11, 0x08, 0x00, 0x00, static_cast<uint8_t>(~message[4]), message[5]});
+    } else {
+      response = answerEcho(request);
+    }
+    response->setTiming(1000, 1000 + roundTrips[i]);
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+  }
+  CHECK(operation.next() == nullptr);
+  REQUIRE(latencyCalls == 1);
+  CHECK(result.samples == 3);
+  CHECK(result.failures == 1);
+  CHECK(result.minUs == 9000);
+  CHECK(result.maxUs == 11000);
+  CHECK(result.averageUs() == 10000);
+}
+
+TEST_CASE("Streaming file read", "[file]") {
+  std::vector<uint16_t> records;  // record numbers as seen by the callback
+  std::vector<uint16_t> chunkSizes;
+  int errorCalls = 0;
+  uint16_t failedChunk = 0xFFFF;
+  uint16_t failedRecord = 0;
+  esp32Modbus::Error lastError = esp32Modbus::SUCCESS;
+  auto onRecords = [&](uint8_t, uint16_t file, uint16_t record, const uint8_t* data, uint16_t count) {
+    CHECK(file == 7);
+    chunkSizes.push_back(count);
+    for (uint16_t i = 0; i < count; ++i) {
+      CHECK(((data[2 * i] << 8) | data[2 * i + 1]) == record + i);
+      records.push_back(record + i);
+    }
+  };
+  auto onError = [&](uint8_t, esp32Modbus::Error error, uint16_t chunk, uint16_t record) {
+    ++errorCalls;
+    lastError = error;
+    failedChunk = chunk;
+    failedRecord = record;
+  };
+  // record value == record number
+  auto answer = [](ModbusRequest* request, uint16_t count) {
+    uint8_t* message = request->getMessage();
+    uint16_t record = (message[6] << 8) | message[7];
+    std::vector<uint8_t> frame = {message[0], 0x14, static_cast<uint8_t>(2 + 2 * count), static_cast<uint8_t>(1 + 2 * count), 0x06};
+    for (uint16_t i = 0; i < count; ++i) {
+      frame.push_back((record + i) >> 8);
+      frame.push_back((record + i) & 0xFF);
+    }
+    return answerFrame(request, frame);
+  };
+
+  SECTION("all frames succeed") {
+    esp32ModbusRTUInternals::FileReadOperation operation(0x11, 7, 100, 250, onRecords, onError);
+    CHECK(operation.chunks() == 3);
+    ModbusRequest* request;
+    while ((request = operation.next()) != nullptr) {
+      CHECK(operation.next() == nullptr);  // one frame at a time
+      uint8_t* message = request->getMessage();
+      CHECK(message[1] == 0x14);
+      CHECK(((message[4] << 8) | message[5]) == 7);
+      uint16_t count = (message[8] << 8) | message[9];
+      ModbusResponse* response = answer(request, count);
+      REQUIRE(response->isComplete());
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+    CHECK(errorCalls == 0);
+    CHECK(operation.received() == 250);
+    REQUIRE(chunkSizes.size() == 3);
+    CHECK(chunkSizes[0] == 121);
+    CHECK(chunkSizes[1] == 121);
+    CHECK(chunkSizes[2] == 8);
+    REQUIRE(records.size() == 250);
+    CHECK(records.front() == 100);
+    CHECK(records.back() == 349);
+  }
+
+  SECTION("short sub-response ends the read") {
+    esp32ModbusRTUInternals::FileReadOperation operation(0x11, 7, 0, 250, onRecords, onError);
+    ModbusRequest* request = operation.next();
+    ModbusResponse* response = answer(request, 121);
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+
+    request = operation.next();
+    REQUIRE(request != nullptr);
+    response = answer(request, 120);  // one record missing: byte count mismatch
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+
+    CHECK(operation.next() == nullptr);
+    CHECK(records.size() == 121);
+    CHECK(errorCalls == 1);
+    CHECK(lastError == esp32Modbus::INVALID_RESPONSE);
+    CHECK(failedChunk == 1);
+    CHECK(failedRecord == 121);
+  }
+}
+
+TEST_CASE("FIFO drain", "[fifo]") {
+  std::vector<uint16_t> values;
+  int batches = 0;
+  int endCalls = 0;
+  int errorCalls = 0;
+  auto onFifo = [&](uint8_t, uint16_t pointer, const uint8_t* data, uint16_t count) {
+    CHECK(pointer == 0x04DE);
+    if (count == 0) {
+      ++endCalls;
+      return;
+    }
+    ++batches;
+    for (uint16_t i = 0; i < count; ++i) values.push_back((data[2 * i] << 8) | data[2 * i + 1]);
+  };
+  auto onError = [&](uint8_t, esp32Modbus::Error) { ++errorCalls; };
+  // queue of `count` registers, value == running number from first
+  auto answer = [](ModbusRequest* request, uint8_t count, uint16_t first) {
+    std::vector<uint8_t> frame = {request->getMessage()[0], 0x18, 0x00, static_cast<uint8_t>(2 + 2 * count), 0x00, count};
+    for (uint16_t i = 0; i < count; ++i) {
+      frame.push_back((first + i) >> 8);
+      frame.push_back((first + i) & 0xFF);
+    }
+    return answerFrame(request, frame);
+  };
+
+  SECTION("until empty") {
+    esp32ModbusRTUInternals::FifoDrainOperation operation(0x11, 0x04DE, 0, onFifo, onError);
+    uint8_t queued[] = {31, 5, 0};
+    uint16_t next = 0;
+    for (uint8_t count : queued) {
+      ModbusRequest* request = operation.next();
+      REQUIRE(request != nullptr);
+      CHECK(request->getFunctionCode() == esp32Modbus::READ_FIFO_QUEUE);
+      ModbusResponse* response = answer(request, count, next);
+      REQUIRE(response->isComplete());
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+      next += count;
+    }
+    CHECK(operation.next() == nullptr);
+    CHECK(batches == 2);
+    CHECK(endCalls == 1);
+    CHECK(errorCalls == 0);
+    REQUIRE(values.size() == 36);
+    CHECK(values.back() == 35);
+  }
+
+  SECTION("bounded by maxReads") {
+    esp32ModbusRTUInternals::FifoDrainOperation operation(0x11, 0x04DE, 2, onFifo, onError);
+    for (int i = 0; i < 2; ++i) {
+      ModbusRequest* request = operation.next();
+      REQUIRE(request != nullptr);
+      ModbusResponse* response = answer(request, 31, 0);
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+    CHECK(operation.next() == nullptr);
+    CHECK(batches == 2);
+    CHECK(endCalls == 1);
+  }
+
+  SECTION("error ends the drain") {
+    esp32ModbusRTUInternals::FifoDrainOperation operation(0x11, 0x04DE, 0, onFifo, onError);
+    ModbusRequest* request = operation.next();
+    ModbusResponse* response = answerException(request);
+    operation.onResponse(request, response);
+    delete response;
+    delete request;
+    CHECK(operation.next() == nullptr);
+    CHECK(errorCalls == 1);
+    CHECK(endCalls == 0);
+  }
+}
+
+TEST_CASE("Bulk write throughput against line rate", "[.][benchmark]") {
+  // Bus model of one transaction, as timed by esp32ModbusRTU::_send/_receive:
+  // t3.5 before the request, request, TX guard (1 char + 500 us), slave
+  // turnaround, response, t3.5 before the next request. 8N1: 10 bits/char.
+  const uint32_t bauds[] = {9600, 19200, 115200};
+  const double slaveTurnaroundUs = 1000;
+  const uint16_t registers = 512;  // 1 KB
+  const uint16_t frameSizes[] = {1, 16, 64, 123};
+
+  for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); ++b) {
+    double charUs = 10e6 / bauds[b];
+    double lineRate = bauds[b] / 10.0;
+    for (size_t f = 0; f < sizeof(frameSizes) / sizeof(frameSizes[0]); ++f) {
+      uint16_t perFrame = frameSizes[f];
+      double totalUs = 0;
+      for (uint16_t sent = 0; sent < registers; sent += perFrame) {
+        uint16_t n = registers - sent < perFrame ? registers - sent : perFrame;
+        totalUs += 2 * esp32ModbusRTUInternals::rtuSilenceUs(bauds[b]);
+        totalUs += (9 + 2 * n) * charUs + charUs + 500 + slaveTurnaroundUs + 8 * charUs;
+      }
+      double effective = registers * 2 / (totalUs / 1e6);
+      std::printf("%6u baud, %3u registers/frame: %8.0f B/s payload, %5.1f %% of line rate (%.0f B/s)\n",
+                  bauds[b], perFrame, effective, 100 * effective / lineRate, lineRate);
+    }
+  }
+
+  // host cost of planning and building the frames
+  uint8_t data[1024] = {0};
+  const int rounds = 2000;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    esp32ModbusRTUInternals::BulkWriteOperation operation(0x11, 0, registers, data, nullptr, nullptr);
+    while (ModbusRequest* request = operation.next()) {
+      ModbusResponse* response = answerEcho(request);
+      operation.onResponse(request, response);
+      delete response;
+      delete request;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("bulk write of 1 KB: %.2f us host time per operation\n", seconds / rounds * 1e6);
+}
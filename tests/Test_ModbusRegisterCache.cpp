@@ -0,0 +1,137 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusRegisterCache.h>
+#include <ModbusMessage.h>
+
+#include "Includes/catch.hpp"
+
+using esp32ModbusRTUInternals::RegisterCache;
+
+TEST_CASE("Register cache from read responses", "[cache]") {
+  RegisterCache cache;
+  uint16_t values[3];
+
+  // FC03, 3 registers from 0x006B
+  esp32ModbusRTUInternals::ModbusRequest03 request(0x11, 0x006B, 0x0003);
+  const uint8_t response[] = {0x11, 0x03, 0x06, 0xAE, 0x41, 0x56, 0x52, 0x43, 0x40, 0x49, 0xAD};
+  cache.update(request.getMessage(), request.getSize(), response, sizeof(response), 1000);
+
+  SECTION("fresh values are returned") {
+    REQUIRE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 3, 50, 1020, values));
+    CHECK(values[0] == 0xAE41);
+    CHECK(values[1] == 0x5652);
+    CHECK(values[2] == 0x4340);
+    CHECK(cache.hits() == 1);
+  }
+
+  SECTION("stale values are not") {
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 3, 10, 1020, values));
+    CHECK(cache.misses() == 1);
+  }
+
+  SECTION("partial overlap is a miss") {
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 3, 50, 1020, values));
+    CHECK(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 2, 50, 1020, values));
+  }
+
+  SECTION("other table or slave is a miss") {
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_INPUT_REGISTERS, 0x006B, 1, 50, 1020, values));
+    CHECK_FALSE(cache.load(0x12, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 1, 50, 1020, values));
+  }
+
+  SECTION("invalidate") {
+    cache.invalidate(0x11);
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 1, 50, 1020, values));
+  }
+
+  SECTION("a broadcast write drops its range of every slave") {
+    cache.store(0x22, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 0x0001, 1000);
+    esp32ModbusRTUInternals::ModbusRequest06 broadcast(0x00, 0x006C, 0x1234);
+    cache.invalidateWrite(broadcast.getMessage(), broadcast.getSize());
+    CHECK_FALSE(cache.load(0x22, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 1, 50, 1020, values));
+    CHECK(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 1, 50, 1020, values));
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 1, 50, 1020, values));
+    CHECK(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006D, 1, 50, 1020, values));
+  }
+  SECTION("a failed write drops its range of that slave only") {
+    cache.store(0x22, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 0x0001, 1000);
+    uint16_t data[] = {0x0001, 0x0002};
+    esp32ModbusRTUInternals::ModbusRequest17 write(0x11, 0x0000, 1, 0x006C, 2, data);
+    cache.invalidateWrite(write.getMessage(), write.getSize());
+    CHECK(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 1, 50, 1020, values));
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 1, 50, 1020, values));
+    CHECK(cache.load(0x22, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006C, 1, 50, 1020, values));
+
+    esp32ModbusRTUInternals::ModbusRequest03 read(0x11, 0x006B, 1);
+    cache.invalidateWrite(read.getMessage(), read.getSize());  // reads change nothing
+    CHECK(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x006B, 1, 50, 1020, values));
+  }
+}
+
+TEST_CASE("Register cache from write echoes", "[cache]") {
+  RegisterCache cache;
+  uint16_t values[2];
+
+  SECTION("FC06") {
+    esp32ModbusRTUInternals::ModbusRequest06 request(0x11, 0x0001, 0x0003);
+    const uint8_t response[] = {0x11, 0x06, 0x00, 0x01, 0x00, 0x03, 0x9A, 0x9B};
+    cache.update(request.getMessage(), request.getSize(), response, sizeof(response), 500);
+    REQUIRE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x0001, 1, 0, 500, values));
+    CHECK(values[0] == 0x0003);
+  }
+
+  SECTION("FC16 takes the values from the request") {
+    uint8_t data[] = {0x00, 0x0A, 0x01, 0x02};
+    esp32ModbusRTUInternals::ModbusRequest16 request(0x11, 0x0001, 0x0002, data);
+    const uint8_t response[] = {0x11, 0x10, 0x00, 0x01, 0x00, 0x02, 0x12, 0x98};
+    cache.update(request.getMessage(), request.getSize(), response, sizeof(response), 500);
+    REQUIRE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x0001, 2, 0, 500, values));
+    CHECK(values[0] == 0x000A);
+    CHECK(values[1] == 0x0102);
+  }
+
+  SECTION("FC 0x16 masks a cached register") {
+    cache.store(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x0004, 0x0012, 100);
+    esp32ModbusRTUInternals::ModbusRequestMaskWrite request(0x11, 0x0004, 0x00F2, 0x0025);
+    cache.update(request.getMessage(), request.getSize(), request.getMessage(), request.getSize(), 500);
+    CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x0004, 1, 100, 500, values));
+    REQUIRE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0x0004, 1, 400, 500, values));
+    CHECK(values[0] == 0x0017);
+  }
+
+  SECTION("FC0F and FC01 bits") {
+    bool coils[] = {true, false, true, true, false, false, false, false, true, true};
+    esp32ModbusRTUInternals::ModbusRequest0F request(0x11, 0x0013, 10, coils);
+    const uint8_t response[] = {0x11, 0x0F, 0x00, 0x13, 0x00, 0x0A, 0x26, 0x99};
+    cache.update(request.getMessage(), request.getSize(), response, sizeof(response), 500);
+    uint16_t bits[10];
+    REQUIRE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_COILS, 0x0013, 10, 0, 500, bits));
+    for (int i = 0; i < 10; ++i) CHECK((bits[i] != 0) == coils[i]);
+  }
+}
+
+TEST_CASE("Register cache serves coil reads beyond 125 bits", "[cache]") {
+  RegisterCache cache;
+  for (uint16_t i = 0; i < 200; ++i) {
+    cache.store(0x11, esp32ModbusRTUInternals::TABLE_COILS, i, i % 3 == 0, 1000);
+  }
+  bool coils[200];
+  REQUIRE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_COILS, 0, 200, 50, 1020, coils));
+  CHECK(coils[0]);
+  CHECK_FALSE(coils[1]);
+  CHECK(coils[198]);
+  CHECK_FALSE(coils[199]);
+  CHECK_FALSE(cache.load(0x11, esp32ModbusRTUInternals::TABLE_COILS, 0, 201, 50, 1020, coils));
+}
+
+TEST_CASE("Register cache evicts the oldest entries when full", "[cache]") {
+  RegisterCache cache;
+  uint16_t value;
+  for (uint32_t i = 0; i < 4 * MODBUS_CACHE_SIZE; ++i) {
+    cache.store(0x01, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, i, i, i);
+  }
+  uint32_t newest = 4 * MODBUS_CACHE_SIZE - 1;
+  REQUIRE(cache.load(0x01, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, newest, 1, 1000000, newest, &value));
+  CHECK(value == newest);
+  CHECK_FALSE(cache.load(0x01, esp32ModbusRTUInternals::TABLE_HOLDING_REGISTERS, 0, 1, 1000000, newest, &value));
+}
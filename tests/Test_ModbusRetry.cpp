@@ -0,0 +1,61 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusRetry.h>
+
+#include "Includes/catch.hpp"
+
+TEST_CASE("Retry backoff schedule", "[retry]") {
+  SECTION("exponential with cap") {
+    esp32Modbus::RetryPolicy policy(4, 50, 2, 300);
+    CHECK(policy.backoff(1) == 50);
+    CHECK(policy.backoff(2) == 100);
+    CHECK(policy.backoff(3) == 200);
+    CHECK(policy.backoff(4) == 300);
+    CHECK(policy.backoff(9) == 300);
+  }
+
+  SECTION("constant") {
+    esp32Modbus::RetryPolicy policy(3, 20, 1);
+    CHECK(policy.backoff(1) == 20);
+    CHECK(policy.backoff(3) == 20);
+  }
+
+  SECTION("default policy does not retry") {
+    esp32Modbus::RetryPolicy policy;
+    CHECK(policy.maxRetries == 0);
+  }
+}
+
+TEST_CASE("Retryable errors", "[retry]") {
+  CHECK(esp32Modbus::isRetryable(esp32Modbus::TIMEOUT));
+  CHECK(esp32Modbus::isRetryable(esp32Modbus::CRC_ERROR));
+  CHECK(esp32Modbus::isRetryable(esp32Modbus::SERVER_DEVICE_BUSY));
+  CHECK_FALSE(esp32Modbus::isRetryable(esp32Modbus::ILLEGAL_DATA_ADDRESS));
+  CHECK_FALSE(esp32Modbus::isRetryable(esp32Modbus::SUCCESS));
+}
+
+TEST_CASE("Retry counters per slave and error type", "[retry]") {
+  esp32ModbusRTUInternals::RetryStats stats;
+  esp32Modbus::RetryCounters counters;
+
+  stats.record(0x11, esp32Modbus::TIMEOUT);
+  stats.record(0x11, esp32Modbus::CRC_ERROR);
+  stats.record(0x11, esp32Modbus::TIMEOUT);
+  stats.record(0x22, esp32Modbus::SERVER_DEVICE_BUSY);
+
+  REQUIRE(stats.get(0x11, &counters));
+  CHECK(counters.total == 3);
+  CHECK(counters.timeout == 2);
+  CHECK(counters.crc == 1);
+  CHECK(counters.busy == 0);
+
+  REQUIRE(stats.get(0x22, &counters));
+  CHECK(counters.busy == 1);
+
+  CHECK_FALSE(stats.get(0x33, &counters));
+  CHECK(stats.totals().total == 4);
+
+  stats.reset();
+  CHECK_FALSE(stats.get(0x11, &counters));
+  CHECK(stats.totals().total == 0);
+}
@@ -0,0 +1,242 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusServer.h>
+#include <ModbusFramer.h>
+#include <ModbusMessage.h>
+
+#include "Includes/catch.hpp"
+#include "Includes/WithCRC.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using esp32Modbus::RegisterMap;
+using esp32ModbusRTUInternals::ModbusServer;
+using esp32ModbusRTUInternals::RTUFramer;
+
+namespace {
+
+// Response without CRC, empty when the server stays silent
+std::vector<uint8_t> serve(ModbusServer* server, const std::vector<uint8_t>& request) {
+  std::vector<uint8_t> frame = withCRC(request);
+  uint8_t response[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];
+  size_t length = server->handle(frame.data(), frame.size(), response);
+  if (length == 0) return {};
+  REQUIRE(esp32ModbusRTUInternals::rtuCheckCRC(response, length));
+  return std::vector<uint8_t>(response, response + length - 2);
+}
+
+}  // namespace
+
+TEST_CASE("Server reads", "[server]") {
+  uint8_t coils[4] = {};
+  // spec example: coils 20-38 (0x13 on) read as CD 6B 05, the block starts at 16
+  const uint8_t expected[] = {0xCD, 0x6B, 0x05};
+  for (int i = 0; i < 19; ++i) {
+    if ((expected[i / 8] >> (i % 8)) & 1) coils[(i + 3) / 8] |= 1 << ((i + 3) % 8);
+  }
+  const uint8_t inputs[] = {0xAC, 0xDB, 0x35};
+  uint16_t holding[10] = {};
+  holding[8] = 0x022B;
+  holding[9] = 0x0000;
+  const uint16_t input[] = {0x000A};
+  RegisterMap map;
+  map.setCoils(16, 32, coils);
+  map.setDiscreteInputs(196, 24, inputs);
+  map.setHoldingRegisters(99, 10, holding);  // 107 is the 9th
+  map.setInputRegisters(8, 1, input);
+  ModbusServer server(0x11, &map);
+
+  CHECK(serve(&server, {0x11, 0x01, 0x00, 0x13, 0x00, 0x13}) == std::vector<uint8_t>({0x11, 0x01, 0x03, 0xCD, 0x6B, 0x05}));
+  CHECK(serve(&server, {0x11, 0x02, 0x00, 0xC4, 0x00, 0x16}) == std::vector<uint8_t>({0x11, 0x02, 0x03, 0xAC, 0xDB, 0x35 & 0x3F}));
+  CHECK(serve(&server, {0x11, 0x03, 0x00, 0x6B, 0x00, 0x02}) == std::vector<uint8_t>({0x11, 0x03, 0x04, 0x02, 0x2B, 0x00, 0x00}));
+  CHECK(serve(&server, {0x11, 0x04, 0x00, 0x08, 0x00, 0x01}) == std::vector<uint8_t>({0x11, 0x04, 0x02, 0x00, 0x0A}));
+  CHECK(server.stats().requests == 4);
+  CHECK(server.stats().responses == 4);
+}
+
+TEST_CASE("Server writes", "[server]") {
+  uint8_t coils[3] = {};
+  uint16_t holding[8] = {0, 0, 0, 0x00FE, 0x0ACD, 0x0001, 0x0003, 0x000D};
+  RegisterMap map;
+  map.setCoils(0, 20, coils);
+  map.setHoldingRegisters(0, 8, holding);
+  std::vector<uint16_t> writes;
+  map.onWrite([&](esp32Modbus::FunctionCode fc, uint16_t address, uint16_t count) {
+    writes.insert(writes.end(), {static_cast<uint16_t>(fc), address, count});
+  });
+  ModbusServer server(0x11, &map);
+
+  CHECK(serve(&server, {0x11, 0x05, 0x00, 0x0A, 0xFF, 0x00}) == std::vector<uint8_t>({0x11, 0x05, 0x00, 0x0A, 0xFF, 0x00}));
+  CHECK(coils[1] == 0x04);
+  CHECK(serve(&server, {0x11, 0x06, 0x00, 0x01, 0x00, 0x03}) == std::vector<uint8_t>({0x11, 0x06, 0x00, 0x01, 0x00, 0x03}));
+  CHECK(holding[1] == 0x0003);
+  // spec example: coils 20-29 (0x13) = CD 01, here from coil 3 on
+  CHECK(serve(&server, {0x11, 0x0F, 0x00, 0x03, 0x00, 0x0A, 0x02, 0xCD, 0x01}) == std::vector<uint8_t>({0x11, 0x0F, 0x00, 0x03, 0x00, 0x0A}));
+  CHECK(coils[0] == 0x68);  // 0xCD << 3
+  CHECK(coils[1] == 0x0E);  // coils 8-12, coil 10 set again
+  CHECK(serve(&server, {0x11, 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x01, 0x02}) == std::vector<uint8_t>({0x11, 0x10, 0x00, 0x01, 0x00, 0x02}));
+  CHECK(holding[1] == 0x000A);
+  CHECK(holding[2] == 0x0102);
+  // spec example: write 00FF 00FF 00FF to 0x0E.., read 6 from 0x03; shifted to 5 and 3
+  CHECK(serve(&server, {0x11, 0x17, 0x00, 0x03, 0x00, 0x05, 0x00, 0x05, 0x00, 0x03, 0x06, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF}) ==
+        std::vector<uint8_t>({0x11, 0x17, 0x0A, 0x00, 0xFE, 0x0A, 0xCD, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF}));
+  CHECK(writes == std::vector<uint16_t>({0x05, 10, 1, 0x06, 1, 1, 0x0F, 3, 10, 0x10, 1, 2, 0x17, 5, 3}));
+}
+
+TEST_CASE("Server exceptions", "[server]") {
+  uint16_t holding[4] = {};
+  RegisterMap map;
+  map.setHoldingRegisters(10, 4, holding);
+  bool written = false;
+  map.onWrite([&](esp32Modbus::FunctionCode, uint16_t, uint16_t) { written = true; });
+  ModbusServer server(0x11, &map);
+
+  CHECK(serve(&server, {0x11, 0x03, 0x00, 0x0B, 0x00, 0x04}) == std::vector<uint8_t>({0x11, 0x83, 0x02}));  // 11-14
+  CHECK(serve(&server, {0x11, 0x03, 0xFF, 0xFF, 0x00, 0x02}) == std::vector<uint8_t>({0x11, 0x83, 0x02}));
+  CHECK(serve(&server, {0x11, 0x03, 0x00, 0x0A, 0x00, 0x00}) == std::vector<uint8_t>({0x11, 0x83, 0x03}));
+  CHECK(serve(&server, {0x11, 0x03, 0x00, 0x0A, 0x00, 0x7E}) == std::vector<uint8_t>({0x11, 0x83, 0x03}));
+  CHECK(serve(&server, {0x11, 0x01, 0x00, 0x00, 0x00, 0x01}) == std::vector<uint8_t>({0x11, 0x81, 0x02}));  // no coils
+  CHECK(serve(&server, {0x11, 0x05, 0x00, 0x00, 0x12, 0x34}) == std::vector<uint8_t>({0x11, 0x85, 0x03}));
+  CHECK(serve(&server, {0x11, 0x10, 0x00, 0x0A, 0x00, 0x02, 0x03, 0x00, 0x01, 0x00}) == std::vector<uint8_t>({0x11, 0x90, 0x03}));
+  CHECK(serve(&server, {0x11, 0x2B, 0x0E, 0x01, 0x00}) == std::vector<uint8_t>({0x11, 0xAB, 0x01}));
+  // FC17 writes nothing when the read range is invalid
+  CHECK(serve(&server, {0x11, 0x17, 0x00, 0x00, 0x00, 0x01, 0x00, 0x0A, 0x00, 0x01, 0x02, 0x12, 0x34}) == std::vector<uint8_t>({0x11, 0x97, 0x02}));
+  CHECK(holding[0] == 0);
+  CHECK_FALSE(written);
+  CHECK(server.stats().exceptions == 9);
+}
+
+TEST_CASE("Server addressing", "[server]") {
+  uint16_t holding[2] = {};
+  RegisterMap map;
+  map.setHoldingRegisters(0, 2, holding);
+  ModbusServer server(0x11, &map);
+
+  CHECK(serve(&server, {0x12, 0x06, 0x00, 0x00, 0x12, 0x34}).empty());
+  CHECK(holding[0] == 0);
+  CHECK(serve(&server, {0x00, 0x06, 0x00, 0x00, 0x12, 0x34}).empty());  // broadcast: executed, not answered
+  CHECK(holding[0] == 0x1234);
+
+  std::vector<uint8_t> corrupt = withCRC({0x11, 0x06, 0x00, 0x01, 0x56, 0x78});
+  corrupt[4] ^= 0x01;
+  uint8_t response[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];
+  CHECK(server.handle(corrupt.data(), corrupt.size(), response) == 0);
+  CHECK(holding[1] == 0);
+
+  CHECK(server.stats().ignored == 1);
+  CHECK(server.stats().broadcasts == 1);
+  CHECK(server.stats().crcErrors == 1);
+  CHECK(server.stats().responses == 0);
+}
+
+TEST_CASE("Request lengths end frames on their last byte", "[server]") {
+  uint16_t holding[4] = {1, 2, 3, 4};
+  RegisterMap map;
+  map.setHoldingRegisters(0, 4, holding);
+  ModbusServer server(0x11, &map);
+
+  std::vector<uint8_t> stream = withCRC({0x11, 0x10, 0x00, 0x00, 0x00, 0x01, 0x02, 0xAA, 0xBB});
+  std::vector<uint8_t> read = withCRC({0x11, 0x03, 0x00, 0x00, 0x00, 0x02});
+  stream.insert(stream.end(), read.begin(), read.end());
+
+  RTUFramer framer(1750, esp32ModbusRTUInternals::rtuRequestLength);
+  std::vector<std::vector<uint8_t>> responses;
+  uint32_t respondedAt = 0;
+  uint32_t now = 1000;
+  framer.onFrame([&](const uint8_t* frame, size_t length) {
+    uint8_t response[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];
+    size_t responseLength = server.handle(frame, length, response);
+    responses.emplace_back(response, response + responseLength);
+    respondedAt = now;
+  });
+  // 19200 baud, 520 us per byte, glued frames without silence in between
+  for (uint8_t value : stream) {
+    framer.feed(value, now);
+    if (responses.size() < 2) now += 520;
+  }
+  REQUIRE(responses.size() == 2);
+  CHECK(respondedAt == 1000 + 520 * (stream.size() - 1));  // no t3.5 waited
+  CHECK(holding[0] == 0xAABB);
+  CHECK(responses[1] == withCRC({0x11, 0x03, 0x04, 0xAA, 0xBB, 0x00, 0x02}));
+
+  CHECK(esp32ModbusRTUInternals::rtuRequestLength(read.data(), 1) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuRequestLength(read.data(), 2) == 8);
+  CHECK(esp32ModbusRTUInternals::rtuRequestLength(stream.data(), 6) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuRequestLength(stream.data(), 7) == 11);
+  const uint8_t fc17[] = {0x11, 0x17, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x02};
+  CHECK(esp32ModbusRTUInternals::rtuRequestLength(fc17, 10) == 0);
+  CHECK(esp32ModbusRTUInternals::rtuRequestLength(fc17, 11) == 15);
+}
+
+TEST_CASE("Other slaves' responses on the bus", "[server]") {
+  // The request hint takes a response for a request: FC03 would end after 8 bytes
+  std::vector<uint8_t> other = withCRC({0x22, 0x03, 0x00, 0x00, 0x00, 0x02});
+  std::vector<uint8_t> otherResponse = withCRC({0x22, 0x03, 0x04, 0x12, 0x34, 0x56, 0x78});
+  std::vector<uint8_t> own = withCRC({0x11, 0x03, 0x00, 0x00, 0x00, 0x01});
+
+  RTUFramer framer(1750, esp32ModbusRTUInternals::rtuRequestLength);
+  std::vector<std::vector<uint8_t>> frames;
+  framer.onFrame([&](const uint8_t* frame, size_t length) { frames.emplace_back(frame, frame + length); });
+
+  SECTION("responses are delimited by silence") {
+    framer.feed(other.data(), other.size(), 1000);
+    framer.feed(otherResponse.data(), otherResponse.size(), 5000);
+    CHECK(frames.size() == 1);  // not cut at 8 bytes
+    framer.feed(own.data(), own.size(), 12000);
+    REQUIRE(frames.size() == 3);
+    CHECK(frames[1] == otherResponse);
+    CHECK(frames[2] == own);
+    CHECK(framer.stats().crcErrors == 0);
+  }
+
+  SECTION("a corrupted request is still counted once") {
+    own[4] ^= 0x01;
+    framer.feed(own.data(), own.size(), 1000);
+    framer.poll(5000);
+    CHECK(frames.empty());
+    CHECK(framer.stats().crcErrors == 1);
+  }
+}
+
+// Time from the last request byte to a complete response frame, the slave
+// side's share of the turnaround (t3.5 before sending comes on top).
+TEST_CASE("Server response latency", "[.][benchmark]") {
+  uint16_t holding[125];
+  for (int i = 0; i < 125; ++i) holding[i] = i;
+  uint8_t coils[250] = {};
+  RegisterMap map;
+  map.setHoldingRegisters(0, 125, holding);
+  map.setCoils(0, 2000, coils);
+  ModbusServer server(0x11, &map);
+  RTUFramer framer(1750, esp32ModbusRTUInternals::rtuRequestLength);
+  uint8_t response[esp32ModbusRTUInternals::MODBUS_RTU_MAX_ADU];
+  volatile size_t sink = 0;
+  framer.onFrame([&](const uint8_t* frame, size_t length) { sink = sink + server.handle(frame, length, response); });
+
+  std::vector<uint8_t> write(7 + 2 * 123);
+  write[0] = 0x11;
+  write[1] = 0x10;
+  write[5] = 123;
+  write[6] = 2 * 123;
+  struct { const char* name; std::vector<uint8_t> frame; } cases[] = {
+    {"FC03 1 register", withCRC({0x11, 0x03, 0x00, 0x00, 0x00, 0x01})},
+    {"FC03 125 registers", withCRC({0x11, 0x03, 0x00, 0x00, 0x00, 0x7D})},
+    {"FC01 2000 coils, offset", withCRC({0x11, 0x01, 0x00, 0x03, 0x07, 0xD0 - 3})},
+    {"FC10 123 registers", withCRC(write)},
+  };
+  const int rounds = 200000;
+  for (auto& c : cases) {
+    const uint8_t* frame = c.frame.data();
+    size_t last = c.frame.size() - 1;
+    double total = 0;
+    for (int r = 0; r < rounds; ++r) {
+      framer.feed(frame, last, 0);
+      auto start = std::chrono::steady_clock::now();
+      framer.feed(frame[last], 0);
+      total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::printf("%-26s %7.1f ns from last byte to response\n", c.name, total / rounds * 1e9);
+  }
+  CHECK(server.stats().exceptions == 0);
+}
@@ -0,0 +1,224 @@
+/* copyright 2019 Bert Melis */
+
+#include <ModbusTrace.h>
+
+#include "Includes/catch.hpp"
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using esp32ModbusRTUInternals::FrameTrace;
+
+namespace {
+
+struct Packet {
+  uint64_t timestamp;
+  uint32_t flags;
+  std::vector<uint8_t> frame;
+  std::string comment;
+};
+
+uint32_t u32(const std::vector<uint8_t>& file, size_t offset) {
+  uint32_t value;
+  memcpy(&value, &file[offset], 4);
+  return value;
+}
+
+uint16_t u16(const std::vector<uint8_t>& file, size_t offset) {
+  uint16_t value;
+  memcpy(&value, &file[offset], 2);
+  return value;
+}
+
+std::vector<uint8_t> exportTrace(const FrameTrace& trace) {
+  std::vector<uint8_t> file;
+  REQUIRE(trace.exportPcapng([&file](const uint8_t* data, size_t length) {
+    file.insert(file.end(), data, data + length);
+    return true;
+  }));
+  return file;
+}
+
+// Enhanced packet blocks of a pcapng file, checking the block structure
+std::vector<Packet> parsePcapng(const std::vector<uint8_t>& file) {
+  std::vector<Packet> packets;
+  REQUIRE(file.size() >= 28);
+  REQUIRE(u32(file, 0) == 0x0A0D0D0A);
+  REQUIRE(u32(file, 8) == 0x1A2B3C4D);
+  size_t offset = 0;
+  int interfaces = 0;
+  while (offset < file.size()) {
+    uint32_t type = u32(file, offset);
+    uint32_t length = u32(file, offset + 4);
+    REQUIRE(length % 4 == 0);
+    REQUIRE(offset + length <= file.size());
+    REQUIRE(u32(file, offset + length - 4) == length);
+    if (type == 1) {
+      ++interfaces;
+      CHECK(u16(file, offset + 8) == esp32ModbusRTUInternals::MODBUS_TRACE_LINKTYPE);
+    } else if (type == 6) {
+      Packet packet;
+      packet.timestamp = static_cast<uint64_t>(u32(file, offset + 12)) << 32 | u32(file, offset + 16);
+      uint32_t captured = u32(file, offset + 20);
+      CHECK(u32(file, offset + 24) == captured);
+      packet.frame.assign(&file[offset + 28], &file[offset + 28 + captured]);
+      size_t option = offset + 28 + (captured + 3) / 4 * 4;
+      while (u16(file, option) != 0) {
+        uint16_t code = u16(file, option);
+        uint16_t optionLength = u16(file, option + 2);
+        if (code == 2) packet.flags = u32(file, option + 4);
+        if (code == 1) packet.comment.assign(reinterpret_cast<const char*>(&file[option + 4]), optionLength);
+        option += 4 + (optionLength + 3) / 4 * 4;
+      }
+      packets.push_back(packet);
+    }
+    offset += length;
+  }
+  CHECK(interfaces == 1);
+  return packets;
+}
+
+}  // namespace
+
+TEST_CASE("Frame trace export", "[trace]") {
+  FrameTrace trace(1024);
+  const uint8_t request[] = {0x11, 0x03, 0x00, 0x6B, 0x00, 0x01, 0xF6, 0x87};
+  const uint8_t response[] = {0x11, 0x83, 0x02, 0xC1, 0x34};
+  trace.capture(esp32ModbusRTUInternals::TRACE_TX, 0x11, esp32Modbus::SUCCESS, request, sizeof(request), 1000);
+  trace.capture(esp32ModbusRTUInternals::TRACE_RX, 0x11, esp32Modbus::ILLEGAL_DATA_ADDRESS, response, sizeof(response), 9000);
+  trace.capture(esp32ModbusRTUInternals::TRACE_RX, 0x12, esp32Modbus::TIMEOUT, nullptr, 0, 5009000);
+
+  std::vector<Packet> packets = parsePcapng(exportTrace(trace));
+  REQUIRE(packets.size() == 3);
+  CHECK(packets[0].timestamp == 1000);
+  CHECK(packets[0].flags == 2);  // outbound
+  CHECK(packets[0].frame == std::vector<uint8_t>(request, request + sizeof(request)));
+  CHECK(packets[0].comment == "TX slave=17 outcome=0x00 Success");
+  CHECK(packets[1].timestamp == 9000);
+  CHECK(packets[1].flags == 1);  // inbound
+  CHECK(packets[1].frame == std::vector<uint8_t>(response, response + sizeof(response)));
+  CHECK(packets[1].comment == "RX slave=17 outcome=0x02 Illegal data address");
+  CHECK(packets[2].frame.empty());
+  CHECK(packets[2].comment.find("RX slave=18 outcome=0xE0") == 0);
+  CHECK(trace.captured() == 3);
+  CHECK(trace.overwritten() == 0);
+
+  // a request from the queues tells how it was scheduled instead of an outcome
+  trace.captureRequest(esp32Modbus::RELAY, true, 1, 2500, request, sizeof(request), 5010000);
+  packets = parsePcapng(exportTrace(trace));
+  REQUIRE(packets.size() == 4);
+  CHECK(packets[3].flags == 2);
+  CHECK(packets[3].frame == std::vector<uint8_t>(request, request + sizeof(request)));
+  CHECK(packets[3].comment == "TX slave=17 priority=2 wait=2500 continuation retry");
+
+  // only what came after the clear
+  trace.clear();
+  trace.capture(esp32ModbusRTUInternals::TRACE_TX, 0x11, esp32Modbus::SUCCESS, request, sizeof(request), 6000000);
+  packets = parsePcapng(exportTrace(trace));
+  REQUIRE(packets.size() == 1);
+  CHECK(packets[0].timestamp == 6000000);
+
+  // a writer refusing a chunk ends the export
+  int chunks = 0;
+  CHECK_FALSE(trace.exportPcapng([&chunks](const uint8_t*, size_t) { return ++chunks < 2; }));
+  CHECK(chunks == 2);
+}
+
+TEST_CASE("Frame trace overwrites the oldest frames", "[trace]") {
+  FrameTrace trace(300);  // 256 bytes
+  uint8_t frame[100];
+  for (uint8_t i = 0; i < 10; ++i) {
+    memset(frame, i, sizeof(frame));
+    trace.capture(esp32ModbusRTUInternals::TRACE_TX, 0x01, esp32Modbus::SUCCESS, frame, sizeof(frame), i * 1000);
+  }
+  std::vector<Packet> packets = parsePcapng(exportTrace(trace));
+  REQUIRE(packets.size() == 2);  // 2 x (13 + 100) fit
+  CHECK(packets[0].frame[0] == 8);
+  CHECK(packets[1].frame[99] == 9);
+  CHECK(trace.overwritten() == 8);
+
+  // micros() wrapped between the frames: timestamps keep increasing
+  FrameTrace wrapped(1024);
+  wrapped.capture(esp32ModbusRTUInternals::TRACE_TX, 0x01, esp32Modbus::SUCCESS, frame, 8, UINT32_MAX - 99);
+  wrapped.capture(esp32ModbusRTUInternals::TRACE_RX, 0x01, esp32Modbus::SUCCESS, frame, 8, 400);
+  packets = parsePcapng(exportTrace(wrapped));
+  REQUIRE(packets.size() == 2);
+  CHECK(packets[1].timestamp - packets[0].timestamp == 500);
+}
+
+TEST_CASE("Frame trace keeps frames of the full ADU size", "[trace]") {
+  FrameTrace trace(1024);
+  uint8_t frame[256];
+  for (size_t i = 0; i < sizeof(frame); ++i) frame[i] = i;
+  trace.capture(esp32ModbusRTUInternals::TRACE_RX, 0x11, esp32Modbus::SUCCESS, frame, sizeof(frame), 1000);
+  trace.capture(esp32ModbusRTUInternals::TRACE_TX, 0x11, esp32Modbus::SUCCESS, frame, 8, 2000);
+  std::vector<Packet> packets = parsePcapng(exportTrace(trace));
+  REQUIRE(packets.size() == 2);
+  CHECK(packets[0].frame == std::vector<uint8_t>(frame, frame + sizeof(frame)));
+  CHECK(packets[1].frame.size() == 8);
+
+  // eviction steps over the long record too
+  for (uint32_t i = 0; i < 8; ++i) {
+    trace.capture(esp32ModbusRTUInternals::TRACE_TX, 0x11, esp32Modbus::SUCCESS, frame, 100, 3000 + i);
+  }
+  packets = parsePcapng(exportTrace(trace));
+  CHECK(packets.size() == 1024 / (13 + 100));
+  CHECK(trace.overwritten() == 2 + 8 - 1024 / (13 + 100));
+}
+
+TEST_CASE("Frame trace exports full ADU frames with the longest comments", "[trace]") {
+  FrameTrace trace(1024);
+  uint8_t frame[256];
+  for (size_t i = 0; i < sizeof(frame); ++i) frame[i] = i;
+  trace.capture(esp32ModbusRTUInternals::TRACE_RX, 247, esp32Modbus::GATEWAY_TARGET_FAILED, frame, sizeof(frame), 1000);
+  frame[0] = 247;
+  trace.captureRequest(esp32Modbus::STATUS, true, 2, 0xFFFFFFFF, frame, sizeof(frame), 2000);
+  std::vector<Packet> packets = parsePcapng(exportTrace(trace));
+  REQUIRE(packets.size() == 2);
+  CHECK(packets[0].frame.size() == 256);
+  CHECK(packets[0].comment == "RX slave=247 outcome=0x0B Gateway target device failed to respo");  // cut off at 63
+  CHECK(packets[1].frame.size() == 256);
+  CHECK(packets[1].comment == "TX slave=247 priority=3 wait=4294967295 continuation retry");
+}
+
+TEST_CASE("Frame trace export while capturing", "[trace]") {
+  FrameTrace trace(512);
+  std::atomic<bool> stop(false);
+  std::thread capturing([&trace, &stop] {
+    uint8_t frame[60];
+    for (uint32_t i = 0; !stop; ++i) {
+      uint8_t length = 4 + i % 57;
+      memset(frame, length, length);  // every byte tells the length
+      trace.capture(esp32ModbusRTUInternals::TRACE_RX, length, esp32Modbus::SUCCESS, frame, length, i);
+    }
+  });
+  while (trace.overwritten() < 100) std::this_thread::yield();
+  uint32_t before = trace.overwritten();
+  bool intact = true;
+  // until the capture moved on by many ring lengths, whatever the scheduling
+  for (int round = 0; (round < 200 || trace.overwritten() - before < 10000) && round < 1000000 && intact; ++round) {
+    std::vector<uint8_t> file;
+    trace.exportPcapng([&file](const uint8_t* data, size_t length) {
+      file.insert(file.end(), data, data + length);
+      return true;
+    });
+    // walk the packets without Catch assertions, they are many
+    size_t offset = 0;
+    while (offset + 8 <= file.size() && intact) {
+      uint32_t type = u32(file, offset);
+      uint32_t length = u32(file, offset + 4);
+      if (type == 6) {
+        uint32_t captured = u32(file, offset + 20);
+        for (uint32_t i = 0; i < captured; ++i) intact = intact && file[offset + 28 + i] == captured;
+      }
+      offset += length;
+    }
+  }
+  uint32_t after = trace.overwritten();
+  stop = true;
+  capturing.join();
+  CHECK(intact);
+  CHECK(after > before);  // the exports raced the capture
+}
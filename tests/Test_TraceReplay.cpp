@@ -0,0 +1,486 @@
+/* copyright 2019 Bert Melis */
+
+// Trace replay: the frames of a pcapng trace as exportTrace() writes it go
+// through the response parser and the request scheduler again, on the host.
+// A production capture is replayed by the hidden case at the end:
+//   MODBUS_REPLAY_TRACE=trace.pcapng MODBUS_REPLAY_BAUD=19200 ./tests "[replay]"
+// It reports the parse throughput, the responses the parser rejects (and
+// where that differs from the outcome the device traced) and how the
+// scheduler would have ordered the traced requests.
+// The trace keeps one timestamp per frame, not the timing between its bytes.
+// Master-side responses are fed to ModbusResponse back to back, without a
+// clock: a frame that is not complete after its last byte gets endOfFrame(),
+// the outcome _receive() reaches after t3.5 of silence. Only slave mode
+// requests go through a timed path, the RTUFramer at the character time.
+
+#include <ModbusFramer.h>
+#include <ModbusMessage.h>
+#include <ModbusScheduler.h>
+#include <ModbusTrace.h>
+
+#include "Includes/catch.hpp"
+#include "Includes/WithCRC.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+using esp32ModbusRTUInternals::FrameTrace;
+using esp32ModbusRTUInternals::ModbusRequest;
+using esp32ModbusRTUInternals::ModbusResponse;
+
+namespace {
+
+struct Record {
+  uint64_t timestamp;
+  bool inbound;
+  std::vector<uint8_t> frame;
+  bool scheduled;  // a request the worker took from the queues
+  uint8_t priority;
+  uint32_t waitUs;
+  bool continuation;
+  bool retry;
+  uint8_t outcome;  // received frames: the error the device reported
+};
+
+struct ParseReport {
+  uint32_t responses;   // replayed through ModbusResponse
+  uint32_t bytes;
+  uint32_t errors;      // responses the parser did not accept
+  uint32_t mismatches;  // outcome differs from the traced one
+  uint32_t unpaired;    // responses whose request was overwritten in the ring
+  uint32_t perError[256];
+  uint32_t requests;    // slave mode requests replayed through the RTUFramer
+  uint32_t reframed;    // of those, delivered as a frame again
+  bool master;          // the trace has scheduled requests, else it is from slave mode
+};
+
+struct ScheduleReport {
+  uint32_t requests;
+  uint32_t reordered;  // served at another position than traced
+  uint32_t retries;    // not in the waits, the backoff is not traced
+  uint32_t count[4];
+  uint64_t tracedWaitUs[4];
+  uint64_t simulatedWaitUs[4];
+  uint32_t tracedMaxUs[4];
+  uint32_t simulatedMaxUs[4];
+};
+
+uint32_t u32(const std::vector<uint8_t>& file, size_t offset) {
+  uint32_t value;
+  memcpy(&value, &file[offset], 4);
+  return value;
+}
+
+uint16_t u16(const std::vector<uint8_t>& file, size_t offset) {
+  uint16_t value;
+  memcpy(&value, &file[offset], 2);
+  return value;
+}
+
+// Enhanced packet blocks with their comments decoded; stops at a truncated block
+std::vector<Record> readPcapng(const std::vector<uint8_t>& file) {
+  std::vector<Record> records;
+  if (file.size() < 12 || u32(file, 0) != 0x0A0D0D0A || u32(file, 8) != 0x1A2B3C4D) return records;
+  size_t offset = 0;
+  while (offset + 12 <= file.size()) {
+    uint32_t type = u32(file, offset);
+    uint32_t length = u32(file, offset + 4);
+    if (length < 12 || offset + length > file.size()) break;
+    uint32_t captured = type == 6 ? u32(file, offset + 20) : 0;
+    if (type == 6 && 32 + captured <= length) {
+      Record record = Record();
+      record.timestamp = static_cast<uint64_t>(u32(file, offset + 12)) << 32 | u32(file, offset + 16);
+      record.frame.assign(&file[offset + 28], &file[offset + 28 + captured]);
+      uint32_t flags = 0;
+      std::string comment;
+      size_t option = offset + 28 + (captured + 3) / 4 * 4;
+      while (option + 4 <= offset + length - 4 && u16(file, option) != 0) {
+        uint16_t code = u16(file, option);
+        uint16_t optionLength = u16(file, option + 2);
+        if (option + 4 + optionLength > offset + length - 4) break;
+        if (code == 2 && optionLength == 4) flags = u32(file, option + 4);
+        if (code == 1) comment.assign(reinterpret_cast<const char*>(&file[option + 4]), optionLength);
+        option += 4 + (optionLength + 3) / 4 * 4;
+      }
+      record.inbound = (flags & 3) == 1;
+      unsigned slave;
+      unsigned priority;
+      unsigned outcome;
+      unsigned long wait;
+      if (sscanf(comment.c_str(), "TX slave=%u priority=%u wait=%lu", &slave, &priority, &wait) == 3) {
+        record.scheduled = true;
+        record.priority = priority & 0x03;
+        record.waitUs = wait;
+        record.continuation = comment.find(" continuation") != std::string::npos;
+        record.retry = comment.find(" retry") != std::string::npos;
+      } else if (sscanf(comment.c_str(), "%*2s slave=%u outcome=0x%x", &slave, &outcome) == 2) {
+        record.outcome = outcome;
+      }
+      records.push_back(record);
+    }
+    offset += length;
+  }
+  return records;
+}
+
+// The request the driver would have built for a traced frame: the typed class
+// where there is one, so the response is validated the same way
+ModbusRequest* requestFromFrame(const std::vector<uint8_t>& frame) {
+  using namespace esp32ModbusRTUInternals;  // NOLINT
+  uint8_t slave = frame[0];
+  uint16_t address = frame.size() >= 6 ? frame[2] << 8 | frame[3] : 0;
+  uint16_t count = frame.size() >= 6 ? frame[4] << 8 | frame[5] : 0;
+  bool fixed = frame.size() == 8;
+  bool block = frame.size() >= 9 && frame.size() == 9u + frame[6];
+  switch (frame[1]) {
+  case 0x01: if (fixed) return new ModbusRequest01(slave, address, count); break;
+  case 0x02: if (fixed) return new ModbusRequest02(slave, address, count); break;
+  case 0x03: if (fixed) return new ModbusRequest03(slave, address, count); break;
+  case 0x04: if (fixed) return new ModbusRequest04(slave, address, count); break;
+  case 0x05: if (fixed) return new ModbusRequest05(slave, address, count == 0xFF00); break;
+  case 0x06: if (fixed) return new ModbusRequest06(slave, address, count); break;
+  case 0x0F: if (block) return new ModbusRequest0F(slave, address, count, &frame[7]); break;
+  case 0x10: if (block) return new ModbusRequest16(slave, address, count, &frame[7]); break;
+  }
+  return new ModbusRequestRaw(slave, frame[1], &frame[2], frame.size() - 4, 0);
+}
+
+// Responses as _receive() takes them: byte by byte until the frame is rejected,
+// then the silence after the last byte. The trace keeps the time of the frame,
+// not of every byte; they arrive back to back, as from the UART FIFO.
+// A trace without scheduled requests is from slave mode: its requests go
+// through the RTUFramer, with the character time of the baud rate.
+ParseReport replayParse(const std::vector<Record>& records, uint32_t baudRate) {
+  ParseReport report = ParseReport();
+  uint32_t charUs = 11000000UL / baudRate;
+  uint32_t silenceUs = esp32ModbusRTUInternals::rtuSilenceUs(baudRate);
+  esp32ModbusRTUInternals::RTUFramer framer(silenceUs, esp32ModbusRTUInternals::rtuRequestLength);
+  framer.onFrame([&report](const uint8_t*, size_t) { ++report.reframed; });
+  for (const Record& record : records) report.master = report.master || record.scheduled;
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    const Record& record = records[i];
+    if (!record.inbound) continue;
+    report.bytes += record.frame.size();
+    if (i > 0 && records[i - 1].scheduled) {
+      const std::vector<uint8_t>& sent = records[i - 1].frame;
+      if (sent.size() < 4) continue;
+      ModbusRequest* request = requestFromFrame(sent);
+      size_t length = request->responseLength();
+      if (length == 0 || length > 255) length = 255;
+      ModbusResponse response(length, request);
+      for (size_t j = 0; j < record.frame.size() && !response.isRejected(); ++j) response.add(record.frame[j]);
+      if (!response.isRejected() && !response.isComplete()) response.endOfFrame();
+      esp32Modbus::Error outcome = response.isSuccess() ? esp32Modbus::SUCCESS : response.getError();
+      ++report.responses;
+      if (outcome != esp32Modbus::SUCCESS) {
+        ++report.errors;
+        ++report.perError[outcome];
+      }
+      if (outcome != record.outcome) ++report.mismatches;
+      delete request;
+    } else if (report.master) {
+      ++report.unpaired;
+    } else if (!record.frame.empty()) {
+      ++report.requests;
+      uint32_t end = static_cast<uint32_t>(record.timestamp);
+      uint32_t first = end - static_cast<uint32_t>(record.frame.size() - 1) * charUs;
+      for (size_t j = 0; j < record.frame.size(); ++j) framer.feed(record.frame[j], first + j * charUs);
+      framer.poll(end + silenceUs);
+    }
+  }
+  return report;
+}
+
+// The traced requests scheduled again by nextToServe(), each holding the bus
+// as long as it did in the trace, plus t3.5 before the next one. A request
+// arrives when it was queued (send time minus its wait), a continuation when
+// the transaction before it ends, a retry at its traced send time (the latest
+// it can have been due) at the front of its queue.
+ScheduleReport replaySchedule(const std::vector<Record>& records, uint32_t baudRate) {
+  struct Item {
+    uint64_t arrival;
+    uint64_t busy;
+    const Record* record;
+  };
+  ScheduleReport report = ScheduleReport();
+  uint32_t charUs = 11000000UL / baudRate;
+  uint32_t silenceUs = esp32ModbusRTUInternals::rtuSilenceUs(baudRate);
+
+  std::vector<Item> items;
+  for (size_t i = 0; i < records.size(); ++i) {
+    const Record& record = records[i];
+    if (!record.scheduled) continue;
+    Item item;
+    item.record = &record;
+    item.arrival = record.retry ? record.timestamp
+                                : record.timestamp - (record.waitUs < record.timestamp ? record.waitUs : record.timestamp);
+    item.busy = record.frame.size() * charUs;  // a broadcast's turnaround is not traced
+    if (i + 1 < records.size() && records[i + 1].inbound && records[i + 1].timestamp - record.timestamp > item.busy)
+      item.busy = records[i + 1].timestamp - record.timestamp;
+    items.push_back(item);
+  }
+  report.requests = items.size();
+
+  // queued requests in order of arrival, continuations released by their predecessor
+  std::vector<size_t> arrivals;
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (!items[i].record->continuation) arrivals.push_back(i);
+  }
+  std::stable_sort(arrivals.begin(), arrivals.end(),
+                   [&items](size_t a, size_t b) { return items[a].arrival < items[b].arrival; });
+  std::deque<size_t> queues[4];
+  size_t continuations[4];
+  uint64_t released[4] = {0};
+  for (int p = 0; p < 4; ++p) continuations[p] = SIZE_MAX;
+  size_t admitted = 0;
+  uint64_t free = 0;
+  uint32_t position = 0;
+
+  while (position < items.size()) {
+    uint64_t now = free;
+    bool waiting = false;
+    for (int p = 0; p < 4; ++p) waiting = waiting || !queues[p].empty() || continuations[p] != SIZE_MAX;
+    if (!waiting && admitted < arrivals.size() && items[arrivals[admitted]].arrival > now)
+      now = items[arrivals[admitted]].arrival;
+    for (; admitted < arrivals.size() && items[arrivals[admitted]].arrival <= now; ++admitted) {
+      size_t index = arrivals[admitted];
+      const Record* record = items[index].record;
+      if (record->retry)
+        queues[record->priority].push_front(index);
+      else
+        queues[record->priority].push_back(index);
+    }
+    uint8_t continuationMask = 0;
+    uint8_t queuedMask = 0;
+    for (int p = 0; p < 4; ++p) {
+      if (continuations[p] != SIZE_MAX) continuationMask |= 1 << p;
+      if (!queues[p].empty()) queuedMask |= 1 << p;
+    }
+    esp32ModbusRTUInternals::ScheduleChoice choice = esp32ModbusRTUInternals::nextToServe(continuationMask, queuedMask);
+    if (choice.priority < 0) break;  // a continuation whose predecessor is not in the trace
+
+    size_t index;
+    uint64_t arrival;
+    if (choice.continuation) {
+      index = continuations[choice.priority];
+      arrival = released[choice.priority];
+      continuations[choice.priority] = SIZE_MAX;
+    } else {
+      index = queues[choice.priority].front();
+      arrival = items[index].arrival;
+      queues[choice.priority].pop_front();
+    }
+    if (index != position) ++report.reordered;
+    ++position;
+
+    const Record* record = items[index].record;
+    uint64_t end = now + items[index].busy;
+    free = end + silenceUs;
+    if (index + 1 < items.size() && items[index + 1].record->continuation) {
+      uint8_t next = items[index + 1].record->priority;
+      continuations[next] = index + 1;
+      released[next] = end;
+    }
+    if (record->retry) {
+      ++report.retries;
+      continue;
+    }
+    uint32_t simulated = static_cast<uint32_t>(now - arrival);
+    ++report.count[record->priority];
+    report.tracedWaitUs[record->priority] += record->waitUs;
+    report.simulatedWaitUs[record->priority] += simulated;
+    if (record->waitUs > report.tracedMaxUs[record->priority]) report.tracedMaxUs[record->priority] = record->waitUs;
+    if (simulated > report.simulatedMaxUs[record->priority]) report.simulatedMaxUs[record->priority] = simulated;
+  }
+  return report;
+}
+
+void printReport(const ParseReport& parse, const ScheduleReport& schedule) {
+  printf("responses: %u (%u bytes received), %u rejected, %u differ from the traced outcome, %u without request\n",
+         parse.responses, parse.bytes, parse.errors, parse.mismatches, parse.unpaired);
+  for (int error = 1; error < 256; ++error) {
+    if (parse.perError[error] == 0) continue;
+    printf("  0x%02X %-28s %u\n", error, esp32Modbus::getErrorDescription(static_cast<esp32Modbus::Error>(error)),
+           parse.perError[error]);
+  }
+  if (parse.requests) printf("slave mode requests: %u, %u framed again\n", parse.requests, parse.reframed);
+  printf("scheduled requests: %u, %u served at another position, %u retries\n",
+         schedule.requests, schedule.reordered, schedule.retries);
+  printf("%-10s %6s %14s %14s %14s %14s\n", "priority", "count", "traced avg us", "replay avg us", "traced max us",
+         "replay max us");
+  for (int p = 0; p < 4; ++p) {
+    if (schedule.count[p] == 0) continue;
+    printf("%-10s %6u %14llu %14llu %14u %14u\n", esp32Modbus::getPriorityDescription(static_cast<esp32Modbus::ModbusPriority>(p)),
+           schedule.count[p], static_cast<unsigned long long>(schedule.tracedWaitUs[p] / schedule.count[p]),
+           static_cast<unsigned long long>(schedule.simulatedWaitUs[p] / schedule.count[p]),
+           schedule.tracedMaxUs[p], schedule.simulatedMaxUs[p]);
+  }
+}
+
+void captureRequest(FrameTrace* trace, ModbusRequest* request, esp32Modbus::ModbusPriority priority,
+                    bool continuation, uint32_t waitUs, uint32_t nowUs) {
+  trace->captureRequest(priority, continuation, 0, waitUs, request->getMessage(), request->getSize(), nowUs);
+  delete request;
+}
+
+void captureResponse(FrameTrace* trace, const std::vector<uint8_t>& frame, esp32Modbus::Error outcome, uint32_t nowUs) {
+  trace->capture(esp32ModbusRTUInternals::TRACE_RX, frame.empty() ? 0 : frame[0], outcome, frame.data(), frame.size(), nowUs);
+}
+
+std::vector<Record> exportRecords(const FrameTrace& trace) {
+  std::vector<uint8_t> file;
+  REQUIRE(trace.exportPcapng([&file](const uint8_t* data, size_t length) {
+    file.insert(file.end(), data, data + length);
+    return true;
+  }));
+  return readPcapng(file);
+}
+
+// A STATUS read on the bus when a RELAY write (at 5 ms) and an EMERGENCY write
+// (at 8 ms) are queued, served in priority order or, with fifo, as they came.
+// Then a continuation of the last one. The trace starts with a response whose
+// request was overwritten.
+std::vector<Record> buildTrace(bool fifo) {
+  using namespace esp32ModbusRTUInternals;  // NOLINT
+  FrameTrace trace(4096);
+
+  captureResponse(&trace, withCRC({0x01, 0x03, 0x02, 0x00, 0x01}), esp32Modbus::SUCCESS, 0);
+  captureRequest(&trace, new ModbusRequest03(0x01, 0x0000, 1), esp32Modbus::STATUS, false, 0, 0);
+  captureResponse(&trace, withCRC({0x01, 0x03, 0x02, 0x00, 0x2A}), esp32Modbus::SUCCESS, 20000);
+
+  std::vector<uint8_t> echo = withCRC({0x03, 0x05, 0x00, 0x10, 0xFF, 0x00});
+  echo.back() ^= 0xFF;  // line noise: the device saw a CRC error
+  std::vector<uint8_t> exception = withCRC({0x02, 0x86, 0x02});  // traced as success, the parser disagrees
+  if (fifo) {
+    captureRequest(&trace, new ModbusRequest06(0x02, 0x0020, 7), esp32Modbus::RELAY, false, 17000, 22000);
+    captureResponse(&trace, exception, esp32Modbus::SUCCESS, 40000);
+    captureRequest(&trace, new ModbusRequest05(0x03, 0x0010, true), esp32Modbus::EMERGENCY, false, 34000, 42000);
+    captureResponse(&trace, echo, esp32Modbus::CRC_ERROR, 60000);
+  } else {
+    captureRequest(&trace, new ModbusRequest05(0x03, 0x0010, true), esp32Modbus::EMERGENCY, false, 14000, 22000);
+    captureResponse(&trace, echo, esp32Modbus::CRC_ERROR, 40000);
+    captureRequest(&trace, new ModbusRequest06(0x02, 0x0020, 7), esp32Modbus::RELAY, false, 37000, 42000);
+    captureResponse(&trace, exception, esp32Modbus::SUCCESS, 60000);
+  }
+  captureRequest(&trace, new ModbusRequest04(0x01, 0x0000, 2), fifo ? esp32Modbus::EMERGENCY : esp32Modbus::RELAY,
+                 true, 2000, 62000);
+  captureResponse(&trace, std::vector<uint8_t>(), esp32Modbus::TIMEOUT, 1062000);
+  return exportRecords(trace);
+}
+
+}  // namespace
+
+TEST_CASE("Scheduling decisions", "[replay]") {
+  using esp32ModbusRTUInternals::nextToServe;
+  CHECK(nextToServe(0x00, 0x00).priority == -1);
+  CHECK(nextToServe(0x00, 0x0C).priority == 2);
+  CHECK(nextToServe(0x08, 0x06).priority == 1);
+  CHECK_FALSE(nextToServe(0x08, 0x06).continuation);
+  // a continuation goes before the queue of its level, not before higher levels
+  CHECK(nextToServe(0x02, 0x02).continuation);
+  CHECK(nextToServe(0x04, 0x01).priority == 0);
+}
+
+TEST_CASE("Trace replay", "[replay]") {
+  std::vector<Record> records = buildTrace(false);
+  REQUIRE(records.size() == 9);
+  CHECK(records[0].inbound);
+  CHECK(records[1].scheduled);
+  CHECK(records[1].priority == esp32Modbus::STATUS);
+  CHECK(records[3].waitUs == 14000);
+  CHECK(records[4].outcome == esp32Modbus::CRC_ERROR);
+  CHECK(records[7].continuation);
+
+  ParseReport parse = replayParse(records, 19200);
+  CHECK(parse.responses == 4);
+  CHECK(parse.errors == 3);
+  CHECK(parse.perError[esp32Modbus::CRC_ERROR] == 1);
+  CHECK(parse.perError[esp32Modbus::ILLEGAL_DATA_ADDRESS] == 1);
+  CHECK(parse.perError[esp32Modbus::TIMEOUT] == 1);
+  CHECK(parse.mismatches == 1);  // the exception traced as success
+  CHECK(parse.unpaired == 1);
+  CHECK(parse.requests == 0);
+  CHECK(parse.master);
+
+  // traced in priority order: the replay agrees
+  ScheduleReport schedule = replaySchedule(records, 19200);
+  CHECK(schedule.requests == 4);
+  CHECK(schedule.reordered == 0);
+  CHECK(schedule.count[esp32Modbus::EMERGENCY] == 1);
+  CHECK(schedule.simulatedMaxUs[esp32Modbus::EMERGENCY] == Approx(14000).epsilon(0.01));
+  CHECK(schedule.count[esp32Modbus::RELAY] == 2);
+  CHECK(schedule.simulatedMaxUs[esp32Modbus::RELAY] == Approx(37000).epsilon(0.01));
+
+  // traced first come, first served: the replay serves the emergency write
+  // and its continuation before the relay write
+  schedule = replaySchedule(buildTrace(true), 19200);
+  CHECK(schedule.reordered == 3);
+  CHECK(schedule.tracedMaxUs[esp32Modbus::EMERGENCY] == 34000);
+  CHECK(schedule.simulatedMaxUs[esp32Modbus::EMERGENCY] < 15000);
+  CHECK(schedule.simulatedMaxUs[esp32Modbus::RELAY] > 30000);
+}
+
+TEST_CASE("Trace replay in slave mode", "[replay]") {
+  FrameTrace trace(1024);
+  std::vector<uint8_t> request = withCRC({0x0A, 0x03, 0x00, 0x00, 0x00, 0x01});
+  std::vector<uint8_t> answer = withCRC({0x0A, 0x03, 0x02, 0x12, 0x34});
+  for (uint32_t i = 0; i < 3; ++i) {
+    trace.capture(esp32ModbusRTUInternals::TRACE_RX, 0x0A, esp32Modbus::SUCCESS, request.data(), request.size(), i * 10000);
+    trace.capture(esp32ModbusRTUInternals::TRACE_TX, 0x0A, esp32Modbus::SUCCESS, answer.data(), answer.size(), i * 10000 + 4000);
+  }
+  ParseReport parse = replayParse(exportRecords(trace), 19200);
+  CHECK_FALSE(parse.master);
+  CHECK(parse.responses == 0);
+  CHECK(parse.requests == 3);
+  CHECK(parse.reframed == 3);
+  CHECK(replaySchedule(exportRecords(trace), 19200).requests == 0);
+}
+
+TEST_CASE("Trace replay of a capture", "[.][replay]") {
+  const char* path = getenv("MODBUS_REPLAY_TRACE");
+  const char* baud = getenv("MODBUS_REPLAY_BAUD");
+  uint32_t baudRate = baud ? strtoul(baud, nullptr, 10) : 9600;
+  std::vector<Record> records;
+  if (path) {
+    FILE* file = fopen(path, "rb");
+    REQUIRE(file != nullptr);
+    std::vector<uint8_t> content;
+    uint8_t chunk[4096];
+    size_t length;
+    while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) content.insert(content.end(), chunk, chunk + length);
+    fclose(file);
+    records = readPcapng(content);
+  } else {
+    records = buildTrace(false);  // no capture given: the built-in one
+  }
+  REQUIRE(baudRate > 0);
+  REQUIRE_FALSE(records.empty());
+
+  ParseReport parse = replayParse(records, baudRate);
+  uint32_t rounds = 0;
+  auto start = std::chrono::steady_clock::now();
+  double seconds = 0;
+  while (seconds < 0.5) {
+    replayParse(records, baudRate);
+    ++rounds;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  ScheduleReport schedule = replaySchedule(records, baudRate);
+
+  printf("%s: %u frames at %u baud\n", path ? path : "built-in trace", static_cast<unsigned>(records.size()), baudRate);
+  printf("parse: %.0f frames/s, %.1f MB/s (%u rounds)\n", rounds * records.size() / seconds,
+         rounds * static_cast<double>(parse.bytes) / seconds / 1e6, rounds);
+  printReport(parse, schedule);
+  if (parse.master) {
+    CHECK(schedule.requests > 0);
+  } else {
+    CHECK(parse.requests > 0);
+  }
+}
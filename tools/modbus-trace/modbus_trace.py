@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+Modbus RTU trace tool
+
+Reads the pcapng files written by esp32ModbusRTU::exportTrace() and prints a
+summary per slave and function code, or the frames as text or CSV. A trace
+printed as hex (e.g. over Serial) is converted back to pcapng first.
+
+Usage:
+    python modbus_trace.py summary trace.pcapng
+    python modbus_trace.py dump trace.pcapng [--csv]
+    python modbus_trace.py unhex trace.txt trace.pcapng
+"""
+
+import argparse
+import csv
+import re
+import struct
+import sys
+from collections import defaultdict
+
+SECTION_HEADER_BLOCK = 0x0A0D0D0A
+ENHANCED_PACKET_BLOCK = 6
+OPTION_COMMENT = 1
+OPTION_EPB_FLAGS = 2
+FLAG_INBOUND = 1
+
+OUTCOME = re.compile(r"slave=(\d+) outcome=0x([0-9A-Fa-f]{2}) ?(.*)")
+SCHEDULE = re.compile(r"slave=(\d+) priority=(\d) wait=(\d+)( continuation)?( retry)?")
+PRIORITIES = ["EMERGENCY", "SENSOR", "RELAY", "STATUS"]
+
+
+class Frame:
+    def __init__(self, timestamp, inbound, data, slave, outcome, description):
+        self.timestamp = timestamp  # microseconds since boot
+        self.inbound = inbound
+        self.data = data
+        self.slave = slave
+        self.outcome = outcome  # esp32Modbus::Error, 0 = success
+        self.description = description
+        self.priority = None  # requests from the queues: priority, queue wait (us), continuation, retry
+        self.wait = None
+        self.continuation = False
+        self.retry = False
+
+    @property
+    def direction(self):
+        return "RX" if self.inbound else "TX"
+
+    @property
+    def function_code(self):
+        return self.data[1] & 0x7F if len(self.data) > 1 else None
+
+
+def read_pcapng(path):
+    """Enhanced packet blocks of the first interface as Frames"""
+    with open(path, "rb") as f:
+        content = f.read()
+    if len(content) < 12 or struct.unpack_from("<I", content, 0)[0] != SECTION_HEADER_BLOCK:
+        sys.exit(f"{path}: not a pcapng file")
+    endian = "<" if struct.unpack_from("<I", content, 8)[0] == 0x1A2B3C4D else ">"
+    frames = []
+    offset = 0
+    while offset + 12 <= len(content):
+        block_type, length = struct.unpack_from(endian + "II", content, offset)
+        if length < 12 or offset + length > len(content):
+            print(f"{path}: truncated block at {offset}, stopping", file=sys.stderr)
+            break
+        if block_type == ENHANCED_PACKET_BLOCK:
+            _, high, low, captured, _ = struct.unpack_from(endian + "IIIII", content, offset + 8)
+            data = content[offset + 28:offset + 28 + captured]
+            flags = 0
+            comment = ""
+            option = offset + 28 + (captured + 3) // 4 * 4
+            while option + 4 <= offset + length - 4:
+                code, option_length = struct.unpack_from(endian + "HH", content, option)
+                if code == 0:
+                    break
+                value = content[option + 4:option + 4 + option_length]
+                if code == OPTION_EPB_FLAGS:
+                    flags = struct.unpack(endian + "I", value)[0]
+                elif code == OPTION_COMMENT:
+                    comment = value.decode("ascii", "replace")
+                option += 4 + (option_length + 3) // 4 * 4
+            match = OUTCOME.search(comment)
+            slave = int(match.group(1)) if match else (data[0] if data else 0)
+            outcome = int(match.group(2), 16) if match else 0
+            description = match.group(3) if match else ""
+            frame = Frame(high << 32 | low, flags & 3 == FLAG_INBOUND, data, slave, outcome, description)
+            match = SCHEDULE.search(comment)
+            if match:
+                frame.slave = int(match.group(1))
+                frame.priority = int(match.group(2))
+                frame.wait = int(match.group(3))
+                frame.continuation = match.group(4) is not None
+                frame.retry = match.group(5) is not None
+            frames.append(frame)
+        offset += length
+    return frames
+
+
+def summary(frames):
+    if not frames:
+        print("no frames")
+        return
+    duration = (frames[-1].timestamp - frames[0].timestamp) / 1e6
+    tx = [f for f in frames if not f.inbound]
+    rx = [f for f in frames if f.inbound]
+    print(f"{len(frames)} frames over {duration:.3f} s: {len(tx)} sent ({sum(len(f.data) for f in tx)} bytes), "
+          f"{len(rx)} received ({sum(len(f.data) for f in rx)} bytes)")
+
+    # a received frame answers the frame sent before it
+    stats = defaultdict(lambda: {"requests": 0, "outcomes": defaultdict(int), "times": []})
+    pending = None
+    for frame in frames:
+        if not frame.inbound:
+            if pending is not None and pending.slave != 0:
+                stats[(pending.slave, pending.function_code)]["outcomes"]["no response traced"] += 1
+            pending = frame
+            stats[(frame.slave, frame.function_code)]["requests"] += 1
+            continue
+        if pending is None:
+            continue  # slave mode request, or the request was overwritten
+        entry = stats[(pending.slave, pending.function_code)]
+        entry["outcomes"][frame.description or f"0x{frame.outcome:02X}"] += 1
+        entry["times"].append(frame.timestamp - pending.timestamp)
+        pending = None
+
+    print()
+    print(f"{'slave':>5} {'FC':>4} {'requests':>9} {'min ms':>8} {'avg ms':>8} {'max ms':>8}  outcomes")
+    for (slave, function_code), entry in sorted(stats.items(), key=lambda item: (item[0][0], item[0][1] or 0)):
+        times = entry["times"]
+        timing = (f"{min(times) / 1000:8.1f} {sum(times) / len(times) / 1000:8.1f} {max(times) / 1000:8.1f}"
+                  if times else f"{'-':>8} {'-':>8} {'-':>8}")
+        outcomes = ", ".join(f"{name}: {count}" for name, count in sorted(entry["outcomes"].items()))
+        fc = f"{function_code:02X}" if function_code is not None else "-"
+        print(f"{slave:>5} {fc:>4} {entry['requests']:>9} {timing}  {outcomes}")
+
+    # queue waits of the requests the worker took from the queues, retries count from their first submission
+    waits = defaultdict(list)
+    for frame in tx:
+        if frame.priority is not None and not frame.retry:
+            waits[frame.priority].append(frame.wait)
+    if waits:
+        print()
+        print(f"{'priority':<10} {'requests':>9} {'avg wait ms':>12} {'max wait ms':>12}")
+        for priority in sorted(waits):
+            values = waits[priority]
+            print(f"{PRIORITIES[priority]:<10} {len(values):>9} {sum(values) / len(values) / 1000:12.1f} "
+                  f"{max(values) / 1000:12.1f}")
+
+
+def dump(frames, as_csv):
+    start = frames[0].timestamp if frames else 0
+    if as_csv:
+        writer = csv.writer(sys.stdout)
+        writer.writerow(["time_us", "direction", "slave", "function_code", "outcome", "description",
+                         "priority", "wait_us", "frame"])
+        for frame in frames:
+            writer.writerow([frame.timestamp, frame.direction, frame.slave,
+                             frame.function_code if frame.function_code is not None else "",
+                             frame.outcome, frame.description,
+                             frame.priority if frame.priority is not None else "",
+                             frame.wait if frame.wait is not None else "", frame.data.hex()])
+        return
+    for frame in frames:
+        status = "" if frame.outcome == 0 else f"  [{frame.description or hex(frame.outcome)}]"
+        print(f"{(frame.timestamp - start) / 1e6:12.6f} {frame.direction} {frame.data.hex(' ')}{status}")
+
+
+def unhex(source, destination):
+    """Hex digits to binary, anything else (spaces, line breaks, log prefixes before ':') skipped"""
+    digits = []
+    with open(source, "r", errors="replace") as f:
+        for line in f:
+            line = line.split(":", 1)[1] if ":" in line else line
+            digits.extend(re.findall(r"[0-9A-Fa-f]", line))
+    if len(digits) % 2:
+        sys.exit(f"{source}: odd number of hex digits")
+    data = bytes(int("".join(digits[i:i + 2]), 16) for i in range(0, len(digits), 2))
+    with open(destination, "wb") as f:
+        f.write(data)
+    print(f"{len(data)} bytes written to {destination}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Summarize and convert esp32ModbusRTU frame traces")
+    commands = parser.add_subparsers(dest="command", required=True)
+    command = commands.add_parser("summary", help="frames, bytes, response times and outcomes per slave/FC")
+    command.add_argument("trace")
+    command = commands.add_parser("dump", help="frames as text or CSV")
+    command.add_argument("trace")
+    command.add_argument("--csv", action="store_true")
+    command = commands.add_parser("unhex", help="hex printed trace to pcapng")
+    command.add_argument("source")
+    command.add_argument("destination")
+    args = parser.parse_args()
+
+    if args.command == "unhex":
+        unhex(args.source, args.destination)
+    elif args.command == "summary":
+        summary(read_pcapng(args.trace))
+    else:
+        dump(read_pcapng(args.trace), args.csv)
+
+
+if __name__ == "__main__":
+    main()